@@ -0,0 +1,107 @@
+/*
+ * include/common/acmatch.h
+ * Aho-Corasick automaton for matching many strings at once.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COMMON_ACMATCH_H
+#define _COMMON_ACMATCH_H
+
+/* One node of the trie, designated by its index in the node array. Index 0 is
+ * the root, which is never anybody's child, so 0 also means "none" for the
+ * child and sibling links.
+ */
+struct ac_node {
+	unsigned int child;     /* first child */
+	unsigned int sibling;   /* next child of the same parent */
+	unsigned int fail;      /* longest proper suffix present in the trie */
+	unsigned int edges;     /* first of the children in the edge arrays, valid once prepared */
+	int head;               /* first entry ending here (lowest id), -1 if none */
+	int out;                /* node holding the lowest id here or on the fail chain, -1 if none */
+	unsigned char nb;       /* number of children, up to AC_MAX_EDGES */
+	unsigned char c;        /* byte leading to this node */
+};
+
+/* Nodes with more children than this use a full table of 256 transitions */
+#define AC_MAX_EDGES 16
+
+/* A string inserted in the tree. Entries ending on the same node are chained
+ * by increasing id, ids being assigned in insertion order.
+ */
+struct ac_entry {
+	void *ptr;              /* caller's pointer, returned on match */
+	unsigned int id;        /* insertion order */
+	int next;               /* next entry on the same node, or next free one */
+};
+
+struct ac_tree {
+	struct ac_node *nodes;
+	unsigned int nb_nodes, sz_nodes;
+	struct ac_entry *entries;
+	unsigned int nb_entries, sz_entries;
+	int free_entry;         /* first free entry, -1 if none */
+	unsigned int live;      /* number of entries in use */
+	unsigned int dead;      /* number of entries deleted since the trie was built */
+	unsigned int next_id;   /* id given to the next inserted entry */
+	unsigned int min_id;    /* lowest id in use, valid once prepared */
+	int icase;              /* case-insensitive matching */
+	int dirty;              /* fail links and outputs must be recomputed */
+	unsigned char *edge_c;  /* byte of each edge, children of a node being contiguous and sorted */
+	unsigned int *edge_n;   /* child node of each edge, or 256 transitions for large nodes */
+	unsigned int root[256]; /* root's children by byte, for a faster restart */
+};
+
+/* Allocates an empty tree, folding case if <icase> is non-zero. Returns NULL
+ * on memory shortage.
+ */
+struct ac_tree *ac_new(int icase);
+
+/* Releases tree <t> and all its nodes. <t> may be NULL. */
+void ac_free(struct ac_tree *t);
+
+/* Inserts the <len> bytes at <str> associated with pointer <ptr>, which ranks
+ * after all the entries already present. Returns 0 on success or -1 on memory
+ * shortage, in which case the tree is left unchanged.
+ */
+int ac_insert(struct ac_tree *t, const char *str, int len, void *ptr);
+
+/* Removes the entry associated with <ptr> which was inserted with <str> and
+ * <len>. Returns 1 if it was found, otherwise 0.
+ */
+int ac_delete(struct ac_tree *t, const char *str, int len, void *ptr);
+
+/* Computes the fail links and outputs if the tree was modified. It must be
+ * called before any of the match functions. Returns 0 on success or -1 on
+ * memory shortage.
+ */
+int ac_prepare(struct ac_tree *t);
+
+/* These ones return the pointer of the lowest id entry which respectively
+ * appears anywhere in, starts or ends the <len> bytes at <str>, or NULL if
+ * there is none.
+ */
+void *ac_match_sub(const struct ac_tree *t, const char *str, int len);
+void *ac_match_beg(const struct ac_tree *t, const char *str, int len);
+void *ac_match_end(const struct ac_tree *t, const char *str, int len);
+
+#endif /* _COMMON_ACMATCH_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
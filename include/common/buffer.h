@@ -48,16 +48,19 @@ struct buffer_wait {
 };
 
 extern struct pool_head *pool2_buffer;
+extern struct pool_head *pool2_large_buffer;
 extern struct buffer buf_empty;
 extern struct buffer buf_wanted;
 extern struct list buffer_wq;
 
 int init_buffer();
+int buffer_reserve_slab();
 int buffer_replace2(struct buffer *b, char *pos, char *end, const char *str, int len);
 int buffer_insert_line2(struct buffer *b, char *pos, const char *str, int len);
 void buffer_dump(FILE *o, struct buffer *b, int from, int to);
 void buffer_slow_realign(struct buffer *buf);
 void buffer_bounce_realign(struct buffer *buf);
+struct buffer *b_upgrade(struct buffer **buf);
 
 /*****************************************************************/
 /* These functions are used to compute various buffer area sizes */
@@ -442,8 +445,8 @@ static inline int bo_putblk(struct buffer *b, const char *blk, int len)
 	memcpy(b->p, blk, half);
 	b->p = b_ptr(b, half);
 	if (len > half) {
-		memcpy(b->p, blk, len - half);
-		b->p = b_ptr(b, half);
+		memcpy(b->p, blk + half, len - half);
+		b->p = b_ptr(b, len - half);
 	}
 	b->o += len;
 	return len;
@@ -515,10 +518,13 @@ static inline struct buffer *b_alloc_fast(struct buffer **buf)
 	return b;
 }
 
-/* Releases buffer *buf (no check of emptiness) */
+/* Releases buffer *buf (no check of emptiness) to the pool it comes from */
 static inline void __b_drop(struct buffer **buf)
 {
-	pool_free2(pool2_buffer, *buf);
+	if (unlikely(pool2_large_buffer && (*buf)->size > pool2_buffer->size - sizeof(struct buffer)))
+		pool_free2(pool2_large_buffer, *buf);
+	else
+		pool_free2(pool2_buffer, *buf);
 }
 
 /* Releases buffer *buf if allocated. */
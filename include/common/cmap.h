@@ -0,0 +1,225 @@
+/*
+ * include/common/cmap.h
+ * Compiled map files, looked up in place once mapped into memory.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COMMON_CMAP_H
+#define _COMMON_CMAP_H
+
+#include <stdint.h>
+#include <common/iptable.h>
+
+/* First bytes of a compiled map. The version is part of it, so that maps
+ * compiled by another version are recognized and refused.
+ */
+#define CMAP_MAGIC_PREFIX "HAPCMAP"
+#define CMAP_MAGIC CMAP_MAGIC_PREFIX "2"
+
+/* Written in native order so that maps compiled on another architecture are
+ * rejected.
+ */
+#define CMAP_ENDIAN 0x01020304
+
+/* How the keys are matched */
+enum {
+	CMAP_STR = 0,           /* exact string */
+	CMAP_INT,               /* exact integer */
+	CMAP_IP,                /* longest IPv4 or IPv6 network */
+	CMAP_KINDS              /* number of kinds */
+};
+
+extern const char *cmap_kinds[CMAP_KINDS];
+
+/* An entry, by line order. Offsets are relative to the string area. */
+struct cmap_entry {
+	uint32_t key;
+	uint32_t value;
+	uint32_t key_len;       /* key length, not counting the trailing zero */
+	uint32_t pad;
+};
+
+/* An integer key */
+struct cmap_int {
+	int64_t value;
+	uint32_t entry;
+	uint32_t pad;
+};
+
+/* A network of the range table, by the order of the table */
+struct cmap_net {
+	uint32_t entry;
+	uint32_t parent;        /* closest network covering this one, IPT_NONE if none */
+	uint32_t len;           /* prefix length */
+};
+
+/* The range table of one address family */
+struct cmap_ipx {
+	uint64_t nets;          /* offset of the networks */
+	uint64_t keys;          /* offset of the bounds and upper levels */
+	uint64_t bval;          /* offset of the network of each range */
+	uint32_t nb_nets;
+	uint32_t nb_keys;
+	uint32_t nb_lvl;
+	uint32_t lvl_off[IPT_MAX_LEVELS];
+	uint32_t lvl_nb[IPT_MAX_LEVELS];
+};
+
+/* Beginning of the file. Offsets are relative to the beginning of the file and
+ * aligned to 8 bytes.
+ */
+struct cmap_hdr {
+	char magic[8];          /* CMAP_MAGIC */
+	uint32_t endian;        /* CMAP_ENDIAN */
+	uint32_t kind;          /* CMAP_* */
+	uint64_t size;          /* file size */
+	uint32_t nb_entries;
+	uint32_t nb_slots;      /* size of the hash table, a power of two */
+	uint32_t nb_ints;
+	uint32_t pad;
+	uint64_t entries;       /* struct cmap_entry[nb_entries] */
+	uint64_t slots;         /* entry + 1 by hash of the key, 0 if free */
+	uint64_t strings;       /* nul-terminated keys and values */
+	uint64_t strings_size;
+	uint64_t ints;          /* struct cmap_int[nb_ints], sorted by value and entry */
+	struct cmap_ipx ip4, ip6;
+};
+
+/* A compiled map mapped into memory. Deletions are kept apart since the file
+ * is read-only.
+ */
+struct cmap {
+	void *area;             /* the mapping */
+	uint64_t size;
+	unsigned int kind;
+	unsigned int nb_entries;
+	unsigned int nb_slots;
+	unsigned int nb_ints;
+	const struct cmap_entry *entries;
+	const uint32_t *slots;
+	const char *strings;
+	const struct cmap_int *ints;
+	const struct cmap_net *nets4, *nets6;
+	struct ipt_index ix4, ix6;
+	unsigned char *dead;    /* bitmap of deleted entries, NULL if none */
+	unsigned int nb_dead;
+};
+
+/* A compiled map being built */
+struct cmap_builder {
+	unsigned int kind;
+	struct cmap_entry *entries;
+	unsigned int nb_entries, sz_entries;
+	char *strings;
+	uint64_t strings_size, sz_strings;
+	struct cmap_int *ints;
+	unsigned int nb_ints, sz_ints;
+	struct ipt *ipt4, *ipt6;
+};
+
+/* Allocates a builder for a map of kind <kind>. Returns NULL on memory
+ * shortage.
+ */
+struct cmap_builder *cmapb_new(unsigned int kind);
+
+/* Releases builder <b>, which may be NULL. */
+void cmapb_free(struct cmap_builder *b);
+
+/* Appends an entry of key <key> and value <value>. Returns its number or -1 on
+ * memory shortage or if the map is too large.
+ */
+int cmapb_add(struct cmap_builder *b, const char *key, const char *value);
+
+/* Indexes entry <entry> of a CMAP_INT map under integer <value>. Returns 0 on
+ * success or -1 on memory shortage.
+ */
+int cmapb_add_int(struct cmap_builder *b, unsigned int entry, long long value);
+
+/* Indexes entry <entry> of a CMAP_IP map under network <addr>/<len>, <addr>
+ * being <klen> bytes in network order. Returns 0 on success or -1 on memory
+ * shortage.
+ */
+int cmapb_add_net(struct cmap_builder *b, unsigned int entry, const void *addr, unsigned int klen, unsigned int len);
+
+/* Writes the map to file <path>. It is written to a temporary file first,
+ * which is then renamed, so that processes which mapped the previous file are
+ * not affected. Returns 0 on success or -1 with errno set.
+ */
+int cmapb_write(struct cmap_builder *b, const char *path);
+
+/* Maps compiled map <path> into memory. Returns it on success. Otherwise NULL
+ * is returned, and <msg> is set to NULL if the file is not a compiled map, or
+ * to a static error message.
+ */
+struct cmap *cmap_open(const char *path, const char **msg);
+
+/* Unmaps map <m>, which may be NULL. */
+void cmap_close(struct cmap *m);
+
+/* Returns the first live entry of key <str> of <len> bytes, or -1 if none. */
+int cmap_lookup_str(const struct cmap *m, const char *str, int len);
+
+/* Returns the first live entry of integer <value>, or -1 if none. */
+int cmap_lookup_int(const struct cmap *m, long long value);
+
+/* Returns the first live entry of the longest network matching address <addr>
+ * of <klen> bytes in network order, or -1 if none. The prefix length is set
+ * into <len> on success.
+ */
+int cmap_lookup_ip(const struct cmap *m, const void *addr, unsigned int klen, unsigned int *len);
+
+/* Returns the first live entry after entry <prev> whose key is <key>, or -1 if
+ * none. <prev> is -1 to start.
+ */
+int cmap_find(const struct cmap *m, const char *key, int prev);
+
+/* Returns the entry designated by <ptr>, which must point to an entry of <m>
+ * as displayed by cmap_ptr(), or -1.
+ */
+int cmap_entry_at(const struct cmap *m, const void *ptr);
+
+/* Deletes entry <entry>. Returns 0 on success or -1 on memory shortage. */
+int cmap_delete(struct cmap *m, unsigned int entry);
+
+static inline int cmap_is_dead(const struct cmap *m, unsigned int entry)
+{
+	return m->dead && (m->dead[entry >> 3] & (1 << (entry & 7)));
+}
+
+static inline const char *cmap_key(const struct cmap *m, unsigned int entry)
+{
+	return m->strings + m->entries[entry].key;
+}
+
+static inline const char *cmap_value(const struct cmap *m, unsigned int entry)
+{
+	return m->strings + m->entries[entry].value;
+}
+
+/* returns a pointer identifying entry <entry>, like the address of an element */
+static inline const void *cmap_ptr(const struct cmap *m, unsigned int entry)
+{
+	return &m->entries[entry];
+}
+
+#endif /* _COMMON_CMAP_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
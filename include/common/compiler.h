@@ -107,5 +107,17 @@
 #endif
 #endif
 
+/* Hints the CPU that the memory at <ptr> will soon be read (prefetch_r) or
+ * written (prefetch_w). This is only a hint which never faults, so <ptr> may
+ * be NULL or invalid.
+ */
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 1))
+#define prefetch_r(ptr) __builtin_prefetch((ptr), 0)
+#define prefetch_w(ptr) __builtin_prefetch((ptr), 1)
+#else
+#define prefetch_r(ptr) do { } while (0)
+#define prefetch_w(ptr) do { } while (0)
+#endif
+
 
 #endif /* _COMMON_COMPILER_H */
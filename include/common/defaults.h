@@ -163,6 +163,9 @@
 #define DEF_HANA_ONERR		HANA_ONERR_FAILCHK
 #define DEF_HANA_ERRLIMIT	10
 
+// default interval between two purges of a server's idle connection pool (ms)
+#define DEF_POOL_PURGE_DELAY	1000
+
 // X-Forwarded-For header default
 #define DEF_XFORWARDFOR_HDR	"X-Forwarded-For"
 
@@ -212,6 +215,31 @@
 #define MAX_SIGNAL 256
 #endif
 
+/* The optional timer wheel is made of TIMER_WHEEL_SLOTS slots, each of which
+ * covers 2^TIMER_WHEEL_SHIFT ms. Only timers set at least two slots away are
+ * stored there, closer ones always go to the precise wait queue. Both must be
+ * powers of two and the whole wheel must cover less than 24 days.
+ */
+#ifndef TIMER_WHEEL_SHIFT
+#define TIMER_WHEEL_SHIFT 10
+#endif
+
+#ifndef TIMER_WHEEL_SLOTS
+#define TIMER_WHEEL_SLOTS 512
+#endif
+
+/* Maximum number of runnable tasks processed per polling loop */
+#ifndef MAX_TASKS_PER_LOOP
+#define MAX_TASKS_PER_LOOP 200
+#endif
+
+/* With adaptive accept, the accept batch is reduced when the processing part
+ * of the polling loop takes more than this number of microseconds on average.
+ */
+#ifndef ADAPTIVE_ACCEPT_LOOP_US
+#define ADAPTIVE_ACCEPT_LOOP_US 1000
+#endif
+
 /* Maximum host name length */
 #ifndef MAX_HOSTNAME_LEN
 #if MAXHOSTNAMELEN
@@ -0,0 +1,183 @@
+/*
+ * include/common/h2.h
+ * HTTP/2 protocol definitions (RFC7540).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COMMON_H2_H
+#define _COMMON_H2_H
+
+#include <stdint.h>
+
+/* the connection preface sent by the client, 24 bytes */
+#define H2_CONN_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_CONN_PREFACE_LEN 24
+
+/* size of a frame header */
+#define H2_FH_SIZE 9
+
+/* frame types, section 6 */
+enum h2_ft {
+	H2_FT_DATA            = 0x00,
+	H2_FT_HEADERS         = 0x01,
+	H2_FT_PRIORITY        = 0x02,
+	H2_FT_RST_STREAM      = 0x03,
+	H2_FT_SETTINGS        = 0x04,
+	H2_FT_PUSH_PROMISE    = 0x05,
+	H2_FT_PING            = 0x06,
+	H2_FT_GOAWAY          = 0x07,
+	H2_FT_WINDOW_UPDATE   = 0x08,
+	H2_FT_CONTINUATION    = 0x09,
+	H2_FT_ENTRIES /* must be last */
+};
+
+/* frame flags, the same values are shared by several frame types */
+#define H2_F_DATA_END_STREAM        0x01
+#define H2_F_DATA_PADDED            0x08
+
+#define H2_F_HEADERS_END_STREAM     0x01
+#define H2_F_HEADERS_END_HEADERS    0x04
+#define H2_F_HEADERS_PADDED         0x08
+#define H2_F_HEADERS_PRIORITY       0x20
+
+#define H2_F_SETTINGS_ACK           0x01
+#define H2_F_PING_ACK               0x01
+#define H2_F_CONTINUATION_END_HEADERS 0x04
+
+/* error codes, section 7 */
+enum h2_err {
+	H2_ERR_NO_ERROR            = 0x0,
+	H2_ERR_PROTOCOL_ERROR      = 0x1,
+	H2_ERR_INTERNAL_ERROR      = 0x2,
+	H2_ERR_FLOW_CONTROL_ERROR  = 0x3,
+	H2_ERR_SETTINGS_TIMEOUT    = 0x4,
+	H2_ERR_STREAM_CLOSED       = 0x5,
+	H2_ERR_FRAME_SIZE_ERROR    = 0x6,
+	H2_ERR_REFUSED_STREAM      = 0x7,
+	H2_ERR_CANCEL              = 0x8,
+	H2_ERR_COMPRESSION_ERROR   = 0x9,
+	H2_ERR_CONNECT_ERROR       = 0xa,
+	H2_ERR_ENHANCE_YOUR_CALM   = 0xb,
+	H2_ERR_INADEQUATE_SECURITY = 0xc,
+	H2_ERR_HTTP_1_1_REQUIRED   = 0xd,
+};
+
+/* settings identifiers, section 6.5.2 */
+#define H2_SETTINGS_HEADER_TABLE_SIZE      0x0001
+#define H2_SETTINGS_ENABLE_PUSH            0x0002
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS 0x0003
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE    0x0004
+#define H2_SETTINGS_MAX_FRAME_SIZE         0x0005
+#define H2_SETTINGS_MAX_HEADER_LIST_SIZE   0x0006
+
+/* default values of the settings, and limits */
+#define H2_INITIAL_WINDOW_SIZE     65535
+#define H2_MIN_FRAME_SIZE          16384
+#define H2_MAX_FRAME_SIZE          16777215
+#define H2_MAX_WINDOW_SIZE         2147483647
+
+/* Reads a 16, 24 or 32 bits big-endian integer from <p>, which may be
+ * unaligned.
+ */
+static inline unsigned int h2_get_n16(const void *p)
+{
+	const unsigned char *s = p;
+
+	return (s[0] << 8) + s[1];
+}
+
+static inline unsigned int h2_get_n24(const void *p)
+{
+	const unsigned char *s = p;
+
+	return (s[0] << 16) + (s[1] << 8) + s[2];
+}
+
+static inline unsigned int h2_get_n32(const void *p)
+{
+	const unsigned char *s = p;
+
+	return ((unsigned int)s[0] << 24) + (s[1] << 16) + (s[2] << 8) + s[3];
+}
+
+/* Writes a 16, 24 or 32 bits big-endian integer <v> to <p> */
+static inline void h2_set_n16(void *p, unsigned int v)
+{
+	unsigned char *d = p;
+
+	d[0] = v >> 8;
+	d[1] = v;
+}
+
+static inline void h2_set_n24(void *p, unsigned int v)
+{
+	unsigned char *d = p;
+
+	d[0] = v >> 16;
+	d[1] = v >> 8;
+	d[2] = v;
+}
+
+static inline void h2_set_n32(void *p, unsigned int v)
+{
+	unsigned char *d = p;
+
+	d[0] = v >> 24;
+	d[1] = v >> 16;
+	d[2] = v >> 8;
+	d[3] = v;
+}
+
+/* Builds a frame header at <p> for a frame of type <type>, flags <flags> and
+ * payload length <len>, for stream <sid>. <p> must have room for H2_FH_SIZE
+ * bytes.
+ */
+static inline void h2_set_frame_hdr(void *p, int len, int type, int flags, int sid)
+{
+	unsigned char *d = p;
+
+	h2_set_n24(d, len);
+	d[3] = type;
+	d[4] = flags;
+	h2_set_n32(d + 5, sid & 0x7fffffff);
+}
+
+/* returns the name of frame type <ft> for debugging purposes */
+static inline const char *h2_ft_str(int ft)
+{
+	switch (ft) {
+	case H2_FT_DATA          : return "DATA";
+	case H2_FT_HEADERS       : return "HEADERS";
+	case H2_FT_PRIORITY      : return "PRIORITY";
+	case H2_FT_RST_STREAM    : return "RST_STREAM";
+	case H2_FT_SETTINGS      : return "SETTINGS";
+	case H2_FT_PUSH_PROMISE  : return "PUSH_PROMISE";
+	case H2_FT_PING          : return "PING";
+	case H2_FT_GOAWAY        : return "GOAWAY";
+	case H2_FT_WINDOW_UPDATE : return "WINDOW_UPDATE";
+	case H2_FT_CONTINUATION  : return "CONTINUATION";
+	default                  : return "_UNKNOWN_";
+	}
+}
+
+#endif /* _COMMON_H2_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
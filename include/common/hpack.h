@@ -0,0 +1,102 @@
+/*
+ * include/common/hpack.h
+ * HPACK header compression for HTTP/2 (RFC7541).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COMMON_HPACK_H
+#define _COMMON_HPACK_H
+
+#include <stdint.h>
+
+#include <common/chunk.h>
+
+struct hdr_idx;
+
+/* number of entries in the static table */
+#define HPACK_SHT_SIZE 61
+
+/* overhead counted for each dynamic table entry (section 4.1) */
+#define HPACK_DHT_ENTRY_OVERHEAD 32
+
+/* decoding errors */
+#define HPACK_ERR_NONE        0
+#define HPACK_ERR_TRUNCATED  -1  /* block ends in the middle of a representation */
+#define HPACK_ERR_BAD_INT    -2  /* integer too large */
+#define HPACK_ERR_BAD_IDX    -3  /* index out of the tables */
+#define HPACK_ERR_HUFFMAN    -4  /* invalid Huffman sequence */
+#define HPACK_ERR_TBL_SIZE   -5  /* dynamic table size update above the limit */
+#define HPACK_ERR_TOO_LARGE  -6  /* out of room to store the headers */
+
+/* A decoded header field. The name and value are not zero-terminated. */
+struct hpack_hdr {
+	const char *n;
+	const char *v;
+	unsigned int nl;
+	unsigned int vl;
+};
+
+/* A dynamic table entry. The name and value are stored contiguously in the
+ * table's area at offset <ofs>.
+ */
+struct hpack_dte {
+	uint32_t ofs;
+	uint32_t nl;
+	uint32_t vl;
+};
+
+/* Dynamic table. It is allocated at once with room for <size> bytes of names
+ * and values in <area> and for as many entries as the RFC size accounting may
+ * allow in <dte>, so that inserting a header never requires any allocation.
+ * Entries are referenced from <dte> as a ring whose newest entry is at <head>.
+ * Strings are stored in <area> in insertion order; <front> is where the next
+ * one goes, and the area is compacted when there is not enough contiguous
+ * room left.
+ */
+struct hpack_dht {
+	uint32_t size;        /* allocated area size, also the max table size */
+	uint32_t max;         /* current max size, set by the encoder (<= size) */
+	uint32_t total;       /* current size as counted by the RFC */
+	uint32_t front;       /* first free byte in the area */
+	uint16_t nb_slots;    /* number of slots in <dte> */
+	uint16_t used;        /* number of entries in use */
+	uint16_t head;        /* slot of the newest entry */
+	struct hpack_dte *dte;
+	char *area;
+};
+
+/* the static table, entry 0 is unused */
+extern const struct hpack_hdr hpack_sht[HPACK_SHT_SIZE + 1];
+
+struct hpack_dht *hpack_dht_alloc(uint32_t size);
+void hpack_dht_free(struct hpack_dht *dht);
+
+int hpack_decode_frame(struct hpack_dht *dht, const unsigned char *raw, int len,
+                       struct hpack_hdr *list, int max, struct chunk *tmp);
+
+int hpack_hdrs_to_h1(const struct hpack_hdr *list, int nb, struct chunk *out, struct hdr_idx *idx);
+
+int hpack_encode_header(struct chunk *out, const char *n, int nl, const char *v, int vl);
+int hpack_encode_status(struct chunk *out, int status);
+
+#endif /* _COMMON_HPACK_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
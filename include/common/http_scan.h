@@ -0,0 +1,190 @@
+/*
+ * include/common/http_scan.h
+ * Vectorized scanning primitives used by the HTTP/1 parser.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COMMON_HTTP_SCAN_H
+#define _COMMON_HTTP_SCAN_H
+
+/* A scanner implementation. Both functions work on the bytes between <p> and
+ * <e> and return a pointer to where the parser must resume. They are allowed
+ * to stop earlier than the exact position (eg: on the last bytes which do not
+ * fill a vector), but never after it, so the caller's FSM always completes the
+ * job byte per byte :
+ *   - name_end() stops on the first byte not in [A-Za-z0-9-], which covers
+ *     the vast majority of header name characters ;
+ *   - crlf() stops on the first CR or LF.
+ */
+struct http_scan_impl {
+	const char *name;
+	const char *(*name_end)(const char *p, const char *e);
+	const char *(*crlf)(const char *p, const char *e);
+	int (*supported)(void);
+};
+
+/* all known implementations, the last one has a NULL name */
+extern const struct http_scan_impl http_scan_impls[];
+
+/* the implementation in use, copied here for a cheaper access */
+extern struct http_scan_impl http_scan;
+
+/* Selects implementation <name>, or the best supported one if <name> is NULL.
+ * Returns 0 on success or -1 if it does not exist or is not supported.
+ */
+int http_scan_select(const char *name);
+
+/* Skips the complete chunks of a chunked body present in <p>..<e>, starting
+ * with <*len> bytes of data. See src/http_scan.c for details.
+ */
+const char *http_scan_chunks(const char *p, const char *e,
+                             unsigned long long *len, unsigned long long *body);
+
+/* hex digit values, -1 for other characters */
+extern const signed char http_scan_hex[256];
+
+/* The two functions below parse the parts of a chunked body located between
+ * the chunks' data, byte per byte. They work on a ring of <size> bytes
+ * starting at <data>, <ptr> being the first byte to parse and <avail> the
+ * number of bytes available from there, which may wrap. They return the
+ * number of bytes parsed on success, 0 if more data are needed, or -1 on
+ * error, in which case <*err> points to the faulty byte.
+ */
+
+/* Parses the CRLF, or a possible LF alone, which ends the data of a chunk. */
+static inline int http_scan_chunk_crlf(const char *data, unsigned int size,
+                                       const char *ptr, unsigned int avail,
+                                       const char **err)
+{
+	int bytes = 1;
+
+	/* data availability is checked once we know what to expect */
+	if (*ptr == '\r') {
+		bytes++;
+		if (++ptr >= data + size)
+			ptr = data;
+	}
+
+	if (avail < bytes)
+		return 0;
+
+	if (*ptr != '\n') {
+		*err = ptr;
+		return -1;
+	}
+	return bytes;
+}
+
+/* Parses a chunk size line, which is in the following form, though we are
+ * only interested in the size and CRLF :
+ *    1*HEXDIGIT *WSP *[ ';' extensions ] CRLF
+ * The size is stored into <*chunk> on success. Sizes of 2GB and more are
+ * rejected.
+ */
+static inline int http_scan_chunk_size(const char *data, unsigned int size,
+                                       const char *ptr, unsigned int avail,
+                                       unsigned int *chunk, const char **err)
+{
+	const char *ptr_old = ptr;
+	const char *end = data + size;
+	const char *stop = ptr + avail;
+	unsigned int len = 0;
+	int c, ret;
+
+	if (stop >= end)
+		stop -= size;
+
+	while (1) {
+		if (ptr == stop)
+			return 0;
+		c = http_scan_hex[(unsigned char)*ptr];
+		if (c < 0) /* not a hex digit anymore */
+			break;
+		if (++ptr >= end)
+			ptr = data;
+		if (len & 0xF8000000) /* integer overflow will occur if result >= 2GB */
+			goto error;
+		len = (len << 4) + c;
+	}
+
+	/* empty size not allowed */
+	if (ptr == ptr_old)
+		goto error;
+
+	while (*ptr == ' ' || *ptr == '\t') {
+		if (++ptr >= end)
+			ptr = data;
+		if (ptr == stop)
+			return 0;
+	}
+
+	/* Up to there, we know that at least one byte is present at *ptr. Check
+	 * for the end of chunk size.
+	 */
+	while (1) {
+		if (*ptr == '\r' || *ptr == '\n') {
+			if (*ptr == '\r') {
+				if (++ptr >= end)
+					ptr = data;
+				if (ptr == stop)
+					return 0;
+			}
+
+			if (*ptr != '\n')
+				goto error;
+			if (++ptr >= end)
+				ptr = data;
+			/* done */
+			break;
+		}
+		else if (*ptr == ';') {
+			/* chunk extension, ends at next CRLF */
+			if (++ptr >= end)
+				ptr = data;
+			if (ptr == stop)
+				return 0;
+
+			while (*ptr != '\r' && *ptr != '\n') {
+				if (++ptr >= end)
+					ptr = data;
+				if (ptr == stop)
+					return 0;
+			}
+			/* we have a CRLF now, loop above */
+			continue;
+		}
+		else
+			goto error;
+	}
+
+	ret = ptr - ptr_old;
+	if (ptr < ptr_old)
+		ret += size;
+	*chunk = len;
+	return ret;
+ error:
+	*err = ptr;
+	return -1;
+}
+
+#endif /* _COMMON_HTTP_SCAN_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
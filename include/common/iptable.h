@@ -0,0 +1,169 @@
+/*
+ * include/common/iptable.h
+ * Compact longest-prefix-match table for large sets of IPv4 or IPv6 networks.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COMMON_IPTABLE_H
+#define _COMMON_IPTABLE_H
+
+#include <stdint.h>
+#include <ebmbtree.h>
+
+/* "no entry" value for entry indexes */
+#define IPT_NONE 0xffffffffU
+
+/* number of keys per block of the search tree, the whole block being compared
+ * at once.
+ */
+#define IPT_FANOUT 16
+
+/* enough levels for 2^32 ranges */
+#define IPT_MAX_LEVELS 8
+
+/* The table is rebuilt once the networks added or deleted since the last
+ * build exceed this count and a quarter of the table.
+ */
+#define IPT_MIN_DELTA 64
+
+/* A network. Entries are designated by their index, which changes when the
+ * table is rebuilt.
+ */
+struct ipt_entry {
+	void *data;             /* caller's data, returned on match */
+	const void *owner;      /* caller's identifier, used to find the entry again */
+	unsigned int parent;    /* closest entry of the base covering this one, IPT_NONE if none */
+	unsigned char len;      /* prefix length in bits */
+	unsigned char dead;     /* deleted, the slot being reclaimed at the next build */
+};
+
+/* A network added since the last build, indexed by prefix */
+struct ipt_delta {
+	unsigned long idx;      /* entry, as a long to keep the node aligned */
+	struct ebmb_node node;  /* the key follows */
+};
+
+/* An IPv6 address in host order */
+struct ipt_key6 {
+	uint64_t hi, lo;
+};
+
+/* A table of ranges, holding the lower bound of each range of addresses
+ * sharing the same longest match, and a static search tree whose upper levels
+ * hold the first bound of each block of IPT_FANOUT keys of the level below.
+ */
+struct ipt_index {
+	unsigned int klen;      /* key length in bytes, 4 or 16 */
+	const uint32_t *k4;     /* IPv4 bounds then upper levels, in host order */
+	const struct ipt_key6 *k6; /* IPv6 bounds then upper levels */
+	const unsigned int *bval; /* entry matching each range, IPT_NONE if none */
+	unsigned int nb_lvl;    /* number of levels, 0 if empty */
+	unsigned int lvl_off[IPT_MAX_LEVELS]; /* first key of each level */
+	unsigned int lvl_nb[IPT_MAX_LEVELS];  /* number of keys of each level */
+};
+
+/* The entries are split in three parts :
+ *   - [0, nb_base) : the base, sorted by address and length, and flattened
+ *     into a table of ranges at the last build ;
+ *   - [nb_base, nb_indexed) : networks added since, in the delta tree ;
+ *   - [nb_indexed, nb_entries) : networks not yet indexed.
+ */
+struct ipt {
+	unsigned int klen;      /* key length in bytes, 4 or 16 */
+	struct ipt_entry *entries;
+	unsigned char *keys;    /* <klen> bytes per entry, in network order */
+	unsigned int nb_entries, sz_entries;
+	unsigned int nb_base;
+	unsigned int nb_indexed;
+	unsigned int nb_dead;   /* deleted entries still holding a slot */
+	struct eb_root delta;
+	struct ipt_index ix;    /* ranges of the base */
+	unsigned int builds;    /* number of times the base was built */
+};
+
+/* Allocates an empty table for keys of <klen> bytes, 4 for IPv4 or 16 for
+ * IPv6. Returns NULL on memory shortage.
+ */
+struct ipt *ipt_new(unsigned int klen);
+
+/* Releases table <t>. The data of the entries is left to the caller. <t> may
+ * be NULL.
+ */
+void ipt_free(struct ipt *t);
+
+/* Adds network <key>/<len>, <key> being in network order, associated with
+ * <data> and <owner>. The network ranks after those already present with the
+ * same prefix. Returns 0 on success or -1 on memory shortage.
+ */
+int ipt_insert(struct ipt *t, const void *key, unsigned int len, void *data, const void *owner);
+
+/* Returns the first live entry of <owner> for network <key>/<len>, or NULL if
+ * none. If <key> is NULL, all entries are scanned for <owner>.
+ */
+struct ipt_entry *ipt_find(struct ipt *t, const void *key, unsigned int len, const void *owner);
+
+/* Removes entry <e> found by ipt_find(). Its data is left to the caller. */
+void ipt_remove(struct ipt *t, struct ipt_entry *e);
+
+/* Indexes the networks added since the last call into the delta tree, which
+ * only costs a tree insertion per network. Must be called before ipt_lookup()
+ * after insertions. Returns 0 on success or -1 on memory shortage, in which
+ * case the networks not yet indexed cannot be found.
+ */
+int ipt_prepare(struct ipt *t);
+
+/* Rebuilds the base from all the live entries, which empties the delta tree
+ * and reclaims the deleted entries. It takes time proportional to the table
+ * size, so callers do it outside of the lookup path once ipt_need_build()
+ * says so. Returns 0 on success or -1 on memory shortage, in which case the
+ * table is unchanged.
+ */
+int ipt_build(struct ipt *t);
+
+/* Returns the entry of the range of index <ix> holding address <addr> in
+ * network order, or IPT_NONE if the index is empty.
+ */
+unsigned int ipt_index_lookup(const struct ipt_index *ix, const void *addr);
+
+/* Returns the entry of the longest network matching address <addr> of <klen>
+ * bytes in network order, or NULL if none.
+ */
+struct ipt_entry *ipt_lookup(const struct ipt *t, const void *addr);
+
+/* Returns non-zero if enough networks were added or deleted since the last
+ * build for ipt_build() to be worth it.
+ */
+static inline int ipt_need_build(const struct ipt *t)
+{
+	unsigned int changes = t->nb_entries - t->nb_base + t->nb_dead;
+
+	return changes > IPT_MIN_DELTA && changes > t->nb_base / 4;
+}
+
+/* returns the key of entry <e> */
+static inline const unsigned char *ipt_key(const struct ipt *t, const struct ipt_entry *e)
+{
+	return t->keys + (e - t->entries) * t->klen;
+}
+
+#endif /* _COMMON_IPTABLE_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -35,6 +35,14 @@
 #endif
 #define MEM_F_EXACT	0x2
 
+/* flags for pool_reserve_slab(), also reported in pool->slab_flags */
+#define POOL_SLAB_HUGEPAGES	0x1	/* try to back the slab with explicit hugepages */
+#define POOL_SLAB_HUGETLB	0x2	/* the slab was obtained from hugetlbfs */
+#define POOL_SLAB_THP		0x4	/* the slab was advised for transparent hugepages */
+
+/* objects carved from a slab are aligned on cache lines */
+#define POOL_SLAB_ALIGN		64
+
 /* reserve an extra void* at the end of a pool for linking */
 #ifdef DEBUG_MEMORY_POOLS
 #define POOL_EXTRA (sizeof(void *))
@@ -55,6 +63,13 @@ struct pool_head {
 	unsigned int flags;	/* MEM_F_* */
 	unsigned int users;	/* number of pools sharing this zone */
 	unsigned int failed;	/* failed allocations */
+	char *slab;		/* optional pre-reserved area objects are carved from */
+	unsigned long slab_size; /* size of the slab in bytes */
+	unsigned long slab_used; /* bytes already carved from the slab */
+	unsigned int slab_flags; /* POOL_SLAB_* */
+	int slab_node;		/* NUMA node the slab is bound to, or -1 */
+	unsigned int hits;	/* allocations served from the free list */
+	unsigned int misses;	/* allocations which required a malloc() */
 	char name[12];		/* name of the pool */
 };
 
@@ -92,6 +107,21 @@ void *pool_refill_alloc(struct pool_head *pool, unsigned int avail);
  */
 struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags);
 
+/* Reserves a contiguous memory area large enough for <count> objects of pool
+ * <pool>, from which next refills will carve their objects before resorting
+ * to malloc(). <flags> may contain POOL_SLAB_HUGEPAGES, and if <node> is not
+ * negative, the area is bound to this NUMA node. All pages are touched before
+ * returning. Returns 1 on success, 0 if the area could not be reserved.
+ */
+int pool_reserve_slab(struct pool_head *pool, unsigned int count, unsigned int flags, int node);
+
+/* Returns non-zero if <ptr> was carved from the slab of pool <pool> */
+static inline int pool_in_slab(const struct pool_head *pool, const void *ptr)
+{
+	return (const char *)ptr >= pool->slab &&
+	       (const char *)ptr < pool->slab + pool->slab_size;
+}
+
 /* Dump statistics on pools usage.
  */
 void dump_pools_to_trash();
@@ -129,11 +159,14 @@ static inline void *pool_get_first(struct pool_head *pool)
 	if ((p = pool->free_list) != NULL) {
 		pool->free_list = *POOL_LINK(pool, p);
 		pool->used++;
+		pool->hits++;
 #ifdef DEBUG_MEMORY_POOLS
 		/* keep track of where the element was allocated from */
 		*POOL_LINK(pool, p) = (void *)pool;
 #endif
 	}
+	else
+		pool->misses++;
 	return p;
 }
 
@@ -0,0 +1,148 @@
+/*
+ * include/common/rxset.h
+ * Combined matcher for sets of regular expressions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COMMON_RXSET_H
+#define _COMMON_RXSET_H
+
+/* Memory allowed to the cache of DFA states of one set. When it is exhausted,
+ * the cache is flushed and rebuilt from the current state.
+ */
+#ifndef RXSET_CACHE_SIZE
+#define RXSET_CACHE_SIZE (2 * 1024 * 1024)
+#endif
+
+/* Expressions producing more NFA states than this, usually because of large
+ * counted repetitions, are left to the caller.
+ */
+#define RXSET_MAX_NFA 10000
+
+/* NFA state types */
+enum {
+	RXN_CHAR = 0,           /* consumes one byte of charset <arg> and goes to <out> */
+	RXN_SPLIT,              /* goes to both <out> and <out1> */
+	RXN_EPS,                /* goes to <out> */
+	RXN_MATCH,              /* expression <arg> matches */
+	RXN_EOS,                /* expression <arg> matches if the subject ends here */
+};
+
+struct rxn_state {
+	unsigned int type;
+	unsigned int out, out1;
+	unsigned int arg;
+};
+
+/* a set of bytes */
+struct rx_charset {
+	unsigned int bits[8];
+};
+
+/* A DFA state, which is the set of the NFA states of type CHAR, MATCH or EOS
+ * reached at a given position, except those reached from the unanchored
+ * starts which are implicitly part of every state.
+ */
+struct rxd_state {
+	unsigned int *set;      /* sorted NFA states */
+	unsigned int nb;        /* number of NFA states in <set> */
+	unsigned int hash;
+	int hnext;              /* next state in the same hash bucket, -1 if none */
+	unsigned int acc;       /* lowest id matching when reaching this state */
+	unsigned int acc_end;   /* lowest id matching if the subject ends here */
+};
+
+struct rxset {
+	int icase;              /* case-insensitive matching */
+	int prepared;           /* no more expressions may be added */
+	unsigned int nb_exprs;  /* number of expressions added */
+	unsigned int min_id;    /* lowest id added */
+
+	/* NFA */
+	struct rxn_state *nfa;
+	unsigned int nb_nfa, sz_nfa;
+	struct rx_charset *cs;
+	unsigned int nb_cs, sz_cs;
+	unsigned int *cs_hash;  /* charsets by hash, for deduplication */
+	unsigned int sz_cs_hash;
+	unsigned int *astart;   /* anchored starts ('^'), only tried at the beginning */
+	unsigned int nb_astart, sz_astart;
+	unsigned int *ustart;   /* unanchored starts, tried at every position */
+	unsigned int nb_ustart, sz_ustart;
+
+	/* byte classes: bytes which no charset tells apart share the same class */
+	unsigned char cls[256];
+	unsigned char rep[256]; /* one byte of each class */
+	unsigned int nb_cls;
+
+	/* closure of the unanchored starts, part of every DFA state */
+	unsigned int *uset;
+	unsigned int nb_uset;
+	unsigned int uacc, uacc_end;
+
+	/* work area, one entry per NFA state */
+	unsigned int *mark;
+	unsigned int gen;
+	unsigned int *work;
+	unsigned int nb_work;
+	unsigned int *stack;
+
+	/* DFA cache */
+	struct rxd_state *dfa;
+	unsigned int nb_dfa, sz_dfa;
+	unsigned int *trans;    /* <nb_cls> transitions per state, state+1 or 0 if not computed */
+	int *dfa_hash;          /* first state of each bucket, -1 if none */
+	unsigned int sz_dfa_hash;
+	int init;               /* initial state, -1 if not computed */
+	unsigned int mem;       /* memory used by the cache */
+	unsigned int flushes;   /* number of times the cache was flushed */
+};
+
+/* Allocates an empty set, folding case if <icase> is non-zero. Returns NULL on
+ * memory shortage.
+ */
+struct rxset *rxset_new(int icase);
+
+/* Releases set <s>. <s> may be NULL. */
+void rxset_free(struct rxset *s);
+
+/* Adds expression <str> under id <id>, which must be greater than the ids
+ * already added. The syntax is the one of PCRE without any option. Returns 1
+ * on success, 0 if the expression uses a construct the set does not support
+ * (back-references, assertions, ...) in which case the caller has to match it
+ * by itself, or -1 on memory shortage. The set is unchanged on failure.
+ */
+int rxset_add(struct rxset *s, const char *str, unsigned int id);
+
+/* Finalizes the set once all expressions are added. Returns 0 on success or
+ * -1 on memory shortage.
+ */
+int rxset_prepare(struct rxset *s);
+
+/* Looks the <len> bytes at <str> up in prepared set <s>. Returns 1 and sets
+ * <id> to the lowest id of the expressions found in the subject, 0 if none is
+ * found, or -1 on memory shortage.
+ */
+int rxset_exec(struct rxset *s, const char *str, int len, unsigned int *id);
+
+#endif /* _COMMON_RXSET_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
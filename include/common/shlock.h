@@ -0,0 +1,214 @@
+/*
+ * include/common/shlock.h
+ * Inter-process locks for structures placed in shared memory.
+ *
+ * Copyright (C) 2011-2012 EXCELIANCE
+ *
+ * Author: Emeric Brun - emeric@exceliance.fr
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _COMMON_SHLOCK_H
+#define _COMMON_SHLOCK_H
+
+#ifndef USE_PRIVATE_CACHE
+#ifdef USE_PTHREAD_PSHARED
+#include <pthread.h>
+#else
+#ifdef USE_SYSCALL_FUTEX
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
+
+/* A lock protecting a memory area shared between processes. It must be
+ * placed in the shared area itself and initialized with shlock_init() before
+ * forking. With USE_PRIVATE_CACHE, shared areas are never really shared and
+ * locking is a no-op.
+ */
+struct shlock {
+#ifndef USE_PRIVATE_CACHE
+#ifdef USE_PTHREAD_PSHARED
+	pthread_mutex_t mutex;
+#else
+	unsigned int waiters;
+#endif
+#else
+	int unused;
+#endif
+};
+
+#if defined (USE_PRIVATE_CACHE)
+
+static inline int shlock_init(struct shlock *lock)
+{
+	return 0;
+}
+
+#define shlock_lock(l)
+#define shlock_unlock(l)
+
+#elif defined (USE_PTHREAD_PSHARED)
+
+/* Returns 0 on success, -1 if the mutex could not be initialized */
+static inline int shlock_init(struct shlock *lock)
+{
+	pthread_mutexattr_t attr;
+
+	if (pthread_mutexattr_init(&attr))
+		return -1;
+
+	if (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED)) {
+		pthread_mutexattr_destroy(&attr);
+		return -1;
+	}
+
+	if (pthread_mutex_init(&lock->mutex, &attr)) {
+		pthread_mutexattr_destroy(&attr);
+		return -1;
+	}
+	return 0;
+}
+
+#define shlock_lock(l)   pthread_mutex_lock(&(l)->mutex)
+#define shlock_unlock(l) pthread_mutex_unlock(&(l)->mutex)
+
+#else
+
+#ifdef USE_SYSCALL_FUTEX
+static inline void _shlock_wait4lock(unsigned int *count, unsigned int *uaddr, int value)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAIT, value, NULL, 0, 0);
+}
+
+static inline void _shlock_awakelocker(unsigned int *uaddr)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAKE, 1, NULL, 0, 0);
+}
+
+#else /* internal spin lock */
+
+#if (defined (__i486__) || defined (__i586__) || defined (__i686__) || defined (__x86_64__)) && !defined(__VMS)
+static inline void relax()
+{
+	__asm volatile("rep;nop\n" ::: "memory");
+}
+#else /* if no x86_64 or i586 arch: use less optimized but generic asm */
+static inline void relax()
+{
+	__asm volatile("" ::: "memory");
+}
+#endif
+
+static inline void _shlock_wait4lock(unsigned int *count, unsigned int *uaddr, int value)
+{
+        int i;
+
+        for (i = 0; i < *count; i++) {
+                relax();
+                relax();
+        }
+        *count = *count << 1;
+}
+
+#define _shlock_awakelocker(a)
+
+#endif
+
+#if (defined (__i486__) || defined (__i586__) || defined (__i686__) || defined (__x86_64__)) && !defined(__VMS)
+static inline unsigned int xchg(unsigned int *ptr, unsigned int x)
+{
+	__asm volatile("lock xchgl %0,%1"
+		     : "=r" (x), "+m" (*ptr)
+		     : "0" (x)
+		     : "memory");
+	return x;
+}
+
+static inline unsigned int cmpxchg(unsigned int *ptr, unsigned int old, unsigned int new)
+{
+	unsigned int ret;
+
+	__asm volatile("lock cmpxchgl %2,%1"
+		     : "=a" (ret), "+m" (*ptr)
+		     : "r" (new), "0" (old)
+		     : "memory");
+	return ret;
+}
+
+static inline unsigned char atomic_dec(unsigned int *ptr)
+{
+	unsigned char ret;
+	__asm volatile("lock decl %0\n"
+		     "setne %1\n"
+		     : "+m" (*ptr), "=qm" (ret)
+		     :
+		     : "memory");
+	return ret;
+}
+
+#else /* if no x86_64 or i586 arch: use less optimized gcc >= 4.1 built-ins */
+static inline unsigned int xchg(unsigned int *ptr, unsigned int x)
+{
+	return __sync_lock_test_and_set(ptr, x);
+}
+
+static inline unsigned int cmpxchg(unsigned int *ptr, unsigned int old, unsigned int new)
+{
+	return __sync_val_compare_and_swap(ptr, old, new);
+}
+
+static inline unsigned char atomic_dec(unsigned int *ptr)
+{
+	return __sync_sub_and_fetch(ptr, 1) ? 1 : 0;
+}
+
+#endif
+
+static inline int shlock_init(struct shlock *lock)
+{
+	lock->waiters = 0;
+	return 0;
+}
+
+static inline void shlock_lock(struct shlock *lock)
+{
+	unsigned int x;
+	unsigned int count = 4;
+
+	x = cmpxchg(&lock->waiters, 0, 1);
+	if (x) {
+		if (x != 2)
+			x = xchg(&lock->waiters, 2);
+
+		while (x) {
+			_shlock_wait4lock(&count, &lock->waiters, 2);
+			x = xchg(&lock->waiters, 2);
+		}
+	}
+}
+
+static inline void shlock_unlock(struct shlock *lock)
+{
+	if (atomic_dec(&lock->waiters)) {
+		lock->waiters = 0;
+		_shlock_awakelocker(&lock->waiters);
+	}
+}
+
+#endif
+
+#endif /* _COMMON_SHLOCK_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
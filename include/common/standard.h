@@ -714,6 +714,20 @@ static inline unsigned int my_popcountl(unsigned long a)
 	return cnt;
 }
 
+/* Simple ffs implementation. It returns the position of the lowest bit set
+ * in a word, starting at 1, or zero if no bit is set.
+ */
+static inline unsigned int my_ffsl(unsigned long a)
+{
+	unsigned int cnt;
+
+	if (!a)
+		return 0;
+	for (cnt = 1; !(a & 1); a >>= 1)
+		cnt++;
+	return cnt;
+}
+
 /* Build a word with the <bits> lower bits set (reverse of my_popcountl) */
 static inline unsigned long nbits(int bits)
 {
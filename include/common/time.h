@@ -56,6 +56,7 @@ extern unsigned int   now_ms;           /* internal date in milliseconds (may wr
 extern unsigned int   samp_time;        /* total elapsed time over current sample */
 extern unsigned int   idle_time;        /* total idle time over current sample */
 extern unsigned int   idle_pct;         /* idle to total ratio over last sample (percent) */
+extern unsigned int   loop_time;        /* average processing time per polling loop (us) */
 extern struct timeval now;              /* internal date is a monotonic function of real clock */
 extern struct timeval date;             /* the real current date */
 extern struct timeval start_date;       /* the process's start date */
@@ -536,7 +537,8 @@ static inline void measure_idle()
 	/* Let's compute the idle to work ratio. We worked between after_poll
 	 * and before_poll, and slept between before_poll and date. The idle_pct
 	 * is updated at most twice every second. Note that the current second
-	 * rarely changes so we avoid a multiply when not needed.
+	 * rarely changes so we avoid a multiply when not needed. The work time
+	 * is also used to compute the average loop_time.
 	 */
 	int delta;
 
@@ -544,6 +546,13 @@ static inline void measure_idle()
 		delta *= 1000000;
 	idle_time += delta + (date.tv_usec - before_poll.tv_usec);
 
+	/* the processing time of the last loop is averaged over 8 loops */
+	if ((delta = before_poll.tv_sec - after_poll.tv_sec))
+		delta *= 1000000;
+	delta += before_poll.tv_usec - after_poll.tv_usec;
+	if ((unsigned int)delta < 1000000)
+		loop_time = (loop_time * 7 + delta) / 8;
+
 	if ((delta = date.tv_sec - after_poll.tv_sec))
 		delta *= 1000000;
 	samp_time += delta + (date.tv_usec - after_poll.tv_usec);
@@ -101,6 +101,27 @@ struct acl_cond *build_acl_cond(const char *file, int line, struct proxy *px, co
  */
 enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct session *sess, struct stream *strm, unsigned int opt);
 
+/* Same as acl_exec_cond(), except that the results of ACLs having a slot in
+ * <memo> are taken from it when known, or stored there once computed.
+ */
+enum acl_test_res acl_exec_cond_memo(struct acl_cond *cond, struct proxy *px, struct session *sess,
+                                     struct stream *strm, unsigned int opt, struct acl_memo *memo);
+
+/* Assigns memoization slots to the ACLs of proxy <px> referenced more than
+ * once by the conditions of the rules in <rules>, a list of act_rule. Returns
+ * the number of slots assigned.
+ */
+int acl_assign_memo_slots(struct proxy *px, struct list *rules);
+
+/* Forgets all results stored in <memo> */
+static inline void acl_memo_reset(struct acl_memo *memo)
+{
+	if (memo->nb) {
+		memset(memo->known, 0, sizeof(memo->known));
+		memo->nb = 0;
+	}
+}
+
 /* Returns a pointer to the first ACL conflicting with usage at place <where>
  * which is one of the SMP_VAL_* bits indicating a check place, or NULL if
  * no conflict is found. Only full conflicts are detected (ACL is not usable).
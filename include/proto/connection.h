@@ -66,6 +66,26 @@ static inline int conn_ctrl_ready(const struct connection *conn)
 	return (conn->flags & CO_FL_CTRL_READY);
 }
 
+/* returns true if the transport layer is able to receive into a pipe on this
+ * connection. Some transport layers only support splicing once a specific
+ * state is reached (eg: SSL once the kernel handles the TLS records), so they
+ * provide a pipe_ready() callback to report it.
+ */
+static inline int conn_xprt_can_rcv_pipe(const struct connection *conn)
+{
+	return conn->xprt && conn->xprt->rcv_pipe &&
+		(!conn->xprt->pipe_ready || conn->xprt->pipe_ready(conn, 0));
+}
+
+/* returns true if the transport layer is able to send from a pipe on this
+ * connection. See conn_xprt_can_rcv_pipe() above.
+ */
+static inline int conn_xprt_can_snd_pipe(const struct connection *conn)
+{
+	return conn->xprt && conn->xprt->snd_pipe &&
+		(!conn->xprt->pipe_ready || conn->xprt->pipe_ready(conn, 1));
+}
+
 /* Calls the init() function of the transport layer if any and if not done yet,
  * and sets the CO_FL_XPRT_READY flag to indicate it was properly initialized.
  * Returns <0 in case of error.
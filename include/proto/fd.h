@@ -35,6 +35,24 @@ extern unsigned int *fd_cache;      // FD events cache
 extern unsigned int *fd_updt;       // FD updates list
 extern int fd_cache_num;            // number of events in the cache
 extern int fd_nbupdt;               // number of updates in the list
+extern unsigned int poll_events_hist[POLL_HIST_BUCKETS]; // events per poll() call
+
+/* Accounts for one poll() call having returned <events> events in the
+ * histogram reported in "show info".
+ */
+static inline void fd_count_poll_events(int events)
+{
+	int bucket = 0;
+
+	if (events > 0) {
+		bucket = 1;
+		while (events > 1 && bucket < POLL_HIST_BUCKETS - 1) {
+			events >>= 1;
+			bucket++;
+		}
+	}
+	poll_events_hist[bucket]++;
+}
 
 /* Deletes an FD from the fdsets, and recomputes the maxfd limit.
  * The file descriptor is also closed.
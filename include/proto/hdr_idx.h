@@ -22,10 +22,24 @@
 #ifndef _PROTO_HDR_IDX_H
 #define _PROTO_HDR_IDX_H
 
+#include <string.h>
+
 #include <common/config.h>
 #include <types/hdr_idx.h>
 
 extern struct pool_head *pool2_hdr_idx;
+extern struct pool_head *pool2_hdr_hash;
+
+/*
+ * Marks the name index of <list> as needing to be rebuilt, if any. This must
+ * be called by any code modifying the headers in a way the index cannot track
+ * (eg: rewriting whole lines).
+ */
+static inline void hdr_idx_hash_invalidate(struct hdr_idx *list)
+{
+	if (list->hash)
+		list->hash->dirty = 1;
+}
 
 /*
  * Initialize the list pointers.
@@ -40,6 +54,11 @@ static inline void hdr_idx_init(struct hdr_idx *list)
 	}
 	list->tail = 0;
 	list->used = list->last = 1;
+	if (list->hash) {
+		memset(list->hash->head, 0, sizeof(list->hash->head));
+		list->hash->e[0].bucket = HDR_HASH_NONE;
+		list->hash->dirty = 0;
+	}
 }
 
 /*
@@ -70,10 +89,25 @@ static inline int hdr_idx_first_pos(struct hdr_idx *list)
  */
 static inline void hdr_idx_set_start(struct hdr_idx *list, int len, int cr)
 {
+	if (list->hash && list->v[0].next && (list->v[0].len != len || list->v[0].cr != cr))
+		list->hash->dirty = 1;
 	list->v[0].len = len;
 	list->v[0].cr = cr;
 }
 
+/*
+ * Returns the bucket of header name <name> of length <len> in the name index.
+ * The hash is case-insensitive.
+ */
+static inline unsigned int hdr_hash_bucket(const char *name, int len)
+{
+	unsigned int h = 0;
+
+	while (len--)
+		h = h * 33 + (*name++ | 0x20);
+	return (h ^ (h >> HDR_HASH_BITS)) & (HDR_HASH_SIZE - 1);
+}
+
 /*
  * Add a header entry to <list> after element <after>. <after> is ignored when
  * the list is empty or full. Common usage is to set <after> to list->tail.
@@ -82,9 +116,27 @@ static inline void hdr_idx_set_start(struct hdr_idx *list, int len, int cr)
  * if the array is already full. An effort is made to fill the array linearly,
  * but once the last entry has been used, we have to search for unused blocks,
  * which takes much more time. For this reason, it's important to size is
- * appropriately.
+ * appropriately. <line> points to the header line in the message, it is used
+ * to keep the name index up to date when there is one.
+ */
+int hdr_idx_add(int len, int cr, struct hdr_idx *list, int after, const char *line);
+
+/*
+ * Rebuilds the name index of <list> from the message starting at <msg>.
+ */
+void hdr_idx_hash_build(struct hdr_idx *list, const char *msg);
+
+/*
+ * Unlinks element <cur> from the name index, <prev> being the previous element
+ * in the list. It must be called after <cur> was unlinked from the list.
+ */
+void hdr_idx_hash_del(struct hdr_idx *list, int cur, int prev);
+
+/*
+ * Adds <delta> to the position of all elements following <after> in the list.
+ * It must be called when the length of element <after> is changed.
  */
-int hdr_idx_add(int len, int cr, struct hdr_idx *list, int after);
+void hdr_idx_hash_shift(struct hdr_idx *list, int after, int delta);
 
 #endif /* _PROTO_HDR_IDX_H */
 
@@ -26,6 +26,11 @@
 
 #include <types/listener.h>
 
+/* adaptive accept statistics, reported in "show info" */
+extern unsigned int accept_batch;     /* last accept batch size computed in adaptive mode */
+extern unsigned int accept_deferrals; /* number of accept batches cut in adaptive mode */
+extern unsigned int accept_backlog;   /* connections left in the accept queue upon last deferral */
+
 /* This function adds the specified listener's file descriptor to the polling
  * lists if it is in the LI_LISTEN state. The listener enters LI_READY or
  * LI_FULL state depending on its number of connections.
@@ -119,6 +124,19 @@ struct bind_kw *bind_find_kw(const char *kw);
 /* Dumps all registered "bind" keywords to the <out> string pointer. */
 void bind_dump_kws(char **out);
 
+/* Splits each listener of bind_conf <bind_conf> into as many SO_REUSEPORT
+ * listeners as requested by its "shards" setting, each of them running on a
+ * subset of the processes in <mask>. Returns 0 if OK, otherwise a combination
+ * of ERR_* flags with an error message in <err>.
+ */
+int bind_conf_make_shards(struct bind_conf *bind_conf, unsigned long mask, char **err);
+
+/* Returns the processes listener <l> may run on, 0 meaning all */
+static inline unsigned long listener_bind_proc(const struct listener *l)
+{
+	return l->bind_proc ? l->bind_proc : l->bind_conf->bind_proc;
+}
+
 /* allocate an bind_conf struct for a bind line, and chain it to list head <lh>.
  * If <arg> is not NULL, it is duplicated into ->arg to store useful config
  * information for error reporting.
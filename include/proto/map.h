@@ -34,5 +34,6 @@ struct map_reference *map_get_reference(const char *reference);
 
 int sample_load_map(struct arg *arg, struct sample_conv *conv,
                     const char *file, int line, char **err);
+int map_compile(const char *type, const char *in, const char *out, char **err);
 
 #endif /* _PROTO_PATTERN_H */
@@ -0,0 +1,40 @@
+/*
+ * include/proto/mux_h2.h
+ * This file defines function prototypes for the HTTP/2 multiplexer.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _PROTO_MUX_H2_H
+#define _PROTO_MUX_H2_H
+
+#include <common/config.h>
+#include <types/connection.h>
+#include <types/listener.h>
+#include <types/session.h>
+#include <types/task.h>
+
+int h2c_frt_wanted(struct connection *conn, struct listener *l);
+int h2c_frt_init(struct connection *conn, struct session *sess, struct task *t);
+void h2c_stream_gone(struct connection *conn);
+
+#endif /* _PROTO_MUX_H2_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
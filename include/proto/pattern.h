@@ -194,6 +194,18 @@ int pat_ref_delete_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt);
 void pat_ref_prune(struct pat_ref *ref);
 int pat_ref_load(struct pat_ref *ref, struct pattern_expr *expr, int patflags, int soe, char **err);
 void pat_ref_reload(struct pat_ref *ref, struct pat_ref *replace);
+int pat_ref_split_line(char *line, char **key, char **value);
+struct pat_ref *pat_ref_prepare(struct pat_ref *ref);
+void pat_ref_abort(struct pat_ref *ref, unsigned int gen);
+int pat_ref_open_gen(struct pat_ref *gen, const char *filename, FILE **file, char **err);
+int pat_ref_load_gen(struct pat_ref *gen, FILE *file, int *line, char **err);
+void pat_ref_commit(struct pat_ref *ref);
+
+/* Returns version <gen> of <ref> if it is the one being prepared, or NULL. */
+static inline struct pat_ref *pat_ref_gen(struct pat_ref *ref, unsigned int gen)
+{
+	return ref->next && ref->next_gen == gen ? ref->next : NULL;
+}
 
 
 /*
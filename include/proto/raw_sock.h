@@ -26,6 +26,11 @@
 
 extern struct xprt_ops raw_sock;
 
+#if defined(CONFIG_HAP_LINUX_SPLICE)
+int raw_sock_to_pipe(struct connection *conn, struct pipe *pipe, unsigned int count);
+int raw_sock_from_pipe(struct connection *conn, struct pipe *pipe);
+#endif
+
 #endif /* _PROTO_RAW_SOCK_H */
 
 /*
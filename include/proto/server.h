@@ -146,6 +146,12 @@ void srv_shutdown_streams(struct server *srv, int why);
  */
 void srv_shutdown_backup_streams(struct proxy *px, int why);
 
+/* Idle server connection pool, see srv_pool_conn() */
+int srv_pool_conn(struct connection *conn);
+struct connection *srv_take_pooled_conn(struct server *srv);
+void srv_purge_pool(struct server *srv, unsigned int count);
+int srv_init_pool(struct server *srv);
+
 /* Appends some information to a message string related to a server going UP or
  * DOWN.  If both <forced> and <reason> are null and the server tracks another
  * one, a "via" information will be provided to know where the status came from.
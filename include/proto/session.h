@@ -37,6 +37,7 @@ struct session *session_new(struct proxy *fe, struct listener *li, enum obj_type
 void session_free(struct session *sess);
 int init_session();
 int session_accept_fd(struct listener *l, int cfd, struct sockaddr_storage *addr);
+void session_set_idle(struct session *sess, struct connection *conn, struct task *t);
 
 /* Remove the refcount from the session to the tracked counters, and clear the
  * pointer to ensure this is only performed once. The caller is responsible for
@@ -73,6 +73,16 @@
  *
  * The run queue works similarly to the wait queue except that the current date
  * is replaced by an insertion counter which can also wrap without any problem.
+ *
+ * When "tune.timer-wheel" is enabled, timers set far enough in the future do
+ * not go to the tree but to a coarse timer wheel. Each slot of the wheel is a
+ * plain list covering 2^TIMER_WHEEL_SHIFT ms, so that queuing or requeuing a
+ * task there is O(1). The node's key is then set to the slot's start date so
+ * that it remains a minorant of the real expiration date. When the current
+ * date reaches a slot, all of its tasks are moved to the tree which remains
+ * in charge of waking them up precisely. Most of the long timeouts (client,
+ * server, keep-alive) are updated or cancelled long before they expire, so
+ * they never have to reach the tree.
  */
 
 /* The farthest we can look back in a timer tree */
@@ -87,6 +97,7 @@ extern unsigned int niced_tasks;  /* number of niced tasks in the run queue */
 extern struct pool_head *pool2_task;
 extern struct eb32_node *last_timer;   /* optimization: last queued timer */
 extern struct eb32_node *rq_next;    /* optimization: next task except if delete/insert */
+extern unsigned int timer_wheel_count; /* number of tasks in the timer wheel */
 
 /* return 0 if task is in run queue, otherwise non-zero */
 static inline int task_in_rq(struct task *t)
@@ -97,7 +108,7 @@ static inline int task_in_rq(struct task *t)
 /* return 0 if task is in wait queue, otherwise non-zero */
 static inline int task_in_wq(struct task *t)
 {
-	return t->wq.node.leaf_p != NULL;
+	return t->wq.node.leaf_p != NULL || !LIST_ISEMPTY(&t->tw);
 }
 
 /* puts the task <t> in run queue with reason flags <f>, and returns <t> */
@@ -118,6 +129,13 @@ static inline struct task *task_wakeup(struct task *t, unsigned int f)
  */
 static inline struct task *__task_unlink_wq(struct task *t)
 {
+	if (!LIST_ISEMPTY(&t->tw)) {
+		LIST_DEL(&t->tw);
+		LIST_INIT(&t->tw);
+		timer_wheel_count--;
+		return t;
+	}
+
 	eb32_delete(&t->wq);
 	if (last_timer == &t->wq)
 		last_timer = NULL;
@@ -180,6 +198,7 @@ static inline struct task *task_init(struct task *t)
 {
 	t->wq.node.leaf_p = NULL;
 	t->rq.node.leaf_p = NULL;
+	LIST_INIT(&t->tw);
 	t->state = TASK_SLEEPING;
 	t->nice = 0;
 	t->calls = 0;
@@ -270,6 +289,9 @@ int wake_expired_tasks();
 /* Perform minimal initializations, report 0 in case of error, 1 if OK. */
 int init_task();
 
+/* Allocate the timer wheel, report 0 in case of error, 1 if OK. */
+int init_timer_wheel();
+
 #endif /* _PROTO_TASK_H */
 
 /*
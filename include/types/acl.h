@@ -131,7 +131,7 @@ struct acl {
 	struct list list;           /* chaining */
 	char *name;		    /* acl name */
 	struct list expr;	    /* list of acl_exprs */
-	int cache_idx;              /* ACL index in cache */
+	int cache_idx;              /* ACL index in acl_memo, <0 if not memoized */
 	unsigned int use;           /* or'ed bit mask of all acl_expr's SMP_USE_* */
 	unsigned int val;           /* or'ed bit mask of all acl_expr's SMP_VAL_* */
 };
@@ -148,6 +148,20 @@ struct acl_term_suite {
 	struct list terms;          /* list of acl_terms */
 };
 
+/* Maximum number of ACLs per proxy whose results may be memoized */
+#define ACL_MEMO_MAX    512
+#define ACL_MEMO_WORDS  (ACL_MEMO_MAX / (8 * sizeof(long)))
+
+/* Results of the ACLs already evaluated while running a rule set, indexed by
+ * acl->cache_idx. It must be reset using acl_memo_reset() as soon as an action
+ * may have changed what the ACLs see.
+ */
+struct acl_memo {
+	unsigned int nb;                        /* number of results stored */
+	unsigned long known[ACL_MEMO_WORDS];    /* results already known */
+	unsigned long pass[ACL_MEMO_WORDS];     /* results which are ACL_TEST_PASS */
+};
+
 struct acl_cond {
 	struct list list;           /* Some specific tests may use multiple conditions */
 	struct list suites;         /* list of acl_term_suites */
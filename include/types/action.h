@@ -104,6 +104,15 @@ struct act_rule {
 	                              struct session *sess, struct stream *s, int flags);
 	struct action_kw *kw;
 	struct applet applet;                  /* used for the applet registration. */
+	struct {
+		const char *file;              /* file where the rule is declared */
+		int line;                      /* line where the rule is declared */
+	} conf;
+	struct {
+		unsigned long long calls;      /* number of times the rule was evaluated */
+		unsigned long long matches;    /* number of times its condition matched */
+		unsigned long long cost;       /* time spent in its condition, in rdtsc() units */
+	} prof;                                /* only updated when rules profiling is enabled */
 	union {
 		struct {
 			char *realm;
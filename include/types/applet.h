@@ -30,7 +30,12 @@
 #include <common/chunk.h>
 #include <common/config.h>
 
+struct act_rule;
 struct appctx;
+struct h2s;
+struct cache;
+struct cache_entry;
+struct cache_block;
 
 /* Applet descriptor */
 struct applet {
@@ -96,6 +101,11 @@ struct appctx {
 			signed char data_type;	/* type of data to compare, or -1 if none */
 			signed char data_op;	/* operator (STD_OP_*) when data_type set */
 		} table;
+		struct {
+			struct proxy *px;	/* proxy being dumped */
+			struct act_rule *rule;	/* rule to dump next in <px>, NULL = first one */
+			int idx;		/* position of this rule in <px> */
+		} rules;
 		struct {
 			const char *msg;	/* pointer to a persistent message to be returned in PRINT state */
 			char *err;        /* pointer to a 'must free' message to be returned in PRINT_FREE state */
@@ -107,6 +117,10 @@ struct appctx {
 			unsigned int display_flags;
 			struct pat_ref *ref;
 			struct bref bref;	/* back-reference from the pat_ref_elt being dumped */
+			unsigned int entry;	/* next entry of the compiled map to dump */
+			unsigned int gen;	/* version being dumped or prepared */
+			FILE *file;		/* file being loaded into the version, or NULL */
+			int line;		/* last line read from <file> */
 			struct pattern_expr *expr;
 			struct chunk chunk;
 		} map;
@@ -163,6 +177,16 @@ struct appctx {
 			unsigned int max_frame_size;
 			struct list  list;
 		} spoe;                         /* used by SPOE filter */
+		struct {
+			struct h2s *h2s;        /* HTTP/2 stream, NULL once detached */
+		} h2;                           /* used by the HTTP/2 mux */
+		struct {
+			struct cache *cache;    /* cache the object belongs to */
+			struct cache_entry *entry; /* object being sent, referenced */
+			struct cache_block *blk; /* block being sent */
+			unsigned int ofs;       /* offset of the next byte to send in <blk> */
+			unsigned int left;      /* number of bytes left to send */
+		} cache;                        /* used by the HTTP cache filter */
 	} ctx;					/* used by stats I/O handlers to dump the stats */
 };
 
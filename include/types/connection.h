@@ -214,6 +214,7 @@ struct xprt_ops {
 	int  (*snd_buf)(struct connection *conn, struct buffer *buf, int flags); /* send callback */
 	int  (*rcv_pipe)(struct connection *conn, struct pipe *pipe, unsigned int count); /* recv-to-pipe callback */
 	int  (*snd_pipe)(struct connection *conn, struct pipe *pipe); /* send-to-pipe callback */
+	int  (*pipe_ready)(const struct connection *conn, int dir); /* optional: may rcv_pipe (0) / snd_pipe (1) be used now ? */
 	void (*shutr)(struct connection *, int);    /* shutr function */
 	void (*shutw)(struct connection *, int);    /* shutw function */
 	void (*close)(struct connection *);         /* close the transport layer */
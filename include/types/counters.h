@@ -88,6 +88,8 @@ struct be_counters {
 	long long srv_aborts;                   /* aborted responses during DATA phase caused by the server */
 	long long retries;                      /* retried and redispatched connections (BE only) */
 	long long redispatches;                 /* retried and redispatched connections (BE only) */
+	long long connect;                      /* number of new connections established to servers (BE only) */
+	long long reuse;                        /* number of idle server connections reused (BE only) */
 	long long failed_secu;			/* blocked responses because of security concerns */
 
 	long long failed_checks, failed_hana;	/* failed health checks and health analyses for servers */
@@ -102,6 +102,13 @@ struct fdtab {
 	unsigned char cloned:1;              /* 1 if a cloned socket, requires EPOLL_CTL_DEL on close */
 };
 
+/* Number of buckets in the histogram of events returned per poll() call.
+ * Bucket 0 counts calls which returned no event, and bucket N>0 counts calls
+ * which returned between 2^(N-1) and 2^N-1 events, the last bucket also
+ * counting all larger values.
+ */
+#define POLL_HIST_BUCKETS 10
+
 /* less often used information */
 struct fdinfo {
 	struct port_range *port_range;       /* optional port range to bind to */
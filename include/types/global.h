@@ -66,6 +66,13 @@
 #define GTUNE_USE_GAI            (1<<5)
 #define GTUNE_USE_REUSEPORT      (1<<6)
 #define GTUNE_RESOLVE_DONTFAIL   (1<<7)
+#define GTUNE_TIMER_WHEEL        (1<<8)
+#define GTUNE_BUF_HUGEPAGES      (1<<9)
+#define GTUNE_BUF_NUMA_BIND      (1<<10)
+#define GTUNE_EPOLL_BATCH        (1<<11)
+#define GTUNE_USE_URING          (1<<12)
+#define GTUNE_ADAPTIVE_ACCEPT    (1<<13)
+#define GTUNE_HTTP_HDR_HASH      (1<<14)
 
 /* Access level for a stats socket */
 #define ACCESS_LVL_NONE     0
@@ -142,9 +149,11 @@ struct global {
 		int options;       /* various tuning options */
 		int recv_enough;   /* how many input bytes at once are "enough" */
 		int bufsize;       /* buffer size in bytes, defaults to BUFSIZE */
+		int bufsize_large; /* if not null, size of the buffers full headers are moved to */
 		int maxrewrite;    /* buffer max rewrite size in bytes, defaults to MAXREWRITE */
 		int reserved_bufs; /* how many buffers can only be allocated for response */
 		int buf_limit;     /* if not null, how many total buffers may only be allocated */
+		int buf_prealloc;  /* if not null, how many buffers are pre-reserved in a slab */
 		int client_sndbuf; /* set client sndbuf to this value if not null */
 		int client_rcvbuf; /* set client rcvbuf to this value if not null */
 		int server_sndbuf; /* set server sndbuf to this value if not null */
@@ -59,6 +59,33 @@ struct hdr_idx_elem {
         unsigned next :15; /* offset of next header if len>0. 0=end of list. */
 };
 
+/*
+ * Optional side index of the headers by name. Each element of the hdr_idx
+ * array has its counterpart in <e>, which stores the position of the line
+ * relative to the beginning of the message, and chains all the headers whose
+ * names fall into the same bucket in the list's order. This way, looking a
+ * header up doesn't require to walk over all the other ones. When some
+ * modifications make it too complex to maintain, it is marked dirty and is
+ * rebuilt at once on next lookup.
+ */
+#define HDR_HASH_BITS    6
+#define HDR_HASH_SIZE    (1 << HDR_HASH_BITS)
+#define HDR_HASH_NONE    0xff       /* bucket of unindexed elements */
+
+struct hdr_hash_elem {
+	unsigned int ofs;           /* offset of the line from the beginning of the message */
+	unsigned short prev;        /* previous element in the list */
+	unsigned short next;        /* next element in the same bucket, 0=end */
+	unsigned char bucket;       /* bucket of this header's name, or HDR_HASH_NONE */
+};
+
+struct hdr_hash {
+	int dirty;                             /* must be rebuilt before use */
+	unsigned short head[HDR_HASH_SIZE];    /* first element of each bucket, 0=none */
+	unsigned short tail[HDR_HASH_SIZE];    /* last element of each bucket */
+	struct hdr_hash_elem e[0];             /* one per hdr_idx element */
+};
+
 /*
  * This structure provides necessary information to store, find, remove
  * index entries from a list. This list cannot reference more than 32k
@@ -66,6 +93,7 @@ struct hdr_idx_elem {
  */
 struct hdr_idx {
 	struct hdr_idx_elem *v;     /* the array itself */
+	struct hdr_hash *hash;      /* optional index by name, NULL if unused */
 	short size;                 /* size of the array including the head */
 	short used;                 /* # of elements really used (1..size) */
 	short last;                 /* length of the allocated area (1..size) */
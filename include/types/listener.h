@@ -105,6 +105,8 @@ enum li_state {
 #define LI_O_V6ONLY             0x0400  /* bind to IPv6 only on Linux >= 2.4.21 */
 #define LI_O_V4V6               0x0800  /* bind to IPv4/IPv6 on Linux >= 2.4.21 */
 #define LI_O_ACC_CIP            0x1000  /* find the proxied address in the NetScaler Client IP header */
+#define LI_O_SHARD_CPU          0x2000  /* steer connections to shards based on the receiving CPU */
+#define LI_O_H2                 0x4000  /* speak HTTP/2 without negotiation ("proto h2") */
 
 /* Note: if a listener uses LI_O_UNLIMITED, it is highly recommended that it adds its own
  * maxconn setting to the global.maxsock value so that its resources are reserved.
@@ -124,6 +126,7 @@ enum li_state {
 #define BC_SSL_O_USE_TLSV12     0x0080	/* force TLSv12 */
 /* 0x00F0 reserved for 'force' protocol version options */
 #define BC_SSL_O_NO_TLS_TICKETS 0x0100	/* disable session resumption tickets */
+#define BC_SSL_O_KTLS           0x0200	/* hand the TLS records over to the kernel (kTLS) */
 #endif
 
 /* "bind" line settings */
@@ -156,6 +159,7 @@ struct bind_conf {
 	int is_ssl;                /* SSL is required for these listeners */
 	int generate_certs;        /* 1 if generate-certificates option is set, else 0 */
 	unsigned long bind_proc;   /* bitmask of processes allowed to use these listeners */
+	int shards;                /* number of SO_REUSEPORT sockets per address, 0=none, -1=auto */
 	struct {                   /* UNIX socket permissions */
 		uid_t uid;         /* -1 to leave unchanged */
 		gid_t gid;         /* -1 to leave unchanged */
@@ -185,6 +189,8 @@ struct listener {
 	struct fe_counters *counters;	/* statistics counters */
 	struct protocol *proto;		/* protocol this listener belongs to */
 	struct xprt_ops *xprt;          /* transport-layer operations for this socket */
+	unsigned long bind_proc;	/* processes this shard is bound to, 0 = bind_conf's */
+	int shard;			/* shard number of this listener, 0 for the first one */
 	int nbconn;			/* current number of connections on this listener */
 	int maxconn;			/* maximum connections allowed on this listener */
 	unsigned int backlog;		/* if set, listen backlog */
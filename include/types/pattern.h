@@ -22,10 +22,14 @@
 #ifndef _TYPES_PATTERN_H
 #define _TYPES_PATTERN_H
 
+#include <common/acmatch.h>
+#include <common/cmap.h>
 #include <common/compat.h>
 #include <common/config.h>
+#include <common/iptable.h>
 #include <common/mini-clist.h>
 #include <common/regex.h>
+#include <common/rxset.h>
 
 #include <types/sample.h>
 
@@ -65,6 +69,7 @@ enum pat_match_res {
 enum {
 	PAT_MF_IGNORE_CASE = 1 << 0,       /* ignore case */
 	PAT_MF_NO_DNS      = 1 << 1,       /* dont perform any DNS requests */
+	PAT_MF_IP_TABLE    = 1 << 2,       /* index IP networks in compact tables instead of trees */
 };
 
 /* possible flags for patterns storage */
@@ -95,6 +100,7 @@ enum {
 #define PAT_REF_MAP 0x1 /* Set if the reference is used by at least one map. */
 #define PAT_REF_ACL 0x2 /* Set if the reference is used by at least one acl. */
 #define PAT_REF_SMP 0x4 /* Flag used if the reference contains a sample. */
+#define PAT_REF_LOADING 0x8 /* Version still being loaded, cannot be used yet. */
 
 /* This struct contain a list of reference strings for dunamically
  * updatable patterns.
@@ -107,6 +113,10 @@ struct pat_ref {
 	char *display; /* String displayed to identify the pattern origin. */
 	struct list head; /* The head of the list of struct pat_ref_elt. */
 	struct list pat; /* The head of the list of struct pattern_expr. */
+	struct cmap *cmap; /* Compiled map file the first entries are looked up in, or NULL. */
+	struct pat_ref *next; /* Version being prepared, swapped in at commit, or NULL. */
+	unsigned int next_gen; /* Number of the last version prepared. */
+	unsigned int curr_gen; /* Number of the version in use, 0 for the initial one. */
 };
 
 /* This is a part of struct pat_ref. Each entry contain one
@@ -186,6 +196,17 @@ struct pattern_list {
  * patterns to test against. The structure is organized so that the hot parts
  * are grouped together in order to optimize caching.
  */
+/* The regex list of an expression compiled into a combined matcher. The
+ * patterns the matcher does not support are left to the regex library, and
+ * are tried in list order before those of the matcher found in the subject.
+ */
+struct pat_rx {
+	struct rxset *set;            /* combined matcher, NULL if the list must be walked */
+	struct pattern **pats;        /* all the patterns, by list order */
+	unsigned int *slow;           /* indexes of the patterns left to the regex library */
+	unsigned int nb_pats, nb_slow;
+};
+
 struct pattern_expr {
 	struct list list; /* Used for chaining pattern_expr in pat_ref. */
 	unsigned long long revision; /* updated for each update */
@@ -198,6 +219,10 @@ struct pattern_expr {
 	struct list patterns;         /* list of acl_patterns */
 	struct eb_root pattern_tree;  /* may be used for lookup in large datasets */
 	struct eb_root pattern_tree_2;  /* may be used for different types */
+	struct ac_tree *ac;             /* automaton for long string lists, built on demand */
+	struct pat_rx *rx;              /* combined matcher for long regex lists, built on demand */
+	struct ipt *ipt4;               /* IPv4 networks with PAT_MF_IP_TABLE, replaces pattern_tree */
+	struct ipt *ipt6;               /* IPv6 networks with PAT_MF_IP_TABLE, replaces pattern_tree_2 */
 	int mflags;                     /* flags relative to the parsing or matching method. */
 };
 
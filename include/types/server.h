@@ -161,6 +161,7 @@ enum srv_initaddr {
 /* 0x00F0 reserved for 'force' protocol version options */
 #define SRV_SSL_O_NO_TLS_TICKETS 0x0100 /* disable session resumption tickets */
 #define SRV_SSL_O_NO_REUSE     0x200  /* disable session reuse */
+#define SRV_SSL_O_KTLS         0x400  /* hand the TLS records over to the kernel (kTLS) */
 #endif
 
 struct pid_list {
@@ -206,6 +207,12 @@ struct server {
 	struct list priv_conns;			/* private idle connections attached to stream interfaces */
 	struct list idle_conns;			/* sharable idle connections attached or not to a stream interface */
 	struct list safe_conns;			/* safe idle connections attached to stream interfaces, shared */
+	struct list pool_conns;			/* idle connections not attached to any stream, most recent first */
+	unsigned int pool_cur;			/* number of connections in pool_conns */
+	unsigned int pool_unused;		/* min of pool_cur since the last purge, ie: never picked */
+	unsigned int pool_max_conn;		/* max number of connections in pool_conns (0 = no pool) */
+	unsigned int pool_purge_delay;		/* interval between two pool purges, in ms */
+	struct task *pool_task;			/* the task dedicated to purging the pool */
 	struct task *warmup;                    /* the task dedicated to the warmup when slowstart is set */
 
 	struct conn_src conn_src;               /* connection source settings */
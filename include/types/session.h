@@ -37,6 +37,9 @@
 #include <types/task.h>
 #include <types/vars.h>
 
+/* session flags */
+#define SESS_FL_RESUMED 0x00000001  /* the session was resumed from the idle state */
+
 struct session {
 	struct proxy *fe;               /* the proxy this session depends on for the client side */
 	struct listener *listener;      /* the listener by which the request arrived */
@@ -45,6 +48,7 @@ struct session {
 	struct timeval tv_accept;       /* date of the session's accept() in internal date (monotonic) */
 	struct stkctr stkctr[MAX_SESS_STKCTR];  /* stick counters for tcp-connection */
 	struct vars vars;               /* list of variables for the session scope. */
+	unsigned int flags;             /* SESS_FL_* */
 };
 
 #endif /* _TYPES_SESSION_H */
@@ -281,6 +281,20 @@ enum info_field {
 	INF_IDLE_PCT,
 	INF_NODE,
 	INF_DESCRIPTION,
+	INF_POLL_EVENTS_0,
+	INF_POLL_EVENTS_1,
+	INF_POLL_EVENTS_2,
+	INF_POLL_EVENTS_4,
+	INF_POLL_EVENTS_8,
+	INF_POLL_EVENTS_16,
+	INF_POLL_EVENTS_32,
+	INF_POLL_EVENTS_64,
+	INF_POLL_EVENTS_128,
+	INF_POLL_EVENTS_256,
+	INF_LOOP_TIME,
+	INF_ACCEPT_BATCH,
+	INF_ACCEPT_DEFERRALS,
+	INF_ACCEPT_BACKLOG,
 
 	/* must always be the last one */
 	INF_TOTAL_FIELDS
@@ -376,6 +390,13 @@ enum stat_field {
 	ST_F_INTERCEPTED,
 	ST_F_DCON,
 	ST_F_DSES,
+	ST_F_CACHE_HITS,
+	ST_F_CACHE_MISSES,
+	ST_F_CACHE_EVICTIONS,
+	ST_F_CONNECT,
+	ST_F_REUSE,
+	ST_F_SRV_ICUR,
+	ST_F_SRV_ILIM,
 
 	/* must always be the last one */
 	ST_F_TOTAL_FIELDS
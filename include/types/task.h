@@ -60,6 +60,7 @@ struct task {
 	void *context;			/* the task's context */
 	struct eb32_node wq;		/* ebtree node used to hold the task in the wait queue */
 	int expire;			/* next expiration date for this task, in ticks */
+	struct list tw;			/* list element used to hold the task in the timer wheel */
 };
 
 /*
@@ -19,6 +19,7 @@
 #include <common/standard.h>
 #include <common/uri_auth.h>
 
+#include <types/action.h>
 #include <types/global.h>
 
 #include <proto/acl.h>
@@ -764,6 +765,7 @@ struct acl *parse_acl(const char **args, struct list *known_acl, char **err, str
 		LIST_INIT(&cur_acl->expr);
 		LIST_ADDQ(known_acl, &cur_acl->list);
 		cur_acl->name = name;
+		cur_acl->cache_idx = -1;
 	}
 
 	/* We want to know what features the ACL needs (typically HTTP parsing),
@@ -863,6 +865,7 @@ static struct acl *find_acl_default(const char *acl_name, struct list *known_acl
 	}
 
 	cur_acl->name = name;
+	cur_acl->cache_idx = -1;
 	cur_acl->use |= acl_expr->smp->fetch->use;
 	cur_acl->val |= acl_expr->smp->fetch->val;
 	LIST_INIT(&cur_acl->expr);
@@ -1109,6 +1112,18 @@ struct acl_cond *build_acl_cond(const char *file, int line, struct proxy *px, co
  *         res = !res;
  */
 enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct session *sess, struct stream *strm, unsigned int opt)
+{
+	return acl_exec_cond_memo(cond, px, sess, strm, opt, NULL);
+}
+
+/* Same as acl_exec_cond(), except that when <memo> is not NULL, the results of
+ * the ACLs which were assigned a slot are looked up there first, and stored
+ * there once computed. Results depending on incomplete data (MISS) or on
+ * samples which do not survive a test (eg: counters, time, random) are never
+ * stored.
+ */
+enum acl_test_res acl_exec_cond_memo(struct acl_cond *cond, struct proxy *px, struct session *sess,
+                                     struct stream *strm, unsigned int opt, struct acl_memo *memo)
 {
 #ifndef __VMS
 	__label__ fetch_next;
@@ -1119,6 +1134,9 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 	struct acl *acl;
 	struct sample smp;
 	enum acl_test_res acl_res, suite_res, cond_res;
+	unsigned int smp_flags;
+	unsigned int word;
+	unsigned long bit;
 
 	/* ACLs are iterated over all values, so let's always set the flag to
 	 * indicate this to the fetch functions.
@@ -1142,35 +1160,38 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 		list_for_each_entry(term, &suite->terms, list) {
 			acl = term->acl;
 
-			/* FIXME: use cache !
-			 * check acl->cache_idx for this.
-			 */
+			word = bit = 0;
+			if (memo && acl->cache_idx >= 0) {
+				word = acl->cache_idx / (8 * sizeof(long));
+				bit  = 1UL << (acl->cache_idx % (8 * sizeof(long)));
+				if (memo->known[word] & bit) {
+					acl_res = (memo->pass[word] & bit) ? ACL_TEST_PASS : ACL_TEST_FAIL;
+					goto acl_done;
+				}
+			}
 
 			/* ACL result not cached. Let's scan all the expressions
 			 * and use the first one to match.
 			 */
 			acl_res = ACL_TEST_FAIL;
+			smp_flags = 0;
 			list_for_each_entry(expr, &acl->expr, list) {
 				/* we need to reset context and flags */
 				memset(&smp, 0, sizeof(smp));
 			fetch_next:
 				if (!sample_process(px, sess, strm, opt, expr->smp, &smp)) {
+					smp_flags |= smp.flags;
 					/* maybe we could not fetch because of missing data */
 					if (smp.flags & SMP_F_MAY_CHANGE && !(opt & SMP_OPT_FINAL))
 						acl_res |= ACL_TEST_MISS;
 					continue;
 				}
 
+				smp_flags |= smp.flags;
 				acl_res |= pat2acl(pattern_exec_match(&expr->pat, &smp, 0));
 				/*
 				 * OK now acl_res holds the result of this expression
 				 * as one of ACL_TEST_FAIL, ACL_TEST_MISS or ACL_TEST_PASS.
-				 *
-				 * Then if (!MISS) we can cache the result, and put
-				 * (smp.flags & SMP_F_VOLATILE) in the cache flags.
-				 *
-				 * FIXME: implement cache.
-				 *
 				 */
 
 				/* we're ORing these terms, so a single PASS is enough */
@@ -1187,6 +1208,17 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 				if (smp.flags & SMP_F_MAY_CHANGE && !(opt & SMP_OPT_FINAL))
 					acl_res |= ACL_TEST_MISS;
 			}
+
+			/* a definitive result may be reused by the next rules */
+			if (bit && acl_res != ACL_TEST_MISS && !(smp_flags & SMP_F_VOL_TEST)) {
+				memo->known[word] |= bit;
+				if (acl_res == ACL_TEST_PASS)
+					memo->pass[word] |= bit;
+				else
+					memo->pass[word] &= ~bit;
+				memo->nb++;
+			}
+		acl_done:
 			/*
 			 * Here we have the result of an ACL (cached or not).
 			 * ACLs are combined, negated or not, to form conditions.
@@ -1318,6 +1350,44 @@ int acl_find_targets(struct proxy *p)
 	return cfgerr;
 }
 
+/* Assigns memoization slots to the ACLs of proxy <px> which are referenced more
+ * than once by the conditions of the rules in <rules>, a list of act_rule, so
+ * that acl_exec_cond_memo() evaluates them at most once while running these
+ * rules. Other ACLs get no slot since they would not benefit from it. Returns
+ * the number of slots assigned.
+ */
+int acl_assign_memo_slots(struct proxy *px, struct list *rules)
+{
+	struct act_rule *rule;
+	struct acl_term_suite *suite;
+	struct acl_term *term;
+	struct acl *acl;
+	int slots = 0;
+
+	/* first count the references using the index itself. ACLs which are
+	 * not part of the proxy's list keep their negative index.
+	 */
+	list_for_each_entry(acl, &px->acl, list)
+		acl->cache_idx = 0;
+
+	list_for_each_entry(rule, rules, list) {
+		if (!rule->cond)
+			continue;
+		list_for_each_entry(suite, &rule->cond->suites, list)
+			list_for_each_entry(term, &suite->terms, list)
+				if (term->acl->cache_idx >= 0)
+					term->acl->cache_idx++;
+	}
+
+	list_for_each_entry(acl, &px->acl, list) {
+		if (acl->cache_idx > 1 && slots < ACL_MEMO_MAX)
+			acl->cache_idx = slots++;
+		else
+			acl->cache_idx = -1;
+	}
+	return slots;
+}
+
 /* initializes ACLs by resolving the sample fetch names they rely upon.
  * Returns 0 on success, otherwise an error.
  */
@@ -0,0 +1,434 @@
+/*
+ * Aho-Corasick automaton for matching many strings at once
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The strings are stored in a trie whose nodes are linked to the node
+ * representing their longest proper suffix (the "fail" link). Scanning a
+ * subject then costs one transition per byte whatever the number of strings,
+ * instead of one comparison per string and per position. Each node also knows
+ * the node of lowest id among itself and its fail chain, so that the first
+ * string in insertion order is reported without walking the chain.
+ *
+ * Strings may be added and removed at any time. This only updates the trie
+ * and marks it dirty, the fail links being recomputed in a single pass by
+ * ac_prepare() before the next lookup.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <common/acmatch.h>
+#include <common/compiler.h>
+
+/* value of ac_node->nb for nodes using a full transition table */
+#define AC_DENSE 0xff
+
+static unsigned char ac_fold[256];
+
+/* returns the child of node <n> reached with byte <c>, or 0 if none. This one
+ * works on the linked lists and is used while the trie is being modified.
+ */
+static unsigned int ac_child(const struct ac_tree *t, unsigned int n, unsigned char c)
+{
+	unsigned int x;
+
+	if (!n)
+		return t->root[c];
+
+	for (x = t->nodes[n].child; x; x = t->nodes[x].sibling)
+		if (t->nodes[x].c == c)
+			return x;
+	return 0;
+}
+
+/* same as above using the edge arrays, which requires a prepared tree */
+static inline unsigned int ac_next(const struct ac_tree *t, const struct ac_node *n, unsigned char c)
+{
+	const unsigned char *ec;
+	unsigned int i;
+
+	if (n->nb == AC_DENSE)
+		return t->edge_n[n->edges + c];
+
+	ec = t->edge_c + n->edges;
+	for (i = 0; i < n->nb && ec[i] <= c; i++)
+		if (ec[i] == c)
+			return t->edge_n[n->edges + i];
+	return 0;
+}
+
+/* returns the node reached from node <n> with byte <c>, following the fail
+ * links until either a transition exists or the root is reached.
+ */
+static inline unsigned int ac_step(const struct ac_tree *t, unsigned int n, unsigned char c)
+{
+	unsigned int x;
+
+	while (1) {
+		x = ac_next(t, &t->nodes[n], c);
+		if (x || !n)
+			return x;
+		n = t->nodes[n].fail;
+	}
+}
+
+/* ensures that <nodes> more nodes and one more entry may be allocated */
+static int ac_reserve(struct ac_tree *t, unsigned int nodes)
+{
+	unsigned int size;
+	void *new;
+
+	if (t->nb_nodes + nodes > t->sz_nodes) {
+		size = t->sz_nodes * 2;
+		if (size < t->nb_nodes + nodes)
+			size = t->nb_nodes + nodes;
+		new = realloc(t->nodes, size * sizeof(*t->nodes));
+		if (!new)
+			return -1;
+		t->nodes = new;
+		t->sz_nodes = size;
+	}
+
+	if (t->free_entry < 0 && t->nb_entries >= t->sz_entries) {
+		size = t->sz_entries ? t->sz_entries * 2 : 16;
+		new = realloc(t->entries, size * sizeof(*t->entries));
+		if (!new)
+			return -1;
+		t->entries = new;
+		t->sz_entries = size;
+	}
+	return 0;
+}
+
+struct ac_tree *ac_new(int icase)
+{
+	struct ac_tree *t;
+	int i;
+
+	if (!ac_fold['A'])
+		for (i = 0; i < 256; i++)
+			ac_fold[i] = tolower(i);
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	t->nodes = calloc(16, sizeof(*t->nodes));
+	if (!t->nodes) {
+		free(t);
+		return NULL;
+	}
+	t->sz_nodes = 16;
+	t->nb_nodes = 1;
+	t->nodes[0].head = -1;
+	t->nodes[0].out = -1;
+	t->free_entry = -1;
+	t->icase = icase;
+	return t;
+}
+
+void ac_free(struct ac_tree *t)
+{
+	if (!t)
+		return;
+	free(t->nodes);
+	free(t->entries);
+	free(t->edge_c);
+	free(t->edge_n);
+	free(t);
+}
+
+int ac_insert(struct ac_tree *t, const char *str, int len, void *ptr)
+{
+	unsigned int n, x;
+	unsigned char c;
+	int e, *prev;
+
+	if (ac_reserve(t, len) < 0)
+		return -1;
+
+	for (n = 0; len > 0; str++, len--, n = x) {
+		c = *str;
+		if (t->icase)
+			c = ac_fold[c];
+
+		x = ac_child(t, n, c);
+		if (x)
+			continue;
+
+		x = t->nb_nodes++;
+		memset(&t->nodes[x], 0, sizeof(t->nodes[x]));
+		t->nodes[x].c = c;
+		t->nodes[x].head = -1;
+		t->nodes[x].out = -1;
+		if (n) {
+			t->nodes[x].sibling = t->nodes[n].child;
+			t->nodes[n].child = x;
+		}
+		else
+			t->root[c] = x;
+	}
+
+	if (t->free_entry >= 0) {
+		e = t->free_entry;
+		t->free_entry = t->entries[e].next;
+	}
+	else
+		e = t->nb_entries++;
+
+	t->entries[e].ptr = ptr;
+	t->entries[e].id = t->next_id++;
+	t->entries[e].next = -1;
+
+	/* the new entry has the highest id so it goes last */
+	for (prev = &t->nodes[n].head; *prev >= 0; prev = &t->entries[*prev].next)
+		;
+	*prev = e;
+
+	t->live++;
+	t->dirty = 1;
+	return 0;
+}
+
+int ac_delete(struct ac_tree *t, const char *str, int len, void *ptr)
+{
+	unsigned int n;
+	unsigned char c;
+	int *prev, e;
+
+	for (n = 0; len > 0; str++, len--) {
+		c = *str;
+		if (t->icase)
+			c = ac_fold[c];
+		n = ac_child(t, n, c);
+		if (!n)
+			return 0;
+	}
+
+	for (prev = &t->nodes[n].head; *prev >= 0; prev = &t->entries[*prev].next) {
+		e = *prev;
+		if (t->entries[e].ptr != ptr)
+			continue;
+
+		*prev = t->entries[e].next;
+		t->entries[e].ptr = NULL;
+		t->entries[e].next = t->free_entry;
+		t->free_entry = e;
+		t->live--;
+		t->dead++;
+		t->dirty = 1;
+		return 1;
+	}
+	return 0;
+}
+
+/* returns the id of the first entry of node <n>, or UINT_MAX if <n> < 0 */
+static inline unsigned int ac_out_id(const struct ac_tree *t, int n)
+{
+	return n < 0 ? UINT_MAX : t->entries[t->nodes[n].head].id;
+}
+
+/* Lays the children of each node out in the edge arrays, sorted by byte for
+ * small nodes, or as a table of 256 transitions for the root and large nodes.
+ * Returns 0 on success or -1 on memory shortage.
+ */
+static int ac_build_edges(struct ac_tree *t)
+{
+	struct ac_node *nodes = t->nodes;
+	unsigned int n, x, cnt, total, i, j;
+	unsigned char c;
+	void *new;
+
+	total = 0;
+	for (n = 0; n < t->nb_nodes; n++) {
+		cnt = 0;
+		for (x = nodes[n].child; x; x = nodes[x].sibling)
+			cnt++;
+		nodes[n].edges = total;
+		nodes[n].nb = (!n || cnt > AC_MAX_EDGES) ? AC_DENSE : cnt;
+		total += nodes[n].nb == AC_DENSE ? 256 : cnt;
+	}
+
+	new = realloc(t->edge_c, total);
+	if (!new)
+		return -1;
+	t->edge_c = new;
+
+	new = realloc(t->edge_n, total * sizeof(*t->edge_n));
+	if (!new)
+		return -1;
+	t->edge_n = new;
+
+	memcpy(t->edge_n, t->root, sizeof(t->root));
+	for (n = 1; n < t->nb_nodes; n++) {
+		if (nodes[n].nb == AC_DENSE) {
+			memset(t->edge_n + nodes[n].edges, 0, 256 * sizeof(*t->edge_n));
+			for (x = nodes[n].child; x; x = nodes[x].sibling)
+				t->edge_n[nodes[n].edges + nodes[x].c] = x;
+			continue;
+		}
+
+		/* insertion sort, there are few children */
+		i = nodes[n].edges;
+		cnt = 0;
+		for (x = nodes[n].child; x; x = nodes[x].sibling, cnt++) {
+			c = nodes[x].c;
+			for (j = cnt; j > 0 && t->edge_c[i + j - 1] > c; j--) {
+				t->edge_c[i + j] = t->edge_c[i + j - 1];
+				t->edge_n[i + j] = t->edge_n[i + j - 1];
+			}
+			t->edge_c[i + j] = c;
+			t->edge_n[i + j] = x;
+		}
+	}
+	return 0;
+}
+
+int ac_prepare(struct ac_tree *t)
+{
+	struct ac_node *nodes = t->nodes;
+	unsigned int *queue;
+	unsigned int qh, qt;
+	unsigned int n, x, f;
+	int c;
+
+	if (!t->dirty)
+		return 0;
+
+	if (ac_build_edges(t) < 0)
+		return -1;
+
+	queue = malloc(t->nb_nodes * sizeof(*queue));
+	if (!queue)
+		return -1;
+
+	/* Breadth-first walk, so that the fail node, which is always shallower,
+	 * is complete before we use it.
+	 */
+	nodes[0].fail = 0;
+	nodes[0].out = nodes[0].head >= 0 ? 0 : -1;
+	t->min_id = ac_out_id(t, nodes[0].out);
+
+	qh = qt = 0;
+	for (c = 0; c < 256; c++) {
+		x = t->root[c];
+		if (x) {
+			nodes[x].fail = 0;
+			queue[qt++] = x;
+		}
+	}
+
+	while (qh < qt) {
+		n = queue[qh++];
+
+		nodes[n].out = nodes[n].head >= 0 ? (int)n : -1;
+		f = nodes[n].fail;
+		if (ac_out_id(t, nodes[f].out) < ac_out_id(t, nodes[n].out))
+			nodes[n].out = nodes[f].out;
+
+		if (nodes[n].head >= 0 && t->entries[nodes[n].head].id < t->min_id)
+			t->min_id = t->entries[nodes[n].head].id;
+
+		for (x = nodes[n].child; x; x = nodes[x].sibling) {
+			nodes[x].fail = ac_step(t, f, nodes[x].c);
+			queue[qt++] = x;
+		}
+	}
+
+	free(queue);
+	t->dirty = 0;
+	return 0;
+}
+
+void *ac_match_sub(const struct ac_tree *t, const char *str, int len)
+{
+	const struct ac_node *nodes = t->nodes;
+	const unsigned char *p = (const unsigned char *)str;
+	const unsigned char *e = p + len;
+	unsigned int n = 0, id, best_id;
+	int best;
+
+	if (!t->live)
+		return NULL;
+
+	best = nodes[0].out;
+	best_id = ac_out_id(t, best);
+
+	while (best_id != t->min_id && p < e) {
+		n = ac_step(t, n, t->icase ? ac_fold[*p] : *p);
+		p++;
+		if (likely(nodes[n].out < 0))
+			continue;
+
+		id = ac_out_id(t, nodes[n].out);
+		if (id < best_id) {
+			best_id = id;
+			best = nodes[n].out;
+		}
+	}
+
+	return best < 0 ? NULL : t->entries[nodes[best].head].ptr;
+}
+
+void *ac_match_beg(const struct ac_tree *t, const char *str, int len)
+{
+	const struct ac_node *nodes = t->nodes;
+	const unsigned char *p = (const unsigned char *)str;
+	const unsigned char *e = p + len;
+	unsigned int n = 0, id, best_id = UINT_MAX;
+	int best = -1;
+
+	if (!t->live)
+		return NULL;
+
+	while (1) {
+		if (nodes[n].head >= 0) {
+			id = t->entries[nodes[n].head].id;
+			if (id < best_id) {
+				best_id = id;
+				best = n;
+			}
+		}
+
+		if (p >= e)
+			break;
+		n = ac_next(t, &nodes[n], t->icase ? ac_fold[*p] : *p);
+		p++;
+		if (!n)
+			break;
+	}
+
+	return best < 0 ? NULL : t->entries[nodes[best].head].ptr;
+}
+
+void *ac_match_end(const struct ac_tree *t, const char *str, int len)
+{
+	const unsigned char *p = (const unsigned char *)str;
+	const unsigned char *e = p + len;
+	unsigned int n = 0;
+	int out;
+
+	if (!t->live)
+		return NULL;
+
+	while (p < e) {
+		n = ac_step(t, n, t->icase ? ac_fold[*p] : *p);
+		p++;
+	}
+
+	out = t->nodes[n].out;
+	return out < 0 ? NULL : t->entries[t->nodes[out].head].ptr;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
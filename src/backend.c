@@ -1064,9 +1064,18 @@ int connect_server(struct stream *s)
 		 *  ----+-----+-----+    ----+-----+-----+   ----+-----+-----+
 		 *  idle|  -  |  1  |    idle|  -  |  1  |   idle|  2  |  1  |
 		 *  ----+-----+-----+    ----+-----+-----+   ----+-----+-----+
+		 *
+		 * Connections from the server's pool are not attached to any
+		 * stream and have already served complete transactions, so
+		 * they are picked first, as safe ones.
 		 */
 
-		if (!LIST_ISEMPTY(&srv->idle_conns) &&
+		if (!LIST_ISEMPTY(&srv->pool_conns) &&
+		    ((s->txn && (s->txn->flags & TX_NOT_FIRST)) ||
+		     (s->be->options & PR_O_REUSE_MASK) >= PR_O_REUSE_AGGR)) {
+			srv_conn = srv_take_pooled_conn(srv);
+		}
+		else if (!LIST_ISEMPTY(&srv->idle_conns) &&
 		    ((s->be->options & PR_O_REUSE_MASK) != PR_O_REUSE_NEVR &&
 		     s->txn && (s->txn->flags & TX_NOT_FIRST))) {
 			srv_conn = LIST_ELEM(srv->idle_conns.n, struct connection *, list);
@@ -1102,8 +1111,10 @@ int connect_server(struct stream *s)
 			reuse = 1;
 		}
 
-		/* we may have to release our connection if we couldn't swap it */
-		if (old_conn && !old_conn->owner) {
+		/* we may have to release our connection if we couldn't swap it
+		 * nor leave it in its server's pool.
+		 */
+		if (old_conn && !old_conn->owner && !srv_pool_conn(old_conn)) {
 			LIST_DEL(&old_conn->list);
 			conn_force_close(old_conn);
 			conn_free(old_conn);
@@ -1197,6 +1208,15 @@ int connect_server(struct stream *s)
 	s->si[1].exp = tick_add_ifset(now_ms, s->be->timeout.connect);
 
 	if (srv) {
+		if (s->flags & SF_SRV_REUSED) {
+			srv->counters.reuse++;
+			s->be->be_counters.reuse++;
+		}
+		else {
+			srv->counters.connect++;
+			s->be->be_counters.connect++;
+		}
+
 		s->flags |= SF_CURR_SESS;
 		srv->cur_sess++;
 		if (srv->cur_sess > srv->counters.cur_sess_max)
@@ -12,15 +12,23 @@
 
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__linux__)
+#include <dirent.h>
+#endif
+
 #include <common/config.h>
 #include <common/buffer.h>
+#include <common/chunk.h>
 #include <common/memory.h>
+#include <common/standard.h>
 
 #include <types/global.h>
 
 struct pool_head *pool2_buffer;
+struct pool_head *pool2_large_buffer = NULL;
 
 /* These buffers are used to always have a valid pointer to an empty buffer in
  * channels. The first buffer is set once a buffer is empty. The second one is
@@ -59,9 +67,72 @@ int init_buffer()
 		return 0;
 
 	pool_free2(pool2_buffer, buffer);
+
+	/* Large buffers are only allocated on demand for messages whose headers
+	 * do not fit into a regular one, see b_upgrade().
+	 */
+	if (global.tune.bufsize_large) {
+		pool2_large_buffer = create_pool("buffer_big", sizeof (struct buffer) + global.tune.bufsize_large, MEM_F_SHARED|MEM_F_EXACT);
+		if (!pool2_large_buffer)
+			return 0;
+	}
 	return 1;
 }
 
+/* Returns the NUMA node of the first CPU in mask <cpus>, or -1 if it cannot
+ * be determined. The node is retrieved from the "nodeX" entry the kernel
+ * places into each CPU's sysfs directory.
+ */
+static int buffer_numa_node(unsigned long cpus)
+{
+#if defined(__linux__)
+	struct dirent *de;
+	DIR *dir;
+	int node = -1;
+
+	if (!cpus)
+		return -1;
+
+	snprintf(trash.str, trash.size, "/sys/devices/system/cpu/cpu%d", my_ffsl(cpus) - 1);
+	dir = opendir(trash.str);
+	if (!dir)
+		return -1;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (strncmp(de->d_name, "node", 4) == 0 && isdigit((unsigned char)de->d_name[4])) {
+			node = atoi(de->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+#else
+	return -1;
+#endif
+}
+
+/* Reserves the slab of "tune.buffers.prealloc" buffers for the current process
+ * if configured. It must be called once the process runs on its final CPUs so
+ * that the NUMA node derived from its cpu-map is the right one. Returns 0 if
+ * the slab could not be reserved, otherwise 1.
+ */
+int buffer_reserve_slab()
+{
+	unsigned int flags = 0;
+	int node = -1;
+
+	if (!global.tune.buf_prealloc)
+		return 1;
+
+	if (global.tune.options & GTUNE_BUF_HUGEPAGES)
+		flags |= POOL_SLAB_HUGEPAGES;
+
+	if ((global.tune.options & GTUNE_BUF_NUMA_BIND) && relative_pid <= LONGBITS)
+		node = buffer_numa_node(global.cpu_map[relative_pid - 1]);
+
+	return pool_reserve_slab(pool2_buffer, global.tune.buf_prealloc, flags, node);
+}
+
 /* This function writes the string <str> at position <pos> which must be in
  * buffer <b>, and moves <end> just after the end of <str>. <b>'s parameters
  * <l> and <r> are updated to be valid after the shift. The shift value
@@ -176,6 +247,57 @@ void buffer_slow_realign(struct buffer *buf)
 	buf->p = buf->data;
 }
 
+/* Replaces regular buffer *buf with a large one holding the same data. The
+ * input data are placed at the beginning of the new buffer and the output data
+ * at its end, just like buffer_slow_realign() does, so that all offsets
+ * relative to buf->p remain valid. Returns the new buffer, or NULL if large
+ * buffers are not enabled, if *buf is not a regular allocated buffer or if no
+ * memory is available. In this case *buf is left untouched.
+ */
+struct buffer *b_upgrade(struct buffer **buf)
+{
+	struct buffer *old = *buf;
+	struct buffer *b;
+	int block1, block2;
+
+	if (!pool2_large_buffer || !old->size ||
+	    old->size > pool2_buffer->size - sizeof(struct buffer))
+		return NULL;
+
+	b = pool_alloc_dirty(pool2_large_buffer);
+	if (!b)
+		return NULL;
+
+	b->size = pool2_large_buffer->size - sizeof(struct buffer);
+	b->i = old->i;
+	b->o = old->o;
+	b->p = b->data;
+
+	/* output data in two steps to cover wrapping */
+	block1 = old->o;
+	block2 = 0;
+	if (block1 > old->p - old->data) {
+		block2 = old->p - old->data;
+		block1 -= block2;
+	}
+	memcpy(b->data + b->size - old->o, bo_ptr(old), block1);
+	memcpy(b->data + b->size - block2, old->data, block2);
+
+	/* input data in two steps to cover wrapping */
+	block1 = old->i;
+	block2 = 0;
+	if (block1 > old->data + old->size - old->p) {
+		block1 = old->data + old->size - old->p;
+		block2 = old->i - block1;
+	}
+	memcpy(b->data, bi_ptr(old), block1);
+	memcpy(b->data + block1, old->data, block2);
+
+	pool_free2(pool2_buffer, old);
+	*buf = b;
+	return b;
+}
+
 
 /* Realigns a possibly non-contiguous buffer by bouncing bytes from source to
  * destination. It does not use any intermediate buffer and does the move in
@@ -200,6 +200,7 @@ static const struct cfg_opt cfg_opts2[] =
 	{ "http-use-proxy-header",        PR_O2_USE_PXHDR, PR_CAP_FE, 0, PR_MODE_HTTP },
 	{ "http-pretend-keepalive",       PR_O2_FAKE_KA,   PR_CAP_FE|PR_CAP_BE, 0, PR_MODE_HTTP },
 	{ "http-no-delay",                PR_O2_NODELAY,   PR_CAP_FE|PR_CAP_BE, 0, PR_MODE_HTTP },
+	{ "http-idle-release",            PR_O2_IDLE_REL,  PR_CAP_FE, 0, PR_MODE_HTTP },
 	{ NULL, 0, 0, 0 }
 };
 
@@ -653,6 +654,11 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		global.tune.options &= ~GTUNE_USE_KQUEUE;
 	}
+	else if (!strcmp(args[0], "nouring")) {
+		if (alertif_too_many_args(0, file, linenum, args, &err_code))
+			goto out;
+		global.tune.options &= ~GTUNE_USE_URING;
+	}
 	else if (!strcmp(args[0], "nopoll")) {
 		if (alertif_too_many_args(0, file, linenum, args, &err_code))
 			goto out;
@@ -826,6 +832,38 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 				global.tune.buf_limit = global.tune.reserved_bufs + 1;
 		}
 	}
+	else if (!strcmp(args[0], "tune.buffers.prealloc")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.buf_prealloc = atol(args[1]);
+		if (global.tune.buf_prealloc < 0) {
+			Alert("parsing [%s:%d] : '%s' expects a positive integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (!strcmp(args[0], "tune.buffers.hugepages") ||
+		 !strcmp(args[0], "tune.buffers.numa-bind")) {
+		int flag = strcmp(args[0], "tune.buffers.hugepages") ? GTUNE_BUF_NUMA_BIND : GTUNE_BUF_HUGEPAGES;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (strcmp(args[1], "on") == 0)
+			global.tune.options |= flag;
+		else if (strcmp(args[1], "off") == 0)
+			global.tune.options &= ~flag;
+		else {
+			Alert("parsing [%s:%d] : '%s' expects 'on' or 'off' but got '%s'.\n",
+			      file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (!strcmp(args[0], "tune.buffers.reserve")) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -857,6 +895,21 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		chunk_init(&trash, realloc(trash.str, global.tune.bufsize), global.tune.bufsize);
 		alloc_trash_buffers(global.tune.bufsize);
 	}
+	else if (!strcmp(args[0], "tune.bufsize.large")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			Alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.bufsize_large = atol(args[1]);
+		if (global.tune.bufsize_large < 0) {
+			Alert("parsing [%s:%d] : '%s' expects a positive integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (!strcmp(args[0], "tune.maxrewrite")) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -872,6 +925,62 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 	}
+	else if (!strcmp(args[0], "tune.adaptive-accept")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (strcmp(args[1], "on") == 0)
+			global.tune.options |= GTUNE_ADAPTIVE_ACCEPT;
+		else if (strcmp(args[1], "off") == 0)
+			global.tune.options &= ~GTUNE_ADAPTIVE_ACCEPT;
+		else {
+			Alert("parsing [%s:%d] : '%s' expects 'on' or 'off' but got '%s'.\n",
+			      file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (!strcmp(args[0], "tune.http.header-hash")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (strcmp(args[1], "on") == 0)
+			global.tune.options |= GTUNE_HTTP_HDR_HASH;
+		else if (strcmp(args[1], "off") == 0)
+			global.tune.options &= ~GTUNE_HTTP_HDR_HASH;
+		else {
+			Alert("parsing [%s:%d] : '%s' expects 'on' or 'off' but got '%s'.\n",
+			      file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (!strcmp(args[0], "tune.epoll.batch")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (strcmp(args[1], "on") == 0)
+			global.tune.options |= GTUNE_EPOLL_BATCH;
+		else if (strcmp(args[1], "off") == 0)
+			global.tune.options &= ~GTUNE_EPOLL_BATCH;
+		else {
+			Alert("parsing [%s:%d] : '%s' expects 'on' or 'off' but got '%s'.\n",
+			      file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (!strcmp(args[0], "tune.timer-wheel")) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (strcmp(args[1], "on") == 0)
+			global.tune.options |= GTUNE_TIMER_WHEEL;
+		else if (strcmp(args[1], "off") == 0)
+			global.tune.options &= ~GTUNE_TIMER_WHEEL;
+		else {
+			Alert("parsing [%s:%d] : '%s' expects 'on' or 'off' but got '%s'.\n",
+			      file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (!strcmp(args[0], "tune.idletimer")) {
 		unsigned int idle;
 		const char *res;
@@ -1993,6 +2102,8 @@ void init_default_instance()
 	defproxy.defsrv.minconn = 0;
 	defproxy.defsrv.maxconn = 0;
 	defproxy.defsrv.slowstart = 0;
+	defproxy.defsrv.pool_max_conn = 0;
+	defproxy.defsrv.pool_purge_delay = DEF_POOL_PURGE_DELAY;
 	defproxy.defsrv.onerror = DEF_HANA_ONERR;
 	defproxy.defsrv.consecutive_errors_limit = DEF_HANA_ERRLIMIT;
 	defproxy.defsrv.uweight = defproxy.defsrv.iweight = 1;
@@ -7656,6 +7767,28 @@ int check_config_validity()
 			}
 		}
 
+		/* split the listeners of sharded binds over their processes */
+		list_for_each_entry(bind_conf, &curproxy->conf.bind, by_fe) {
+			unsigned long mask;
+			char *err = NULL;
+
+			if (!bind_conf->shards)
+				continue;
+
+			mask = nbits(global.nbproc);
+			if (curproxy->bind_proc)
+				mask &= curproxy->bind_proc;
+			if (bind_conf->bind_proc)
+				mask &= bind_conf->bind_proc;
+
+			if (bind_conf_make_shards(bind_conf, mask, &err) & ERR_CODE) {
+				Alert("Proxy '%s': 'bind %s' at [%s:%d] : %s.\n",
+				      curproxy->id, bind_conf->arg, bind_conf->file, bind_conf->line, err);
+				cfgerr++;
+			}
+			free(err);
+		}
+
 		switch (curproxy->mode) {
 		case PR_MODE_HEALTH:
 			cfgerr += proxy_cfg_ensure_no_http(curproxy);
@@ -8392,6 +8525,9 @@ out_uri_auth_compat:
 		if (!cfgerr)
 			cfgerr += acl_find_targets(curproxy);
 
+		/* ACLs shared by several http-request rules are memoized */
+		acl_assign_memo_slots(curproxy, &curproxy->http_req_rules);
+
 		if ((curproxy->mode == PR_MODE_TCP || curproxy->mode == PR_MODE_HTTP) &&
 		    (((curproxy->cap & PR_CAP_FE) && !curproxy->timeout.client) ||
 		     ((curproxy->cap & PR_CAP_BE) && (curproxy->srv) &&
@@ -8563,6 +8699,21 @@ out_uri_auth_compat:
 				cfgerr += ssl_sock_prepare_srv_ctx(newsrv, curproxy);
 #endif /* USE_OPENSSL */
 
+			if (newsrv->pool_max_conn) {
+				if (curproxy->mode != PR_MODE_HTTP ||
+				    (curproxy->options & PR_O_REUSE_MASK) == PR_O_REUSE_NEVR) {
+					Warning("config : %s '%s', server '%s': 'pool-max-conn' will be ignored (requires 'mode http' and 'http-reuse').\n",
+						proxy_type_str(curproxy), curproxy->id, newsrv->id);
+					err_code |= ERR_WARN;
+					newsrv->pool_max_conn = 0;
+				}
+				else if (srv_init_pool(newsrv) < 0) {
+					Alert("config : %s '%s', server '%s': out of memory while allocating the connection pool task.\n",
+					      proxy_type_str(curproxy), curproxy->id, newsrv->id);
+					cfgerr++;
+				}
+			}
+
 			/* set the check type on the server */
 			newsrv->check.type = curproxy->options2 & PR_O2_CHK_ANY;
 
@@ -9084,7 +9235,7 @@ out_uri_auth_compat:
 			int nbproc;
 
 			nbproc = my_popcountl(curproxy->bind_proc &
-			                      (listener->bind_conf->bind_proc ? listener->bind_conf->bind_proc : curproxy->bind_proc) &
+			                      (listener_bind_proc(listener) ? listener_bind_proc(listener) : curproxy->bind_proc) &
 			                      nbits(global.nbproc));
 
 			if (!nbproc) /* no intersection between listener and frontend */
@@ -9418,6 +9569,12 @@ out_uri_auth_compat:
 				    global.tune.max_http_hdr * sizeof(struct hdr_idx_elem),
 				    MEM_F_SHARED);
 
+	if (global.tune.options & GTUNE_HTTP_HDR_HASH)
+		pool2_hdr_hash = create_pool("hdr_hash",
+					     sizeof(struct hdr_hash) +
+					     global.tune.max_http_hdr * sizeof(struct hdr_hash_elem),
+					     MEM_F_SHARED);
+
 	if (cfgerr > 0)
 		err_code |= ERR_ALERT | ERR_FATAL;
  out:
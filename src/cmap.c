@@ -0,0 +1,593 @@
+/*
+ * Compiled map files, looked up in place once mapped into memory
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Loading a text map allocates an element, a pattern and a sample for each
+ * line, which takes a long time and a lot of memory for maps of millions of
+ * lines, for each process. A compiled map holds the same entries along with
+ * ready-to-use indexes, in a single file which is mapped read-only : loading
+ * it costs nothing more than checking the header, and its pages are shared by
+ * all the processes and only read from disk when looked up.
+ *
+ * The indexes are a hash table of the keys for strings and for the CLI, a
+ * sorted array for integers, and the range tables of src/iptable.c for IPv4
+ * and IPv6 networks. Since the file cannot be changed, deleted entries are
+ * only marked in a bitmap. The format depends on the architecture.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <common/cmap.h>
+#include <common/compiler.h>
+
+/* names of the kinds of maps, by CMAP_* */
+const char *cmap_kinds[CMAP_KINDS] = {
+	[CMAP_STR] = "str",
+	[CMAP_INT] = "int",
+	[CMAP_IP]  = "ip",
+};
+
+/* rounds <x> up to a multiple of 8 */
+#define CMAP_ALIGN(x) (((x) + 7) & ~(uint64_t)7)
+
+/* FNV-1a hash of <len> bytes at <s> */
+static inline uint32_t cmap_hash(const char *s, int len)
+{
+	uint32_t h = 2166136261U;
+
+	while (len--) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+struct cmap_builder *cmapb_new(unsigned int kind)
+{
+	struct cmap_builder *b;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return NULL;
+	b->kind = kind;
+	return b;
+}
+
+void cmapb_free(struct cmap_builder *b)
+{
+	if (!b)
+		return;
+	free(b->entries);
+	free(b->strings);
+	free(b->ints);
+	ipt_free(b->ipt4);
+	ipt_free(b->ipt6);
+	free(b);
+}
+
+/* appends <str> and its trailing zero to the strings, and returns its offset
+ * or -1.
+ */
+static int64_t cmapb_string(struct cmap_builder *b, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint64_t size;
+	int64_t ofs;
+	char *new;
+
+	if (b->strings_size + len > 0xffffffffULL)
+		return -1;
+
+	if (b->strings_size + len > b->sz_strings) {
+		size = b->sz_strings ? b->sz_strings * 2 : 4096;
+		while (size < b->strings_size + len)
+			size *= 2;
+		new = realloc(b->strings, size);
+		if (!new)
+			return -1;
+		b->strings = new;
+		b->sz_strings = size;
+	}
+	ofs = b->strings_size;
+	memcpy(b->strings + ofs, str, len);
+	b->strings_size += len;
+	return ofs;
+}
+
+int cmapb_add(struct cmap_builder *b, const char *key, const char *value)
+{
+	struct cmap_entry *new;
+	int64_t k, v;
+	unsigned int size;
+
+	if (b->nb_entries >= 0x7fffffff)
+		return -1;
+
+	if (b->nb_entries >= b->sz_entries) {
+		size = b->sz_entries ? b->sz_entries * 2 : 1024;
+		new = realloc(b->entries, size * sizeof(*new));
+		if (!new)
+			return -1;
+		b->entries = new;
+		b->sz_entries = size;
+	}
+
+	k = cmapb_string(b, key);
+	v = k < 0 ? -1 : cmapb_string(b, value);
+	if (v < 0)
+		return -1;
+	b->entries[b->nb_entries].key = k;
+	b->entries[b->nb_entries].value = v;
+	b->entries[b->nb_entries].key_len = strlen(key);
+	b->entries[b->nb_entries].pad = 0;
+	return b->nb_entries++;
+}
+
+int cmapb_add_int(struct cmap_builder *b, unsigned int entry, long long value)
+{
+	struct cmap_int *new;
+	unsigned int size;
+
+	if (b->nb_ints >= b->sz_ints) {
+		size = b->sz_ints ? b->sz_ints * 2 : 1024;
+		new = realloc(b->ints, size * sizeof(*new));
+		if (!new)
+			return -1;
+		b->ints = new;
+		b->sz_ints = size;
+	}
+	b->ints[b->nb_ints].value = value;
+	b->ints[b->nb_ints].entry = entry;
+	b->ints[b->nb_ints].pad = 0;
+	b->nb_ints++;
+	return 0;
+}
+
+int cmapb_add_net(struct cmap_builder *b, unsigned int entry, const void *addr, unsigned int klen, unsigned int len)
+{
+	struct ipt **t = (klen == 4) ? &b->ipt4 : &b->ipt6;
+
+	if (!*t && !(*t = ipt_new(klen)))
+		return -1;
+	return ipt_insert(*t, addr, len, (void *)(unsigned long)entry, NULL);
+}
+
+/* orders integers by value then by entry */
+static int cmap_cmp_int(const void *a, const void *b)
+{
+	const struct cmap_int *ia = a, *ib = b;
+
+	if (ia->value != ib->value)
+		return ia->value < ib->value ? -1 : 1;
+	return ia->entry < ib->entry ? -1 : ia->entry > ib->entry;
+}
+
+/* Lays out the range table of <t> from offset <ofs> into <ipx>, and returns
+ * the offset following it.
+ */
+static uint64_t cmapb_layout_ip(const struct ipt *t, struct cmap_ipx *ipx, uint64_t ofs)
+{
+	unsigned int lvl;
+
+	memset(ipx, 0, sizeof(*ipx));
+	if (!t || !t->ix.nb_lvl)
+		return ofs;
+
+	ipx->nb_nets = t->nb_entries;
+	ipx->nb_lvl = t->ix.nb_lvl;
+	for (lvl = 0; lvl < t->ix.nb_lvl; lvl++) {
+		ipx->lvl_off[lvl] = t->ix.lvl_off[lvl];
+		ipx->lvl_nb[lvl] = t->ix.lvl_nb[lvl];
+	}
+	ipx->nb_keys = ipx->lvl_off[ipx->nb_lvl - 1] + ipx->lvl_nb[ipx->nb_lvl - 1];
+
+	ipx->nets = ofs;
+	ofs = CMAP_ALIGN(ofs + (uint64_t)ipx->nb_nets * sizeof(struct cmap_net));
+	ipx->keys = ofs;
+	ofs = CMAP_ALIGN(ofs + (uint64_t)ipx->nb_keys * t->klen);
+	ipx->bval = ofs;
+	ofs = CMAP_ALIGN(ofs + (uint64_t)ipx->lvl_nb[0] * sizeof(uint32_t));
+	return ofs;
+}
+
+/* Copies the range table of <t> laid out into <ipx> into file image <area>. */
+static void cmapb_copy_ip(const struct ipt *t, const struct cmap_ipx *ipx, char *area)
+{
+	struct cmap_net *nets;
+	unsigned int i;
+
+	if (!ipx->nb_lvl)
+		return;
+
+	nets = (struct cmap_net *)(area + ipx->nets);
+	for (i = 0; i < ipx->nb_nets; i++) {
+		nets[i].entry = (unsigned long)t->entries[i].data;
+		nets[i].parent = t->entries[i].parent;
+		nets[i].len = t->entries[i].len;
+	}
+	if (t->klen == 4)
+		memcpy(area + ipx->keys, t->ix.k4, (size_t)ipx->nb_keys * 4);
+	else
+		memcpy(area + ipx->keys, t->ix.k6, (size_t)ipx->nb_keys * 16);
+	memcpy(area + ipx->bval, t->ix.bval, (size_t)ipx->lvl_nb[0] * sizeof(uint32_t));
+}
+
+int cmapb_write(struct cmap_builder *b, const char *path)
+{
+	struct cmap_hdr h, *hdr;
+	uint32_t *slots;
+	char *area, *tmp;
+	uint64_t ofs;
+	unsigned int i, s, mask;
+	size_t done;
+	ssize_t ret;
+	int fd, err;
+
+	if ((b->ipt4 && ipt_build(b->ipt4) < 0) || (b->ipt6 && ipt_build(b->ipt6) < 0)) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (b->nb_ints)
+		qsort(b->ints, b->nb_ints, sizeof(*b->ints), cmap_cmp_int);
+
+	/* the hash table is at most half full */
+	for (s = 16; s < 2 * b->nb_entries; s *= 2)
+		;
+
+	/* lay out the sections */
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CMAP_MAGIC, sizeof(h.magic));
+	h.endian = CMAP_ENDIAN;
+	h.kind = b->kind;
+	h.nb_entries = b->nb_entries;
+	h.nb_slots = s;
+	h.nb_ints = b->nb_ints;
+	ofs = CMAP_ALIGN(sizeof(h));
+	h.entries = ofs;
+	ofs = CMAP_ALIGN(ofs + (uint64_t)b->nb_entries * sizeof(struct cmap_entry));
+	h.slots = ofs;
+	ofs = CMAP_ALIGN(ofs + (uint64_t)s * sizeof(uint32_t));
+	h.ints = ofs;
+	ofs = CMAP_ALIGN(ofs + (uint64_t)b->nb_ints * sizeof(struct cmap_int));
+	ofs = cmapb_layout_ip(b->ipt4, &h.ip4, ofs);
+	ofs = cmapb_layout_ip(b->ipt6, &h.ip6, ofs);
+	h.strings = ofs;
+	h.strings_size = b->strings_size;
+	ofs = CMAP_ALIGN(ofs + b->strings_size);
+	h.size = ofs;
+
+	/* and fill them */
+	area = ((size_t)ofs == ofs) ? calloc(1, ofs) : NULL;
+	if (!area) {
+		errno = ENOMEM;
+		return -1;
+	}
+	hdr = (struct cmap_hdr *)area;
+	*hdr = h;
+	if (b->nb_entries)
+		memcpy(area + hdr->entries, b->entries, (size_t)b->nb_entries * sizeof(struct cmap_entry));
+
+	/* entries are inserted in order so that the first one of a key is
+	 * the first one met when probing.
+	 */
+	slots = (uint32_t *)(area + hdr->slots);
+	mask = s - 1;
+	for (i = 0; i < b->nb_entries; i++) {
+		const char *key = b->strings + b->entries[i].key;
+
+		for (s = cmap_hash(key, b->entries[i].key_len) & mask; slots[s]; s = (s + 1) & mask)
+			;
+		slots[s] = i + 1;
+	}
+
+	if (b->nb_ints)
+		memcpy(area + hdr->ints, b->ints, (size_t)b->nb_ints * sizeof(struct cmap_int));
+	cmapb_copy_ip(b->ipt4, &hdr->ip4, area);
+	cmapb_copy_ip(b->ipt6, &hdr->ip6, area);
+	if (b->strings_size)
+		memcpy(area + hdr->strings, b->strings, b->strings_size);
+
+	/* the file may be mapped by running processes, it must not change */
+	tmp = malloc(strlen(path) + 8);
+	if (!tmp) {
+		free(area);
+		errno = ENOMEM;
+		return -1;
+	}
+	sprintf(tmp, "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto fail;
+
+	for (done = 0; done < ofs; done += ret) {
+		ret = write(fd, area + done, ofs - done);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				ret = 0;
+				continue;
+			}
+			goto fail_close;
+		}
+	}
+
+	if (fchmod(fd, 0644) < 0)
+		goto fail_close;
+	if (close(fd) < 0 || rename(tmp, path) < 0)
+		goto fail_unlink;
+
+	free(tmp);
+	free(area);
+	return 0;
+
+ fail_close:
+	err = errno;
+	close(fd);
+	errno = err;
+ fail_unlink:
+	err = errno;
+	unlink(tmp);
+	errno = err;
+ fail:
+	err = errno;
+	free(tmp);
+	free(area);
+	errno = err;
+	return -1;
+}
+
+/* returns non-zero if <count> objects of <size> bytes at <ofs> are within the
+ * file of <m> and aligned.
+ */
+static int cmap_in(const struct cmap *m, uint64_t ofs, uint64_t count, uint64_t size)
+{
+	return !(ofs & 7) && ofs <= m->size && count <= (m->size - ofs) / size;
+}
+
+/* sets up the index of <ipx> into <ix> and <nets>, returns 0 if it is valid */
+static int cmap_open_ip(struct cmap *m, const struct cmap_ipx *ipx, unsigned int klen,
+                        struct ipt_index *ix, const struct cmap_net **nets)
+{
+	unsigned int lvl;
+
+	memset(ix, 0, sizeof(*ix));
+	ix->klen = klen;
+	*nets = NULL;
+	if (!ipx->nb_lvl)
+		return 0;
+
+	if (ipx->nb_lvl > IPT_MAX_LEVELS ||
+	    !cmap_in(m, ipx->nets, ipx->nb_nets, sizeof(struct cmap_net)) ||
+	    !cmap_in(m, ipx->keys, ipx->nb_keys, klen) ||
+	    !cmap_in(m, ipx->bval, ipx->lvl_nb[0], sizeof(uint32_t)))
+		return -1;
+
+	for (lvl = 0; lvl < ipx->nb_lvl; lvl++) {
+		if (ipx->lvl_off[lvl] > ipx->nb_keys || ipx->lvl_nb[lvl] > ipx->nb_keys - ipx->lvl_off[lvl])
+			return -1;
+		ix->lvl_off[lvl] = ipx->lvl_off[lvl];
+		ix->lvl_nb[lvl] = ipx->lvl_nb[lvl];
+	}
+	ix->nb_lvl = ipx->nb_lvl;
+	if (klen == 4)
+		ix->k4 = (const uint32_t *)((char *)m->area + ipx->keys);
+	else
+		ix->k6 = (const struct ipt_key6 *)((char *)m->area + ipx->keys);
+	ix->bval = (const unsigned int *)((char *)m->area + ipx->bval);
+	*nets = (const struct cmap_net *)((char *)m->area + ipx->nets);
+	return 0;
+}
+
+struct cmap *cmap_open(const char *path, const char **msg)
+{
+	const struct cmap_hdr *hdr;
+	struct cmap *m = NULL;
+	struct stat st;
+	char magic[8];
+	void *area;
+	unsigned int i;
+	int fd;
+
+	*msg = NULL;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (read(fd, magic, sizeof(magic)) != sizeof(magic) ||
+	    memcmp(magic, CMAP_MAGIC_PREFIX, strlen(CMAP_MAGIC_PREFIX)) != 0)
+		goto out;
+
+	*msg = "compiled map was made by another version, it must be compiled again";
+	if (memcmp(magic, CMAP_MAGIC, sizeof(magic)) != 0)
+		goto out;
+
+	*msg = "cannot read compiled map";
+	if (fstat(fd, &st) < 0)
+		goto out;
+
+	*msg = "truncated compiled map";
+	if (st.st_size < (off_t)sizeof(*hdr))
+		goto out;
+
+	area = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED)
+		goto out;
+
+	m = calloc(1, sizeof(*m));
+	if (!m) {
+		*msg = "out of memory";
+		munmap(area, st.st_size);
+		goto out;
+	}
+	m->area = area;
+	m->size = st.st_size;
+
+	hdr = area;
+	*msg = "compiled map was made on another architecture";
+	if (hdr->endian != CMAP_ENDIAN)
+		goto fail;
+
+	*msg = "truncated compiled map";
+	if (hdr->size != m->size)
+		goto fail;
+
+	*msg = "corrupted compiled map";
+	if (hdr->kind >= CMAP_KINDS ||
+	    !hdr->nb_slots || (hdr->nb_slots & (hdr->nb_slots - 1)) ||
+	    hdr->nb_slots <= hdr->nb_entries ||
+	    !cmap_in(m, hdr->entries, hdr->nb_entries, sizeof(struct cmap_entry)) ||
+	    !cmap_in(m, hdr->slots, hdr->nb_slots, sizeof(uint32_t)) ||
+	    !cmap_in(m, hdr->ints, hdr->nb_ints, sizeof(struct cmap_int)) ||
+	    !cmap_in(m, hdr->strings, hdr->strings_size, 1) ||
+	    (hdr->strings_size ? ((char *)area)[hdr->strings + hdr->strings_size - 1] != 0 : hdr->nb_entries != 0))
+		goto fail;
+
+	m->kind = hdr->kind;
+	m->nb_entries = hdr->nb_entries;
+	m->nb_slots = hdr->nb_slots;
+	m->nb_ints = hdr->nb_ints;
+	m->entries = (const struct cmap_entry *)((char *)area + hdr->entries);
+	m->slots = (const uint32_t *)((char *)area + hdr->slots);
+	m->strings = (char *)area + hdr->strings;
+	m->ints = (const struct cmap_int *)((char *)area + hdr->ints);
+
+	/* keys are compared over their length, it must stay in the strings */
+	for (i = 0; i < m->nb_entries; i++) {
+		if ((uint64_t)m->entries[i].key + m->entries[i].key_len >= hdr->strings_size ||
+		    m->entries[i].value >= hdr->strings_size)
+			goto fail;
+	}
+
+	if (cmap_open_ip(m, &hdr->ip4, 4, &m->ix4, &m->nets4) < 0 ||
+	    cmap_open_ip(m, &hdr->ip6, 16, &m->ix6, &m->nets6) < 0)
+		goto fail;
+
+	/* the indexes are looked up at random, so read everything at once */
+	madvise(area, m->size, MADV_WILLNEED);
+	*msg = NULL;
+	close(fd);
+	return m;
+
+ fail:
+	cmap_close(m);
+	m = NULL;
+ out:
+	close(fd);
+	return m;
+}
+
+void cmap_close(struct cmap *m)
+{
+	if (!m)
+		return;
+	munmap(m->area, m->size);
+	free(m->dead);
+	free(m);
+}
+
+int cmap_find(const struct cmap *m, const char *key, int prev)
+{
+	unsigned int mask = m->nb_slots - 1;
+	unsigned int len = strlen(key);
+	unsigned int s, e;
+
+	for (s = cmap_hash(key, len) & mask; (e = m->slots[s]); s = (s + 1) & mask) {
+		e--;
+		if ((int)e > prev && !cmap_is_dead(m, e) && m->entries[e].key_len == len &&
+		    memcmp(cmap_key(m, e), key, len) == 0)
+			return e;
+	}
+	return -1;
+}
+
+int cmap_lookup_str(const struct cmap *m, const char *str, int len)
+{
+	unsigned int mask = m->nb_slots - 1;
+	unsigned int s, e;
+
+	/* <str> may contain zeroes and is not zero-terminated */
+	for (s = cmap_hash(str, len) & mask; (e = m->slots[s]); s = (s + 1) & mask) {
+		e--;
+		if (m->entries[e].key_len == len && memcmp(cmap_key(m, e), str, len) == 0 &&
+		    !cmap_is_dead(m, e))
+			return e;
+	}
+	return -1;
+}
+
+int cmap_lookup_int(const struct cmap *m, long long value)
+{
+	unsigned int lo = 0, hi = m->nb_ints, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (m->ints[mid].value < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < m->nb_ints && m->ints[lo].value == value; lo++)
+		if (!cmap_is_dead(m, m->ints[lo].entry))
+			return m->ints[lo].entry;
+	return -1;
+}
+
+int cmap_lookup_ip(const struct cmap *m, const void *addr, unsigned int klen, unsigned int *len)
+{
+	const struct ipt_index *ix = (klen == 4) ? &m->ix4 : &m->ix6;
+	const struct cmap_net *nets = (klen == 4) ? m->nets4 : m->nets6;
+	unsigned int idx;
+
+	idx = ipt_index_lookup(ix, addr);
+
+	/* deleted networks defer to the ones covering them */
+	while (idx != IPT_NONE && unlikely(cmap_is_dead(m, nets[idx].entry)))
+		idx = nets[idx].parent;
+
+	if (idx == IPT_NONE)
+		return -1;
+	*len = nets[idx].len;
+	return nets[idx].entry;
+}
+
+int cmap_entry_at(const struct cmap *m, const void *ptr)
+{
+	const struct cmap_entry *e = ptr;
+
+	if (e < m->entries || e >= m->entries + m->nb_entries ||
+	    ((const char *)e - (const char *)m->entries) % sizeof(*e))
+		return -1;
+	return e - m->entries;
+}
+
+int cmap_delete(struct cmap *m, unsigned int entry)
+{
+	if (!m->dead) {
+		m->dead = calloc(1, (m->nb_entries + 7) / 8);
+		if (!m->dead)
+			return -1;
+	}
+	if (!cmap_is_dead(m, entry)) {
+		m->dead[entry >> 3] |= 1 << (entry & 7);
+		m->nb_dead++;
+	}
+	return 0;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -24,11 +24,13 @@
 
 #include <types/global.h>
 
+#include <proto/connection.h>
 #include <proto/fd.h>
 
 
 /* private data */
 static struct epoll_event *epoll_events;
+static struct epoll_event *epoll_batch; /* temporary events in batch mode */
 static int epoll_fd;
 
 /* This structure may be used for any purpose. Warning! do not use it in
@@ -54,6 +56,36 @@ REGPRM1 static void __fd_clo(int fd)
 	}
 }
 
+/*
+ * Reorders the <status> events returned by epoll_wait() for batch processing.
+ * A first pass starts to load all the fdtab entries which are going to be
+ * updated, and a second one starts to load the connections owning them while
+ * moving the events of connections in front of the other ones (listeners,
+ * pipes, etc), preserving their respective order. This way the handlers are
+ * called in an order which limits cache misses, and the existing connections
+ * are processed and may release their resources before new ones are accepted.
+ */
+static void _do_sort_events(int status)
+{
+	int count, conn, other;
+	int fd;
+
+	for (count = 0; count < status; count++)
+		prefetch_w(&fdtab[epoll_events[count].data.fd]);
+
+	conn = other = 0;
+	for (count = 0; count < status; count++) {
+		fd = epoll_events[count].data.fd;
+		if (fdtab[fd].iocb == conn_fd_handler) {
+			prefetch_w(fdtab[fd].owner);
+			epoll_events[conn++] = epoll_events[count];
+		}
+		else
+			epoll_batch[other++] = epoll_events[count];
+	}
+	memcpy(epoll_events + conn, epoll_batch, other * sizeof(*epoll_batch));
+}
+
 /*
  * Linux epoll() poller
  */
@@ -125,6 +157,10 @@ REGPRM2 static void _do_poll(struct poller *p, int exp)
 	status = epoll_wait(epoll_fd, epoll_events, global.tune.maxpollevents, wait_time);
 	tv_update_date(wait_time, status);
 	measure_idle();
+	fd_count_poll_events(status);
+
+	if ((global.tune.options & GTUNE_EPOLL_BATCH) && status > 1)
+		_do_sort_events(status);
 
 	/* process polled events */
 
@@ -188,8 +224,17 @@ REGPRM1 static int _do_init(struct poller *p)
 	if (epoll_events == NULL)
 		goto fail_ee;
 
+	epoll_batch = (struct epoll_event*)
+		calloc(1, sizeof(struct epoll_event) * global.tune.maxpollevents);
+
+	if (epoll_batch == NULL)
+		goto fail_eb;
+
 	return 1;
 
+ fail_eb:
+	free(epoll_events);
+	epoll_events = NULL;
  fail_ee:
 	close(epoll_fd);
 	epoll_fd = -1;
@@ -205,6 +250,7 @@ REGPRM1 static int _do_init(struct poller *p)
 REGPRM1 static void _do_term(struct poller *p)
 {
 	free(epoll_events);
+	free(epoll_batch);
 
 	if (epoll_fd >= 0) {
 		close(epoll_fd);
@@ -212,6 +258,7 @@ REGPRM1 static void _do_term(struct poller *p)
 	}
 
 	epoll_events = NULL;
+	epoll_batch = NULL;
 	p->private = NULL;
 	p->pref = 0;
 }
@@ -115,6 +115,7 @@ REGPRM2 static void _do_poll(struct poller *p, int exp)
 			&timeout); // const struct timespec *timeout
 	tv_update_date(delta_ms, status);
 	measure_idle();
+	fd_count_poll_events(status);
 
 	for (count = 0; count < status; count++) {
 		fd = kev[count].ident;
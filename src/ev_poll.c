@@ -123,6 +123,7 @@ REGPRM2 static void _do_poll(struct poller *p, int exp)
 	status = poll(poll_events, nbfd, wait_time);
 	tv_update_date(wait_time, status);
 	measure_idle();
+	fd_count_poll_events(status);
 
 	for (count = 0; status > 0 && count < nbfd; count++) {
 		int e = poll_events[count].revents;
@@ -120,6 +120,7 @@ REGPRM2 static void _do_poll(struct poller *p, int exp)
 
 	tv_update_date(delta_ms, status);
 	measure_idle();
+	fd_count_poll_events(status);
 
 	if (status <= 0)
 		return;
@@ -0,0 +1,583 @@
+/*
+ * FD polling functions for Linux io_uring
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * This poller registers one-shot poll requests through an io_uring. All the
+ * polling changes of a loop are queued into the submission ring and are passed
+ * to the kernel at once by the same io_uring_enter() call which waits for the
+ * completions, which saves one epoll_ctl() syscall per change compared to the
+ * epoll poller. Since poll requests are one-shot, an FD which was reported is
+ * armed again on the next call if it is still polled, which emulates the level
+ * triggered behaviour the rest of the code expects. It requires Linux 5.11 or
+ * above (IORING_FEAT_EXT_ARG and IORING_FEAT_NODROP), otherwise the poller is
+ * disabled and the next one is used.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <linux/io_uring.h>
+
+#include <common/compat.h>
+#include <common/config.h>
+#include <common/debug.h>
+#include <common/standard.h>
+#include <common/ticks.h>
+#include <common/time.h>
+#include <common/tools.h>
+
+#include <types/global.h>
+
+#include <proto/fd.h>
+
+#ifndef POLLRDHUP
+/* POLLRDHUP was defined late in libc, and it appeared in kernel 2.6.17 */
+#define POLLRDHUP 0x2000
+#endif
+
+/* user_data of requests whose completion must be ignored (poll removals) */
+#define URING_UDATA_IGNORE  (~0ULL)
+
+/* the user_data of a poll request is made of the FD and of its generation */
+#define URING_UDATA(fd, gen) (((unsigned long long)(gen) << 32) | (unsigned int)(fd))
+
+/* the submission ring is sized after maxpollevents within these limits */
+#define URING_MIN_SQ_ENTRIES  64
+#define URING_MAX_SQ_ENTRIES  4096
+#define URING_MAX_CQ_ENTRIES  65536
+
+/* the memory shared with the kernel and our local view of it */
+struct uring {
+	int fd;                       /* io_uring file descriptor, or -1 */
+	void *sq_ring, *cq_ring;      /* mapped rings, may be the same area */
+	size_t sq_ring_sz, cq_ring_sz;
+	struct io_uring_sqe *sqes;    /* submission queue entries */
+	size_t sqes_sz;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned int sq_entries;
+	unsigned int sq_local_tail;   /* tail of entries prepared but not yet published */
+	unsigned int to_submit;       /* number of entries not yet submitted */
+};
+
+/* per-FD polling status */
+struct uring_fd {
+	unsigned int gen;             /* generation of the current poll request */
+	unsigned char armed;          /* FD_EV_POLLED_* currently registered */
+	unsigned char rearm;          /* 1 if the FD is in the rearm list */
+};
+
+/* private data */
+static struct uring uring = { .fd = -1 };
+static struct uring_fd *uring_fds;
+static int *uring_rearm;          /* FDs whose poll request fired */
+static int uring_nbrearm;
+
+static inline int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                                     unsigned int flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/* Unmaps the rings and closes the io_uring of <r>. */
+static void uring_release(struct uring *r)
+{
+	if (r->sqes && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqes_sz);
+	if (r->cq_ring && r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_sz);
+	if (r->sq_ring && r->sq_ring != MAP_FAILED)
+		munmap(r->sq_ring, r->sq_ring_sz);
+	if (r->fd >= 0)
+		close(r->fd);
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+}
+
+/* Creates an io_uring with <entries> submission entries and room for at least
+ * <cq_entries> completions, and maps its rings into <r>. The features this
+ * poller relies on are checked. Returns 1 if OK, otherwise 0 with <r> left
+ * released.
+ */
+static int uring_setup(struct uring *r, unsigned int entries, unsigned int cq_entries)
+{
+	struct io_uring_params params;
+
+	memset(r, 0, sizeof(*r));
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = cq_entries;
+
+	r->fd = sys_io_uring_setup(entries, &params);
+	if (r->fd < 0) {
+		r->fd = -1;
+		return 0;
+	}
+
+	if ((params.features & (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)) !=
+	    (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG))
+		goto fail;
+
+	r->sq_ring_sz = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	r->cq_ring_sz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		r->sq_ring_sz = r->cq_ring_sz = MAX(r->sq_ring_sz, r->cq_ring_sz);
+
+	r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED)
+		goto fail;
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ring = r->sq_ring;
+	else {
+		r->cq_ring = mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE,
+		                  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED)
+			goto fail;
+	}
+
+	r->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto fail;
+
+	r->sq_head  = (unsigned int *)((char *)r->sq_ring + params.sq_off.head);
+	r->sq_tail  = (unsigned int *)((char *)r->sq_ring + params.sq_off.tail);
+	r->sq_mask  = (unsigned int *)((char *)r->sq_ring + params.sq_off.ring_mask);
+	r->sq_array = (unsigned int *)((char *)r->sq_ring + params.sq_off.array);
+	r->cq_head  = (unsigned int *)((char *)r->cq_ring + params.cq_off.head);
+	r->cq_tail  = (unsigned int *)((char *)r->cq_ring + params.cq_off.tail);
+	r->cq_mask  = (unsigned int *)((char *)r->cq_ring + params.cq_off.ring_mask);
+	r->cqes     = (struct io_uring_cqe *)((char *)r->cq_ring + params.cq_off.cqes);
+	r->sq_entries = params.sq_entries;
+	r->sq_local_tail = *r->sq_tail;
+	return 1;
+
+ fail:
+	uring_release(r);
+	return 0;
+}
+
+/* Submits the pending entries without waiting for any completion. Returns the
+ * number of entries the kernel consumed, or a negative value on error.
+ */
+static int uring_submit(struct uring *r)
+{
+	int ret;
+
+	__atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+	if (!r->to_submit)
+		return 0;
+	ret = sys_io_uring_enter(r->fd, r->to_submit, 0, 0, NULL, 0);
+	if (ret > 0)
+		r->to_submit -= ret;
+	return ret;
+}
+
+/* Returns a cleared submission entry, submitting the pending ones first if
+ * the ring is full. Returns NULL if no entry could be found.
+ */
+static struct io_uring_sqe *uring_get_sqe(struct uring *r)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	if (r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+		uring_submit(r);
+		if (r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+			return NULL;
+	}
+
+	idx = r->sq_local_tail & *r->sq_mask;
+	sqe = &r->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_array[idx] = idx;
+	r->sq_local_tail++;
+	r->to_submit++;
+	return sqe;
+}
+
+/* Makes the poll request registered for <fd> match its polled status. The
+ * current request, if any, is removed and a new one is added if the FD is
+ * still polled. Nothing is done if the registered events are already the
+ * right ones.
+ */
+static void uring_update_fd(int fd)
+{
+	struct uring_fd *ufd = &uring_fds[fd];
+	struct io_uring_sqe *sqe;
+	unsigned int want;
+
+	want = fdtab[fd].owner ? fdtab[fd].state & FD_EV_POLLED_RW : 0;
+	if (ufd->armed == want)
+		return;
+
+	if (ufd->armed) {
+		sqe = uring_get_sqe(&uring);
+		if (!sqe)
+			goto retry;
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = URING_UDATA(fd, ufd->gen);
+		sqe->user_data = URING_UDATA_IGNORE;
+		ufd->armed = 0;
+	}
+
+	/* any completion of the previous request will now be ignored */
+	ufd->gen++;
+
+	if (!want)
+		return;
+
+	sqe = uring_get_sqe(&uring);
+	if (!sqe)
+		goto retry;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = ((want & FD_EV_POLLED_R) ? POLLIN | POLLRDHUP : 0) |
+	                     ((want & FD_EV_POLLED_W) ? POLLOUT : 0);
+	sqe->user_data = URING_UDATA(fd, ufd->gen);
+	ufd->armed = want;
+	return;
+
+ retry:
+	/* the ring is full, we'll try again on next call */
+	if (!ufd->rearm) {
+		ufd->rearm = 1;
+		uring_rearm[uring_nbrearm++] = fd;
+	}
+}
+
+/*
+ * Immediately remove the file descriptor's poll request upon close, since it
+ * holds a reference to the file which would otherwise remain open until the
+ * request completes. The removal is submitted with the next batch.
+ */
+REGPRM1 static void __fd_clo(int fd)
+{
+	struct uring_fd *ufd = &uring_fds[fd];
+	struct io_uring_sqe *sqe;
+
+	if (ufd->armed) {
+		sqe = uring_get_sqe(&uring);
+		if (sqe) {
+			sqe->opcode = IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = URING_UDATA(fd, ufd->gen);
+			sqe->user_data = URING_UDATA_IGNORE;
+		}
+		ufd->armed = 0;
+	}
+	ufd->gen++;
+}
+
+/*
+ * Linux io_uring() poller
+ */
+REGPRM2 static void _do_poll(struct poller *p, int exp)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	struct io_uring_cqe *cqe;
+	unsigned int head, tail;
+	int status, eo, en;
+	int fd, count, nbrearm;
+	int updt_idx;
+	int wait_time;
+
+	/* first, re-arm the FDs which were reported by the previous call */
+	nbrearm = uring_nbrearm;
+	uring_nbrearm = 0;
+	for (count = 0; count < nbrearm; count++) {
+		fd = uring_rearm[count];
+		uring_fds[fd].rearm = 0;
+		uring_update_fd(fd);
+	}
+
+	/* then scan the update list to find polling changes */
+	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
+		fd = fd_updt[updt_idx];
+		fdtab[fd].updated = 0;
+		fdtab[fd].new = 0;
+
+		if (!fdtab[fd].owner)
+			continue;
+
+		eo = fdtab[fd].state;
+		en = fd_compute_new_polled_status(eo);
+
+		if ((eo ^ en) & FD_EV_POLLED_RW) {
+			/* poll status changed */
+			fdtab[fd].state = en;
+			uring_update_fd(fd);
+		}
+	}
+	fd_nbupdt = 0;
+
+	/* compute the io_uring_enter() timeout */
+	if (!exp)
+		wait_time = MAX_DELAY_MS;
+	else if (tick_is_expired(exp, now_ms))
+		wait_time = 0;
+	else {
+		wait_time = TICKS_TO_MS(tick_remain(now_ms, exp)) + 1;
+		if (wait_time > MAX_DELAY_MS)
+			wait_time = MAX_DELAY_MS;
+	}
+
+	/* don't sleep if some completions are still pending from last call */
+	if (*uring.cq_head != __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE))
+		wait_time = 0;
+
+	/* now submit all changes at once and wait for polled events */
+
+	ts.tv_sec  = wait_time / 1000;
+	ts.tv_nsec = (wait_time % 1000) * 1000000;
+	memset(&arg, 0, sizeof(arg));
+	arg.ts = (unsigned long)&ts;
+
+	gettimeofday(&before_poll, NULL);
+	__atomic_store_n(uring.sq_tail, uring.sq_local_tail, __ATOMIC_RELEASE);
+	status = sys_io_uring_enter(uring.fd, uring.to_submit, wait_time ? 1 : 0,
+	                            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+	                            &arg, sizeof(arg));
+	if (status > 0)
+		uring.to_submit -= status;
+
+	head = *uring.cq_head;
+	tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+	tv_update_date(wait_time, head != tail);
+	measure_idle();
+
+	/* process completed poll requests */
+
+	status = 0;
+	for (; head != tail && status < global.tune.maxpollevents; head++) {
+		struct uring_fd *ufd;
+		unsigned int n, e;
+
+		cqe = &uring.cqes[head & *uring.cq_mask];
+		if (cqe->user_data == URING_UDATA_IGNORE)
+			continue;
+
+		fd = (unsigned int)cqe->user_data;
+		ufd = &uring_fds[fd];
+		if ((unsigned int)(cqe->user_data >> 32) != ufd->gen)
+			continue; /* stale or cancelled request */
+
+		/* the request is consumed, it must be armed again if needed */
+		ufd->armed = 0;
+		if (!ufd->rearm) {
+			ufd->rearm = 1;
+			uring_rearm[uring_nbrearm++] = fd;
+		}
+
+		if (!fdtab[fd].owner)
+			continue;
+
+		e = (cqe->res < 0) ? POLLERR : cqe->res;
+		status++;
+
+		fdtab[fd].ev &= FD_POLL_STICKY;
+		if (POLLIN == FD_POLL_IN && POLLOUT == FD_POLL_OUT &&
+		    POLLPRI == FD_POLL_PRI && POLLERR == FD_POLL_ERR &&
+		    POLLHUP == FD_POLL_HUP) {
+			n = e & (POLLIN|POLLOUT|POLLPRI|POLLERR|POLLHUP);
+		}
+		else {
+			n =	((e & POLLIN ) ? FD_POLL_IN  : 0) |
+				((e & POLLPRI) ? FD_POLL_PRI : 0) |
+				((e & POLLOUT) ? FD_POLL_OUT : 0) |
+				((e & POLLERR) ? FD_POLL_ERR : 0) |
+				((e & POLLHUP) ? FD_POLL_HUP : 0);
+		}
+
+		/* always remap RDHUP to HUP as they're used similarly */
+		if (e & POLLRDHUP) {
+			cur_poller.flags |= HAP_POLL_F_RDHUP;
+			n |= FD_POLL_HUP;
+		}
+
+		fdtab[fd].ev |= n;
+		if (n & (FD_POLL_IN | FD_POLL_HUP | FD_POLL_ERR))
+			fd_may_recv(fd);
+
+		if (n & (FD_POLL_OUT | FD_POLL_ERR))
+			fd_may_send(fd);
+	}
+	__atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+	fd_count_poll_events(status);
+	/* the caller will take care of cached events */
+}
+
+/* Returns the smallest power of two greater than or equal to <v> */
+static unsigned int uring_roundup(unsigned int v)
+{
+	unsigned int r = 1;
+
+	while (r < v)
+		r <<= 1;
+	return r;
+}
+
+/* Creates the ring sized for the current settings. Returns 0 on failure. */
+static int uring_create(void)
+{
+	unsigned int sq, cq;
+
+	sq = uring_roundup(global.tune.maxpollevents * 4);
+	sq = MAX(sq, URING_MIN_SQ_ENTRIES);
+	sq = MIN(sq, URING_MAX_SQ_ENTRIES);
+
+	/* there is at most one poll request per FD, plus the removals */
+	cq = uring_roundup(global.maxsock * 2);
+	cq = MAX(cq, sq * 2);
+	cq = MIN(cq, URING_MAX_CQ_ENTRIES);
+
+	return uring_setup(&uring, sq, cq);
+}
+
+/*
+ * Initialization of the io_uring() poller.
+ * Returns 0 in case of failure, non-zero in case of success. If it fails, it
+ * disables the poller by setting its pref to 0.
+ */
+REGPRM1 static int _do_init(struct poller *p)
+{
+	p->private = NULL;
+
+	if (!uring_create())
+		goto fail_ring;
+
+	uring_fds = calloc(global.maxsock, sizeof(*uring_fds));
+	if (!uring_fds)
+		goto fail_fds;
+
+	uring_rearm = calloc(global.maxsock, sizeof(*uring_rearm));
+	if (!uring_rearm)
+		goto fail_rearm;
+
+	uring_nbrearm = 0;
+	return 1;
+
+ fail_rearm:
+	free(uring_fds);
+	uring_fds = NULL;
+ fail_fds:
+	uring_release(&uring);
+ fail_ring:
+	p->pref = 0;
+	return 0;
+}
+
+/*
+ * Termination of the io_uring() poller.
+ * Memory is released and the poller is marked as unselectable.
+ */
+REGPRM1 static void _do_term(struct poller *p)
+{
+	uring_release(&uring);
+	free(uring_fds);
+	free(uring_rearm);
+	uring_fds = NULL;
+	uring_rearm = NULL;
+	uring_nbrearm = 0;
+	p->private = NULL;
+	p->pref = 0;
+}
+
+/*
+ * Check that the poller works, which requires a recent enough kernel.
+ * Returns 1 if OK, otherwise 0.
+ */
+REGPRM1 static int _do_test(struct poller *p)
+{
+	struct uring r;
+
+	if (!uring_setup(&r, URING_MIN_SQ_ENTRIES, URING_MIN_SQ_ENTRIES * 2))
+		return 0;
+	uring_release(&r);
+	return 1;
+}
+
+/*
+ * Recreate the ring after a fork(). Returns 1 if OK, otherwise 0. The rings
+ * are shared memory, so the processes must not keep using the same one. All
+ * the poll requests are forgotten and will be registered again since the FDs
+ * they were set on are marked for update.
+ */
+REGPRM1 static int _do_fork(struct poller *p)
+{
+	int fd;
+
+	uring_release(&uring);
+	if (!uring_create())
+		return 0;
+
+	uring_nbrearm = 0;
+	for (fd = 0; fd < global.maxsock; fd++) {
+		uring_fds[fd].rearm = 0;
+		uring_fds[fd].gen++;
+		if (uring_fds[fd].armed) {
+			uring_fds[fd].armed = 0;
+			uring_fds[fd].rearm = 1;
+			uring_rearm[uring_nbrearm++] = fd;
+		}
+	}
+	return 1;
+}
+
+/*
+ * It is a constructor, which means that it will automatically be called before
+ * main(). This is GCC-specific but it works at least since 2.95.
+ * Special care must be taken so that it does not need any uninitialized data.
+ */
+__attribute__((constructor))
+static void _do_register(void)
+{
+	struct poller *p;
+
+	if (nbpollers >= MAX_POLLERS)
+		return;
+
+	uring.fd = -1;
+	p = &pollers[nbpollers++];
+
+	p->name = "io_uring";
+	p->pref = 350;
+	p->flags = 0;
+	p->private = NULL;
+
+	p->clo  = __fd_clo;
+	p->test = _do_test;
+	p->init = _do_init;
+	p->term = _do_term;
+	p->poll = _do_poll;
+	p->fork = _do_fork;
+}
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -171,6 +171,7 @@ unsigned int *fd_cache = NULL; // FD events cache
 unsigned int *fd_updt = NULL;  // FD updates list
 int fd_cache_num = 0;          // number of events in the cache
 int fd_nbupdt = 0;             // number of updates in the list
+unsigned int poll_events_hist[POLL_HIST_BUCKETS]; // events per poll() call
 
 /* Deletes an FD from the fdsets, and recomputes the maxfd limit.
  * The file descriptor is also closed.
@@ -211,6 +212,12 @@ void fd_process_cached_events()
 		fd = fd_cache[entry];
 		e = fdtab[fd].state;
 
+		/* in batch mode, start to load the next owner while this one
+		 * is being processed.
+		 */
+		if ((global.tune.options & GTUNE_EPOLL_BATCH) && entry + 1 < fd_cache_num)
+			prefetch_r(fdtab[fd_cache[entry + 1]].owner);
+
 		fdtab[fd].ev &= FD_POLL_STICKY;
 
 		if ((e & (FD_EV_READY_R | FD_EV_ACTIVE_R)) == (FD_EV_READY_R | FD_EV_ACTIVE_R))
@@ -0,0 +1,962 @@
+/*
+ * HTTP cache filter
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The cache stores complete GET responses in a memory area which is shared
+ * between all processes when nbproc is greater than one. The area is cut into
+ * fixed size blocks. An object is a chain of blocks, the first one starting
+ * with the object's descriptor followed by the key ("<method> <host><uri>"),
+ * then the response headers and body as they were received from the server.
+ * Objects are indexed by the hash of their key, and the full key is compared
+ * on lookups. When blocks are missing, the least recently used objects are
+ * evicted. Objects being sent are referenced so that they are never evicted
+ * nor reused until the last reader releases them.
+ *
+ * On a hit, the request is routed to the cache applet instead of a server and
+ * the applet sends the stored response, which then goes through the usual
+ * response analysers exactly like a response coming from a server.
+ *
+ * Only 200 responses with a Content-Length are stored. The lifetime is taken
+ * from "Cache-Control: s-maxage/max-age" or "Expires", and is bounded by the
+ * filter's max-age. The same directives as "option checkcache" prevent
+ * responses from being stored, as well as Set-Cookie and Vary headers.
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include <common/buffer.h>
+#include <common/cfgparse.h>
+#include <common/hash.h>
+#include <common/memory.h>
+#include <common/mini-clist.h>
+#include <common/shlock.h>
+#include <common/standard.h>
+#include <common/time.h>
+
+#include <eb32tree.h>
+
+#include <types/applet.h>
+#include <types/filters.h>
+#include <types/global.h>
+#include <types/proto_http.h>
+#include <types/proxy.h>
+
+#include <proto/applet.h>
+#include <proto/channel.h>
+#include <proto/filters.h>
+#include <proto/flt_cache.h>
+#include <proto/hdr_idx.h>
+#include <proto/log.h>
+#include <proto/proto_http.h>
+#include <proto/stream.h>
+#include <proto/stream_interface.h>
+
+/* payload of a storage block */
+#define CACHE_BLOCK_SIZE 1024
+
+/* default settings */
+#define CACHE_DEF_SIZE      (16 << 20)
+#define CACHE_DEF_MAXAGE    60
+#define CACHE_DEF_MAXOBJSZ  (256 << 10)
+
+/* cache applet states */
+enum {
+	HTTP_CACHE_FWD = 0,    /* sending the object */
+	HTTP_CACHE_END,        /* done, waiting for the stream to close */
+};
+
+/* flags of a transaction's cache state */
+#define CACHE_ST_F_HIT      0x0001  /* the response is served by the cache */
+#define CACHE_ST_F_NOSTORE  0x0002  /* the response must not be stored */
+
+static const char *cache_flt_id = "cache filter";
+
+struct flt_ops cache_ops;
+
+static struct applet http_cache_applet;
+
+static struct pool_head *pool2_cache_st;
+
+struct cache_block {
+	struct cache_block *next;    /* next block of the same object, or next free block */
+	unsigned char data[CACHE_BLOCK_SIZE];
+};
+
+/* Object descriptor, placed at the beginning of the object's first block */
+struct cache_entry {
+	struct eb32_node node;       /* indexed on the key's hash, not in the tree if leaf_p is NULL */
+	struct list lru;             /* position in the LRU list */
+	unsigned int expire;         /* expiration date (wall clock, in seconds) */
+	unsigned int refcnt;         /* number of applets sending the object */
+	unsigned int key_len;        /* length of the key following the descriptor */
+	unsigned int hdr_len;        /* length of the response headers following the key */
+	unsigned int body_len;       /* length of the response body following the headers */
+};
+
+/* the longest key we accept, it must fit in the first block */
+#define CACHE_KEY_MAX (CACHE_BLOCK_SIZE - sizeof(struct cache_entry))
+
+/* The shared area */
+struct cache_shm {
+	struct shlock lock;
+	struct eb_root entries;      /* objects indexed by key hash */
+	struct list lru;             /* objects, least recently used first */
+	struct cache_block *free;    /* list of free blocks */
+	unsigned int nb_blocks;
+	unsigned int nb_free;
+	unsigned long long lookups;  /* number of lookups */
+	unsigned long long hits;     /* number of lookups which returned an object */
+	unsigned long long stores;   /* number of stored objects */
+	unsigned long long evictions;/* number of unexpired objects evicted to make room */
+	struct cache_block blocks[0];
+};
+
+/* Filter configuration */
+struct cache {
+	struct proxy *proxy;
+	unsigned int size;           /* size of the shared area in bytes */
+	unsigned int maxage;         /* max lifetime of an object in seconds */
+	unsigned int maxobjsz;       /* max headers+body size of an object */
+	int shared;                  /* non-zero if the area is shared between processes */
+	struct cache_shm *shm;
+};
+
+/* Per-transaction state */
+struct cache_st {
+	char *key;                   /* request's key, NULL if it may not be cached */
+	unsigned int key_len;
+	unsigned int hash;
+	unsigned int flags;          /* CACHE_ST_F_* */
+	struct cache_entry *entry;   /* object being stored, not indexed yet */
+	struct cache_block *blk;     /* block being written */
+	unsigned int ofs;            /* write offset in <blk> */
+	unsigned int left;           /* body bytes still expected */
+};
+
+#define cache_lock(c)   do { if ((c)->shared) shlock_lock(&(c)->shm->lock); } while (0)
+#define cache_unlock(c) do { if ((c)->shared) shlock_unlock(&(c)->shm->lock); } while (0)
+
+/* returns the first block of object <entry> */
+static inline struct cache_block *cache_entry_block(struct cache_entry *entry)
+{
+	return (struct cache_block *)((char *)entry - offsetof(struct cache_block, data));
+}
+
+/* returns a pointer to the key of object <entry> */
+static inline char *cache_entry_key(struct cache_entry *entry)
+{
+	return (char *)(entry + 1);
+}
+
+/* Returns all the blocks of object <entry> to the free list. Must be called
+ * with the lock held.
+ */
+static void cache_free_entry(struct cache *cache, struct cache_entry *entry)
+{
+	struct cache_shm *shm = cache->shm;
+	struct cache_block *first, *last;
+	unsigned int nb = 1;
+
+	first = last = cache_entry_block(entry);
+	while (last->next) {
+		last = last->next;
+		nb++;
+	}
+	last->next = shm->free;
+	shm->free = first;
+	shm->nb_free += nb;
+}
+
+/* Removes object <entry> from the index and the LRU list. It is released
+ * immediately if no applet is sending it, otherwise the last one will do it.
+ * Must be called with the lock held.
+ */
+static void cache_unlink(struct cache *cache, struct cache_entry *entry)
+{
+	eb32_delete(&entry->node);
+	LIST_DEL(&entry->lru);
+	LIST_INIT(&entry->lru);
+	if (!entry->refcnt)
+		cache_free_entry(cache, entry);
+}
+
+/* Drops a reference on object <entry> */
+static void cache_release(struct cache *cache, struct cache_entry *entry)
+{
+	cache_lock(cache);
+	if (!--entry->refcnt && !entry->node.node.leaf_p)
+		cache_free_entry(cache, entry);
+	cache_unlock(cache);
+}
+
+/* Reserves <nb> chained blocks, evicting the least recently used objects if
+ * needed. Must be called with the lock held. Returns the first block, or NULL
+ * if not enough blocks could be found.
+ */
+static struct cache_block *cache_alloc_blocks(struct cache *cache, unsigned int nb)
+{
+	struct cache_shm *shm = cache->shm;
+	struct cache_entry *entry, *back;
+	struct cache_block *first, *last;
+	unsigned int i;
+
+	if (shm->nb_free < nb) {
+		list_for_each_entry_safe(entry, back, &shm->lru, lru) {
+			if (entry->refcnt)
+				continue;
+			if ((int)(entry->expire - date.tv_sec) > 0)
+				shm->evictions++;
+			cache_unlink(cache, entry);
+			if (shm->nb_free >= nb)
+				break;
+		}
+		if (shm->nb_free < nb)
+			return NULL;
+	}
+
+	first = last = shm->free;
+	for (i = 1; i < nb; i++)
+		last = last->next;
+	shm->free = last->next;
+	last->next = NULL;
+	shm->nb_free -= nb;
+	return first;
+}
+
+/* Looks up the key of transaction state <st>. Returns the object with a
+ * reference held, or NULL if it was not found or has expired.
+ */
+static struct cache_entry *cache_lookup(struct cache *cache, struct cache_st *st)
+{
+	struct cache_shm *shm = cache->shm;
+	struct cache_entry *entry = NULL;
+	struct eb32_node *node;
+
+	cache_lock(cache);
+	shm->lookups++;
+	for (node = eb32_lookup(&shm->entries, st->hash); node; node = eb32_next_dup(node)) {
+		entry = container_of(node, struct cache_entry, node);
+		if (entry->key_len == st->key_len &&
+		    memcmp(cache_entry_key(entry), st->key, st->key_len) == 0)
+			break;
+		entry = NULL;
+	}
+
+	if (entry) {
+		if ((int)(entry->expire - date.tv_sec) <= 0) {
+			cache_unlink(cache, entry);
+			entry = NULL;
+		}
+		else {
+			entry->refcnt++;
+			LIST_DEL(&entry->lru);
+			LIST_ADDQ(&shm->lru, &entry->lru);
+			shm->hits++;
+		}
+	}
+	cache_unlock(cache);
+	return entry;
+}
+
+/* Indexes the object stored by transaction state <st>, replacing any older
+ * version of it.
+ */
+static void cache_commit(struct cache *cache, struct cache_st *st)
+{
+	struct cache_shm *shm = cache->shm;
+	struct cache_entry *entry;
+	struct eb32_node *node, *next;
+
+	cache_lock(cache);
+	for (node = eb32_lookup(&shm->entries, st->hash); node; node = next) {
+		next = eb32_next_dup(node);
+		entry = container_of(node, struct cache_entry, node);
+		if (entry->key_len == st->key_len &&
+		    memcmp(cache_entry_key(entry), st->key, st->key_len) == 0)
+			cache_unlink(cache, entry);
+	}
+	eb32_insert(&shm->entries, &st->entry->node);
+	LIST_ADDQ(&shm->lru, &st->entry->lru);
+	shm->stores++;
+	cache_unlock(cache);
+	st->entry = NULL;
+}
+
+/* Releases the object being stored by transaction state <st> */
+static void cache_abort(struct cache *cache, struct cache_st *st)
+{
+	cache_lock(cache);
+	cache_free_entry(cache, st->entry);
+	cache_unlock(cache);
+	st->entry = NULL;
+}
+
+/* Appends <len> bytes from <src> to the object being stored */
+static void cache_write(struct cache_st *st, const char *src, unsigned int len)
+{
+	unsigned int block;
+
+	while (len) {
+		if (st->ofs == CACHE_BLOCK_SIZE) {
+			st->blk = st->blk->next;
+			st->ofs = 0;
+		}
+		block = CACHE_BLOCK_SIZE - st->ofs;
+		if (block > len)
+			block = len;
+		memcpy(st->blk->data + st->ofs, src, block);
+		st->ofs += block;
+		src += block;
+		len -= block;
+	}
+}
+
+/* Appends <len> bytes located at <ofs> bytes from buf->p in <buf>, which may
+ * wrap, to the object being stored.
+ */
+static void cache_write_buf(struct cache_st *st, struct buffer *buf, unsigned int ofs, unsigned int len)
+{
+	char *p = b_ptr(buf, ofs);
+	unsigned int block = buf->data + buf->size - p;
+
+	if (block > len)
+		block = len;
+	cache_write(st, p, block);
+	if (len > block)
+		cache_write(st, buf->data, len - block);
+}
+
+/* Parses the delta-seconds value of a Cache-Control directive. Invalid values
+ * return 0 so that the response is considered stale.
+ */
+static int cache_parse_delta(const char *p, int len)
+{
+	int ret = 0;
+
+	if (!len)
+		return 0;
+	while (len--) {
+		if (*p < '0' || *p > '9')
+			return 0;
+		if (ret > (INT_MAX - 9) / 10)
+			return INT_MAX;
+		ret = ret * 10 + *p++ - '0';
+	}
+	return ret;
+}
+
+/* Returns the number of seconds the response in <msg> may be served from the
+ * cache, or <= 0 if it must not be stored.
+ */
+static int cache_response_lifetime(struct cache *cache, struct stream *s, struct http_msg *msg)
+{
+	struct http_txn *txn = s->txn;
+	char *p = msg->chn->buf->p;
+	struct hdr_ctx ctx;
+	struct tm tm;
+	int maxage = -1, smaxage = -1;
+	long long lifetime;
+	time_t base;
+
+	ctx.idx = 0;
+	while (http_find_header2("Cache-Control", 13, p, &txn->hdr_idx, &ctx)) {
+		if (ctx.vlen >= 9 && strncasecmp(ctx.line + ctx.val, "s-maxage=", 9) == 0)
+			smaxage = cache_parse_delta(ctx.line + ctx.val + 9, ctx.vlen - 9);
+		else if (ctx.vlen >= 8 && strncasecmp(ctx.line + ctx.val, "max-age=", 8) == 0)
+			maxage = cache_parse_delta(ctx.line + ctx.val + 8, ctx.vlen - 8);
+	}
+
+	if (smaxage >= 0)
+		lifetime = smaxage;
+	else if (maxage >= 0)
+		lifetime = maxage;
+	else {
+		ctx.idx = 0;
+		if (!http_find_full_header2("Expires", 7, p, &txn->hdr_idx, &ctx))
+			return cache->maxage;
+
+		/* an invalid date means that the response has already expired */
+		if (!parse_http_date(ctx.line + ctx.val, ctx.vlen, &tm))
+			return 0;
+		lifetime = my_timegm(&tm);
+
+		/* the server's clock is the reference when it is known */
+		base = date.tv_sec;
+		ctx.idx = 0;
+		if (http_find_full_header2("Date", 4, p, &txn->hdr_idx, &ctx) &&
+		    parse_http_date(ctx.line + ctx.val, ctx.vlen, &tm))
+			base = my_timegm(&tm);
+		lifetime -= base;
+	}
+
+	if (lifetime > cache->maxage)
+		lifetime = cache->maxage;
+	return lifetime;
+}
+
+/* Builds the key of the request in <msg> into transaction state <st>. The
+ * key is made of the method, the host and the URI. Returns 0 if the key could
+ * not be built.
+ */
+static int cache_build_key(struct cache_st *st, struct stream *s, struct http_msg *msg)
+{
+	struct http_txn *txn = s->txn;
+	char *p = msg->chn->buf->p;
+	struct hdr_ctx ctx;
+	const char *host = "";
+	int host_len = 0;
+	unsigned int len;
+	char *key;
+	int i;
+
+	ctx.idx = 0;
+	if (http_find_header2("Host", 4, p, &txn->hdr_idx, &ctx)) {
+		host = ctx.line + ctx.val;
+		host_len = ctx.vlen;
+	}
+
+	len = msg->sl.rq.m_l + 1 + host_len + msg->sl.rq.u_l;
+	if (len > CACHE_KEY_MAX)
+		return 0;
+
+	key = malloc(len);
+	if (!key)
+		return 0;
+
+	memcpy(key, p, msg->sl.rq.m_l);
+	i = msg->sl.rq.m_l;
+	key[i++] = ' ';
+	while (host_len--)
+		key[i++] = tolower((unsigned char)*host++);
+	memcpy(key + i, p + msg->sl.rq.u, msg->sl.rq.u_l);
+
+	st->key = key;
+	st->key_len = len;
+	st->hash = hash_crc32(key, len);
+	return 1;
+}
+
+/* Looks the request up in the cache and routes it to the cache applet on a
+ * hit.
+ */
+static void cache_check_request(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	struct cache *cache = FLT_CONF(filter);
+	struct cache_st *st = filter->ctx;
+	struct http_txn *txn = s->txn;
+	char *p = msg->chn->buf->p;
+	struct cache_entry *entry;
+	struct appctx *appctx;
+	enum obj_type *target;
+	struct hdr_ctx ctx;
+
+	/* intercepted requests (stats, services) are not cached */
+	if (txn->meth != HTTP_METH_GET || objt_applet(s->target))
+		return;
+
+	/* responses to authenticated requests are never shared */
+	ctx.idx = 0;
+	if (http_find_header2("Authorization", 13, p, &txn->hdr_idx, &ctx))
+		return;
+
+	if (!cache_build_key(st, s, msg))
+		return;
+
+	/* the client may require a response from the server, which will
+	 * refresh the stored object, or prevent it from being stored.
+	 */
+	ctx.idx = 0;
+	while (http_find_header2("Cache-Control", 13, p, &txn->hdr_idx, &ctx)) {
+		if (ctx.vlen == 8 && strncasecmp(ctx.line + ctx.val, "no-store", 8) == 0) {
+			st->flags |= CACHE_ST_F_NOSTORE;
+			return;
+		}
+		if (ctx.vlen == 8 && strncasecmp(ctx.line + ctx.val, "no-cache", 8) == 0)
+			return;
+	}
+	ctx.idx = 0;
+	if (http_find_header2("Pragma", 6, p, &txn->hdr_idx, &ctx) &&
+	    ctx.vlen == 8 && strncasecmp(ctx.line + ctx.val, "no-cache", 8) == 0)
+		return;
+
+	entry = cache_lookup(cache, st);
+	if (!entry)
+		return;
+
+	target = s->target;
+	s->target = &http_cache_applet.obj_type;
+	appctx = stream_int_register_handler(&s->si[1], &http_cache_applet);
+	if (unlikely(!appctx)) {
+		s->target = target;
+		cache_release(cache, entry);
+		return;
+	}
+
+	appctx->st0 = HTTP_CACHE_FWD;
+	appctx->ctx.cache.cache = cache;
+	appctx->ctx.cache.entry = entry;
+	appctx->ctx.cache.blk = cache_entry_block(entry);
+	appctx->ctx.cache.ofs = sizeof(*entry) + entry->key_len;
+	appctx->ctx.cache.left = entry->hdr_len + entry->body_len;
+
+	/* The flag SF_ASSIGNED prevents from server assignment. */
+	s->flags |= SF_ASSIGNED;
+	st->flags |= CACHE_ST_F_HIT | CACHE_ST_F_NOSTORE;
+}
+
+/* Checks whether the response in <msg> may be stored, and starts storing it
+ * if so. Its body will be appended by cache_http_data().
+ */
+static void cache_check_response(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	struct cache *cache = FLT_CONF(filter);
+	struct cache_st *st = filter->ctx;
+	struct http_txn *txn = s->txn;
+	char *p = msg->chn->buf->p;
+	struct cache_entry *entry;
+	struct cache_block *blk;
+	struct hdr_ctx ctx;
+	unsigned int flags, total;
+	int lifetime;
+
+	if (!st->key || (st->flags & CACHE_ST_F_NOSTORE))
+		return;
+
+	if (txn->status != 200 ||
+	    !(msg->flags & HTTP_MSGF_CNT_LEN) ||
+	    (msg->flags & (HTTP_MSGF_TE_CHNK | HTTP_MSGF_COMPRESSING)))
+		return;
+
+	if (msg->sov + msg->body_len > cache->maxobjsz)
+		return;
+
+	/* the object must be the same for all clients */
+	ctx.idx = 0;
+	if (http_find_header2("Set-Cookie", 10, p, &txn->hdr_idx, &ctx))
+		return;
+	ctx.idx = 0;
+	if (http_find_header2("Vary", 4, p, &txn->hdr_idx, &ctx))
+		return;
+
+	/* check the Pragma and Cache-Control headers like "option checkcache" */
+	flags = txn->flags & (TX_CACHEABLE | TX_CACHE_COOK);
+	txn->flags |= TX_CACHEABLE | TX_CACHE_COOK;
+	check_response_for_cacheability(s, msg->chn);
+	if (!(txn->flags & TX_CACHEABLE)) {
+		txn->flags = (txn->flags & ~(TX_CACHEABLE | TX_CACHE_COOK)) | flags;
+		return;
+	}
+	txn->flags = (txn->flags & ~(TX_CACHEABLE | TX_CACHE_COOK)) | flags;
+
+	lifetime = cache_response_lifetime(cache, s, msg);
+	if (lifetime <= 0)
+		return;
+
+	total = sizeof(*entry) + st->key_len + msg->sov + msg->body_len;
+	cache_lock(cache);
+	blk = cache_alloc_blocks(cache, (total + CACHE_BLOCK_SIZE - 1) / CACHE_BLOCK_SIZE);
+	cache_unlock(cache);
+	if (!blk)
+		return;
+
+	entry = (struct cache_entry *)blk->data;
+	memset(entry, 0, sizeof(*entry));
+	entry->node.key = st->hash;
+	LIST_INIT(&entry->lru);
+	entry->expire   = date.tv_sec + lifetime;
+	entry->key_len  = st->key_len;
+	entry->hdr_len  = msg->sov;
+	entry->body_len = msg->body_len;
+
+	st->entry = entry;
+	st->blk   = blk;
+	st->ofs   = sizeof(*entry);
+	st->left  = msg->body_len;
+	cache_write(st, st->key, st->key_len);
+	cache_write_buf(st, msg->chn->buf, 0, msg->sov);
+
+	register_data_filter(s, msg->chn, filter);
+}
+
+/* Releases everything held by transaction state <st> */
+static void cache_st_free(struct cache *cache, struct cache_st *st)
+{
+	if (st->entry)
+		cache_abort(cache, st);
+	free(st->key);
+	pool_free2(pool2_cache_st, st);
+}
+
+/***********************************************************************/
+static int
+cache_flt_init(struct proxy *px, struct flt_conf *fconf)
+{
+	struct cache *cache = fconf->conf;
+	struct cache_shm *shm;
+	int maptype = MAP_PRIVATE;
+	unsigned int i;
+
+#ifndef USE_PRIVATE_CACHE
+	if (global.nbproc > 1)
+		maptype = MAP_SHARED;
+#endif
+
+	shm = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, maptype | MAP_ANON, -1, 0);
+	if (!shm || shm == MAP_FAILED) {
+		Alert("config: %s '%s': cannot allocate %u bytes for the cache.\n",
+		      proxy_type_str(px), px->id, cache->size);
+		return -1;
+	}
+
+#ifndef USE_PRIVATE_CACHE
+	if (maptype == MAP_SHARED) {
+		if (shlock_init(&shm->lock)) {
+			Alert("config: %s '%s': cannot initialize the cache's lock.\n",
+			      proxy_type_str(px), px->id);
+			munmap(shm, cache->size);
+			return -1;
+		}
+		cache->shared = 1;
+	}
+#endif
+
+	shm->entries = EB_ROOT;
+	LIST_INIT(&shm->lru);
+	shm->nb_blocks = (cache->size - sizeof(*shm)) / sizeof(struct cache_block);
+	shm->nb_free = shm->nb_blocks;
+	for (i = 0; i < shm->nb_blocks; i++)
+		shm->blocks[i].next = (i + 1 < shm->nb_blocks) ? &shm->blocks[i + 1] : NULL;
+	shm->free = &shm->blocks[0];
+	cache->shm = shm;
+	return 0;
+}
+
+static void
+cache_flt_deinit(struct proxy *px, struct flt_conf *fconf)
+{
+	struct cache *cache = fconf->conf;
+
+	if (cache->shm)
+		munmap(cache->shm, cache->size);
+	free(cache);
+}
+
+static int
+cache_flt_check(struct proxy *px, struct flt_conf *fconf)
+{
+	if (px->mode != PR_MODE_HTTP) {
+		Warning("config: %s '%s': the cache filter is ignored outside of 'mode http'.\n",
+			proxy_type_str(px), px->id);
+	}
+	return 0;
+}
+
+static int
+cache_start_analyze(struct stream *s, struct filter *filter, struct channel *chn)
+{
+	if (filter->ctx == NULL) {
+		struct cache_st *st;
+
+		if (!(st = pool_alloc2(pool2_cache_st)))
+			return -1;
+		memset(st, 0, sizeof(*st));
+		filter->ctx = st;
+	}
+	return 1;
+}
+
+static int
+cache_end_analyze(struct stream *s, struct filter *filter, struct channel *chn)
+{
+	struct cache_st *st = filter->ctx;
+
+	if (st) {
+		cache_st_free(FLT_CONF(filter), st);
+		filter->ctx = NULL;
+	}
+	return 1;
+}
+
+static void
+cache_detach(struct stream *s, struct filter *filter)
+{
+	cache_end_analyze(s, filter, NULL);
+}
+
+static int
+cache_http_headers(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	struct cache_st *st = filter->ctx;
+
+	if (!st)
+		goto end;
+
+	if (!(msg->chn->flags & CF_ISRESP))
+		cache_check_request(s, filter, msg);
+	else
+		cache_check_response(s, filter, msg);
+  end:
+	return 1;
+}
+
+static int
+cache_http_data(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	struct cache_st *st = filter->ctx;
+	unsigned int avail = MIN(msg->chunk_len + msg->next, msg->chn->buf->i) - flt_rsp_nxt(filter);
+
+	if (avail && st->entry) {
+		if (avail > st->left)
+			cache_abort(FLT_CONF(filter), st);
+		else {
+			cache_write_buf(st, msg->chn->buf, flt_rsp_nxt(filter), avail);
+			st->left -= avail;
+		}
+	}
+	return avail;
+}
+
+static int
+cache_http_end(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	struct cache_st *st = filter->ctx;
+
+	if (!(msg->chn->flags & CF_ISRESP) || !st || !st->entry)
+		goto end;
+
+	if (st->left)
+		cache_abort(FLT_CONF(filter), st);
+	else
+		cache_commit(FLT_CONF(filter), st);
+  end:
+	return 1;
+}
+
+/***********************************************************************/
+/* The cache applet sends the object it references, then closes */
+static void http_cache_io_handler(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct channel *req = si_oc(si);
+	struct channel *res = si_ic(si);
+	struct cache_block *blk = appctx->ctx.cache.blk;
+	unsigned int ofs = appctx->ctx.cache.ofs;
+	unsigned int left = appctx->ctx.cache.left;
+	int len, max;
+
+	if (unlikely(si->state == SI_ST_DIS || si->state == SI_ST_CLO))
+		goto out;
+
+	/* Check if the input buffer is avalaible. */
+	if (res->buf->size == 0) {
+		si_applet_cant_put(si);
+		goto out;
+	}
+
+	/* check that the output is not closed */
+	if (res->flags & (CF_SHUTW|CF_SHUTW_NOW))
+		appctx->st0 = HTTP_CACHE_END;
+
+	if (appctx->st0 == HTTP_CACHE_FWD) {
+		while (left) {
+			if (ofs == CACHE_BLOCK_SIZE) {
+				blk = blk->next;
+				ofs = 0;
+			}
+			len = CACHE_BLOCK_SIZE - ofs;
+			if (len > left)
+				len = left;
+			max = channel_recv_max(res);
+			if (len > max)
+				len = max;
+			if (len <= 0 || bi_putblk(res, (char *)blk->data + ofs, len) < 0) {
+				si_applet_cant_put(si);
+				break;
+			}
+			ofs  += len;
+			left -= len;
+		}
+		appctx->ctx.cache.blk  = blk;
+		appctx->ctx.cache.ofs  = ofs;
+		appctx->ctx.cache.left = left;
+		if (!left)
+			appctx->st0 = HTTP_CACHE_END;
+	}
+
+	if (appctx->st0 == HTTP_CACHE_END) {
+		/* eat the whole request */
+		bo_skip(req, req->buf->o);
+		res->flags |= CF_READ_NULL;
+		si_shutr(si);
+	}
+
+	if ((res->flags & CF_SHUTR) && (si->state == SI_ST_EST))
+		si_shutw(si);
+
+	if (appctx->st0 == HTTP_CACHE_END) {
+		if ((req->flags & CF_SHUTW) && (si->state == SI_ST_EST)) {
+			si_shutr(si);
+			res->flags |= CF_READ_NULL;
+		}
+	}
+ out:
+	/* just to make gcc happy */ ;
+}
+
+static void http_cache_applet_release(struct appctx *appctx)
+{
+	cache_release(appctx->ctx.cache.cache, appctx->ctx.cache.entry);
+}
+
+static struct applet http_cache_applet = {
+	.obj_type = OBJ_TYPE_APPLET,
+	.name = "<CACHE>", /* used for logging */
+	.fct = http_cache_io_handler,
+	.release = http_cache_applet_release,
+};
+
+/***********************************************************************/
+/* Reports the statistics of the cache filter declared in proxy <px>. Returns
+ * 0 if <px> has no cache.
+ */
+int cache_get_proxy_stats(struct proxy *px, unsigned long long *hits,
+                          unsigned long long *misses, unsigned long long *evictions)
+{
+	struct flt_conf *fconf;
+	struct cache *cache;
+
+	list_for_each_entry(fconf, &px->filter_configs, list) {
+		if (fconf->id != cache_flt_id)
+			continue;
+
+		cache = fconf->conf;
+		if (!cache->shm)
+			return 0;
+
+		cache_lock(cache);
+		*hits      = cache->shm->hits;
+		*misses    = cache->shm->lookups - cache->shm->hits;
+		*evictions = cache->shm->evictions;
+		cache_unlock(cache);
+		return 1;
+	}
+	return 0;
+}
+
+/***********************************************************************/
+struct flt_ops cache_ops = {
+	.init   = cache_flt_init,
+	.deinit = cache_flt_deinit,
+	.check  = cache_flt_check,
+
+	.detach = cache_detach,
+
+	.channel_start_analyze = cache_start_analyze,
+	.channel_end_analyze   = cache_end_analyze,
+
+	.http_headers          = cache_http_headers,
+	.http_data             = cache_http_data,
+	.http_end              = cache_http_end,
+};
+
+/* Parses the "cache" filter line:
+ *   filter cache [size <size>] [max-age <time>] [max-object-size <size>]
+ */
+static int
+parse_cache_flt(char **args, int *cur_arg, struct proxy *px,
+                struct flt_conf *fconf, char **err, void *private)
+{
+	struct flt_conf *fc;
+	struct cache *cache;
+	int pos = *cur_arg + 1;
+	const char *res;
+
+	list_for_each_entry(fc, &px->filter_configs, list) {
+		if (fc->id == cache_flt_id) {
+			memprintf(err, "%s: Proxy supports only one cache filter\n", px->id);
+			return -1;
+		}
+	}
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache) {
+		memprintf(err, "%s: out of memory", args[*cur_arg]);
+		return -1;
+	}
+	cache->proxy    = px;
+	cache->size     = CACHE_DEF_SIZE;
+	cache->maxage   = CACHE_DEF_MAXAGE;
+	cache->maxobjsz = CACHE_DEF_MAXOBJSZ;
+
+	while (*args[pos]) {
+		if (!strcmp(args[pos], "size") || !strcmp(args[pos], "max-object-size") ||
+		    !strcmp(args[pos], "max-age")) {
+			if (!*args[pos + 1]) {
+				memprintf(err, "'%s' : '%s' option without value",
+					  args[*cur_arg], args[pos]);
+				goto error;
+			}
+			if (!strcmp(args[pos], "max-age"))
+				res = parse_time_err(args[pos + 1], &cache->maxage, TIME_UNIT_S);
+			else
+				res = parse_size_err(args[pos + 1],
+						     !strcmp(args[pos], "size") ? &cache->size : &cache->maxobjsz);
+			if (res) {
+				memprintf(err, "'%s' : unexpected character '%c' in '%s' value '%s'",
+					  args[*cur_arg], *res, args[pos], args[pos + 1]);
+				goto error;
+			}
+			pos += 2;
+		}
+		else
+			break;
+	}
+
+	if (cache->size < sizeof(struct cache_shm) + 64 * sizeof(struct cache_block)) {
+		memprintf(err, "'%s' : size must be at least %u bytes",
+			  args[*cur_arg], (unsigned int)(sizeof(struct cache_shm) + 64 * sizeof(struct cache_block)));
+		goto error;
+	}
+
+	if (cache->maxobjsz > cache->size / 2) {
+		memprintf(err, "'%s' : max-object-size must not exceed half of the cache size",
+			  args[*cur_arg]);
+		goto error;
+	}
+
+	*cur_arg    = pos;
+	fconf->id   = cache_flt_id;
+	fconf->conf = cache;
+	fconf->ops  = &cache_ops;
+	return 0;
+
+ error:
+	free(cache);
+	return -1;
+}
+
+/* Declare the filter parser for "cache" keyword */
+static struct flt_kw_list filter_kws = { "CACHE", { }, {
+		{ "cache", parse_cache_flt, NULL },
+		{ NULL, NULL, NULL },
+	}
+};
+
+#ifdef __VMS
+void __flt_cache_init(void)
+#else
+__attribute__((constructor))
+static void
+__flt_cache_init(void)
+#endif
+{
+	flt_register_keywords(&filter_kws);
+	pool2_cache_st = create_pool("cache_st", sizeof(struct cache_st), MEM_F_SHARED);
+}
@@ -52,6 +52,7 @@ static int select_compression_response_header(struct comp_state *st,
 					      struct stream *s,
 					      struct http_msg *msg);
 
+static int http_compression_buffer_fit(struct buffer *in, struct buffer **out);
 static int http_compression_buffer_init(struct buffer *in, struct buffer *out);
 static int http_compression_buffer_add_data(struct comp_state *st,
 					    struct buffer *in,
@@ -157,6 +158,9 @@ comp_http_data(struct stream *s, struct filter *filter, struct http_msg *msg)
 	if (!st->initialized) {
 		unsigned int fwd = flt_rsp_fwd(filter) + st->hdrs_len;
 
+		if (http_compression_buffer_fit(buf, &zbuf) < 0)
+			return -1;
+
 		b_reset(tmpbuf);
 		b_adv(buf, fwd);
 		ret = http_compression_buffer_init(buf, zbuf);
@@ -173,7 +177,7 @@ comp_http_data(struct stream *s, struct filter *filter, struct http_msg *msg)
 		len = MIN(tmpbuf->size - buffer_len(tmpbuf), len);
 
 		b_adv(buf, *nxt);
-		block = bi_contig_data(buf);
+		block = MIN(bi_contig_data(buf), len);
 		memcpy(bi_end(tmpbuf), bi_ptr(buf), block);
 		if (len > block)
 			memcpy(bi_end(tmpbuf)+block, buf->data, len-block);
@@ -208,6 +212,9 @@ comp_http_chunk_trailers(struct stream *s, struct filter *filter,
 			struct buffer *buf = msg->chn->buf;
 			unsigned int   fwd = flt_rsp_fwd(filter) + st->hdrs_len;
 
+			if (http_compression_buffer_fit(buf, &zbuf) < 0)
+				return -1;
+
 			b_reset(tmpbuf);
 			b_adv(buf, fwd);
 			http_compression_buffer_init(buf, zbuf);
@@ -565,6 +572,19 @@ http_emit_chunk_size(char *end, unsigned int chksz)
 	return end - beg;
 }
 
+/*
+ * Make sure the output buffer <*out> is at least as large as <in>, which may
+ * have been moved to a large buffer by b_upgrade(). Returns 0 on success, -1
+ * on memory shortage.
+ */
+static int
+http_compression_buffer_fit(struct buffer *in, struct buffer **out)
+{
+	if ((*out)->size < in->size && !b_upgrade(out))
+		return -1;
+	return 0;
+}
+
 /*
  * Init HTTP compression
  */
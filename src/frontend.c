@@ -81,8 +81,9 @@ int frontend_accept(struct stream *s)
 		http_init_txn(s);
 	}
 
+	/* a session resumed from the idle state was already logged */
 	if ((fe->mode == PR_MODE_TCP || fe->mode == PR_MODE_HTTP)
-	    && (!LIST_ISEMPTY(&fe->logsrvs))) {
+	    && (!LIST_ISEMPTY(&fe->logsrvs)) && !(sess->flags & SESS_FL_RESUMED)) {
 		if (likely(!LIST_ISEMPTY(&fe->logformat))) {
 			/* we have the client ip */
 			if (s->logs.logwait & LW_CLIP)
@@ -114,7 +115,7 @@ int frontend_accept(struct stream *s)
 		}
 	}
 
-	if (unlikely((global.mode & MODE_DEBUG) && conn &&
+	if (unlikely((global.mode & MODE_DEBUG) && conn && !(sess->flags & SESS_FL_RESUMED) &&
 		     (!(global.mode & MODE_QUIET) || (global.mode & MODE_VERBOSE)))) {
 		char pn[INET6_ADDRSTRLEN];
 
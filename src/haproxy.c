@@ -68,6 +68,7 @@
 #include <common/config.h>
 #include <common/defaults.h>
 #include <common/errors.h>
+#include <common/http_scan.h>
 #include <common/memory.h>
 #include <common/mini-clist.h>
 #include <common/namespace.h>
@@ -98,6 +99,7 @@
 #include <proto/hlua.h>
 #include <proto/listener.h>
 #include <proto/log.h>
+#include <proto/map.h>
 #include <proto/pattern.h>
 #include <proto/protocol.h>
 #include <proto/proto_http.h>
@@ -397,6 +399,12 @@ void display_build_opts()
 	}
 #else
 	printf("no (USE_PCRE_JIT not set)");
+#endif
+	printf("\nRegex lists use a combined DFA : ");
+#ifdef USE_REGEX_DFA
+	printf("yes");
+#else
+	printf("no (USE_REGEX_DFA not set)");
 #endif
 	printf("\n");
 #else
@@ -436,6 +444,8 @@ void display_build_opts()
 	printf("Built with network namespace support\n");
 #endif
 
+	printf("HTTP header scanner : %s\n", http_scan.name);
+
 #ifdef USE_DEVICEATLAS
     printf("Built with DeviceAtlas support\n");
 #endif
@@ -478,6 +488,7 @@ void usage(char *name)
 #endif
 		"        -q quiet mode : don't display messages\n"
 		"        -c check mode : only check config files and exit\n"
+		"        -cm <type> <map> <out> compiles a map for map_<type> and exits\n"
 		"        -n sets the maximum total # of connections (%d)\n"
 		"        -m limits the usable amount of memory (in MB)\n"
 		"        -N sets the default, per-proxy maximum # of connections (%d)\n"
@@ -489,6 +500,9 @@ void usage(char *name)
 #if defined(ENABLE_KQUEUE)
 		"        -dk disables kqueue() usage even when available\n"
 #endif
+#if defined(ENABLE_URING)
+		"        -du disables io_uring usage even when available\n"
+#endif
 #if defined(ENABLE_POLL)
 		"        -dp disables poll() usage even when available\n"
 #endif
@@ -767,6 +781,9 @@ void init(int argc, char **argv)
 #if defined(ENABLE_KQUEUE)
 	global.tune.options |= GTUNE_USE_KQUEUE;
 #endif
+#if defined(ENABLE_URING)
+	global.tune.options |= GTUNE_USE_URING;
+#endif
 #if defined(CONFIG_HAP_LINUX_SPLICE)
 	global.tune.options |= GTUNE_USE_SPLICE;
 #endif
@@ -811,6 +828,10 @@ void init(int argc, char **argv)
 			else if (*flag == 'd' && flag[1] == 'k')
 				global.tune.options &= ~GTUNE_USE_KQUEUE;
 #endif
+#if defined(ENABLE_URING)
+			else if (*flag == 'd' && flag[1] == 'u')
+				global.tune.options &= ~GTUNE_USE_URING;
+#endif
 #if defined(CONFIG_HAP_LINUX_SPLICE)
 			else if (*flag == 'd' && flag[1] == 'S')
 				global.tune.options &= ~GTUNE_USE_SPLICE;
@@ -835,6 +856,16 @@ void init(int argc, char **argv)
 				global.tune.options |= GTUNE_RESOLVE_DONTFAIL;
 			else if (*flag == 'd')
 				arg_mode |= MODE_DEBUG;
+			else if (*flag == 'c' && flag[1] == 'm') {
+				/* -cm <type> <in> <out> : compiles a map and exits */
+				if (argc < 4)
+					usage(progname);
+				if (!map_compile(argv[1], argv[2], argv[3], &err_msg)) {
+					Alert("Cannot compile map file %s : %s.\n", argv[2], err_msg);
+					exit(1);
+				}
+				exit(0);
+			}
 			else if (*flag == 'c')
 				arg_mode |= MODE_CHECK;
 #ifndef __VMS
@@ -1034,7 +1065,23 @@ void init(int argc, char **argv)
 	global_listener_queue_task->expire = TICK_ETERNITY;
 
 	/* now we know the buffer size, we can initialize the channels and buffers */
+	if (global.tune.bufsize_large && global.tune.bufsize_large <= global.tune.bufsize) {
+		Warning("tune.bufsize.large (%d) is not larger than tune.bufsize (%d), large buffers are disabled.\n",
+			global.tune.bufsize_large, global.tune.bufsize);
+		global.tune.bufsize_large = 0;
+	}
 	init_buffer();
+
+	/* headers moved to a large buffer may be copied as a whole into the
+	 * trash chunks (eg: by sample fetches), which must then be as large.
+	 */
+	if (global.tune.bufsize_large) {
+		chunk_init(&trash, my_realloc2(trash.str, global.tune.bufsize_large), global.tune.bufsize_large);
+		if (!trash.str || !alloc_trash_buffers(global.tune.bufsize_large)) {
+			Alert("failed to allocate the trash buffers for tune.bufsize.large.\n");
+			exit(1);
+		}
+	}
 #if defined(USE_DEVICEATLAS)
 	init_deviceatlas();
 #endif
@@ -1284,8 +1331,13 @@ void init(int argc, char **argv)
 	if (global.nbproc < 1)
 		global.nbproc = 1;
 
-	swap_buffer = calloc(1, global.tune.bufsize);
-	get_http_auth_buff = calloc(1, global.tune.bufsize);
+	if ((global.tune.options & GTUNE_TIMER_WHEEL) && !init_timer_wheel()) {
+		Alert("Failed to allocate the timer wheel.\n");
+		exit(1);
+	}
+
+	swap_buffer = calloc(1, MAX(global.tune.bufsize, global.tune.bufsize_large));
+	get_http_auth_buff = calloc(1, MAX(global.tune.bufsize, global.tune.bufsize_large));
 	static_table_key = calloc(1, sizeof(*static_table_key));
 
 	fdinfo = calloc(1, sizeof(struct fdinfo) * (global.maxsock));
@@ -1301,6 +1353,9 @@ void init(int argc, char **argv)
 	if (!(global.tune.options & GTUNE_USE_EPOLL))
 		disable_poller("epoll");
 
+	if (!(global.tune.options & GTUNE_USE_URING))
+		disable_poller("io_uring");
+
 	if (!(global.tune.options & GTUNE_USE_POLL))
 		disable_poller("poll");
 
@@ -1588,6 +1643,12 @@ void deinit(void)
 				task_free(s->warmup);
 			}
 
+			if (s->pool_task) {
+				srv_purge_pool(s, s->pool_cur);
+				task_delete(s->pool_task);
+				task_free(s->pool_task);
+			}
+
 			free(s->id);
 			free(s->cookie);
 			free(s->check.bi);
@@ -1723,6 +1784,7 @@ void deinit(void)
 	pool_destroy2(pool2_pendconn);
 	pool_destroy2(pool2_sig_handlers);
 	pool_destroy2(pool2_hdr_idx);
+	pool_destroy2(pool2_hdr_hash);
 	pool_destroy2(pool2_http_txn);
 	deinit_pollers();
 } /* end deinit() */
@@ -2138,6 +2200,11 @@ int main(int argc, char **argv)
 		fork_poller();
 	}
 #endif
+	/* the buffer slab is reserved once we know which CPUs we run on */
+	if (!buffer_reserve_slab())
+		Warning("Failed to pre-reserve %d buffers, they will be allocated on demand.\n",
+			global.tune.buf_prealloc);
+
 	/* initialize structures for name resolution */
 	if (!dns_init_resolvers(1))
 		exit(1);
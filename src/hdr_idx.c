@@ -10,11 +10,43 @@
  *
  */
 
+#include <string.h>
+
 #include <common/config.h>
 #include <common/memory.h>
 #include <proto/hdr_idx.h>
 
 struct pool_head *pool2_hdr_idx = NULL;
+struct pool_head *pool2_hdr_hash = NULL;
+
+/* Links element <cur> located at offset <ofs> at the end of its bucket, given
+ * that <line> points to the header line. Lines without a colon are not
+ * indexed since no lookup may match them.
+ */
+static void hdr_idx_hash_link(struct hdr_idx *list, int cur, unsigned int ofs, const char *line)
+{
+	struct hdr_hash *hash = list->hash;
+	int len = list->v[cur].len;
+	int n;
+
+	hash->e[cur].ofs = ofs;
+	hash->e[cur].next = 0;
+
+	for (n = 0; n < len && line[n] != ':'; n++)
+		;
+
+	if (n >= len) {
+		hash->e[cur].bucket = HDR_HASH_NONE;
+		return;
+	}
+
+	hash->e[cur].bucket = hdr_hash_bucket(line, n);
+	if (hash->head[hash->e[cur].bucket])
+		hash->e[hash->tail[hash->e[cur].bucket]].next = cur;
+	else
+		hash->head[hash->e[cur].bucket] = cur;
+	hash->tail[hash->e[cur].bucket] = cur;
+}
 
 /*
  * Add a header entry to <list> after element <after>. <after> is ignored when
@@ -26,7 +58,7 @@ struct pool_head *pool2_hdr_idx = NULL;
  * which takes much more time. For this reason, it's important to size is
  * appropriately.
  */
-int hdr_idx_add(int len, int cr, struct hdr_idx *list, int after)
+int hdr_idx_add(int len, int cr, struct hdr_idx *list, int after, const char *line)
 {
 	register struct hdr_idx_elem e = { .len=0, .cr=0, .next=0};
 	int new;
@@ -59,10 +91,102 @@ int hdr_idx_add(int len, int cr, struct hdr_idx *list, int after)
 
 	list->used++;
 	list->v[new] = e;
+
+	if (list->hash && !list->hash->dirty) {
+		if (after != list->tail || !line) {
+			/* inserted in the middle, the order of the buckets
+			 * would not be respected anymore. Without the text we
+			 * cannot hash the name either.
+			 */
+			list->hash->dirty = 1;
+		}
+		else {
+			list->hash->e[new].prev = after;
+			hdr_idx_hash_link(list, new,
+			                  after ? list->hash->e[after].ofs + list->v[after].len + list->v[after].cr + 1
+			                        : hdr_idx_first_pos(list),
+			                  line);
+		}
+	}
+
 	list->tail = new;
 	return new;
 }
 
+/*
+ * Rebuilds the name index of <list> from the message starting at <msg>.
+ */
+void hdr_idx_hash_build(struct hdr_idx *list, const char *msg)
+{
+	struct hdr_hash *hash = list->hash;
+	unsigned int ofs;
+	int cur, prev;
+
+	memset(hash->head, 0, sizeof(hash->head));
+	hash->e[0].bucket = HDR_HASH_NONE;
+
+	ofs = hdr_idx_first_pos(list);
+	for (prev = 0, cur = list->v[0].next; cur; prev = cur, cur = list->v[cur].next) {
+		hash->e[cur].prev = prev;
+		hdr_idx_hash_link(list, cur, ofs, msg + ofs);
+		ofs += list->v[cur].len + list->v[cur].cr + 1;
+	}
+	hash->dirty = 0;
+}
+
+/*
+ * Unlinks element <cur> from the name index, <prev> being the previous element
+ * in the list. It must be called after <cur> was unlinked from the list.
+ */
+void hdr_idx_hash_del(struct hdr_idx *list, int cur, int prev)
+{
+	struct hdr_hash *hash = list->hash;
+	int bucket, p;
+
+	if (!hash || hash->dirty)
+		return;
+
+	if (list->v[prev].next)
+		hash->e[list->v[prev].next].prev = prev;
+
+	bucket = hash->e[cur].bucket;
+	if (bucket == HDR_HASH_NONE)
+		return;
+
+	if (hash->head[bucket] == cur) {
+		hash->head[bucket] = hash->e[cur].next;
+		p = 0;
+	}
+	else {
+		/* buckets are short, finding the previous one is cheap */
+		for (p = hash->head[bucket]; p && hash->e[p].next != cur; p = hash->e[p].next)
+			;
+		if (!p) {
+			hash->dirty = 1;
+			return;
+		}
+		hash->e[p].next = hash->e[cur].next;
+	}
+	if (hash->tail[bucket] == cur)
+		hash->tail[bucket] = p;
+	hash->e[cur].bucket = HDR_HASH_NONE;
+}
+
+/*
+ * Adds <delta> to the position of all elements following <after> in the list.
+ * It must be called when the length of element <after> is changed.
+ */
+void hdr_idx_hash_shift(struct hdr_idx *list, int after, int delta)
+{
+	int cur;
+
+	if (!list->hash || list->hash->dirty || !delta)
+		return;
+
+	for (cur = list->v[after].next; cur; cur = list->v[cur].next)
+		list->hash->e[cur].ofs += delta;
+}
+
 
 /*
  * Local variables:
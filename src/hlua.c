@@ -7389,6 +7389,7 @@ void hlua_init(void)
 	LIST_INIT(&socket_tcp.priv_conns);
 	LIST_INIT(&socket_tcp.idle_conns);
 	LIST_INIT(&socket_tcp.safe_conns);
+	LIST_INIT(&socket_tcp.pool_conns);
 	socket_tcp.state = SRV_ST_RUNNING; /* early server setup */
 	socket_tcp.last_change = 0;
 	socket_tcp.id = "LUA-TCP-CONN";
@@ -7435,6 +7436,7 @@ void hlua_init(void)
 	LIST_INIT(&socket_ssl.priv_conns);
 	LIST_INIT(&socket_ssl.idle_conns);
 	LIST_INIT(&socket_ssl.safe_conns);
+	LIST_INIT(&socket_ssl.pool_conns);
 	socket_ssl.state = SRV_ST_RUNNING; /* early server setup */
 	socket_ssl.last_change = 0;
 	socket_ssl.id = "LUA-SSL-CONN";
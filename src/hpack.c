@@ -0,0 +1,761 @@
+/*
+ * HPACK header compression for HTTP/2 (RFC7541).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The decoder supports the whole specification. Its dynamic table is
+ * allocated at once and never needs any allocation afterwards. The encoder
+ * only emits literals without indexing so that it never needs a dynamic
+ * table, which is permitted by the RFC and keeps the per-connection state
+ * small. Strings are Huffman-encoded when this makes them shorter.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/config.h>
+#include <common/hpack.h>
+
+#include <proto/hdr_idx.h>
+
+/* static table, section A */
+const struct hpack_hdr hpack_sht[HPACK_SHT_SIZE + 1] = {
+#define HPACK_SHE(n, v) { n, v, sizeof(n) - 1, sizeof(v) - 1 }
+	[ 0] = HPACK_SHE("",                            ""),
+	[ 1] = HPACK_SHE(":authority",                  ""),
+	[ 2] = HPACK_SHE(":method",                     "GET"),
+	[ 3] = HPACK_SHE(":method",                     "POST"),
+	[ 4] = HPACK_SHE(":path",                       "/"),
+	[ 5] = HPACK_SHE(":path",                       "/index.html"),
+	[ 6] = HPACK_SHE(":scheme",                     "http"),
+	[ 7] = HPACK_SHE(":scheme",                     "https"),
+	[ 8] = HPACK_SHE(":status",                     "200"),
+	[ 9] = HPACK_SHE(":status",                     "204"),
+	[10] = HPACK_SHE(":status",                     "206"),
+	[11] = HPACK_SHE(":status",                     "304"),
+	[12] = HPACK_SHE(":status",                     "400"),
+	[13] = HPACK_SHE(":status",                     "404"),
+	[14] = HPACK_SHE(":status",                     "500"),
+	[15] = HPACK_SHE("accept-charset",              ""),
+	[16] = HPACK_SHE("accept-encoding",             "gzip, deflate"),
+	[17] = HPACK_SHE("accept-language",             ""),
+	[18] = HPACK_SHE("accept-ranges",               ""),
+	[19] = HPACK_SHE("accept",                      ""),
+	[20] = HPACK_SHE("access-control-allow-origin", ""),
+	[21] = HPACK_SHE("age",                         ""),
+	[22] = HPACK_SHE("allow",                       ""),
+	[23] = HPACK_SHE("authorization",               ""),
+	[24] = HPACK_SHE("cache-control",               ""),
+	[25] = HPACK_SHE("content-disposition",         ""),
+	[26] = HPACK_SHE("content-encoding",            ""),
+	[27] = HPACK_SHE("content-language",            ""),
+	[28] = HPACK_SHE("content-length",              ""),
+	[29] = HPACK_SHE("content-location",            ""),
+	[30] = HPACK_SHE("content-range",               ""),
+	[31] = HPACK_SHE("content-type",                ""),
+	[32] = HPACK_SHE("cookie",                      ""),
+	[33] = HPACK_SHE("date",                        ""),
+	[34] = HPACK_SHE("etag",                        ""),
+	[35] = HPACK_SHE("expect",                      ""),
+	[36] = HPACK_SHE("expires",                     ""),
+	[37] = HPACK_SHE("from",                        ""),
+	[38] = HPACK_SHE("host",                        ""),
+	[39] = HPACK_SHE("if-match",                    ""),
+	[40] = HPACK_SHE("if-modified-since",           ""),
+	[41] = HPACK_SHE("if-none-match",               ""),
+	[42] = HPACK_SHE("if-range",                    ""),
+	[43] = HPACK_SHE("if-unmodified-since",         ""),
+	[44] = HPACK_SHE("last-modified",               ""),
+	[45] = HPACK_SHE("link",                        ""),
+	[46] = HPACK_SHE("location",                    ""),
+	[47] = HPACK_SHE("max-forwards",                ""),
+	[48] = HPACK_SHE("proxy-authenticate",          ""),
+	[49] = HPACK_SHE("proxy-authorization",         ""),
+	[50] = HPACK_SHE("range",                       ""),
+	[51] = HPACK_SHE("referer",                     ""),
+	[52] = HPACK_SHE("refresh",                     ""),
+	[53] = HPACK_SHE("retry-after",                 ""),
+	[54] = HPACK_SHE("server",                      ""),
+	[55] = HPACK_SHE("set-cookie",                  ""),
+	[56] = HPACK_SHE("strict-transport-security",   ""),
+	[57] = HPACK_SHE("transfer-encoding",           ""),
+	[58] = HPACK_SHE("user-agent",                  ""),
+	[59] = HPACK_SHE("vary",                        ""),
+	[60] = HPACK_SHE("via",                         ""),
+	[61] = HPACK_SHE("www-authenticate",            ""),
+#undef HPACK_SHE
+};
+
+/* Huffman code of each symbol, right-aligned on <len> bits (appendix B) */
+static const struct {
+	uint32_t code;
+	uint8_t  len;
+} hpack_huff[257] = {
+	{ 0x00001ff8, 13 }, { 0x007fffd8, 23 }, { 0x0fffffe2, 28 }, { 0x0fffffe3, 28 },
+	{ 0x0fffffe4, 28 }, { 0x0fffffe5, 28 }, { 0x0fffffe6, 28 }, { 0x0fffffe7, 28 },
+	{ 0x0fffffe8, 28 }, { 0x00ffffea, 24 }, { 0x3ffffffc, 30 }, { 0x0fffffe9, 28 },
+	{ 0x0fffffea, 28 }, { 0x3ffffffd, 30 }, { 0x0fffffeb, 28 }, { 0x0fffffec, 28 },
+	{ 0x0fffffed, 28 }, { 0x0fffffee, 28 }, { 0x0fffffef, 28 }, { 0x0ffffff0, 28 },
+	{ 0x0ffffff1, 28 }, { 0x0ffffff2, 28 }, { 0x3ffffffe, 30 }, { 0x0ffffff3, 28 },
+	{ 0x0ffffff4, 28 }, { 0x0ffffff5, 28 }, { 0x0ffffff6, 28 }, { 0x0ffffff7, 28 },
+	{ 0x0ffffff8, 28 }, { 0x0ffffff9, 28 }, { 0x0ffffffa, 28 }, { 0x0ffffffb, 28 },
+	{ 0x00000014,  6 }, { 0x000003f8, 10 }, { 0x000003f9, 10 }, { 0x00000ffa, 12 },
+	{ 0x00001ff9, 13 }, { 0x00000015,  6 }, { 0x000000f8,  8 }, { 0x000007fa, 11 },
+	{ 0x000003fa, 10 }, { 0x000003fb, 10 }, { 0x000000f9,  8 }, { 0x000007fb, 11 },
+	{ 0x000000fa,  8 }, { 0x00000016,  6 }, { 0x00000017,  6 }, { 0x00000018,  6 },
+	{ 0x00000000,  5 }, { 0x00000001,  5 }, { 0x00000002,  5 }, { 0x00000019,  6 },
+	{ 0x0000001a,  6 }, { 0x0000001b,  6 }, { 0x0000001c,  6 }, { 0x0000001d,  6 },
+	{ 0x0000001e,  6 }, { 0x0000001f,  6 }, { 0x0000005c,  7 }, { 0x000000fb,  8 },
+	{ 0x00007ffc, 15 }, { 0x00000020,  6 }, { 0x00000ffb, 12 }, { 0x000003fc, 10 },
+	{ 0x00001ffa, 13 }, { 0x00000021,  6 }, { 0x0000005d,  7 }, { 0x0000005e,  7 },
+	{ 0x0000005f,  7 }, { 0x00000060,  7 }, { 0x00000061,  7 }, { 0x00000062,  7 },
+	{ 0x00000063,  7 }, { 0x00000064,  7 }, { 0x00000065,  7 }, { 0x00000066,  7 },
+	{ 0x00000067,  7 }, { 0x00000068,  7 }, { 0x00000069,  7 }, { 0x0000006a,  7 },
+	{ 0x0000006b,  7 }, { 0x0000006c,  7 }, { 0x0000006d,  7 }, { 0x0000006e,  7 },
+	{ 0x0000006f,  7 }, { 0x00000070,  7 }, { 0x00000071,  7 }, { 0x00000072,  7 },
+	{ 0x000000fc,  8 }, { 0x00000073,  7 }, { 0x000000fd,  8 }, { 0x00001ffb, 13 },
+	{ 0x0007fff0, 19 }, { 0x00001ffc, 13 }, { 0x00003ffc, 14 }, { 0x00000022,  6 },
+	{ 0x00007ffd, 15 }, { 0x00000003,  5 }, { 0x00000023,  6 }, { 0x00000004,  5 },
+	{ 0x00000024,  6 }, { 0x00000005,  5 }, { 0x00000025,  6 }, { 0x00000026,  6 },
+	{ 0x00000027,  6 }, { 0x00000006,  5 }, { 0x00000074,  7 }, { 0x00000075,  7 },
+	{ 0x00000028,  6 }, { 0x00000029,  6 }, { 0x0000002a,  6 }, { 0x00000007,  5 },
+	{ 0x0000002b,  6 }, { 0x00000076,  7 }, { 0x0000002c,  6 }, { 0x00000008,  5 },
+	{ 0x00000009,  5 }, { 0x0000002d,  6 }, { 0x00000077,  7 }, { 0x00000078,  7 },
+	{ 0x00000079,  7 }, { 0x0000007a,  7 }, { 0x0000007b,  7 }, { 0x00007ffe, 15 },
+	{ 0x000007fc, 11 }, { 0x00003ffd, 14 }, { 0x00001ffd, 13 }, { 0x0ffffffc, 28 },
+	{ 0x000fffe6, 20 }, { 0x003fffd2, 22 }, { 0x000fffe7, 20 }, { 0x000fffe8, 20 },
+	{ 0x003fffd3, 22 }, { 0x003fffd4, 22 }, { 0x003fffd5, 22 }, { 0x007fffd9, 23 },
+	{ 0x003fffd6, 22 }, { 0x007fffda, 23 }, { 0x007fffdb, 23 }, { 0x007fffdc, 23 },
+	{ 0x007fffdd, 23 }, { 0x007fffde, 23 }, { 0x00ffffeb, 24 }, { 0x007fffdf, 23 },
+	{ 0x00ffffec, 24 }, { 0x00ffffed, 24 }, { 0x003fffd7, 22 }, { 0x007fffe0, 23 },
+	{ 0x00ffffee, 24 }, { 0x007fffe1, 23 }, { 0x007fffe2, 23 }, { 0x007fffe3, 23 },
+	{ 0x007fffe4, 23 }, { 0x001fffdc, 21 }, { 0x003fffd8, 22 }, { 0x007fffe5, 23 },
+	{ 0x003fffd9, 22 }, { 0x007fffe6, 23 }, { 0x007fffe7, 23 }, { 0x00ffffef, 24 },
+	{ 0x003fffda, 22 }, { 0x001fffdd, 21 }, { 0x000fffe9, 20 }, { 0x003fffdb, 22 },
+	{ 0x003fffdc, 22 }, { 0x007fffe8, 23 }, { 0x007fffe9, 23 }, { 0x001fffde, 21 },
+	{ 0x007fffea, 23 }, { 0x003fffdd, 22 }, { 0x003fffde, 22 }, { 0x00fffff0, 24 },
+	{ 0x001fffdf, 21 }, { 0x003fffdf, 22 }, { 0x007fffeb, 23 }, { 0x007fffec, 23 },
+	{ 0x001fffe0, 21 }, { 0x001fffe1, 21 }, { 0x003fffe0, 22 }, { 0x001fffe2, 21 },
+	{ 0x007fffed, 23 }, { 0x003fffe1, 22 }, { 0x007fffee, 23 }, { 0x007fffef, 23 },
+	{ 0x000fffea, 20 }, { 0x003fffe2, 22 }, { 0x003fffe3, 22 }, { 0x003fffe4, 22 },
+	{ 0x007ffff0, 23 }, { 0x003fffe5, 22 }, { 0x003fffe6, 22 }, { 0x007ffff1, 23 },
+	{ 0x03ffffe0, 26 }, { 0x03ffffe1, 26 }, { 0x000fffeb, 20 }, { 0x0007fff1, 19 },
+	{ 0x003fffe7, 22 }, { 0x007ffff2, 23 }, { 0x003fffe8, 22 }, { 0x01ffffec, 25 },
+	{ 0x03ffffe2, 26 }, { 0x03ffffe3, 26 }, { 0x03ffffe4, 26 }, { 0x07ffffde, 27 },
+	{ 0x07ffffdf, 27 }, { 0x03ffffe5, 26 }, { 0x00fffff1, 24 }, { 0x01ffffed, 25 },
+	{ 0x0007fff2, 19 }, { 0x001fffe3, 21 }, { 0x03ffffe6, 26 }, { 0x07ffffe0, 27 },
+	{ 0x07ffffe1, 27 }, { 0x03ffffe7, 26 }, { 0x07ffffe2, 27 }, { 0x00fffff2, 24 },
+	{ 0x001fffe4, 21 }, { 0x001fffe5, 21 }, { 0x03ffffe8, 26 }, { 0x03ffffe9, 26 },
+	{ 0x0ffffffd, 28 }, { 0x07ffffe3, 27 }, { 0x07ffffe4, 27 }, { 0x07ffffe5, 27 },
+	{ 0x000fffec, 20 }, { 0x00fffff3, 24 }, { 0x000fffed, 20 }, { 0x001fffe6, 21 },
+	{ 0x003fffe9, 22 }, { 0x001fffe7, 21 }, { 0x001fffe8, 21 }, { 0x007ffff3, 23 },
+	{ 0x003fffea, 22 }, { 0x003fffeb, 22 }, { 0x01ffffee, 25 }, { 0x01ffffef, 25 },
+	{ 0x00fffff4, 24 }, { 0x00fffff5, 24 }, { 0x03ffffea, 26 }, { 0x007ffff4, 23 },
+	{ 0x03ffffeb, 26 }, { 0x07ffffe6, 27 }, { 0x03ffffec, 26 }, { 0x03ffffed, 26 },
+	{ 0x07ffffe7, 27 }, { 0x07ffffe8, 27 }, { 0x07ffffe9, 27 }, { 0x07ffffea, 27 },
+	{ 0x07ffffeb, 27 }, { 0x0ffffffe, 28 }, { 0x07ffffec, 27 }, { 0x07ffffed, 27 },
+	{ 0x07ffffee, 27 }, { 0x07ffffef, 27 }, { 0x07fffff0, 27 }, { 0x03ffffee, 26 },
+	{ 0x3fffffff, 30 },
+};
+
+/* The Huffman decoder is a finite state machine consuming 4 bits at a time.
+ * Each state is an internal node of the code tree, the root being state 0.
+ * The transition for a state and a nibble gives the next state and possibly
+ * a decoded symbol, since no code is shorter than 5 bits, at most one symbol
+ * may be completed per nibble. The table is built from <hpack_huff> on first
+ * use.
+ */
+#define HUFF_F_SYM     0x01  /* a symbol was decoded */
+#define HUFF_F_ACCEPT  0x02  /* the next state may end the string */
+#define HUFF_F_FAIL    0x04  /* EOS was decoded */
+
+struct huff_trans {
+	uint8_t state;
+	uint8_t flags;
+	uint8_t sym;
+};
+
+static struct huff_trans huff_fsm[256][16];
+static int huff_ready;
+
+static void hpack_huff_init(void)
+{
+	/* code tree : child[node][bit] >= 0 designates an internal node,
+	 * otherwise it is -1 - symbol.
+	 */
+	static int16_t child[256][2];
+	uint8_t depth[256], ones[256];
+	int nodes = 1;
+	int sym, bit, node, i, n, b;
+	struct huff_trans *t;
+
+	memset(child, 0, sizeof(child));
+	depth[0] = 0;
+	ones[0] = 1;
+
+	for (sym = 0; sym < 257; sym++) {
+		node = 0;
+		for (bit = hpack_huff[sym].len - 1; bit >= 0; bit--) {
+			b = (hpack_huff[sym].code >> bit) & 1;
+			if (!bit) {
+				child[node][b] = -1 - sym;
+				break;
+			}
+			if (!child[node][b]) {
+				child[node][b] = nodes;
+				depth[nodes] = depth[node] + 1;
+				ones[nodes] = ones[node] && b;
+				nodes++;
+			}
+			node = child[node][b];
+		}
+	}
+
+	for (i = 0; i < 256; i++) {
+		for (n = 0; n < 16; n++) {
+			t = &huff_fsm[i][n];
+			t->flags = 0;
+			node = i;
+			for (bit = 3; bit >= 0; bit--) {
+				node = child[node][(n >> bit) & 1];
+				if (node < 0) {
+					if (node == -1 - 256)
+						t->flags |= HUFF_F_FAIL;
+					t->flags |= HUFF_F_SYM;
+					t->sym = -1 - node;
+					node = 0;
+				}
+			}
+			t->state = node;
+			/* only a prefix of EOS shorter than 8 bits may pad
+			 * the end of the string (section 5.2).
+			 */
+			if (ones[node] && depth[node] <= 7)
+				t->flags |= HUFF_F_ACCEPT;
+		}
+	}
+	huff_ready = 1;
+}
+
+/* Decodes the <ilen> Huffman-encoded bytes at <in> into <out> which has room
+ * for <olen> bytes. Returns the output length, or a negative error code.
+ */
+static int hpack_huff_dec(const unsigned char *in, int ilen, char *out, int olen)
+{
+	const struct huff_trans *t;
+	int state = 0, accept = HUFF_F_ACCEPT, o = 0;
+
+	if (!huff_ready)
+		hpack_huff_init();
+
+	while (ilen--) {
+		t = &huff_fsm[state][*in >> 4];
+		if (t->flags & (HUFF_F_SYM | HUFF_F_FAIL)) {
+			if (t->flags & HUFF_F_FAIL)
+				return HPACK_ERR_HUFFMAN;
+			if (o >= olen)
+				return HPACK_ERR_TOO_LARGE;
+			out[o++] = t->sym;
+		}
+
+		t = &huff_fsm[t->state][*in & 0xf];
+		if (t->flags & (HUFF_F_SYM | HUFF_F_FAIL)) {
+			if (t->flags & HUFF_F_FAIL)
+				return HPACK_ERR_HUFFMAN;
+			if (o >= olen)
+				return HPACK_ERR_TOO_LARGE;
+			out[o++] = t->sym;
+		}
+		state = t->state;
+		accept = t->flags & HUFF_F_ACCEPT;
+		in++;
+	}
+
+	if (!accept)
+		return HPACK_ERR_HUFFMAN;
+	return o;
+}
+
+/* Allocates a dynamic table able to store <size> bytes as counted by the RFC.
+ * Returns NULL on memory shortage.
+ */
+struct hpack_dht *hpack_dht_alloc(uint32_t size)
+{
+	struct hpack_dht *dht;
+	uint32_t slots = size / HPACK_DHT_ENTRY_OVERHEAD + 1;
+
+	if (slots > 65535)
+		return NULL;
+
+	/* the area is doubled so that it can be compacted from one half to
+	 * the other one.
+	 */
+	dht = calloc(1, sizeof(*dht) + slots * sizeof(*dht->dte) + 2 * size);
+	if (!dht)
+		return NULL;
+
+	dht->size = dht->max = size;
+	dht->nb_slots = slots;
+	dht->dte = (struct hpack_dte *)(dht + 1);
+	dht->area = (char *)(dht->dte + slots);
+	return dht;
+}
+
+void hpack_dht_free(struct hpack_dht *dht)
+{
+	free(dht);
+}
+
+/* Returns the slot of dynamic entry <idx>, 1 being the most recent one. 0
+ * designates the slot following the most recent one.
+ */
+static inline unsigned int hpack_dht_slot(const struct hpack_dht *dht, unsigned int idx)
+{
+	int slot = (int)dht->head - (int)idx + 1;
+
+	if (slot < 0)
+		slot += dht->nb_slots;
+	else if (slot >= dht->nb_slots)
+		slot -= dht->nb_slots;
+	return slot;
+}
+
+/* evicts the oldest entry */
+static void hpack_dht_evict(struct hpack_dht *dht)
+{
+	struct hpack_dte *dte = &dht->dte[hpack_dht_slot(dht, dht->used)];
+
+	dht->total -= dte->nl + dte->vl + HPACK_DHT_ENTRY_OVERHEAD;
+	dht->used--;
+	if (!dht->used)
+		dht->front = 0;
+}
+
+/* Moves all strings to the beginning of the other half of the area, oldest
+ * first, so that all the free space is contiguous at the end.
+ */
+static void hpack_dht_compact(struct hpack_dht *dht)
+{
+	char *from = dht->area;
+	char *to = (dht->area == (char *)(dht->dte + dht->nb_slots)) ? from + dht->size : from - dht->size;
+	struct hpack_dte *dte;
+	uint32_t ofs = 0;
+	int idx;
+
+	for (idx = dht->used; idx > 0; idx--) {
+		dte = &dht->dte[hpack_dht_slot(dht, idx)];
+		memcpy(to + ofs, from + dte->ofs, dte->nl + dte->vl);
+		dte->ofs = ofs;
+		ofs += dte->nl + dte->vl;
+	}
+	dht->area = to;
+	dht->front = ofs;
+}
+
+/* Sets the max size of the table and evicts entries accordingly. Returns 0 on
+ * success or a negative error code if <max> is larger than the table.
+ */
+static int hpack_dht_set_max(struct hpack_dht *dht, uint32_t max)
+{
+	if (max > dht->size)
+		return HPACK_ERR_TBL_SIZE;
+
+	dht->max = max;
+	while (dht->used && dht->total > dht->max)
+		hpack_dht_evict(dht);
+	return 0;
+}
+
+/* Inserts header <n>:<v> as the newest entry, after evicting the oldest ones
+ * as needed. Entries larger than the table just empty it (section 4.4).
+ */
+static void hpack_dht_insert(struct hpack_dht *dht, const char *n, uint32_t nl, const char *v, uint32_t vl)
+{
+	uint32_t need = nl + vl + HPACK_DHT_ENTRY_OVERHEAD;
+	struct hpack_dte *dte;
+
+	while (dht->used && dht->total + need > dht->max)
+		hpack_dht_evict(dht);
+
+	if (need > dht->max)
+		return;
+
+	if (dht->size - dht->front < nl + vl)
+		hpack_dht_compact(dht);
+
+	dht->head = dht->used ? hpack_dht_slot(dht, 0) : 0;
+	dht->used++;
+	dht->total += need;
+
+	dte = &dht->dte[dht->head];
+	dte->ofs = dht->front;
+	dte->nl = nl;
+	dte->vl = vl;
+	memcpy(dht->area + dte->ofs, n, nl);
+	memcpy(dht->area + dte->ofs + nl, v, vl);
+	dht->front += nl + vl;
+}
+
+/* Decodes an integer whose prefix is made of the <bits> lower bits of the
+ * byte at *<raw>. <raw> and <len> are updated. Returns the value, or a
+ * negative error code.
+ */
+static int hpack_decode_int(const unsigned char **raw, int *len, int bits)
+{
+	const unsigned char *p = *raw;
+	int mask = (1 << bits) - 1;
+	int shift = 0;
+	int val;
+
+	if (*len < 1)
+		return HPACK_ERR_TRUNCATED;
+
+	val = *p++ & mask;
+	(*len)--;
+	if (val == mask) {
+		do {
+			if (*len < 1)
+				return HPACK_ERR_TRUNCATED;
+			if (shift > 21)
+				return HPACK_ERR_BAD_INT;
+			val += (*p & 0x7f) << shift;
+			shift += 7;
+			(*len)--;
+		} while (*p++ & 0x80);
+	}
+	*raw = p;
+	return val;
+}
+
+/* Copies <len> bytes from <str> to the end of <tmp>. Returns the copy, or
+ * NULL if there is not enough room.
+ */
+static const char *hpack_store(struct chunk *tmp, const char *str, int len)
+{
+	char *ret = tmp->str + tmp->len;
+
+	if (len > tmp->size - tmp->len)
+		return NULL;
+	memcpy(ret, str, len);
+	tmp->len += len;
+	return ret;
+}
+
+/* Decodes a string literal. Raw strings are referenced in place, Huffman
+ * encoded ones are decoded into <tmp>. Returns 0 on success or a negative
+ * error code.
+ */
+static int hpack_decode_str(const unsigned char **raw, int *len, struct chunk *tmp,
+                            const char **str, unsigned int *slen)
+{
+	int huff = **raw & 0x80;
+	int l, ret;
+
+	if (*len < 1)
+		return HPACK_ERR_TRUNCATED;
+
+	l = hpack_decode_int(raw, len, 7);
+	if (l < 0)
+		return l;
+	if (l > *len)
+		return HPACK_ERR_TRUNCATED;
+
+	if (huff) {
+		ret = hpack_huff_dec(*raw, l, tmp->str + tmp->len, tmp->size - tmp->len);
+		if (ret < 0)
+			return ret;
+		*str = tmp->str + tmp->len;
+		*slen = ret;
+		tmp->len += ret;
+	}
+	else {
+		*str = (const char *)*raw;
+		*slen = l;
+	}
+	*raw += l;
+	*len -= l;
+	return 0;
+}
+
+/* Looks up header <idx> in the static then the dynamic tables. Dynamic
+ * entries are copied into <tmp> since they may be evicted by the next
+ * insertions. Returns 0 on success or a negative error code.
+ */
+static int hpack_lookup(struct hpack_dht *dht, int idx, int name_only, struct chunk *tmp,
+                        struct hpack_hdr *hdr)
+{
+	const struct hpack_dte *dte;
+
+	if (idx <= 0)
+		return HPACK_ERR_BAD_IDX;
+
+	if (idx <= HPACK_SHT_SIZE) {
+		*hdr = hpack_sht[idx];
+		return 0;
+	}
+
+	idx -= HPACK_SHT_SIZE;
+	if (idx > dht->used)
+		return HPACK_ERR_BAD_IDX;
+
+	dte = &dht->dte[hpack_dht_slot(dht, idx)];
+	hdr->nl = dte->nl;
+	hdr->n = hpack_store(tmp, dht->area + dte->ofs, dte->nl);
+	hdr->vl = 0;
+	hdr->v = "";
+	if (!name_only) {
+		hdr->vl = dte->vl;
+		hdr->v = hpack_store(tmp, dht->area + dte->ofs + dte->nl, dte->vl);
+	}
+	if (!hdr->n || !hdr->v)
+		return HPACK_ERR_TOO_LARGE;
+	return 0;
+}
+
+/* Decodes header block <raw> of <len> bytes using dynamic table <dht>, and
+ * stores at most <max> headers into <list>. Names and values point either to
+ * <raw>, to the static table, or into <tmp> which is used to store decoded
+ * strings. They are thus valid as long as <raw> and <tmp> are. Returns the
+ * number of headers, or a negative error code, in which case the dynamic
+ * table is not usable anymore and the connection must be closed.
+ */
+int hpack_decode_frame(struct hpack_dht *dht, const unsigned char *raw, int len,
+                       struct hpack_hdr *list, int max, struct chunk *tmp)
+{
+	struct hpack_hdr *hdr;
+	int count = 0;
+	int idx, ret;
+	unsigned char c;
+
+	while (len > 0) {
+		c = *raw;
+
+		if ((c & 0xe0) == 0x20) {
+			/* 001xxxxx: dynamic table size update */
+			idx = hpack_decode_int(&raw, &len, 5);
+			if (idx < 0)
+				return idx;
+			ret = hpack_dht_set_max(dht, idx);
+			if (ret < 0)
+				return ret;
+			continue;
+		}
+
+		if (count >= max)
+			return HPACK_ERR_TOO_LARGE;
+		hdr = &list[count];
+
+		if (c & 0x80) {
+			/* 1xxxxxxx: indexed header field */
+			idx = hpack_decode_int(&raw, &len, 7);
+			if (idx < 0)
+				return idx;
+			ret = hpack_lookup(dht, idx, 0, tmp, hdr);
+			if (ret < 0)
+				return ret;
+			count++;
+			continue;
+		}
+
+		/* literals: 01xxxxxx with incremental indexing, 0000xxxx
+		 * without indexing, 0001xxxx never indexed.
+		 */
+		idx = hpack_decode_int(&raw, &len, (c & 0x40) ? 6 : 4);
+		if (idx < 0)
+			return idx;
+
+		if (idx) {
+			ret = hpack_lookup(dht, idx, 1, tmp, hdr);
+			if (ret < 0)
+				return ret;
+		}
+		else {
+			ret = hpack_decode_str(&raw, &len, tmp, &hdr->n, &hdr->nl);
+			if (ret < 0)
+				return ret;
+		}
+
+		ret = hpack_decode_str(&raw, &len, tmp, &hdr->v, &hdr->vl);
+		if (ret < 0)
+			return ret;
+
+		if (c & 0x40)
+			hpack_dht_insert(dht, hdr->n, hdr->nl, hdr->v, hdr->vl);
+		count++;
+	}
+	return count;
+}
+
+/* Appends the regular header fields of <list> to <out> as HTTP/1 header
+ * lines, pseudo-headers being skipped, and indexes each of them into <idx>
+ * after its current tail if <idx> is not NULL. The index then describes the
+ * lines exactly as the HTTP parser would have, so that the message does not
+ * need to be parsed again to be processed. <idx> must already reference the
+ * start line, and <out> must contain the message from its beginning for the
+ * name index to be updated. Returns the number of lines appended, or a
+ * negative error code if <out> or <idx> is full.
+ */
+int hpack_hdrs_to_h1(const struct hpack_hdr *list, int nb, struct chunk *out, struct hdr_idx *idx)
+{
+	const struct hpack_hdr *hdr;
+	char *line;
+	int i, lines = 0;
+
+	for (i = 0; i < nb; i++) {
+		hdr = &list[i];
+		if (hdr->nl && hdr->n[0] == ':')
+			continue;
+
+		if (out->len + hdr->nl + hdr->vl + 4 > out->size)
+			return HPACK_ERR_TOO_LARGE;
+
+		line = out->str + out->len;
+		memcpy(line, hdr->n, hdr->nl);
+		line[hdr->nl] = ':';
+		line[hdr->nl + 1] = ' ';
+		memcpy(line + hdr->nl + 2, hdr->v, hdr->vl);
+		line[hdr->nl + 2 + hdr->vl] = '\r';
+		line[hdr->nl + 3 + hdr->vl] = '\n';
+
+		if (idx && hdr_idx_add(hdr->nl + 2 + hdr->vl, 1, idx, idx->tail, line) < 0)
+			return HPACK_ERR_TOO_LARGE;
+
+		out->len += hdr->nl + hdr->vl + 4;
+		lines++;
+	}
+	return lines;
+}
+
+/* Appends integer <val> to <out> using a prefix of <bits> bits, the upper bits
+ * of the first byte being <fb>. Returns 1 on success, 0 if <out> is full.
+ */
+static int hpack_encode_int(struct chunk *out, unsigned char fb, int bits, unsigned int val)
+{
+	unsigned int mask = (1 << bits) - 1;
+
+	if (out->len >= out->size)
+		return 0;
+
+	if (val < mask) {
+		out->str[out->len++] = fb | val;
+		return 1;
+	}
+
+	out->str[out->len++] = fb | mask;
+	val -= mask;
+	while (val >= 0x80) {
+		if (out->len >= out->size)
+			return 0;
+		out->str[out->len++] = 0x80 | (val & 0x7f);
+		val >>= 7;
+	}
+	if (out->len >= out->size)
+		return 0;
+	out->str[out->len++] = val;
+	return 1;
+}
+
+/* Appends string literal <str> to <out>, Huffman-encoded if this makes it
+ * shorter. Returns 1 on success, 0 if <out> is full.
+ */
+static int hpack_encode_str(struct chunk *out, const char *str, int len)
+{
+	const unsigned char *p = (const unsigned char *)str;
+	uint64_t acc = 0;
+	int bits = 0;
+	int hlen, i;
+
+	for (i = 0; i < len; i++)
+		bits += hpack_huff[p[i]].len;
+	hlen = (bits + 7) / 8;
+
+	if (hlen >= len) {
+		if (!hpack_encode_int(out, 0x00, 7, len))
+			return 0;
+		if (len > out->size - out->len)
+			return 0;
+		memcpy(out->str + out->len, str, len);
+		out->len += len;
+		return 1;
+	}
+
+	if (!hpack_encode_int(out, 0x80, 7, hlen))
+		return 0;
+	if (hlen > out->size - out->len)
+		return 0;
+
+	/* <acc> never holds more than 7 pending bits plus one code */
+	bits = 0;
+	for (i = 0; i < len; i++) {
+		acc = (acc << hpack_huff[p[i]].len) | hpack_huff[p[i]].code;
+		bits += hpack_huff[p[i]].len;
+		while (bits >= 8) {
+			bits -= 8;
+			out->str[out->len++] = acc >> bits;
+		}
+	}
+	/* pad with the most significant bits of EOS */
+	if (bits)
+		out->str[out->len++] = (acc << (8 - bits)) | ((1 << (8 - bits)) - 1);
+	return 1;
+}
+
+/* Appends header <n>:<v> to <out> as a literal without indexing, using the
+ * static table for the name when possible. <n> must be in lower case. Returns
+ * 1 on success, or 0 if <out> is full, in which case its contents are
+ * undefined.
+ */
+int hpack_encode_header(struct chunk *out, const char *n, int nl, const char *v, int vl)
+{
+	int idx;
+
+	for (idx = 1; idx <= HPACK_SHT_SIZE; idx++) {
+		if (hpack_sht[idx].nl == nl && memcmp(hpack_sht[idx].n, n, nl) == 0)
+			break;
+	}
+
+	if (idx <= HPACK_SHT_SIZE) {
+		if (!hpack_encode_int(out, 0x00, 4, idx))
+			return 0;
+	}
+	else {
+		if (!hpack_encode_int(out, 0x00, 4, 0) || !hpack_encode_str(out, n, nl))
+			return 0;
+	}
+	return hpack_encode_str(out, v, vl);
+}
+
+/* Appends the ":status" pseudo-header for status <status> to <out>. Returns
+ * 1 on success, or 0 if <out> is full.
+ */
+int hpack_encode_status(struct chunk *out, int status)
+{
+	char buf[3];
+
+	switch (status) {
+	case 200: return hpack_encode_int(out, 0x80, 7, 8);
+	case 204: return hpack_encode_int(out, 0x80, 7, 9);
+	case 206: return hpack_encode_int(out, 0x80, 7, 10);
+	case 304: return hpack_encode_int(out, 0x80, 7, 11);
+	case 400: return hpack_encode_int(out, 0x80, 7, 12);
+	case 404: return hpack_encode_int(out, 0x80, 7, 13);
+	case 500: return hpack_encode_int(out, 0x80, 7, 14);
+	}
+
+	if (status < 100 || status > 999)
+		status = 500;
+	buf[0] = '0' + status / 100;
+	buf[1] = '0' + status / 10 % 10;
+	buf[2] = '0' + status % 10;
+	return hpack_encode_int(out, 0x00, 4, 8) && hpack_encode_str(out, buf, 3);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
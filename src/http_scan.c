@@ -0,0 +1,293 @@
+/*
+ * Vectorized scanning primitives for the HTTP/1 parser
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The HTTP/1 parser spends most of its time looking for the end of header
+ * names and for the CR/LF ending header values. These functions locate them
+ * 16 or 32 bytes at a time using SSE4.2 or AVX2, the implementation being
+ * picked at boot depending on what the CPU supports. The code is built for
+ * these targets using function attributes so that the rest of the binary
+ * remains compatible with any x86-64 CPU.
+ */
+
+#include <string.h>
+
+#include <common/compiler.h>
+#include <common/config.h>
+#include <common/http_scan.h>
+
+#if defined(__x86_64__) && !defined(__VMS) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 5)))
+#define HTTP_SCAN_X86
+#include <immintrin.h>
+#endif
+
+/* Generic version : it's the word-based algorithm the parser always used for
+ * header values, and names are left to the FSM.
+ */
+static const char *http_scan_name_end_generic(const char *p, const char *e)
+{
+	return p;
+}
+
+static const char *http_scan_crlf_generic(const char *p, const char *e)
+{
+	/* speedup: we'll skip packs of 4 or 8 bytes not containing bytes 0x0D
+	 * and lower. In fact since most of the time is spent in the loop, we
+	 * also remove the sign bit test so that bytes 0x8e..0x0d break the
+	 * loop, but we don't care since they're very rare in header values.
+	 */
+#if defined(__x86_64__) && !defined(__VMS)
+	while (p <= e - sizeof(long)) {
+		if ((*(long *)p - 0x0e0e0e0e0e0e0e0eULL) & 0x8080808080808080ULL)
+			return p;
+		p += sizeof(long);
+	}
+#endif
+#if (defined(__x86_64__) || \
+    defined(__i386__) || defined(__i486__) || defined(__i586__) || defined(__i686__) || \
+    defined(__ARM_ARCH_7A__)) && !defined(__VMS)
+	while (p <= e - sizeof(int)) {
+		if ((*(int*)p - 0x0e0e0e0e) & 0x80808080)
+			return p;
+		p += sizeof(int);
+	}
+#endif
+	return p;
+}
+
+static int http_scan_supported_generic(void)
+{
+	return 1;
+}
+
+#ifdef HTTP_SCAN_X86
+
+/* SSE4.2 : header names are checked against 4 character ranges using a single
+ * PCMPESTRI instruction (explicit lengths, since NUL bytes may be present and
+ * must stop the scan). The CR/LF search only needs SSE2.
+ */
+__attribute__((target("sse4.2")))
+static const char *http_scan_name_end_sse42(const char *p, const char *e)
+{
+	const __m128i ranges = _mm_setr_epi8('a', 'z', 'A', 'Z', '0', '9', '-', '-',
+	                                     0, 0, 0, 0, 0, 0, 0, 0);
+	int pos;
+
+	while (e - p >= 16) {
+		pos = _mm_cmpestri(ranges, 8, _mm_loadu_si128((const __m128i *)p), 16,
+		                   _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+		                   _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+		p += pos;
+		if (pos < 16)
+			break;
+	}
+	return p;
+}
+
+__attribute__((target("sse4.2")))
+static const char *http_scan_crlf_sse42(const char *p, const char *e)
+{
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	__m128i v;
+	unsigned int mask;
+
+	while (e - p >= 16) {
+		v = _mm_loadu_si128((const __m128i *)p);
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+	return p;
+}
+
+static int http_scan_supported_sse42(void)
+{
+	return __builtin_cpu_supports("sse4.2");
+}
+
+/* AVX2 : there is no 256-bit version of PCMPESTRI, so the name ranges are
+ * checked with unsigned comparisons : <x> is in [lo..hi] when min(x - lo,
+ * hi - lo) == x - lo. Letters are folded to lower case first. This is only
+ * done for the letters range since folding would make some control chars
+ * look like digits or dashes.
+ */
+__attribute__((target("avx2")))
+static inline __m256i http_scan_in_range_avx2(__m256i v, char lo, char hi)
+{
+	__m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+
+	return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(hi - lo)), t);
+}
+
+__attribute__((target("avx2")))
+static const char *http_scan_name_end_avx2(const char *p, const char *e)
+{
+	__m256i v, ok;
+	unsigned int mask;
+
+	while (e - p >= 32) {
+		v = _mm256_loadu_si256((const __m256i *)p);
+		ok = http_scan_in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+		ok = _mm256_or_si256(ok, http_scan_in_range_avx2(v, '0', '9'));
+		ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+		mask = ~(unsigned int)_mm256_movemask_epi8(ok);
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 32;
+	}
+	return p;
+}
+
+__attribute__((target("avx2")))
+static const char *http_scan_crlf_avx2(const char *p, const char *e)
+{
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	__m256i v;
+	unsigned int mask;
+
+	while (e - p >= 32) {
+		v = _mm256_loadu_si256((const __m256i *)p);
+		mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+		                                            _mm256_cmpeq_epi8(v, lf)));
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 32;
+	}
+	/* finish with the 16-byte version, values are often short */
+	return http_scan_crlf_sse42(p, e);
+}
+
+static int http_scan_supported_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif /* HTTP_SCAN_X86 */
+
+/* Known implementations, by order of preference */
+const struct http_scan_impl http_scan_impls[] = {
+#ifdef HTTP_SCAN_X86
+	{ "avx2",    http_scan_name_end_avx2,    http_scan_crlf_avx2,    http_scan_supported_avx2    },
+	{ "sse4.2",  http_scan_name_end_sse42,   http_scan_crlf_sse42,   http_scan_supported_sse42   },
+#endif
+	{ "generic", http_scan_name_end_generic, http_scan_crlf_generic, http_scan_supported_generic },
+	{ NULL, NULL, NULL, NULL }
+};
+
+/* Starts with the generic one so that the parser works even before the
+ * selection is made (or if it is never made, eg on VMS).
+ */
+struct http_scan_impl http_scan = {
+	"generic", http_scan_name_end_generic, http_scan_crlf_generic, http_scan_supported_generic
+};
+
+/* Selects implementation <name>, or the best supported one if <name> is NULL.
+ * Returns 0 on success or -1 if it does not exist or is not supported.
+ */
+int http_scan_select(const char *name)
+{
+	const struct http_scan_impl *impl;
+
+#ifdef HTTP_SCAN_X86
+	__builtin_cpu_init();
+#endif
+	for (impl = http_scan_impls; impl->name; impl++) {
+		if (name && strcmp(name, impl->name) != 0)
+			continue;
+		if (!impl->supported())
+			continue;
+		http_scan = *impl;
+		return 0;
+	}
+	return -1;
+}
+
+/* Hex digit values, -1 for other characters */
+const signed char http_scan_hex[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/* Skips as many complete chunks as possible from a chunked body located in
+ * the contiguous area <p>..<e>. <p> points to the data of a chunk of which
+ * <*len> bytes remain (possibly none). Each iteration consumes these bytes,
+ * the CRLF after them and the next chunk size line, then sets <*len> to the
+ * new chunk size and adds it to <*body>. It stops at the first sequence which
+ * is incomplete or not in the most common form (bare LF, spaces or extension
+ * after the size, invalid or too large size) and leaves it to the FSM, which
+ * also reports errors. It also stops right after the last chunk (size zero),
+ * which the caller detects by <*len> being zero on a pointer which moved.
+ * Returns the position of the data of the chunk reported in <*len>.
+ */
+const char *http_scan_chunks(const char *p, const char *e,
+                             unsigned long long *len, unsigned long long *body)
+{
+	const unsigned char *q, *r;
+	unsigned long long chunk = *len;
+	unsigned int size;
+	int c;
+
+	while (chunk < (unsigned long long)(e - p)) {
+		/* <data> CR LF 1*HEXDIG CR LF */
+		q = (const unsigned char *)p + chunk;
+		if (q[0] != '\r' || e - (const char *)q < 5 || q[1] != '\n')
+			break;
+		q += 2;
+		r = q;
+		size = 0;
+		while ((const char *)r < e && (c = http_scan_hex[*r]) >= 0) {
+			if (size & 0xF8000000)
+				goto out;
+			size = (size << 4) + c;
+			r++;
+		}
+		if (r == q || e - (const char *)r < 2 || r[0] != '\r' || r[1] != '\n')
+			break;
+
+		p = (const char *)r + 2;
+		chunk = size;
+		*len = size;
+		*body += size;
+		if (!size)
+			break;
+	}
+ out:
+	return p;
+}
+
+#ifndef __VMS
+__attribute__((constructor))
+static void __http_scan_init(void)
+{
+	http_scan_select(NULL);
+}
+#endif
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,574 @@
+/*
+ * Compact longest-prefix-match table for large sets of IPv4 or IPv6 networks
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Once sorted, a set of possibly nested networks splits the address space
+ * into ranges whose longest match is the same network, and there are at most
+ * twice as many ranges as networks. The table stores the lower bound of each
+ * range in a flat array, and a lookup is a search for the last bound lower
+ * than or equal to the address. The search goes down a static tree of blocks
+ * of IPT_FANOUT bounds, each block being compared at once with a branchless
+ * loop which the compiler can vectorize, so that a lookup in millions of
+ * networks touches only a few cache lines, instead of chasing tens of nodes.
+ *
+ * Such a table cannot be updated in place. Networks added at run time go to a
+ * small prefix tree which is looked up as well, while deleted ones are only
+ * marked, a lookup falling back to the closest network covering them. Both
+ * are merged into the table once they represent a significant part of it, so
+ * that the cost of rebuilding is amortized over the updates.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <common/compiler.h>
+#include <common/iptable.h>
+
+/* the table being sorted by ipt_cmp(), qsort() having no context argument */
+static const struct ipt *ipt_sorting;
+
+/* the stack of the networks covering the current position during a build */
+struct ipt_cover {
+	unsigned int idx;
+	struct ipt_key6 last;   /* last address of the network */
+};
+
+static inline uint32_t ipt_read32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+static inline uint64_t ipt_read64(const unsigned char *p)
+{
+	return ((uint64_t)ipt_read32(p) << 32) | ipt_read32(p + 4);
+}
+
+/* returns the address at <p> in host order, IPv4 ones being in <lo> */
+static inline struct ipt_key6 ipt_get(const struct ipt *t, const unsigned char *p)
+{
+	struct ipt_key6 k;
+
+	if (t->klen == 4) {
+		k.hi = 0;
+		k.lo = ipt_read32(p);
+	}
+	else {
+		k.hi = ipt_read64(p);
+		k.lo = ipt_read64(p + 8);
+	}
+	return k;
+}
+
+static inline int ipt_lt(struct ipt_key6 a, struct ipt_key6 b)
+{
+	return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+/* returns the last address of network <k>/<len> */
+static inline struct ipt_key6 ipt_last(const struct ipt *t, struct ipt_key6 k, unsigned int len)
+{
+	unsigned int bits = t->klen * 8 - len;
+
+	if (bits >= 64) {
+		k.lo = ~0ULL;
+		if (bits > 64)
+			k.hi |= ~0ULL >> (128 - bits);
+	}
+	else if (bits)
+		k.lo |= ~0ULL >> (64 - bits);
+	return k;
+}
+
+/* sets <k> to the next address, returns 0 if <k> was the last one */
+static inline int ipt_inc(const struct ipt *t, struct ipt_key6 *k)
+{
+	if (t->klen == 4) {
+		if (k->lo == 0xffffffff)
+			return 0;
+		k->lo++;
+		return 1;
+	}
+	if (++k->lo)
+		return 1;
+	return ++k->hi != 0;
+}
+
+/* clears the bits of <key> beyond the first <len> ones */
+static void ipt_mask(unsigned char *key, unsigned int klen, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < klen; i++, len = len > 8 ? len - 8 : 0)
+		if (len < 8)
+			key[i] &= 0xff00 >> len;
+}
+
+/* number of keys of block <k> of <n> keys lower than or equal to <x> */
+static inline unsigned int ipt_rank4(const uint32_t *k, unsigned int n, uint32_t x)
+{
+	unsigned int i, c = 0;
+
+	if (n == IPT_FANOUT) {
+		for (i = 0; i < IPT_FANOUT; i++)
+			c += k[i] <= x;
+		return c;
+	}
+	for (i = 0; i < n; i++)
+		c += k[i] <= x;
+	return c;
+}
+
+static inline unsigned int ipt_rank6(const struct ipt_key6 *k, unsigned int n, struct ipt_key6 x)
+{
+	unsigned int i, c = 0;
+
+	if (n == IPT_FANOUT) {
+		for (i = 0; i < IPT_FANOUT; i++)
+			c += (k[i].hi < x.hi) | ((k[i].hi == x.hi) & (k[i].lo <= x.lo));
+		return c;
+	}
+	for (i = 0; i < n; i++)
+		c += (k[i].hi < x.hi) | ((k[i].hi == x.hi) & (k[i].lo <= x.lo));
+	return c;
+}
+
+/* Each level gives the block to look into at the level below. The first bound
+ * being the lowest address, the rank is never zero.
+ */
+unsigned int ipt_index_lookup(const struct ipt_index *ix, const void *addr)
+{
+	struct ipt_key6 x6;
+	uint32_t x4;
+	unsigned int lvl = ix->nb_lvl;
+	unsigned int b = 0, n;
+
+	if (!lvl)
+		return IPT_NONE;
+
+	if (ix->klen == 4) {
+		x4 = ipt_read32(addr);
+		while (lvl--) {
+			n = ix->lvl_nb[lvl] - b * IPT_FANOUT;
+			if (n > IPT_FANOUT)
+				n = IPT_FANOUT;
+			b = b * IPT_FANOUT + ipt_rank4(ix->k4 + ix->lvl_off[lvl] + b * IPT_FANOUT, n, x4) - 1;
+		}
+	}
+	else {
+		x6.hi = ipt_read64(addr);
+		x6.lo = ipt_read64((const unsigned char *)addr + 8);
+		while (lvl--) {
+			n = ix->lvl_nb[lvl] - b * IPT_FANOUT;
+			if (n > IPT_FANOUT)
+				n = IPT_FANOUT;
+			b = b * IPT_FANOUT + ipt_rank6(ix->k6 + ix->lvl_off[lvl] + b * IPT_FANOUT, n, x6) - 1;
+		}
+	}
+	return ix->bval[b];
+}
+
+/* Orders entries by address then by length. The same network added several
+ * times ranks by increasing priority, the earliest added one being the last.
+ * Entries of the base are already in this order, and were all added before
+ * the others, which were appended in the order they were added.
+ */
+static int ipt_cmp(const void *a, const void *b)
+{
+	const struct ipt *t = ipt_sorting;
+	unsigned int ia = *(const unsigned int *)a;
+	unsigned int ib = *(const unsigned int *)b;
+	int ret;
+
+	ret = memcmp(t->keys + ia * t->klen, t->keys + ib * t->klen, t->klen);
+	if (ret)
+		return ret;
+	if (t->entries[ia].len != t->entries[ib].len)
+		return t->entries[ia].len < t->entries[ib].len ? -1 : 1;
+	if ((ia < t->nb_base) != (ib < t->nb_base))
+		return ia < t->nb_base ? 1 : -1;
+	if (ia < t->nb_base)
+		return ia < ib ? -1 : 1;
+	return ia < ib ? 1 : -1;
+}
+
+/* compares the network of entry <i> with <key>/<len> in the same order */
+static inline int ipt_cmp_net(const struct ipt *t, unsigned int i, const unsigned char *key, unsigned int len)
+{
+	int ret;
+
+	ret = memcmp(t->keys + i * t->klen, key, t->klen);
+	if (ret)
+		return ret;
+	return (int)t->entries[i].len - (int)len;
+}
+
+/* Appends a range starting at <k> matching entry <val> to the table being
+ * built in <k4>/<k6> and <bval>. A range starting at the same address as the
+ * previous one replaces it, and one with the same entry extends it.
+ */
+static inline void ipt_emit(const struct ipt *t, uint32_t *k4, struct ipt_key6 *k6,
+                            unsigned int *bval, unsigned int *nb,
+                            struct ipt_key6 k, unsigned int val)
+{
+	unsigned int n = *nb;
+
+	if (n) {
+		if (t->klen == 4 ? k4[n - 1] == k.lo : (k6[n - 1].hi == k.hi && k6[n - 1].lo == k.lo)) {
+			bval[n - 1] = val;
+			return;
+		}
+		if (bval[n - 1] == val)
+			return;
+	}
+
+	if (t->klen == 4)
+		k4[n] = k.lo;
+	else
+		k6[n] = k;
+	bval[n] = val;
+	*nb = n + 1;
+}
+
+int ipt_build(struct ipt *t)
+{
+	struct ipt_cover stack[129];
+	struct ipt_entry *entries = NULL;
+	unsigned char *keys = NULL;
+	unsigned int *order = NULL, *bval = NULL;
+	uint32_t *k4 = NULL;
+	struct ipt_key6 *k6 = NULL;
+	struct ipt_key6 k;
+	struct ebmb_node *node, *next;
+	unsigned int live, room, nb, sp, lvl, off, n, i;
+
+	live = t->nb_entries - t->nb_dead;
+	order = malloc((live + 1) * sizeof(*order));
+	entries = malloc((live + 1) * sizeof(*entries));
+	keys = malloc((live + 1) * t->klen);
+
+	/* at most two bounds per network plus the first one, and the upper
+	 * levels of the search tree.
+	 */
+	nb = 2 * live + 1;
+	room = nb + nb / (IPT_FANOUT - 1) + IPT_MAX_LEVELS;
+	bval = malloc(nb * sizeof(*bval));
+	if (t->klen == 4)
+		k4 = malloc(room * sizeof(*k4));
+	else
+		k6 = malloc(room * sizeof(*k6));
+
+	if (!order || !entries || !keys || !bval || (!k4 && !k6))
+		goto fail;
+
+	for (i = n = 0; i < t->nb_entries; i++)
+		if (!t->entries[i].dead)
+			order[n++] = i;
+
+	ipt_sorting = t;
+	qsort(order, live, sizeof(*order), ipt_cmp);
+
+	for (i = 0; i < live; i++) {
+		entries[i] = t->entries[order[i]];
+		memcpy(keys + i * t->klen, t->keys + order[i] * t->klen, t->klen);
+	}
+
+	/* Sweep the networks by address, keeping the stack of those covering
+	 * the current one. Each network starts a range, and ends one which
+	 * goes back to the network covering it.
+	 */
+	k.hi = k.lo = 0;
+	nb = sp = 0;
+	ipt_emit(t, k4, k6, bval, &nb, k, IPT_NONE);
+	for (i = 0; i <= live; i++) {
+		if (i < live)
+			k = ipt_get(t, keys + i * t->klen);
+
+		while (sp && (i == live || ipt_lt(stack[sp - 1].last, k))) {
+			struct ipt_key6 end = stack[--sp].last;
+
+			if (ipt_inc(t, &end))
+				ipt_emit(t, k4, k6, bval, &nb, end, sp ? stack[sp - 1].idx : IPT_NONE);
+		}
+
+		if (i == live)
+			break;
+
+		entries[i].parent = sp ? stack[sp - 1].idx : IPT_NONE;
+		entries[i].dead = 0;
+		if (i && entries[i].len == entries[i - 1].len &&
+		    memcmp(keys + i * t->klen, keys + (i - 1) * t->klen, t->klen) == 0) {
+			/* same network, which is on top of the stack */
+			stack[sp - 1].idx = i;
+		}
+		else {
+			stack[sp].idx = i;
+			stack[sp].last = ipt_last(t, k, entries[i].len);
+			sp++;
+		}
+		ipt_emit(t, k4, k6, bval, &nb, k, i);
+	}
+
+	/* upper levels of the search tree, until one block is enough */
+	t->ix.lvl_off[0] = 0;
+	t->ix.lvl_nb[0] = nb;
+	off = nb;
+	for (lvl = 1; t->ix.lvl_nb[lvl - 1] > IPT_FANOUT; lvl++) {
+		n = (t->ix.lvl_nb[lvl - 1] + IPT_FANOUT - 1) / IPT_FANOUT;
+		for (i = 0; i < n; i++) {
+			if (k4)
+				k4[off + i] = k4[t->ix.lvl_off[lvl - 1] + i * IPT_FANOUT];
+			else
+				k6[off + i] = k6[t->ix.lvl_off[lvl - 1] + i * IPT_FANOUT];
+		}
+		t->ix.lvl_off[lvl] = off;
+		t->ix.lvl_nb[lvl] = n;
+		off += n;
+	}
+	t->ix.nb_lvl = live ? lvl : 0;
+
+	/* the delta is now part of the base */
+	for (node = ebmb_first(&t->delta); node; node = next) {
+		next = ebmb_next(node);
+		ebmb_delete(node);
+		free(container_of(node, struct ipt_delta, node));
+	}
+
+	free(order);
+	free(t->entries);
+	free(t->keys);
+	free((void *)t->ix.k4);
+	free((void *)t->ix.k6);
+	free((void *)t->ix.bval);
+	t->entries = entries;
+	t->keys = keys;
+	t->ix.k4 = k4;
+	t->ix.k6 = k6;
+	t->ix.bval = bval;
+	t->nb_entries = t->nb_base = t->nb_indexed = live;
+	t->sz_entries = live + 1;
+	t->nb_dead = 0;
+	t->builds++;
+	return 0;
+
+ fail:
+	free(order);
+	free(entries);
+	free(keys);
+	free(bval);
+	free(k4);
+	free(k6);
+	return -1;
+}
+
+struct ipt *ipt_new(unsigned int klen)
+{
+	struct ipt *t;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+	t->klen = t->ix.klen = klen;
+	t->delta = EB_ROOT;
+	return t;
+}
+
+void ipt_free(struct ipt *t)
+{
+	struct ebmb_node *node, *next;
+
+	if (!t)
+		return;
+
+	for (node = ebmb_first(&t->delta); node; node = next) {
+		next = ebmb_next(node);
+		ebmb_delete(node);
+		free(container_of(node, struct ipt_delta, node));
+	}
+	free(t->entries);
+	free(t->keys);
+	free((void *)t->ix.k4);
+	free((void *)t->ix.k6);
+	free((void *)t->ix.bval);
+	free(t);
+}
+
+int ipt_insert(struct ipt *t, const void *key, unsigned int len, void *data, const void *owner)
+{
+	struct ipt_entry *e;
+	unsigned int size;
+	void *new;
+
+	if (t->nb_entries >= t->sz_entries) {
+		size = t->sz_entries ? t->sz_entries * 2 : 16;
+		new = realloc(t->entries, size * sizeof(*t->entries));
+		if (!new)
+			return -1;
+		t->entries = new;
+		new = realloc(t->keys, size * t->klen);
+		if (!new)
+			return -1;
+		t->keys = new;
+		t->sz_entries = size;
+	}
+
+	e = &t->entries[t->nb_entries];
+	e->data = data;
+	e->owner = owner;
+	e->parent = IPT_NONE;
+	e->len = len;
+	e->dead = 0;
+	memcpy(t->keys + t->nb_entries * t->klen, key, t->klen);
+	ipt_mask(t->keys + t->nb_entries * t->klen, t->klen, len);
+	t->nb_entries++;
+	return 0;
+}
+
+/* returns the first node of the delta holding network <key>/<len>, <key>
+ * being masked, or NULL if none.
+ */
+static struct ebmb_node *ipt_delta_first(struct ipt *t, const unsigned char *key, unsigned int len)
+{
+	struct ebmb_node *node, *prev;
+
+	node = ebmb_lookup_prefix(&t->delta, key, len);
+	while (node && (prev = ebmb_prev_dup(node)))
+		node = prev;
+	return node;
+}
+
+struct ipt_entry *ipt_find(struct ipt *t, const void *key, unsigned int len, const void *owner)
+{
+	unsigned char k[16];
+	struct ebmb_node *node;
+	struct ipt_entry *e;
+	unsigned int lo, hi, mid, i;
+
+	if (!key) {
+		for (i = 0; i < t->nb_entries; i++) {
+			e = &t->entries[i];
+			if (!e->dead && e->owner == owner)
+				return e;
+		}
+		return NULL;
+	}
+
+	memcpy(k, key, t->klen);
+	ipt_mask(k, t->klen, len);
+
+	/* the base is sorted */
+	lo = 0;
+	hi = t->nb_base;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ipt_cmp_net(t, mid, k, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (i = lo; i < t->nb_base && ipt_cmp_net(t, i, k, len) == 0; i++) {
+		e = &t->entries[i];
+		if (!e->dead && e->owner == owner)
+			return e;
+	}
+
+	for (node = ipt_delta_first(t, k, len); node; node = ebmb_next_dup(node)) {
+		e = &t->entries[container_of(node, struct ipt_delta, node)->idx];
+		if (e->owner == owner)
+			return e;
+	}
+
+	for (i = t->nb_indexed; i < t->nb_entries; i++) {
+		e = &t->entries[i];
+		if (!e->dead && e->owner == owner && ipt_cmp_net(t, i, k, len) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+void ipt_remove(struct ipt *t, struct ipt_entry *e)
+{
+	unsigned int idx = e - t->entries;
+	struct ebmb_node *node;
+	struct ipt_delta *d;
+
+	if (idx >= t->nb_base && idx < t->nb_indexed) {
+		for (node = ipt_delta_first(t, t->keys + idx * t->klen, e->len); node; node = ebmb_next_dup(node)) {
+			d = container_of(node, struct ipt_delta, node);
+			if (d->idx == idx) {
+				ebmb_delete(node);
+				free(d);
+				break;
+			}
+		}
+	}
+
+	e->data = NULL;
+	e->owner = NULL;
+	e->dead = 1;
+	t->nb_dead++;
+}
+
+int ipt_prepare(struct ipt *t)
+{
+	struct ipt_delta *d;
+	unsigned int i;
+
+	for (i = t->nb_indexed; i < t->nb_entries; i++) {
+		if (t->entries[i].dead)
+			continue;
+
+		d = malloc(sizeof(*d) + t->klen);
+		if (!d) {
+			t->nb_indexed = i;
+			return -1;
+		}
+		d->idx = i;
+		memcpy(d->node.key, t->keys + i * t->klen, t->klen);
+		d->node.node.pfx = t->entries[i].len;
+		ebmb_insert_prefix(&t->delta, &d->node, t->klen);
+	}
+	t->nb_indexed = t->nb_entries;
+	return 0;
+}
+
+struct ipt_entry *ipt_lookup(const struct ipt *t, const void *addr)
+{
+	struct eb_root *delta = (struct eb_root *)&t->delta;
+	struct ebmb_node *node;
+	unsigned int idx = IPT_NONE;
+	unsigned int d;
+
+	if (likely(t->ix.nb_lvl)) {
+		idx = ipt_index_lookup(&t->ix, addr);
+
+		/* deleted networks defer to the ones covering them */
+		while (idx != IPT_NONE && unlikely(t->entries[idx].dead))
+			idx = t->entries[idx].parent;
+	}
+
+	if (!eb_is_empty(delta)) {
+		node = ebmb_lookup_longest(delta, addr);
+		if (node) {
+			d = container_of(node, struct ipt_delta, node)->idx;
+			if (idx == IPT_NONE || t->entries[d].len > t->entries[idx].len)
+				idx = d;
+		}
+	}
+
+	return idx == IPT_NONE ? NULL : &t->entries[idx];
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
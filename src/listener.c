@@ -18,6 +18,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
 #ifdef __VMS
 #include <poll.h>
 #include <ioctl.h>
@@ -38,10 +41,16 @@
 #include <proto/freq_ctr.h>
 #include <proto/log.h>
 #include <proto/listener.h>
+#include <proto/proto_tcp.h>
 #include <proto/sample.h>
 #include <proto/stream.h>
 #include <proto/task.h>
 
+/* adaptive accept statistics, reported in "show info" */
+unsigned int accept_batch;
+unsigned int accept_deferrals;
+unsigned int accept_backlog;
+
 /* List head of all known bind keywords */
 static struct bind_kw_list bind_keywords = {
 	.list = LIST_HEAD_INIT(bind_keywords.list)
@@ -57,8 +66,8 @@ void enable_listener(struct listener *listener)
 {
 	if (listener->state == LI_LISTEN) {
 		if ((global.mode & (MODE_DAEMON | MODE_SYSTEMD)) &&
-		    listener->bind_conf->bind_proc &&
-		    !(listener->bind_conf->bind_proc & (1UL << (relative_pid - 1)))) {
+		    listener_bind_proc(listener) &&
+		    !(listener_bind_proc(listener) & (1UL << (relative_pid - 1)))) {
 			/* we don't want to enable this listener and don't
 			 * want any fd event to reach it.
 			 */
@@ -134,8 +143,8 @@ int pause_listener(struct listener *l)
 int resume_listener(struct listener *l)
 {
 	if ((global.mode & (MODE_DAEMON | MODE_SYSTEMD)) &&
-	    l->bind_conf->bind_proc &&
-	    !(l->bind_conf->bind_proc & (1UL << (relative_pid - 1))))
+	    listener_bind_proc(l) &&
+	    !(listener_bind_proc(l) & (1UL << (relative_pid - 1))))
 		return 1;
 
 	if (l->state == LI_ASSIGNED) {
@@ -293,6 +302,109 @@ void delete_listener(struct listener *listener)
 	listener->proto->nb_listeners--;
 }
 
+/* Splits each listener of bind_conf <bind_conf> into as many SO_REUSEPORT
+ * listeners as requested by its "shards" setting. The processes in <mask> are
+ * distributed over the shards in a round-robin fashion, and each shard only
+ * runs on its own processes, so that the kernel distributes the incoming
+ * connections between the processes instead of having all of them compete on
+ * the same socket. The new listeners are inserted right after the one they
+ * were created from, and are registered into the same protocol so that they
+ * are bound in shard order. Returns 0 if OK, otherwise a combination of ERR_*
+ * flags with an error message in <err>.
+ */
+int bind_conf_make_shards(struct bind_conf *bind_conf, unsigned long mask, char **err)
+{
+	unsigned long procs[LONGBITS];
+	struct listener *l, *prev, *new;
+	int nb, shard, proc;
+
+	nb = my_popcountl(mask);
+	if (bind_conf->shards > 0 && bind_conf->shards < nb)
+		nb = bind_conf->shards;
+	bind_conf->shards = nb;
+	if (nb <= 1)
+		return 0;
+
+#if defined(SO_REUSEPORT)
+	if (!(global.tune.options & GTUNE_USE_REUSEPORT)) {
+		memprintf(err, "'shards' requires SO_REUSEPORT which was disabled with 'noreuseport' or '-dR'");
+		return ERR_ALERT | ERR_FATAL;
+	}
+#else
+	memprintf(err, "'shards' requires SO_REUSEPORT which is not supported on this platform");
+	return ERR_ALERT | ERR_FATAL;
+#endif
+
+	/* distribute the processes over the shards */
+	memset(procs, 0, sizeof(procs));
+	for (shard = proc = 0; proc < LONGBITS; proc++) {
+		if (!(mask & (1UL << proc)))
+			continue;
+		procs[shard] |= 1UL << proc;
+		shard = (shard + 1) % nb;
+	}
+
+	list_for_each_entry(l, &bind_conf->listeners, by_bind) {
+		if (l->shard)
+			continue; /* one we've just created */
+
+		if (l->addr.ss_family != AF_INET && l->addr.ss_family != AF_INET6) {
+			memprintf(err, "'shards' is only supported on IPv4 and IPv6 addresses");
+			return ERR_ALERT | ERR_FATAL;
+		}
+
+		if (l->fd != -1) {
+			memprintf(err, "'shards' cannot be used on an inherited file descriptor");
+			return ERR_ALERT | ERR_FATAL;
+		}
+
+		l->bind_proc = procs[0];
+		prev = l;
+		for (shard = 1; shard < nb; shard++) {
+			new = calloc(1, sizeof(*new));
+			if (!new) {
+				memprintf(err, "out of memory while creating shards");
+				return ERR_ALERT | ERR_FATAL;
+			}
+
+			memcpy(new, l, sizeof(*new));
+			new->state = LI_INIT;
+			new->luid = 0;
+			memset(&new->conf, 0, sizeof(new->conf));
+			new->bind_proc = procs[shard];
+			new->shard = shard;
+
+			/* the strings and counters are owned by each listener */
+			new->name = NULL;
+			new->interface = NULL;
+			new->counters = NULL;
+			if (l->name)
+				memprintf(&new->name, "%s-%d", l->name, shard);
+			if (l->interface)
+				new->interface = strdup(l->interface);
+			if ((l->name && !new->name) || (l->interface && !new->interface)) {
+				free(new->name);
+				free(new->interface);
+				free(new);
+				memprintf(err, "out of memory while creating shards");
+				return ERR_ALERT | ERR_FATAL;
+			}
+
+			LIST_ADD(&prev->by_fe, &new->by_fe);
+			LIST_ADD(&prev->by_bind, &new->by_bind);
+			if (new->addr.ss_family == AF_INET)
+				tcpv4_add_listener(new);
+			else
+				tcpv6_add_listener(new);
+
+			jobs++;
+			listeners++;
+			prev = new;
+		}
+	}
+	return 0;
+}
+
 
 #ifdef __VMS
 static int accept_timeout = -1;
@@ -302,6 +414,49 @@ static int accept_timeout = -1;
 #endif
 #endif
 
+/* Returns the number of connections an adaptive listener may accept at once,
+ * never more than <max_accept> unless it is negative (unlimited). Each new
+ * connection creates a runnable task, so the batch is first limited to what
+ * remains of the number of tasks the scheduler processes per loop once the
+ * current run queue is served. It is then reduced in proportion to how much
+ * the average processing time of a loop exceeds ADAPTIVE_ACCEPT_LOOP_US. This
+ * way, existing connections keep being served at a steady pace while a storm
+ * of new connections is absorbed over several loops. At least one connection
+ * is always accepted so that progress is guaranteed.
+ */
+static inline int listener_adaptive_batch(int max_accept)
+{
+	int batch = 1;
+
+	if (tasks_run_queue < MAX_TASKS_PER_LOOP)
+		batch = MAX_TASKS_PER_LOOP - tasks_run_queue;
+
+	if (loop_time > ADAPTIVE_ACCEPT_LOOP_US)
+		batch = (unsigned long long)batch * ADAPTIVE_ACCEPT_LOOP_US / loop_time;
+
+	if (batch < 1)
+		batch = 1;
+	if (max_accept >= 0 && batch > max_accept)
+		batch = max_accept;
+	return batch;
+}
+
+/* Returns the number of connections waiting in the accept queue of listening
+ * socket <fd>, or 0 if it cannot be determined.
+ */
+static unsigned int listener_backlog(int fd)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+	struct tcp_info info;
+	socklen_t len = sizeof(info);
+
+	/* on a listening socket, tcpi_unacked reports the accept queue length */
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0)
+		return info.tcpi_unacked;
+#endif
+	return 0;
+}
+
 /* This function is called on a read event from a listening socket, corresponding
  * to an accept. It tries to accept as many connections as possible, and for each
  * calls the listener's accept handler (generally the frontend's accept handler).
@@ -311,6 +466,7 @@ void listener_accept(int fd)
 	struct listener *l = fdtab[fd].owner;
 	struct proxy *p = l->frontend;
 	int max_accept = l->maxaccept ? l->maxaccept : 1;
+	int deferred = 0;
 	int expire;
 	int cfd;
  	int ret;
@@ -387,6 +543,16 @@ void listener_accept(int fd)
 			max_accept = max;
 	}
 
+	if ((global.tune.options & GTUNE_ADAPTIVE_ACCEPT) && !(l->options & LI_O_UNLIMITED)) {
+		int batch = listener_adaptive_batch(max_accept);
+
+		if (max_accept < 0 || batch < max_accept) {
+			max_accept = batch;
+			deferred = 1;
+		}
+		accept_batch = max_accept;
+	}
+
 	/* Note: if we fail to allocate a connection because of configured
 	 * limits, we'll schedule a new attempt worst 1 second later in the
 	 * worst case. If we fail due to system limits or temporary resource
@@ -542,7 +708,14 @@ void listener_accept(int fd)
 
 	} /* end of while (max_accept--) */
 
-	/* we've exhausted max_accept, so there is no need to poll again */
+	/* we've exhausted max_accept, so there is no need to poll again. If it
+	 * was reduced by the adaptive mode, the remaining connections are
+	 * deferred to next loop.
+	 */
+	if (deferred) {
+		accept_deferrals++;
+		accept_backlog = listener_backlog(fd);
+	}
  stop:
 	fd_done_recv(fd);
 	return;
@@ -852,6 +1025,51 @@ static int bind_parse_process(char **args, int cur_arg, struct proxy *px, struct
 	return 0;
 }
 
+/* parse the "shards" bind keyword */
+static int bind_parse_shards(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	int val;
+
+	if (strcmp(args[cur_arg + 1], "auto") == 0) {
+		conf->shards = -1;
+		return 0;
+	}
+
+	if (!isdigit((int)*args[cur_arg + 1])) {
+		memprintf(err, "'%s' expects 'auto' or a number of shards.", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	val = atol(args[cur_arg + 1]);
+	if (val < 1 || val > LONGBITS) {
+		memprintf(err, "'%s' : invalid value %d, allowed range is 1..%d", args[cur_arg], val, LONGBITS);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	conf->shards = val;
+	return 0;
+}
+
+/* parse the "shard-steering" bind keyword */
+static int bind_parse_shard_steering(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	struct listener *l;
+
+	if (strcmp(args[cur_arg + 1], "cpu") == 0) {
+		list_for_each_entry(l, &conf->listeners, by_bind)
+			l->options |= LI_O_SHARD_CPU;
+	}
+	else if (strcmp(args[cur_arg + 1], "hash") == 0) {
+		list_for_each_entry(l, &conf->listeners, by_bind)
+			l->options &= ~LI_O_SHARD_CPU;
+	}
+	else {
+		memprintf(err, "'%s' expects 'cpu' or 'hash'.", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	return 0;
+}
+
 /* Note: must not be declared <const> as its list will be overwritten.
  * Please take care of keeping this list alphabetically sorted.
  */
@@ -884,6 +1102,8 @@ static struct bind_kw_list bind_kws = { "ALL", { }, {
 	{ "name",         bind_parse_name,         1 }, /* set name of listening socket */
 	{ "nice",         bind_parse_nice,         1 }, /* set nice of listening socket */
 	{ "process",      bind_parse_process,      1 }, /* set list of allowed process for this socket */
+	{ "shard-steering", bind_parse_shard_steering, 1 }, /* set how connections are distributed over shards */
+	{ "shards",       bind_parse_shards,       1 }, /* create one SO_REUSEPORT socket per process */
 	{ /* END */ },
 }};
 
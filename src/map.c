@@ -10,9 +10,12 @@
  *
  */
 
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#include <string.h>
 
+#include <common/cmap.h>
 #include <common/standard.h>
 
 #include <types/applet.h>
@@ -76,6 +79,122 @@ int map_parse_int(const char *text, struct sample_data *data)
 	return 1;
 }
 
+/* Compiles map file <in> into file <out> for the converters matching keys of
+ * <type>, which is "str", "int" or "ip", possibly followed by an underscore and
+ * the type of the values, "str", "int" or "ip", as in the converters names. The
+ * values are checked against this type. The compiled map can then be loaded
+ * by these converters in place of the text file. Returns non-zero on success,
+ * otherwise 0 with <err> filled.
+ */
+int map_compile(const char *type, const char *in, const char *out, char **err)
+{
+	int (*parse_smp)(const char *, struct sample_data *) = map_parse_str;
+	struct cmap_builder *b = NULL;
+	struct sample_data data;
+	struct pattern pat;
+	const char *sep;
+	char *key, *value;
+	FILE *file = NULL;
+	unsigned int mask;
+	int kind, entry, len;
+	int line = 0;
+	int ret = 0;
+
+	sep = strchr(type, '_');
+	len = sep ? sep - type : strlen(type);
+	for (kind = 0; kind < CMAP_KINDS; kind++)
+		if (strlen(cmap_kinds[kind]) == len && strncmp(type, cmap_kinds[kind], len) == 0)
+			break;
+
+	if (sep && strcmp(sep + 1, "int") == 0)
+		parse_smp = map_parse_int;
+	else if (sep && strcmp(sep + 1, "ip") == 0)
+		parse_smp = map_parse_ip;
+	else if (sep && strcmp(sep + 1, "str") != 0)
+		kind = CMAP_KINDS;
+
+	if (kind == CMAP_KINDS) {
+		memprintf(err, "unknown map type '%s', expects 'str', 'int' or 'ip' optionally followed by '_str', '_int' or '_ip'", type);
+		return 0;
+	}
+
+	file = fopen(in, "r");
+	if (!file) {
+		memprintf(err, "failed to open pattern file <%s>", in);
+		return 0;
+	}
+
+	b = cmapb_new(kind);
+	if (!b)
+		goto out_of_memory;
+
+	while (fgets(trash.str, trash.size, file) != NULL) {
+		line++;
+		if (!pat_ref_split_line(trash.str, &key, &value))
+			continue;
+
+		if (!parse_smp(value, &data)) {
+			memprintf(err, "unable to parse '%s'", value);
+			goto bad_line;
+		}
+
+		entry = cmapb_add(b, key, value);
+		if (entry < 0)
+			goto out_of_memory;
+
+		switch (kind) {
+		case CMAP_INT:
+			if (!pat_parse_int(key, &pat, 0, err))
+				goto bad_line;
+			if (!pat.val.range.min_set || !pat.val.range.max_set ||
+			    pat.val.range.min != pat.val.range.max) {
+				memprintf(err, "'%s' is a range, only single values may be compiled", key);
+				goto bad_line;
+			}
+			if (cmapb_add_int(b, entry, pat.val.range.min) < 0)
+				goto out_of_memory;
+			break;
+
+		case CMAP_IP:
+			if (!pat_parse_ip(key, &pat, PAT_MF_NO_DNS, err))
+				goto bad_line;
+			if (pat.type == SMP_T_IPV4) {
+				/* only contiguous masks are indexed */
+				mask = ntohl(pat.val.ipv4.mask.s_addr);
+				if (mask + (mask & -mask) != 0) {
+					memprintf(err, "'%s' has a non-contiguous mask, which cannot be compiled", key);
+					goto bad_line;
+				}
+				mask = mask ? 33 - flsnz(mask & -mask) : 0;
+				if (cmapb_add_net(b, entry, &pat.val.ipv4.addr, 4, mask) < 0)
+					goto out_of_memory;
+			}
+			else if (cmapb_add_net(b, entry, &pat.val.ipv6.addr, 16, pat.val.ipv6.mask) < 0)
+				goto out_of_memory;
+			break;
+		}
+	}
+
+	if (cmapb_write(b, out) < 0) {
+		memprintf(err, "failed to write compiled map <%s> : %s", out, strerror(errno));
+		goto out;
+	}
+
+	ret = 1;
+	goto out;
+
+ bad_line:
+	memprintf(err, "%s at line %d of file '%s'", *err, line, in);
+	goto out;
+
+ out_of_memory:
+	memprintf(err, "out of memory");
+ out:
+	cmapb_free(b);
+	fclose(file);
+	return ret;
+}
+
 /* This crete and initialize map descriptor.
  * Return NULL if out of memory error
  */
@@ -102,6 +221,17 @@ int sample_load_map(struct arg *arg, struct sample_conv *conv,
                     const char *file, int line, char **err)
 {
 	struct map_descriptor *desc;
+	int mflags = PAT_MF_NO_DNS;
+
+	/* IP maps may be indexed in compact tables instead of trees */
+	if (arg[1].type != ARGT_STOP && arg[2].type == ARGT_STR) {
+		if (strcmp(arg[2].data.str.str, "table") == 0)
+			mflags |= PAT_MF_IP_TABLE;
+		else if (strcmp(arg[2].data.str.str, "tree") != 0) {
+			memprintf(err, "map: unknown index <%s>, expects 'tree' or 'table'", arg[2].data.str.str);
+			return 0;
+		}
+	}
 
 	/* create new map descriptor */
 	desc = map_create_descriptor(conv);
@@ -137,7 +267,7 @@ int sample_load_map(struct arg *arg, struct sample_conv *conv,
 	}
 
 	/* Load map. */
-	if (!pattern_read_from_file(&desc->pat, PAT_REF_MAP, arg[0].data.str.str, PAT_MF_NO_DNS,
+	if (!pattern_read_from_file(&desc->pat, PAT_REF_MAP, arg[0].data.str.str, mflags,
 	                            1, err, file, line))
 		return 0;
 
@@ -300,6 +430,7 @@ static int cli_io_handler_pat_list(struct appctx *appctx)
 {
 	struct stream_interface *si = appctx->owner;
 	struct pat_ref_elt *elt;
+	struct cmap *cmap;
 
 	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW))) {
 		/* If we're forced to shut down, we might have to remove our
@@ -325,11 +456,52 @@ static int cli_io_handler_pat_list(struct appctx *appctx)
 		 * pointer points back to the head of the streams list.
 		 */
 		LIST_INIT(&appctx->ctx.map.bref.users);
-		appctx->ctx.map.bref.ref = appctx->ctx.map.ref->head.n;
+		appctx->ctx.map.bref.ref = NULL;
+		appctx->ctx.map.entry = 0;
+		appctx->ctx.map.gen = appctx->ctx.map.ref->curr_gen;
 		appctx->st2 = STAT_ST_LIST;
 		/* fall through */
 
 	case STAT_ST_LIST:
+		/* the elements being dumped may have been released since a new
+		 * version was committed.
+		 */
+		if (appctx->ctx.map.gen != appctx->ctx.map.ref->curr_gen) {
+			if (!LIST_ISEMPTY(&appctx->ctx.map.bref.users)) {
+				LIST_DEL(&appctx->ctx.map.bref.users);
+				LIST_INIT(&appctx->ctx.map.bref.users);
+			}
+			appctx->st2 = STAT_ST_FIN;
+			return 1;
+		}
+
+		/* the entries of a compiled map come first. It may have been
+		 * cleared in the mean time.
+		 */
+		while (!appctx->ctx.map.bref.ref &&
+		       (cmap = appctx->ctx.map.ref->cmap) &&
+		       appctx->ctx.map.entry < cmap->nb_entries) {
+			if (!cmap_is_dead(cmap, appctx->ctx.map.entry)) {
+				chunk_reset(&trash);
+				chunk_appendf(&trash, "%p %s %s\n",
+				              cmap_ptr(cmap, appctx->ctx.map.entry),
+				              cmap_key(cmap, appctx->ctx.map.entry),
+				              cmap_value(cmap, appctx->ctx.map.entry));
+
+				if (bi_putchk(si_ic(si), &trash) == -1) {
+					si_applet_cant_put(si);
+					return 0;
+				}
+			}
+			appctx->ctx.map.entry++;
+		}
+
+		/* then the list, which is only entered once the compiled map
+		 * is done so that it is safely tracked.
+		 */
+		if (!appctx->ctx.map.bref.ref)
+			appctx->ctx.map.bref.ref = appctx->ctx.map.ref->head.n;
+
 		if (!LIST_ISEMPTY(&appctx->ctx.map.bref.users)) {
 			LIST_DEL(&appctx->ctx.map.bref.users);
 			LIST_INIT(&appctx->ctx.map.bref.users);
@@ -728,10 +900,38 @@ static int cli_parse_set_map(char **args, struct appctx *appctx, void *private)
 	return 1;
 }
 
+/* Returns the version of reference appctx->ctx.map.ref designated by argument
+ * <arg> of the form "@<ver>", if it is being prepared and is complete.
+ * Otherwise NULL is returned and the error message is set.
+ */
+static struct pat_ref *cli_map_gen(struct appctx *appctx, const char *arg)
+{
+	struct pat_ref *gen = NULL;
+	unsigned long ver;
+	char *error;
+
+	ver = strtoul(arg + 1, &error, 10);
+	if (arg[1] && !*error && ver <= UINT_MAX)
+		gen = pat_ref_gen(appctx->ctx.map.ref, ver);
+
+	if (!gen) {
+		appctx->ctx.cli.msg = "Unknown version. Please use the one returned by the last 'prepare'.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		return NULL;
+	}
+	if (gen->flags & PAT_REF_LOADING) {
+		appctx->ctx.cli.msg = "This version is still being loaded.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		return NULL;
+	}
+	return gen;
+}
+
 static int cli_parse_add_map(char **args, struct appctx *appctx, void *private)
 {
 	if (strcmp(args[1], "map") == 0 ||
 	    strcmp(args[1], "acl") == 0) {
+		struct pat_ref *ref;
 		int ret;
 		char *err;
 
@@ -741,6 +941,12 @@ static int cli_parse_add_map(char **args, struct appctx *appctx, void *private)
 		else
 			appctx->ctx.map.display_flags = PAT_REF_ACL;
 
+		/* An optional version "@<ver>" designates a version being
+		 * prepared instead of the current one.
+		 */
+		if (*args[2] == '@')
+			args++;
+
 		/* If the keywork is "map", we expect three parameters, if it
 		 * is "acl", we expect only two parameters
 		 */
@@ -781,12 +987,19 @@ static int cli_parse_add_map(char **args, struct appctx *appctx, void *private)
 			return 1;
 		}
 
+		ref = appctx->ctx.map.ref;
+		if (*args[1] == '@') {
+			ref = cli_map_gen(appctx, args[1]);
+			if (!ref)
+				return 1;
+		}
+
 		/* Add value. */
 		err = NULL;
 		if (appctx->ctx.map.display_flags == PAT_REF_MAP)
-			ret = pat_ref_add(appctx->ctx.map.ref, args[3], args[4], &err);
+			ret = pat_ref_add(ref, args[3], args[4], &err);
 		else
-			ret = pat_ref_add(appctx->ctx.map.ref, args[3], NULL, &err);
+			ret = pat_ref_add(ref, args[3], NULL, &err);
 		if (!ret) {
 			if (err)
 				memprintf(&err, "%s.\n", err);
@@ -803,6 +1016,198 @@ static int cli_parse_add_map(char **args, struct appctx *appctx, void *private)
 	return 0;
 }
 
+/* Loads the file of the version being prepared by batches, yielding between
+ * them so that other streams keep being processed, then reports the version.
+ */
+static int cli_io_handler_prepare_map(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct pat_ref *gen;
+	char *err = NULL;
+	int ret;
+
+	/* the version is aborted by the release handler if the client left */
+	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW)))
+		return 1;
+
+	switch (appctx->st2) {
+	case STAT_ST_LIST:
+		/* it may have been replaced by another "prepare" meanwhile */
+		gen = pat_ref_gen(appctx->ctx.map.ref, appctx->ctx.map.gen);
+		if (!gen) {
+			memprintf(&err, "Version %u was replaced while being loaded.\n", appctx->ctx.map.gen);
+			goto fail;
+		}
+
+		ret = pat_ref_load_gen(gen, appctx->ctx.map.file, &appctx->ctx.map.line, &err);
+		if (!ret) {
+			si_applet_want_put(si);
+			return 0;
+		}
+		if (ret < 0) {
+			memprintf(&err, "%s.\n", err);
+			goto fail;
+		}
+
+		fclose(appctx->ctx.map.file);
+		appctx->ctx.map.file = NULL;
+		gen->flags &= ~PAT_REF_LOADING;
+		appctx->st2 = STAT_ST_END;
+		/* fall through */
+
+	case STAT_ST_END:
+		chunk_printf(&trash, "New version created: %u\n", appctx->ctx.map.gen);
+		if (bi_putchk(si_ic(si), &trash) == -1) {
+			si_applet_cant_put(si);
+			return 0;
+		}
+		appctx->st2 = STAT_ST_FIN;
+		/* fall through */
+
+	default:
+		return 1;
+	}
+
+ fail:
+	/* report the error as a regular message once the load is aborted */
+	appctx->io_release(appctx);
+	appctx->io_release = NULL;
+	appctx->ctx.cli.err = err;
+	appctx->st0 = CLI_ST_PRINT_FREE;
+	si_applet_want_put(si);
+	return 0;
+}
+
+/* Aborts the version being loaded if the load was interrupted */
+static void cli_release_prepare_map(struct appctx *appctx)
+{
+	if (appctx->ctx.map.file) {
+		fclose(appctx->ctx.map.file);
+		appctx->ctx.map.file = NULL;
+		pat_ref_abort(appctx->ctx.map.ref, appctx->ctx.map.gen);
+	}
+}
+
+static int cli_parse_prepare_map(char **args, struct appctx *appctx, void *private)
+{
+	if (strcmp(args[1], "map") == 0 ||
+	    strcmp(args[1], "acl") == 0) {
+		struct pat_ref *gen;
+		char *err = NULL;
+
+		/* <file> is opened by the process, restrict it to admins */
+		if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+			return 1;
+
+		/* Set ACL or MAP flags. */
+		if (args[1][0] == 'm')
+			appctx->ctx.map.display_flags = PAT_REF_MAP;
+		else
+			appctx->ctx.map.display_flags = PAT_REF_ACL;
+
+		/* Expect the map name and an optional file. */
+		if (!*args[2]) {
+			if (appctx->ctx.map.display_flags == PAT_REF_MAP)
+				appctx->ctx.cli.msg = "'prepare map' expects a map identifier and an optional file.\n";
+			else
+				appctx->ctx.cli.msg = "'prepare acl' expects an ACL identifier and an optional file.\n";
+			appctx->st0 = CLI_ST_PRINT;
+			return 1;
+		}
+
+		/* lookup into the refs and check the map flag */
+		appctx->ctx.map.ref = pat_ref_lookup_ref(args[2]);
+		if (!appctx->ctx.map.ref ||
+		    !(appctx->ctx.map.ref->flags & appctx->ctx.map.display_flags)) {
+			if (appctx->ctx.map.display_flags == PAT_REF_MAP)
+				appctx->ctx.cli.msg = "Unknown map identifier. Please use #<id> or <file>.\n";
+			else
+				appctx->ctx.cli.msg = "Unknown ACL identifier. Please use #<id> or <file>.\n";
+			appctx->st0 = CLI_ST_PRINT;
+			return 1;
+		}
+
+		gen = pat_ref_prepare(appctx->ctx.map.ref);
+		if (!gen) {
+			appctx->ctx.cli.msg = "Out of memory error.\n";
+			appctx->st0 = CLI_ST_PRINT;
+			return 1;
+		}
+		appctx->ctx.map.gen = appctx->ctx.map.ref->next_gen;
+		appctx->ctx.map.file = NULL;
+		appctx->ctx.map.line = 0;
+		appctx->st2 = STAT_ST_END;
+
+		/* the version cannot be used until the file is loaded */
+		if (*args[3]) {
+			if (!pat_ref_open_gen(gen, args[3], &appctx->ctx.map.file, &err)) {
+				pat_ref_abort(appctx->ctx.map.ref, appctx->ctx.map.gen);
+				memprintf(&err, "%s.\n", err);
+				appctx->ctx.cli.err = err;
+				appctx->st0 = CLI_ST_PRINT_FREE;
+				return 1;
+			}
+			if (appctx->ctx.map.file) {
+				gen->flags |= PAT_REF_LOADING;
+				appctx->st2 = STAT_ST_LIST;
+			}
+		}
+
+		appctx->io_handler = cli_io_handler_prepare_map;
+		appctx->io_release = cli_release_prepare_map;
+		return 0;
+	}
+
+	return 1;
+}
+
+static int cli_parse_commit_map(char **args, struct appctx *appctx, void *private)
+{
+	if (strcmp(args[1], "map") == 0 ||
+	    strcmp(args[1], "acl") == 0) {
+		if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+			return 1;
+
+		/* Set ACL or MAP flags. */
+		if (args[1][0] == 'm')
+			appctx->ctx.map.display_flags = PAT_REF_MAP;
+		else
+			appctx->ctx.map.display_flags = PAT_REF_ACL;
+
+		/* Expect the version and the map name. */
+		if (*args[2] != '@' || !*args[3]) {
+			if (appctx->ctx.map.display_flags == PAT_REF_MAP)
+				appctx->ctx.cli.msg = "'commit map' expects a version and a map identifier.\n";
+			else
+				appctx->ctx.cli.msg = "'commit acl' expects a version and an ACL identifier.\n";
+			appctx->st0 = CLI_ST_PRINT;
+			return 1;
+		}
+
+		/* lookup into the refs and check the map flag */
+		appctx->ctx.map.ref = pat_ref_lookup_ref(args[3]);
+		if (!appctx->ctx.map.ref ||
+		    !(appctx->ctx.map.ref->flags & appctx->ctx.map.display_flags)) {
+			if (appctx->ctx.map.display_flags == PAT_REF_MAP)
+				appctx->ctx.cli.msg = "Unknown map identifier. Please use #<id> or <file>.\n";
+			else
+				appctx->ctx.cli.msg = "Unknown ACL identifier. Please use #<id> or <file>.\n";
+			appctx->st0 = CLI_ST_PRINT;
+			return 1;
+		}
+
+		if (!cli_map_gen(appctx, args[2]))
+			return 1;
+
+		/* the previous version is released in the background */
+		pat_ref_commit(appctx->ctx.map.ref);
+		appctx->st0 = CLI_ST_PROMPT;
+		return 1;
+	}
+
+	return 1;
+}
+
 static int cli_parse_del_map(char **args, struct appctx *appctx, void *private)
 {
 	if (args[1][0] == 'm')
@@ -932,13 +1337,17 @@ static int cli_parse_clear_map(char **args, struct appctx *appctx, void *private
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "add",   "acl", NULL }, "add acl        : add acl entry", cli_parse_add_map, NULL },
 	{ { "clear", "acl", NULL }, "clear acl <id> : clear the content of this acl", cli_parse_clear_map, NULL },
+	{ { "commit", "acl", NULL }, "commit acl     : replace an acl with a prepared version", cli_parse_commit_map, NULL },
 	{ { "del",   "acl", NULL }, "del acl        : delete acl entry", cli_parse_del_map, NULL },
 	{ { "get",   "acl", NULL }, "get acl        : report the patterns matching a sample for an ACL", cli_parse_get_map, cli_io_handler_map_lookup, cli_release_mlook },
+	{ { "prepare", "acl", NULL }, "prepare acl    : create a new version of an acl, optionally loaded from a file", cli_parse_prepare_map, NULL },
 	{ { "show",  "acl", NULL }, "show acl [id]  : report available acls or dump an acl's contents", cli_parse_show_map, NULL },
 	{ { "add",   "map", NULL }, "add map        : add map entry", cli_parse_add_map, NULL },
 	{ { "clear", "map", NULL }, "clear map <id> : clear the content of this map", cli_parse_clear_map, NULL },
+	{ { "commit", "map", NULL }, "commit map     : replace a map with a prepared version", cli_parse_commit_map, NULL },
 	{ { "del",   "map", NULL }, "del map        : delete map entry", cli_parse_del_map, NULL },
 	{ { "get",   "map", NULL }, "get map        : report the keys and values matching a sample for a map", cli_parse_get_map, cli_io_handler_map_lookup, cli_release_mlook },
+	{ { "prepare", "map", NULL }, "prepare map    : create a new version of a map, optionally loaded from a file", cli_parse_prepare_map, NULL },
 	{ { "set",   "map", NULL }, "set map        : modify map entry", cli_parse_set_map, NULL },
 	{ { "show",  "map", NULL }, "show map [id]  : report available maps or dump a map's contents", cli_parse_show_map, NULL },
 	{ { NULL }, NULL, NULL, NULL }
@@ -972,7 +1381,7 @@ static struct sample_conv_kw_list sample_conv_kws = {ILH, {
 	{ "map_reg",     sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_STR,  SMP_T_STR,  (void *)PAT_MATCH_REG },
 	{ "map_regm",    sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_STR,  SMP_T_STR,  (void *)PAT_MATCH_REGM},
 	{ "map_int",     sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_SINT, SMP_T_STR,  (void *)PAT_MATCH_INT },
-	{ "map_ip",      sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_ADDR, SMP_T_STR,  (void *)PAT_MATCH_IP  },
+	{ "map_ip",      sample_conv_map, ARG3(1,STR,STR,STR), sample_load_map, SMP_T_ADDR, SMP_T_STR,  (void *)PAT_MATCH_IP  },
 
 	{ "map_str_int", sample_conv_map, ARG2(1,STR,SINT), sample_load_map, SMP_T_STR,  SMP_T_SINT, (void *)PAT_MATCH_STR },
 	{ "map_beg_int", sample_conv_map, ARG2(1,STR,SINT), sample_load_map, SMP_T_STR,  SMP_T_SINT, (void *)PAT_MATCH_BEG },
@@ -982,7 +1391,7 @@ static struct sample_conv_kw_list sample_conv_kws = {ILH, {
 	{ "map_end_int", sample_conv_map, ARG2(1,STR,SINT), sample_load_map, SMP_T_STR,  SMP_T_SINT, (void *)PAT_MATCH_END },
 	{ "map_reg_int", sample_conv_map, ARG2(1,STR,SINT), sample_load_map, SMP_T_STR,  SMP_T_SINT, (void *)PAT_MATCH_REG },
 	{ "map_int_int", sample_conv_map, ARG2(1,STR,SINT), sample_load_map, SMP_T_SINT, SMP_T_SINT, (void *)PAT_MATCH_INT },
-	{ "map_ip_int",  sample_conv_map, ARG2(1,STR,SINT), sample_load_map, SMP_T_ADDR, SMP_T_SINT, (void *)PAT_MATCH_IP  },
+	{ "map_ip_int",  sample_conv_map, ARG3(1,STR,SINT,STR), sample_load_map, SMP_T_ADDR, SMP_T_SINT, (void *)PAT_MATCH_IP  },
 
 	{ "map_str_ip",  sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_STR,  SMP_T_ADDR, (void *)PAT_MATCH_STR },
 	{ "map_beg_ip",  sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_STR,  SMP_T_ADDR, (void *)PAT_MATCH_BEG },
@@ -992,7 +1401,7 @@ static struct sample_conv_kw_list sample_conv_kws = {ILH, {
 	{ "map_end_ip",  sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_STR,  SMP_T_ADDR, (void *)PAT_MATCH_END },
 	{ "map_reg_ip",  sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_STR,  SMP_T_ADDR, (void *)PAT_MATCH_REG },
 	{ "map_int_ip",  sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_SINT, SMP_T_ADDR, (void *)PAT_MATCH_INT },
-	{ "map_ip_ip",   sample_conv_map, ARG2(1,STR,STR), sample_load_map, SMP_T_ADDR, SMP_T_ADDR, (void *)PAT_MATCH_IP  },
+	{ "map_ip_ip",   sample_conv_map, ARG3(1,STR,STR,STR), sample_load_map, SMP_T_ADDR, SMP_T_ADDR, (void *)PAT_MATCH_IP  },
 
 	{ /* END */ },
 }};
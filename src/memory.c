@@ -10,6 +10,13 @@
  *
  */
 
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
 #include <types/applet.h>
 #include <types/cli.h>
 #include <types/global.h>
@@ -88,12 +95,146 @@ struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags)
 			strlcpy2(pool->name, name, sizeof(pool->name));
 		pool->size = size;
 		pool->flags = flags;
+		pool->slab_node = -1;
 		LIST_ADDQ(start, &pool->list);
 	}
 	pool->users++;
 	return pool;
 }
 
+/* Returns the distance between two objects carved from the slab of <pool> */
+static inline unsigned long pool_slab_stride(const struct pool_head *pool)
+{
+	return (pool->size + POOL_EXTRA + POOL_SLAB_ALIGN - 1) & -(unsigned long)POOL_SLAB_ALIGN;
+}
+
+/* Carves one object from the slab of pool <pool> and returns it, or returns
+ * NULL if the slab is exhausted.
+ */
+static void *pool_slab_carve(struct pool_head *pool)
+{
+	unsigned long stride = pool_slab_stride(pool);
+	unsigned long end;
+
+	end = pool->slab_used += stride;
+	if (end > pool->slab_size)
+		return NULL;
+	return pool->slab + end - stride;
+}
+
+#if defined(__linux__) && defined(__NR_mbind)
+/* Binds the <len> bytes at <addr> to NUMA node <node> using the mbind()
+ * syscall directly so that we don't depend on libnuma. Returns 0 on success.
+ */
+static int pool_slab_bind(void *addr, unsigned long len, int node)
+{
+	unsigned long nodemask[4] = { 0, 0, 0, 0 };
+
+	if (node >= (int)(sizeof(nodemask) * 8))
+		return -1;
+	nodemask[node / LONGBITS] = 1UL << (node % LONGBITS);
+	/* 2 = MPOL_BIND */
+	return syscall(__NR_mbind, addr, len, 2, nodemask, sizeof(nodemask) * 8, 0);
+}
+#else
+static int pool_slab_bind(void *addr, unsigned long len, int node)
+{
+	return -1;
+}
+#endif
+
+/* Reserves a contiguous memory area large enough for <count> objects of pool
+ * <pool>, from which next refills will carve their objects before resorting
+ * to malloc(). <flags> may contain POOL_SLAB_HUGEPAGES to first try to map
+ * the area from the explicit 2MB hugepages reserve, and to fall back to normal
+ * pages advised for transparent hugepages. If <node> is not negative, the area
+ * is bound to this NUMA node. All pages are touched before returning so that
+ * the page faults are paid at startup and not under load. Objects carved from
+ * the slab are never released to the system. Returns 1 on success, 0 if the
+ * area could not be reserved. Only one slab may be reserved per pool.
+ */
+int pool_reserve_slab(struct pool_head *pool, unsigned int count, unsigned int flags, int node)
+{
+	unsigned long size, page, pos;
+	char *area = MAP_FAILED;
+
+	if (pool->slab || !count)
+		return 0;
+
+	page = sysconf(_SC_PAGESIZE);
+	size = pool_slab_stride(pool) * count;
+	pool->slab_flags = 0;
+
+#ifdef MAP_HUGETLB
+	if (flags & POOL_SLAB_HUGEPAGES) {
+		unsigned long hsize = (size + (2UL << 20) - 1) & -(2UL << 20);
+
+		area = mmap(NULL, hsize, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (area != MAP_FAILED) {
+			size = hsize;
+			page = 2UL << 20;
+			pool->slab_flags |= POOL_SLAB_HUGETLB;
+		}
+	}
+#endif
+	if (area == MAP_FAILED) {
+		size = (size + page - 1) & -page;
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (area == MAP_FAILED)
+			return 0;
+#ifdef MADV_HUGEPAGE
+		if ((flags & POOL_SLAB_HUGEPAGES) && madvise(area, size, MADV_HUGEPAGE) == 0)
+			pool->slab_flags |= POOL_SLAB_THP;
+#endif
+	}
+
+	pool->slab_node = -1;
+	if (node >= 0 && pool_slab_bind(area, size, node) == 0)
+		pool->slab_node = node;
+
+	/* the binding only applies to pages faulted after mbind() */
+	for (pos = 0; pos < size; pos += page)
+		area[pos] = 0;
+
+	pool->slab = area;
+	pool->slab_size = size;
+	pool->slab_used = 0;
+	return 1;
+}
+
+/* Releases objects from the free list <list> of pool <pool> to the system as
+ * long as more than <keep> objects are available in the pool. Objects carved
+ * from the pool's slab are never released and are kept at the head of the
+ * list. Returns the new list.
+ */
+static void *pool_trim_list(struct pool_head *pool, void *list, unsigned int keep)
+{
+	void *temp, *next = list;
+	void *kept = NULL;
+
+	while (next && (int)(pool->allocated - pool->used) > (int)keep) {
+		temp = next;
+		next = *POOL_LINK(pool, temp);
+		if (pool_in_slab(pool, temp)) {
+			*POOL_LINK(pool, temp) = kept;
+			kept = temp;
+			continue;
+		}
+		pool->allocated--;
+		FREE(temp);
+	}
+
+	while (kept) {
+		temp = kept;
+		kept = *POOL_LINK(pool, temp);
+		*POOL_LINK(pool, temp) = next;
+		next = temp;
+	}
+	return next;
+}
+
 /* Allocates new entries for pool <pool> until there are at least <avail> + 1
  * available, then returns the last one for immediate use, so that at least
  * <avail> are left available in the pool upon return. NULL is returned if the
@@ -114,7 +255,9 @@ void *pool_refill_alloc(struct pool_head *pool, unsigned int avail)
 		if (pool->limit && pool->allocated >= pool->limit)
 			return NULL;
 
-		ptr = MALLOC(pool->size + POOL_EXTRA);
+		ptr = pool->slab_used < pool->slab_size ? pool_slab_carve(pool) : NULL;
+		if (!ptr)
+			ptr = MALLOC(pool->size + POOL_EXTRA);
 		if (!ptr) {
 			pool->failed++;
 			if (failed)
@@ -142,20 +285,14 @@ void *pool_refill_alloc(struct pool_head *pool, unsigned int avail)
  */
 void pool_flush2(struct pool_head *pool)
 {
-	void *temp, *next;
 	if (!pool)
 		return;
 
-	next = pool->free_list;
-	while (next) {
-		temp = next;
-		next = *POOL_LINK(pool, temp);
-		pool->allocated--;
-		FREE(temp);
-	}
-	pool->free_list = next;
+	pool->free_list = pool_trim_list(pool, pool->free_list, 0);
 
-	/* here, we should have pool->allocate == pool->used */
+	/* here, we should have pool->allocate == pool->used, except for
+	 * objects carved from the slab which are never released.
+	 */
 }
 
 /*
@@ -172,17 +309,8 @@ void pool_gc2()
 		goto out;
 
 	list_for_each_entry(entry, &pools, list) {
-		void *temp, *next;
 		//qfprintf(stderr, "Flushing pool %s\n", entry->name);
-		next = entry->free_list;
-		while (next &&
-		       (int)(entry->allocated - entry->used) > (int)entry->minavail) {
-			temp = next;
-			next = *POOL_LINK(entry, temp);
-			entry->allocated--;
-			FREE(temp);
-		}
-		entry->free_list = next;
+		entry->free_list = pool_trim_list(entry, entry->free_list, entry->minavail);
 	}
  out:
 	recurse--;
@@ -204,6 +332,8 @@ void *pool_destroy2(struct pool_head *pool)
 		pool->users--;
 		if (!pool->users) {
 			LIST_DEL(&pool->list);
+			if (pool->slab)
+				munmap(pool->slab, pool->slab_size);
 			FREE(pool);
 		}
 	}
@@ -220,10 +350,21 @@ void dump_pools_to_trash()
 	allocated = used = nbpools = 0;
 	chunk_printf(&trash, "Dumping pools usage. Use SIGQUIT to flush them.\n");
 	list_for_each_entry(entry, &pools, list) {
-		chunk_appendf(&trash, "  - Pool %s (%d bytes) : %d allocated (%u bytes), %d used, %d failures, %d users%s\n",
+		chunk_appendf(&trash, "  - Pool %s (%d bytes) : %d allocated (%u bytes), %d used, %d failures, %u hits, %u misses, %d users%s\n",
 			 entry->name, entry->size, entry->allocated,
 		         entry->size * entry->allocated, entry->used, entry->failed,
+			 entry->hits, entry->misses,
 			 entry->users, (entry->flags & MEM_F_SHARED) ? " [SHARED]" : "");
+		if (entry->slab) {
+			chunk_appendf(&trash, "      slab: %lu bytes (%s), %lu carved",
+				      entry->slab_size,
+				      (entry->slab_flags & POOL_SLAB_HUGETLB) ? "hugetlb" :
+				      (entry->slab_flags & POOL_SLAB_THP) ? "thp" : "normal pages",
+				      MIN(entry->slab_used, entry->slab_size));
+			if (entry->slab_node >= 0)
+				chunk_appendf(&trash, ", numa node %d", entry->slab_node);
+			chunk_appendf(&trash, "\n");
+		}
 
 		allocated += entry->allocated * entry->size;
 		used += entry->used * entry->size;
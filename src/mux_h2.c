@@ -0,0 +1,2316 @@
+/*
+ * HTTP/2 frontend multiplexer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * An HTTP/2 connection (h2c) takes over the client connection once the
+ * protocol is known, either by ALPN or because the listener is configured
+ * with "proto h2". It demultiplexes the frames received on the connection and
+ * creates one regular stream per HTTP/2 stream (h2s). The front stream
+ * interface of each of these streams is attached to an applet which feeds the
+ * stream with an HTTP/1.1 version of the request, and which converts back the
+ * HTTP/1.1 response to HTTP/2 frames. This way all the existing HTTP
+ * analysers, rules, filters and logs work unmodified on HTTP/2 requests.
+ *
+ * All frames are emitted into a single mux buffer which is sent over the
+ * connection. Each stream has its own receive buffer where the request is
+ * placed until its applet moves it to the stream's request channel. The
+ * demux stops when a stream's buffer is full, which is also the limit at
+ * which WINDOW_UPDATE frames are emitted, so that a slow stream cannot make
+ * the connection buffer too much data.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <common/buffer.h>
+#include <common/cfgparse.h>
+#include <common/chunk.h>
+#include <common/config.h>
+#include <common/h2.h>
+#include <common/hpack.h>
+#include <common/memory.h>
+#include <common/standard.h>
+
+#include <eb32tree.h>
+
+#include <types/global.h>
+#include <types/listener.h>
+#include <types/proxy.h>
+
+#include <proto/applet.h>
+#include <proto/channel.h>
+#include <proto/connection.h>
+#include <proto/hdr_idx.h>
+#include <proto/listener.h>
+#include <proto/mux_h2.h>
+#include <proto/proto_http.h>
+#include <proto/session.h>
+#include <proto/stream.h>
+#include <proto/stream_interface.h>
+#include <proto/task.h>
+
+#ifdef USE_OPENSSL
+#include <proto/ssl_sock.h>
+#endif
+
+static struct pool_head *pool2_h2c;
+static struct pool_head *pool2_h2s;
+
+/* settings advertised to the clients, set by the tune.h2.* keywords */
+static unsigned int h2_settings_header_table_size      = 4096;
+static int          h2_settings_initial_window_size    = H2_INITIAL_WINDOW_SIZE;
+static unsigned int h2_settings_max_concurrent_streams = 100;
+
+/* decoded header list, sized to tune.http.maxhdr on first use */
+static struct hpack_hdr *h2_hdr_list;
+
+/* connection states */
+enum h2_cs {
+	H2_CS_PREFACE,   /* waiting for the client preface */
+	H2_CS_SETTINGS1, /* waiting for the client's first SETTINGS frame */
+	H2_CS_FRAME_H,   /* waiting for a frame header */
+	H2_CS_FRAME_P,   /* waiting for (the rest of) a frame payload */
+	H2_CS_ERROR,     /* connection error, a GOAWAY must be sent */
+	H2_CS_ERROR2,    /* GOAWAY sent, only waiting for the streams to leave */
+};
+
+/* h2c flags */
+#define H2_CF_DEM_MROOM     0x00000001  /* demux blocked on lack of room in the mux buffer */
+#define H2_CF_DEM_SFULL     0x00000002  /* demux blocked on a full stream buffer */
+#define H2_CF_DEM_BLOCK_ANY 0x00000003  /* any of the demux blocking reasons above */
+#define H2_CF_GOAWAY_RCVD   0x00000010  /* GOAWAY received, no more streams */
+#define H2_CF_GOAWAY_SENT   0x00000020  /* GOAWAY sent, no more streams */
+
+/* HTTP/2 connection descriptor */
+struct h2c {
+	struct connection *conn;
+	struct session *sess;       /* the connection's session */
+	struct task *task;          /* timeouts and deferred releases */
+	enum h2_cs st0;             /* connection state */
+	enum h2_err errcode;        /* error code to report in the GOAWAY frame */
+	unsigned int flags;         /* H2_CF_* */
+	int max_id;                 /* highest stream ID seen, for GOAWAY */
+
+	/* demux */
+	int dsi;                    /* stream ID of the current frame */
+	int dfl;                    /* remaining length of the current frame's payload */
+	int dpl;                    /* padding length of the current DATA frame */
+	unsigned char dft;          /* current frame type */
+	unsigned char dff;          /* current frame flags */
+	int hsi;                    /* stream ID of the header block being assembled, or 0 */
+	unsigned char hff;          /* flags of the HEADERS frame of this block */
+	int rcvd_c;                 /* connection-level bytes to acknowledge */
+	int rcvd_s;                 /* bytes to acknowledge on stream <rcvd_sid> */
+	int rcvd_sid;
+	struct hpack_dht *ddht;     /* decoder's dynamic table */
+	struct buffer *dbuf;        /* demux buffer */
+	struct buffer *hbuf;        /* header block being assembled, if any */
+
+	/* mux */
+	int miw;                    /* initial window size of the client's streams */
+	int mws;                    /* connection window we may still send */
+	int mfs;                    /* max frame size accepted by the client */
+	struct buffer *mbuf;        /* mux buffer */
+	struct list send_list;      /* streams waiting for room or window, or for their closing frame */
+
+	unsigned int nb_streams;    /* number of h2s, including the orphaned ones */
+	unsigned int nb_sess;       /* number of streams still referencing the connection */
+	int timeout;                /* idle timeout */
+	struct eb_root streams_by_id;
+};
+
+/* stream states, section 5.1 */
+enum h2_ss {
+	H2_SS_OPEN,      /* request not fully received */
+	H2_SS_HREM,      /* half-closed(remote) : request fully received */
+	H2_SS_ERROR,     /* reset or aborted */
+};
+
+/* h2s flags */
+#define H2_SF_ES_RCVD       0x00000001  /* END_STREAM received */
+#define H2_SF_ES_SENT       0x00000002  /* END_STREAM sent */
+#define H2_SF_RST_RCVD      0x00000004  /* RST_STREAM received */
+#define H2_SF_RST_SENT      0x00000008  /* RST_STREAM sent */
+#define H2_SF_REQ_CHNK      0x00000010  /* request body is chunk-encoded for HTTP/1 */
+#define H2_SF_HEAD          0x00000020  /* HEAD request, no body in the response */
+#define H2_SF_HDRS_SENT     0x00000040  /* response headers sent */
+#define H2_SF_BLK_MROOM     0x00000100  /* blocked on room in the mux buffer */
+#define H2_SF_BLK_MFCTL     0x00000200  /* blocked on the connection window */
+#define H2_SF_BLK_SFCTL     0x00000400  /* blocked on the stream window */
+#define H2_SF_BLK_ANY       0x00000700
+
+/* response parser states */
+enum h2_rs {
+	H2_RS_HDR,       /* waiting for the response headers */
+	H2_RS_BODY_CL,   /* body delimited by content-length */
+	H2_RS_BODY_CLOSE,/* body delimited by the end of the response */
+	H2_RS_CHNK_SIZE, /* waiting for a chunk size */
+	H2_RS_CHNK_DATA, /* inside a chunk */
+	H2_RS_CHNK_CRLF, /* waiting for the CRLF after a chunk */
+	H2_RS_TRAILERS,  /* skipping the trailers */
+	H2_RS_DONE,      /* response complete */
+};
+
+/* HTTP/2 stream descriptor */
+struct h2s {
+	struct h2c *h2c;
+	struct appctx *appctx;      /* NULL once the stream is gone (orphan) */
+	struct eb32_node by_id;     /* place in the connection's streams tree */
+	struct list list;           /* place in the connection's send list */
+	enum h2_ss st;
+	enum h2_err errcode;        /* error code to report in RST_STREAM */
+	unsigned int flags;         /* H2_SF_* */
+	int mws;                    /* stream window we may still send */
+	enum h2_rs res_st;          /* response parser state */
+	unsigned long long body_len;/* remaining response body or chunk length */
+	struct buffer *rxbuf;       /* HTTP/1 version of the request */
+	struct hdr_idx idx;         /* request headers index, v=NULL if none */
+	int rq_m_l, rq_u_l;         /* method and URI lengths if idx is set */
+	int hdr_len;                /* request headers length if idx is set */
+};
+
+static struct applet h2_applet;
+static struct data_cb h2_conn_cb;
+static struct task *h2_timeout_task(struct task *t);
+
+/*****************************************************************/
+/* functions below are buffer helpers                            */
+/*****************************************************************/
+
+/* Copies <len> bytes at offset <ofs> of <b>'s input into <out> */
+static void h2_bi_peek(const struct buffer *b, int ofs, void *out, int len)
+{
+	const char *p = b->p + ofs;
+	int n;
+
+	if (p >= b->data + b->size)
+		p -= b->size;
+	n = b->data + b->size - p;
+	if (n > len)
+		n = len;
+	memcpy(out, p, n);
+	memcpy((char *)out + n, b->data, len - n);
+}
+
+/* Removes <len> bytes from <b>'s input */
+static void h2_bi_skip(struct buffer *b, int len)
+{
+	b->i -= len;
+	b->p += len;
+	if (b->p >= b->data + b->size)
+		b->p -= b->size;
+	if (!b->i)
+		b->p = b->data;
+}
+
+/* Appends <len> bytes from <blk> to <b>'s input. The caller must have checked
+ * that there is enough room.
+ */
+static void h2_bi_put(struct buffer *b, const char *blk, int len)
+{
+	int n = bi_contig_space(b);
+
+	if (n > len)
+		n = len;
+	memcpy(bi_end(b), blk, n);
+	memcpy(b->data, blk + n, len - n);
+	b->i += len;
+}
+
+/* Moves <len> bytes from <from>'s input to <to>'s input. The caller must have
+ * checked that both are possible.
+ */
+static void h2_bi_xfer(struct buffer *to, struct buffer *from, int len)
+{
+	int n;
+
+	while (len > 0) {
+		n = bi_contig_data(from);
+		if (n > len)
+			n = len;
+		h2_bi_put(to, from->p, n);
+		h2_bi_skip(from, n);
+		len -= n;
+	}
+}
+
+/*****************************************************************/
+/* functions below are frame emitters                            */
+/*****************************************************************/
+
+/* returns the room left in the mux buffer */
+static inline int h2c_mux_room(const struct h2c *h2c)
+{
+	return h2c->mbuf->size - h2c->mbuf->o;
+}
+
+/* Appends a frame of type <type> with flags <flags> for stream <sid>, with
+ * payload <data> of <len> bytes, to the mux buffer. Returns 1 on success or 0
+ * if there is not enough room, in which case nothing is emitted.
+ */
+static int h2c_send_frame(struct h2c *h2c, int type, int flags, int sid, const void *data, int len)
+{
+	char hdr[H2_FH_SIZE];
+
+	if (h2c_mux_room(h2c) < H2_FH_SIZE + len)
+		return 0;
+
+	h2_set_frame_hdr(hdr, len, type, flags, sid);
+	bo_putblk(h2c->mbuf, hdr, H2_FH_SIZE);
+	if (len)
+		bo_putblk(h2c->mbuf, data, len);
+	return 1;
+}
+
+/* sends our SETTINGS frame, and extends the connection window if the streams
+ * are given a larger one. The mux buffer is known to be empty.
+ */
+static void h2c_send_settings(struct h2c *h2c)
+{
+	char buf[18];
+	char inc[4];
+	int len = 0;
+
+	h2_set_n16(buf + len, H2_SETTINGS_MAX_CONCURRENT_STREAMS);
+	h2_set_n32(buf + len + 2, h2_settings_max_concurrent_streams);
+	len += 6;
+
+	if (h2_settings_header_table_size != 4096) {
+		h2_set_n16(buf + len, H2_SETTINGS_HEADER_TABLE_SIZE);
+		h2_set_n32(buf + len + 2, h2_settings_header_table_size);
+		len += 6;
+	}
+
+	if (h2_settings_initial_window_size != H2_INITIAL_WINDOW_SIZE) {
+		h2_set_n16(buf + len, H2_SETTINGS_INITIAL_WINDOW_SIZE);
+		h2_set_n32(buf + len + 2, h2_settings_initial_window_size);
+		len += 6;
+	}
+	h2c_send_frame(h2c, H2_FT_SETTINGS, 0, 0, buf, len);
+
+	if (h2_settings_initial_window_size > H2_INITIAL_WINDOW_SIZE) {
+		h2_set_n32(inc, h2_settings_initial_window_size - H2_INITIAL_WINDOW_SIZE);
+		h2c_send_frame(h2c, H2_FT_WINDOW_UPDATE, 0, 0, inc, 4);
+	}
+}
+
+/* sends RST_STREAM with error <err> for stream <sid>. Returns 1 on success or
+ * 0 if there is no room.
+ */
+static int h2c_send_rst(struct h2c *h2c, int sid, enum h2_err err)
+{
+	char buf[4];
+
+	h2_set_n32(buf, err);
+	return h2c_send_frame(h2c, H2_FT_RST_STREAM, 0, sid, buf, 4);
+}
+
+/* Sends the pending WINDOW_UPDATE frames. Returns 1 if everything was sent,
+ * or 0 if some are still pending.
+ */
+static int h2c_send_wu(struct h2c *h2c)
+{
+	char buf[4];
+
+	if (h2c->rcvd_c) {
+		h2_set_n32(buf, h2c->rcvd_c);
+		if (!h2c_send_frame(h2c, H2_FT_WINDOW_UPDATE, 0, 0, buf, 4))
+			return 0;
+		h2c->rcvd_c = 0;
+	}
+
+	if (h2c->rcvd_s) {
+		h2_set_n32(buf, h2c->rcvd_s);
+		if (!h2c_send_frame(h2c, H2_FT_WINDOW_UPDATE, 0, h2c->rcvd_sid, buf, 4))
+			return 0;
+		h2c->rcvd_s = 0;
+	}
+	return 1;
+}
+
+/* marks the connection in error with code <err>. A GOAWAY will be sent. */
+static void h2c_error(struct h2c *h2c, enum h2_err err)
+{
+	if (h2c->st0 >= H2_CS_ERROR)
+		return;
+	h2c->errcode = err;
+	h2c->st0 = H2_CS_ERROR;
+}
+
+/*****************************************************************/
+/* functions below are stream management                         */
+/*****************************************************************/
+
+static struct h2s *h2c_st_by_id(struct h2c *h2c, int id)
+{
+	struct eb32_node *node;
+
+	node = eb32_lookup(&h2c->streams_by_id, id);
+	if (!node)
+		return NULL;
+	return container_of(node, struct h2s, by_id);
+}
+
+/* updates the connection's idle timeout */
+static void h2c_update_timeout(struct h2c *h2c)
+{
+	if (!h2c->nb_streams || h2c->st0 >= H2_CS_ERROR)
+		h2c->task->expire = tick_add_ifset(now_ms, h2c->timeout);
+	else
+		h2c->task->expire = TICK_ETERNITY;
+	task_queue(h2c->task);
+}
+
+/* releases stream <h2s>. Its appctx must have been detached. */
+static void h2s_destroy(struct h2s *h2s)
+{
+	struct h2c *h2c = h2s->h2c;
+
+	eb32_delete(&h2s->by_id);
+	LIST_DEL(&h2s->list);
+	b_free(&h2s->rxbuf);
+	pool_free2(pool2_hdr_idx, h2s->idx.v);
+	pool_free2(pool2_h2s, h2s);
+
+	if (!--h2c->nb_streams) {
+		h2c_update_timeout(h2c);
+		task_wakeup(h2c->task, TASK_WOKEN_OTHER);
+	}
+}
+
+/* wakes up the stream's applet */
+static inline void h2s_notify(struct h2s *h2s)
+{
+	if (h2s->appctx)
+		appctx_wakeup(h2s->appctx);
+}
+
+/* resets stream <h2s> with error <err>. Returns 1 on success, or 0 if there
+ * is no room to send RST_STREAM yet.
+ */
+static int h2s_reset(struct h2s *h2s, enum h2_err err)
+{
+	if (!(h2s->flags & (H2_SF_RST_SENT | H2_SF_RST_RCVD))) {
+		if (!h2c_send_rst(h2s->h2c, h2s->by_id.key, err))
+			return 0;
+		h2s->flags |= H2_SF_RST_SENT;
+	}
+	h2s->st = H2_SS_ERROR;
+	h2s->errcode = err;
+	h2s_notify(h2s);
+	return 1;
+}
+
+/* Emits the frame which closes orphaned stream <h2s> : an empty DATA frame
+ * with END_STREAM if the response was delimited by the end of the stream, or
+ * RST_STREAM if it did not complete or if the request is still being sent.
+ * Returns 1 once nothing remains to be sent for this stream, or 0 if there
+ * is no room yet.
+ */
+static int h2s_send_close(struct h2s *h2s)
+{
+	struct h2c *h2c = h2s->h2c;
+
+	if (h2s->flags & H2_SF_RST_SENT)
+		return 1;
+
+	if (!(h2s->flags & H2_SF_ES_SENT) && h2s->res_st == H2_RS_BODY_CLOSE &&
+	    h2s->st != H2_SS_ERROR) {
+		if (!h2c_send_frame(h2c, H2_FT_DATA, H2_F_DATA_END_STREAM, h2s->by_id.key, NULL, 0))
+			return 0;
+		h2s->flags |= H2_SF_ES_SENT;
+	}
+
+	if ((h2s->flags & (H2_SF_ES_SENT | H2_SF_ES_RCVD)) == (H2_SF_ES_SENT | H2_SF_ES_RCVD) ||
+	    (h2s->flags & H2_SF_RST_RCVD))
+		return 1;
+
+	/* either the response is incomplete, or the client is still
+	 * sending a request we're not interested in anymore.
+	 */
+	if (!h2c_send_rst(h2c, h2s->by_id.key,
+	                  (h2s->flags & H2_SF_ES_SENT) ? H2_ERR_NO_ERROR : H2_ERR_CANCEL))
+		return 0;
+	h2s->flags |= H2_SF_RST_SENT;
+	return 1;
+}
+
+/* Creates a new stream <sid> on connection <h2c> with its receive buffer,
+ * which is left empty. Returns NULL on memory shortage.
+ */
+static struct h2s *h2s_new(struct h2c *h2c, int sid)
+{
+	struct h2s *h2s;
+
+	h2s = pool_alloc2(pool2_h2s);
+	if (!h2s)
+		return NULL;
+
+	h2s->rxbuf = &buf_empty;
+	if (!b_alloc_margin(&h2s->rxbuf, 0)) {
+		pool_free2(pool2_h2s, h2s);
+		return NULL;
+	}
+
+	h2s->h2c = h2c;
+	h2s->appctx = NULL;
+	h2s->st = H2_SS_OPEN;
+	h2s->errcode = H2_ERR_NO_ERROR;
+	h2s->flags = 0;
+	h2s->mws = h2c->miw;
+	h2s->res_st = H2_RS_HDR;
+	h2s->body_len = 0;
+	h2s->idx.v = NULL;
+	h2s->idx.size = global.tune.max_http_hdr;
+	h2s->idx.hash = NULL;
+	LIST_INIT(&h2s->list);
+	h2s->by_id.key = sid;
+	eb32_insert(&h2c->streams_by_id, &h2s->by_id);
+	h2c->nb_streams++;
+	return h2s;
+}
+
+/* Creates the appctx, session and stream carrying stream <h2s>. Returns 0 on
+ * success or -1 on failure, in which case the caller has to destroy <h2s>.
+ */
+static int h2s_attach_stream(struct h2s *h2s)
+{
+	struct h2c *h2c = h2s->h2c;
+	struct listener *l = h2c->sess->listener;
+	struct proxy *p = h2c->sess->fe;
+	struct appctx *appctx;
+	struct session *sess;
+	struct stream *s;
+	struct task *t;
+
+	appctx = appctx_new(&h2_applet);
+	if (!appctx)
+		goto out;
+	appctx->ctx.h2.h2s = h2s;
+
+	/* the session's origin is the connection so that all the connection
+	 * related sample fetches and log tags work as usual.
+	 */
+	sess = session_new(p, l, &h2c->conn->obj_type);
+	if (!sess)
+		goto out_free_appctx;
+
+	if ((t = task_new()) == NULL)
+		goto out_free_sess;
+	t->nice = l->nice;
+
+	if ((s = stream_new(sess, t, &appctx->obj_type)) == NULL)
+		goto out_free_task;
+
+	s->target         = l->default_target;
+	s->req.analysers |= l->analysers;
+
+	/* this is normally done by the listener, and undone at the end of
+	 * process_stream().
+	 */
+	l->nbconn++;
+	p->feconn++;
+	jobs++;
+	if (!(l->options & LI_O_UNLIMITED))
+		actconn++;
+	totalconn++;
+
+	h2s->appctx = appctx;
+	h2c->nb_sess++;
+	appctx_wakeup(appctx);
+	return 0;
+
+ out_free_task:
+	task_free(t);
+ out_free_sess:
+	session_free(sess);
+ out_free_appctx:
+	appctx_free(appctx);
+ out:
+	return -1;
+}
+
+/* aborts all the streams of connection <h2c> which is dying */
+static void h2c_abort_streams(struct h2c *h2c)
+{
+	struct eb32_node *node;
+	struct h2s *h2s;
+
+	node = eb32_first(&h2c->streams_by_id);
+	while (node) {
+		h2s = container_of(node, struct h2s, by_id);
+		node = eb32_next(node);
+
+		h2s->st = H2_SS_ERROR;
+		if (h2s->appctx)
+			appctx_wakeup(h2s->appctx);
+		else
+			h2s_destroy(h2s);
+	}
+}
+
+/* wakes up the streams waiting for room or window */
+static void h2c_wake_senders(struct h2c *h2c)
+{
+	struct h2s *h2s, *back;
+
+	list_for_each_entry_safe(h2s, back, &h2c->send_list, list) {
+		if (!h2s->appctx)
+			continue;
+		h2s->flags &= ~H2_SF_BLK_ANY;
+		LIST_DEL(&h2s->list);
+		LIST_INIT(&h2s->list);
+		appctx_wakeup(h2s->appctx);
+	}
+}
+
+/*****************************************************************/
+/* functions below are the demux                                 */
+/*****************************************************************/
+
+/* returns non-zero if <n> of length <nl> is header name <str> */
+static inline int h2_hdr_is(const char *n, int nl, const char *str)
+{
+	return nl == strlen(str) && memcmp(n, str, nl) == 0;
+}
+
+/* Returns non-zero if the <len> bytes at <str> contain a CR, LF or NUL, which
+ * are forbidden in field values (8.1.2.6) and would allow to inject extra
+ * lines into the HTTP/1 request.
+ */
+static int h2_has_crlfnul(const char *str, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (str[i] == '\r' || str[i] == '\n' || str[i] == 0)
+			return 1;
+	}
+	return 0;
+}
+
+/* Returns non-zero if the <len> bytes at <str> contain a space or a control
+ * character, which cannot appear in an HTTP/1 request line.
+ */
+static int h2_has_spctl(const char *str, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if ((unsigned char)str[i] <= 0x20 || str[i] == 0x7f)
+			return 1;
+	}
+	return 0;
+}
+
+/* Converts the <nb> decoded request headers of <list> to an HTTP/1.1 request
+ * in <out>. <es> indicates that the request has no body. The request body
+ * will have to be chunk-encoded if H2_SF_REQ_CHNK is set in <flags>. If <idx>
+ * is not NULL, the lines are indexed into it as the HTTP parser would have
+ * done, unless the URI contains characters the parser reports, in which case
+ * <idx> is released so that the request is parsed again. Returns 0 on
+ * success, -1 if the request is malformed, or -2 if it or its index does not
+ * fit.
+ */
+static int h2_make_h1_request(const struct hpack_hdr *list, int nb, int es,
+                              struct chunk *out, struct hdr_idx *idx,
+                              unsigned int *flags)
+{
+	const struct hpack_hdr *meth = NULL, *scheme = NULL, *auth = NULL, *path = NULL;
+	const struct hpack_hdr *hdr;
+	struct hpack_hdr extra;
+	int has_host = 0, has_cl = 0, regular = 0, cookies = 0;
+	int i, j, first;
+
+	for (i = 0; i < nb; i++) {
+		hdr = &list[i];
+
+		if (hdr->nl && hdr->n[0] == ':') {
+			/* pseudo-headers must be unique and come first (8.1.2.1) */
+			if (regular || h2_has_crlfnul(hdr->v, hdr->vl))
+				return -1;
+			if (h2_hdr_is(hdr->n, hdr->nl, ":method") && !meth)
+				meth = hdr;
+			else if (h2_hdr_is(hdr->n, hdr->nl, ":scheme") && !scheme)
+				scheme = hdr;
+			else if (h2_hdr_is(hdr->n, hdr->nl, ":authority") && !auth)
+				auth = hdr;
+			else if (h2_hdr_is(hdr->n, hdr->nl, ":path") && !path)
+				path = hdr;
+			else
+				return -1;
+			continue;
+		}
+
+		regular = 1;
+		if (!hdr->nl)
+			return -1;
+		for (j = 0; j < hdr->nl; j++) {
+			if ((hdr->n[j] >= 'A' && hdr->n[j] <= 'Z') || !HTTP_IS_TOKEN(hdr->n[j]))
+				return -1;
+		}
+		if (h2_has_crlfnul(hdr->v, hdr->vl))
+			return -1;
+
+		/* connection-specific headers are forbidden (8.1.2.2) */
+		if (h2_hdr_is(hdr->n, hdr->nl, "connection") ||
+		    h2_hdr_is(hdr->n, hdr->nl, "proxy-connection") ||
+		    h2_hdr_is(hdr->n, hdr->nl, "keep-alive") ||
+		    h2_hdr_is(hdr->n, hdr->nl, "upgrade") ||
+		    h2_hdr_is(hdr->n, hdr->nl, "transfer-encoding"))
+			return -1;
+		if (h2_hdr_is(hdr->n, hdr->nl, "te") &&
+		    !(hdr->vl == 8 && memcmp(hdr->v, "trailers", 8) == 0))
+			return -1;
+
+		if (h2_hdr_is(hdr->n, hdr->nl, "host"))
+			has_host = 1;
+		else if (h2_hdr_is(hdr->n, hdr->nl, "content-length"))
+			has_cl = 1;
+		else if (h2_hdr_is(hdr->n, hdr->nl, "cookie"))
+			cookies++;
+	}
+
+	/* CONNECT is not supported, the other methods need all the
+	 * pseudo-headers (8.1.2.3).
+	 */
+	if (!meth || !scheme || !path || !path->vl || !meth->vl ||
+	    h2_hdr_is(meth->v, meth->vl, "CONNECT"))
+		return -1;
+
+	/* the method and the path are placed as-is on the request line */
+	for (j = 0; j < meth->vl; j++) {
+		if (!HTTP_IS_TOKEN(meth->v[j]))
+			return -1;
+	}
+	if (h2_has_spctl(path->v, path->vl))
+		return -1;
+
+	/* the parser flags non-ASCII URIs, let it see them */
+	for (j = 0; idx && j < path->vl; j++) {
+		if ((unsigned char)path->v[j] >= 0x80) {
+			pool_free2(pool2_hdr_idx, idx->v);
+			idx->v = NULL;
+			idx = NULL;
+		}
+	}
+
+	if (h2_hdr_is(meth->v, meth->vl, "HEAD"))
+		*flags |= H2_SF_HEAD;
+
+	if (!chunk_strncat(out, meth->v, meth->vl) ||
+	    !chunk_strncat(out, " ", 1) ||
+	    !chunk_strncat(out, path->v, path->vl) ||
+	    !chunk_strncat(out, " HTTP/1.1\r\n", 11))
+		return -2;
+
+	if (idx) {
+		hdr_idx_init(idx);
+		hdr_idx_set_start(idx, out->len - 2, 1);
+	}
+
+	if (auth && !has_host) {
+		extra.n = "host";
+		extra.nl = 4;
+		extra.v = auth->v;
+		extra.vl = auth->vl;
+		if (hpack_hdrs_to_h1(&extra, 1, out, idx) < 0)
+			return -2;
+	}
+
+	/* the header fields are emitted in runs delimited by the cookies */
+	for (first = i = 0; i <= nb; i++) {
+		if (i < nb && !h2_hdr_is(list[i].n, list[i].nl, "cookie"))
+			continue;
+		if (hpack_hdrs_to_h1(list + first, i - first, out, idx) < 0)
+			return -2;
+		first = i + 1;
+	}
+
+	/* cookies may be split into several fields, they must be merged into
+	 * a single one for HTTP/1 (8.1.2.5).
+	 */
+	if (cookies) {
+		j = out->len;
+		if (!chunk_strncat(out, "cookie: ", 8))
+			return -2;
+		for (i = 0; i < nb; i++) {
+			hdr = &list[i];
+			if (!h2_hdr_is(hdr->n, hdr->nl, "cookie"))
+				continue;
+			if (!chunk_strncat(out, hdr->v, hdr->vl) ||
+			    (--cookies && !chunk_strncat(out, "; ", 2)))
+				return -2;
+		}
+		if (!chunk_strncat(out, "\r\n", 2))
+			return -2;
+		if (idx && hdr_idx_add(out->len - j - 2, 1, idx, idx->tail, out->str + j) < 0)
+			return -2;
+	}
+
+	/* a body of unknown length is chunk-encoded */
+	if (!es && !has_cl) {
+		extra.n = "transfer-encoding";
+		extra.nl = 17;
+		extra.v = "chunked";
+		extra.vl = 7;
+		if (hpack_hdrs_to_h1(&extra, 1, out, idx) < 0)
+			return -2;
+		*flags |= H2_SF_REQ_CHNK;
+	}
+
+	if (!chunk_strncat(out, "\r\n", 2))
+		return -2;
+	return 0;
+}
+
+/* Decodes the complete header block <raw> of <len> bytes sent for stream
+ * <sid> with HEADERS flags <flags>, and either creates the stream or handles
+ * the trailers. There must be room for a RST_STREAM frame in the mux buffer.
+ * Returns 1 on success or -1 on connection error.
+ */
+static int h2c_decode_headers(struct h2c *h2c, int sid, int flags, const unsigned char *raw, int len)
+{
+	struct chunk *tmp, *out;
+	struct h2s *h2s;
+	struct hdr_idx idx;
+	unsigned int sflags = 0;
+	int es = flags & H2_F_HEADERS_END_STREAM;
+	int nb, ret;
+
+	tmp = get_trash_chunk();
+	nb = hpack_decode_frame(h2c->ddht, raw, len, h2_hdr_list, global.tune.max_http_hdr, tmp);
+	if (nb < 0) {
+		h2c_error(h2c, H2_ERR_COMPRESSION_ERROR);
+		return -1;
+	}
+
+	h2s = h2c_st_by_id(h2c, sid);
+	if (h2s) {
+		/* trailers, they're dropped since HTTP/1 only supports them
+		 * with chunked encoding and few servers care.
+		 */
+		if (h2s->flags & H2_SF_ES_RCVD) {
+			h2s_reset(h2s, H2_ERR_STREAM_CLOSED);
+			return 1;
+		}
+		if (!es) {
+			h2s_reset(h2s, H2_ERR_PROTOCOL_ERROR);
+			return 1;
+		}
+		/* the demux always keeps room for the last chunk */
+		if (h2s->flags & H2_SF_REQ_CHNK)
+			h2_bi_put(h2s->rxbuf, "0\r\n\r\n", 5);
+		h2s->flags |= H2_SF_ES_RCVD;
+		h2s->st = H2_SS_HREM;
+		h2s_notify(h2s);
+		return 1;
+	}
+
+	/* the stream was already closed, and possibly reset by us */
+	if (sid <= h2c->max_id)
+		return 1;
+
+	if (!(sid & 1)) {
+		h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+		return -1;
+	}
+	h2c->max_id = sid;
+
+	if (h2c->flags & (H2_CF_GOAWAY_RCVD | H2_CF_GOAWAY_SENT))
+		return 1;
+
+	if (h2c->nb_streams >= h2_settings_max_concurrent_streams) {
+		h2c_send_rst(h2c, sid, H2_ERR_REFUSED_STREAM);
+		return 1;
+	}
+
+	/* the headers are indexed while being converted so that the stream
+	 * does not have to parse them again.
+	 */
+	idx.v = pool_alloc2(pool2_hdr_idx);
+	idx.size = global.tune.max_http_hdr;
+	idx.hash = NULL;
+
+	out = get_trash_chunk();
+	chunk_reset(out);
+	ret = h2_make_h1_request(h2_hdr_list, nb, es, out, idx.v ? &idx : NULL, &sflags);
+	if (ret == -2 && idx.v) {
+		/* the index may be the one which is full, in which case the
+		 * parser will reject the request.
+		 */
+		pool_free2(pool2_hdr_idx, idx.v);
+		idx.v = NULL;
+		chunk_reset(out);
+		sflags = 0;
+		ret = h2_make_h1_request(h2_hdr_list, nb, es, out, NULL, &sflags);
+	}
+	if (ret == 0 && out->len > global.tune.bufsize - 17)
+		ret = -2;
+	if (ret < 0) {
+		pool_free2(pool2_hdr_idx, idx.v);
+		h2c_send_rst(h2c, sid, ret == -1 ? H2_ERR_PROTOCOL_ERROR : H2_ERR_INTERNAL_ERROR);
+		return 1;
+	}
+
+	h2s = h2s_new(h2c, sid);
+	if (!h2s) {
+		pool_free2(pool2_hdr_idx, idx.v);
+		h2c_send_rst(h2c, sid, H2_ERR_REFUSED_STREAM);
+		return 1;
+	}
+
+	if (idx.v) {
+		/* the request line is "<meth> <path> HTTP/1.1" */
+		h2s->idx = idx;
+		h2s->rq_m_l = (char *)memchr(out->str, ' ', out->len) - out->str;
+		h2s->rq_u_l = idx.v[0].len - h2s->rq_m_l - 10;
+		h2s->hdr_len = out->len;
+	}
+
+	h2s->flags |= sflags;
+	if (es) {
+		h2s->flags |= H2_SF_ES_RCVD;
+		h2s->st = H2_SS_HREM;
+	}
+	h2_bi_put(h2s->rxbuf, out->str, out->len);
+
+	if (h2s_attach_stream(h2s) < 0) {
+		h2s_destroy(h2s);
+		h2c_send_rst(h2c, sid, H2_ERR_REFUSED_STREAM);
+	}
+	return 1;
+}
+
+/* Processes a HEADERS or CONTINUATION frame whose payload is complete and
+ * contiguous at the beginning of the demux buffer. Returns 1 once the frame
+ * is processed, 0 if it must be retried later, or -1 on connection error.
+ */
+static int h2c_handle_headers(struct h2c *h2c)
+{
+	const unsigned char *p = (const unsigned char *)h2c->dbuf->p;
+	int len = h2c->dfl;
+	int flags = h2c->dff;
+	int sid = h2c->dsi;
+	int pad = 0;
+
+	if (!sid) {
+		h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+		return -1;
+	}
+
+	/* the stream may need to be reset, and this must be known before
+	 * decoding since the decoder's state changes.
+	 */
+	if (h2c_mux_room(h2c) < H2_FH_SIZE + 4) {
+		h2c->flags |= H2_CF_DEM_MROOM;
+		return 0;
+	}
+
+	if (h2c->dft == H2_FT_HEADERS) {
+		if (flags & H2_F_HEADERS_PADDED) {
+			if (!len) {
+				h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+				return -1;
+			}
+			pad = *p;
+			p++;
+			len--;
+		}
+		if (flags & H2_F_HEADERS_PRIORITY) {
+			if (len < 5) {
+				h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+				return -1;
+			}
+			p += 5;
+			len -= 5;
+		}
+		if (pad > len) {
+			h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+			return -1;
+		}
+		len -= pad;
+		h2c->hff = flags;
+	}
+
+	if (!(flags & H2_F_HEADERS_END_HEADERS) || h2c->hsi) {
+		/* the block is split over several frames and must be
+		 * assembled before being decoded.
+		 */
+		if (!h2c->hsi) {
+			h2c->hbuf = &buf_empty;
+			if (!b_alloc_margin(&h2c->hbuf, 0)) {
+				h2c_error(h2c, H2_ERR_INTERNAL_ERROR);
+				return -1;
+			}
+			h2c->hsi = sid;
+		}
+		if (len > h2c->hbuf->size - h2c->hbuf->i) {
+			h2c_error(h2c, H2_ERR_ENHANCE_YOUR_CALM);
+			return -1;
+		}
+		memcpy(h2c->hbuf->data + h2c->hbuf->i, p, len);
+		h2c->hbuf->i += len;
+		if (!(flags & H2_F_HEADERS_END_HEADERS))
+			return 1;
+
+		p = (const unsigned char *)h2c->hbuf->data;
+		len = h2c->hbuf->i;
+	}
+
+	if (h2c_decode_headers(h2c, sid, h2c->hff, p, len) < 0)
+		return -1;
+
+	if (h2c->hsi) {
+		h2c->hsi = 0;
+		b_free(&h2c->hbuf);
+	}
+	return 1;
+}
+
+/* Processes (part of) a DATA frame. Returns 1 once the frame is processed, 0
+ * if it must be continued later, or -1 on connection error.
+ */
+static int h2c_handle_data(struct h2c *h2c)
+{
+	struct buffer *dbuf = h2c->dbuf;
+	struct h2s *h2s;
+	char size[12];
+	int len, room, sl;
+
+	if (!h2c->dsi) {
+		h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+		return -1;
+	}
+
+	/* only one stream's credit is tracked at a time */
+	if (h2c->rcvd_s && h2c->rcvd_sid != h2c->dsi && !h2c_send_wu(h2c)) {
+		h2c->flags |= H2_CF_DEM_MROOM;
+		return 0;
+	}
+
+	if (h2c->dff & H2_F_DATA_PADDED) {
+		if (!dbuf->i)
+			return 0;
+		if (!h2c->dfl) {
+			h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+			return -1;
+		}
+		h2c->dpl = *(unsigned char *)dbuf->p;
+		h2_bi_skip(dbuf, 1);
+		h2c->dfl--;
+		h2c->rcvd_c++;
+		if (h2c->dpl > h2c->dfl) {
+			h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+			return -1;
+		}
+		h2c->dff &= ~H2_F_DATA_PADDED;
+	}
+
+	h2s = h2c_st_by_id(h2c, h2c->dsi);
+	if (!h2s || !h2s->appctx || h2s->st != H2_SS_OPEN) {
+		if (!h2s && h2c->dsi > h2c->max_id) {
+			/* idle stream */
+			h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+			return -1;
+		}
+
+		if (h2s && h2s->st == H2_SS_HREM) {
+			if (!h2s_reset(h2s, H2_ERR_STREAM_CLOSED)) {
+				h2c->flags |= H2_CF_DEM_MROOM;
+				return 0;
+			}
+		}
+
+		/* the data are dropped but they still count for the
+		 * connection's window.
+		 */
+		len = MIN(dbuf->i, h2c->dfl);
+		h2_bi_skip(dbuf, len);
+		h2c->dfl -= len;
+		h2c->rcvd_c += len;
+		return h2c->dfl ? 0 : 1;
+	}
+
+	while (h2c->dfl > h2c->dpl) {
+		len = MIN(dbuf->i, h2c->dfl - h2c->dpl);
+		if (!len)
+			return 0;
+
+		/* with chunked encoding, keep room for the chunk's size and
+		 * CRLF, and for the last chunk.
+		 */
+		room = h2s->rxbuf->size - h2s->rxbuf->i;
+		if (h2s->flags & H2_SF_REQ_CHNK)
+			room -= 17;
+		if (len > room)
+			len = room;
+		if (len <= 0) {
+			h2c->flags |= H2_CF_DEM_SFULL;
+			h2s_notify(h2s);
+			return 0;
+		}
+
+		if (h2s->flags & H2_SF_REQ_CHNK) {
+			sl = snprintf(size, sizeof(size), "%x\r\n", len);
+			h2_bi_put(h2s->rxbuf, size, sl);
+		}
+		h2_bi_xfer(h2s->rxbuf, dbuf, len);
+		if (h2s->flags & H2_SF_REQ_CHNK)
+			h2_bi_put(h2s->rxbuf, "\r\n", 2);
+
+		h2c->dfl -= len;
+		h2c->rcvd_c += len;
+		h2c->rcvd_s += len;
+		h2c->rcvd_sid = h2c->dsi;
+		h2s_notify(h2s);
+	}
+
+	/* skip the padding */
+	len = MIN(dbuf->i, h2c->dfl);
+	h2_bi_skip(dbuf, len);
+	h2c->dfl -= len;
+	h2c->rcvd_c += len;
+	if (h2c->dfl)
+		return 0;
+
+	if (h2c->dff & H2_F_DATA_END_STREAM) {
+		if (h2s->flags & H2_SF_REQ_CHNK)
+			h2_bi_put(h2s->rxbuf, "0\r\n\r\n", 5);
+		h2s->flags |= H2_SF_ES_RCVD;
+		h2s->st = H2_SS_HREM;
+		/* no need to update the window of a closed stream */
+		h2c->rcvd_s = 0;
+		h2s_notify(h2s);
+	}
+	return 1;
+}
+
+/* processes a SETTINGS frame. Returns 1 once processed, 0 if it must be retried
+ * later, or -1 on connection error.
+ */
+static int h2c_handle_settings(struct h2c *h2c)
+{
+	const unsigned char *p = (const unsigned char *)h2c->dbuf->p;
+	struct eb32_node *node;
+	struct h2s *h2s;
+	unsigned int id, arg;
+	int ofs, delta;
+
+	if (h2c->dsi) {
+		h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+		return -1;
+	}
+
+	if (h2c->dff & H2_F_SETTINGS_ACK) {
+		if (h2c->dfl) {
+			h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+			return -1;
+		}
+		return 1;
+	}
+
+	if (h2c->dfl % 6) {
+		h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+		return -1;
+	}
+
+	/* the ACK must be sent */
+	if (h2c_mux_room(h2c) < H2_FH_SIZE) {
+		h2c->flags |= H2_CF_DEM_MROOM;
+		return 0;
+	}
+
+	for (ofs = 0; ofs < h2c->dfl; ofs += 6) {
+		id  = h2_get_n16(p + ofs);
+		arg = h2_get_n32(p + ofs + 2);
+
+		switch (id) {
+		case H2_SETTINGS_ENABLE_PUSH:
+			if (arg > 1) {
+				h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+				return -1;
+			}
+			break;
+		case H2_SETTINGS_INITIAL_WINDOW_SIZE:
+			if (arg > H2_MAX_WINDOW_SIZE) {
+				h2c_error(h2c, H2_ERR_FLOW_CONTROL_ERROR);
+				return -1;
+			}
+			/* the difference applies to all streams (6.9.2) */
+			delta = arg - h2c->miw;
+			h2c->miw = arg;
+			for (node = eb32_first(&h2c->streams_by_id); node; node = eb32_next(node)) {
+				h2s = container_of(node, struct h2s, by_id);
+				h2s->mws += delta;
+			}
+			if (delta > 0)
+				h2c_wake_senders(h2c);
+			break;
+		case H2_SETTINGS_MAX_FRAME_SIZE:
+			if (arg < H2_MIN_FRAME_SIZE || arg > H2_MAX_FRAME_SIZE) {
+				h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+				return -1;
+			}
+			h2c->mfs = arg;
+			break;
+		}
+	}
+
+	h2c_send_frame(h2c, H2_FT_SETTINGS, H2_F_SETTINGS_ACK, 0, NULL, 0);
+	return 1;
+}
+
+/* processes a WINDOW_UPDATE frame. Returns 1 once processed, 0 if it must be
+ * retried later, or -1 on connection error.
+ */
+static int h2c_handle_window_update(struct h2c *h2c)
+{
+	struct h2s *h2s;
+	int inc;
+
+	if (h2c->dfl != 4) {
+		h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+		return -1;
+	}
+
+	inc = h2_get_n32(h2c->dbuf->p) & 0x7fffffff;
+
+	if (!h2c->dsi) {
+		if (!inc) {
+			h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+			return -1;
+		}
+		if (h2c->mws >= 0 && inc > H2_MAX_WINDOW_SIZE - h2c->mws) {
+			h2c_error(h2c, H2_ERR_FLOW_CONTROL_ERROR);
+			return -1;
+		}
+		h2c->mws += inc;
+		h2c_wake_senders(h2c);
+		return 1;
+	}
+
+	h2s = h2c_st_by_id(h2c, h2c->dsi);
+	if (!h2s) {
+		if (h2c->dsi > h2c->max_id) {
+			h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+			return -1;
+		}
+		return 1;
+	}
+
+	if (!inc || (h2s->mws >= 0 && inc > H2_MAX_WINDOW_SIZE - h2s->mws)) {
+		if (!h2s_reset(h2s, inc ? H2_ERR_FLOW_CONTROL_ERROR : H2_ERR_PROTOCOL_ERROR)) {
+			h2c->flags |= H2_CF_DEM_MROOM;
+			return 0;
+		}
+		return 1;
+	}
+
+	h2s->mws += inc;
+	if (h2s->flags & H2_SF_BLK_SFCTL) {
+		h2s->flags &= ~H2_SF_BLK_ANY;
+		LIST_DEL(&h2s->list);
+		LIST_INIT(&h2s->list);
+		h2s_notify(h2s);
+	}
+	return 1;
+}
+
+/* processes the frame whose header is in <h2c>, when its payload is complete
+ * and contiguous (except for DATA frames). Returns 1 once processed, 0 if it
+ * must be retried later, or -1 on connection error.
+ */
+static int h2c_handle_frame(struct h2c *h2c)
+{
+	struct buffer *dbuf = h2c->dbuf;
+	struct h2s *h2s;
+	int ret = 1;
+
+	if (h2c->dft == H2_FT_DATA)
+		return h2c_handle_data(h2c);
+
+	/* all other frames need their whole payload */
+	if (dbuf->i < h2c->dfl)
+		return 0;
+	if (bi_contig_data(dbuf) < h2c->dfl)
+		buffer_slow_realign(dbuf);
+
+	switch (h2c->dft) {
+	case H2_FT_HEADERS:
+	case H2_FT_CONTINUATION:
+		ret = h2c_handle_headers(h2c);
+		break;
+
+	case H2_FT_SETTINGS:
+		ret = h2c_handle_settings(h2c);
+		break;
+
+	case H2_FT_WINDOW_UPDATE:
+		ret = h2c_handle_window_update(h2c);
+		break;
+
+	case H2_FT_PING:
+		if (h2c->dsi) {
+			h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+			return -1;
+		}
+		if (h2c->dfl != 8) {
+			h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+			return -1;
+		}
+		if (!(h2c->dff & H2_F_PING_ACK) &&
+		    !h2c_send_frame(h2c, H2_FT_PING, H2_F_PING_ACK, 0, dbuf->p, 8)) {
+			h2c->flags |= H2_CF_DEM_MROOM;
+			return 0;
+		}
+		break;
+
+	case H2_FT_RST_STREAM:
+		if (!h2c->dsi || h2c->dsi > h2c->max_id) {
+			h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+			return -1;
+		}
+		if (h2c->dfl != 4) {
+			h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+			return -1;
+		}
+		h2s = h2c_st_by_id(h2c, h2c->dsi);
+		if (h2s) {
+			h2s->flags |= H2_SF_RST_RCVD;
+			h2s->st = H2_SS_ERROR;
+			if (h2s->appctx)
+				appctx_wakeup(h2s->appctx);
+			else
+				h2s_destroy(h2s);
+		}
+		break;
+
+	case H2_FT_GOAWAY:
+		if (h2c->dsi) {
+			h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+			return -1;
+		}
+		if (h2c->dfl < 8) {
+			h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+			return -1;
+		}
+		h2c->flags |= H2_CF_GOAWAY_RCVD;
+		break;
+
+	case H2_FT_PRIORITY:
+		if (!h2c->dsi) {
+			h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+			return -1;
+		}
+		if (h2c->dfl != 5) {
+			h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+			return -1;
+		}
+		break;
+
+	case H2_FT_PUSH_PROMISE:
+		/* clients must not push */
+		h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+		return -1;
+
+	default:
+		/* unknown frames are ignored */
+		break;
+	}
+
+	if (ret > 0) {
+		h2_bi_skip(dbuf, h2c->dfl);
+		h2c->dfl = 0;
+	}
+	return ret;
+}
+
+/* processes as many frames as possible from the demux buffer */
+static void h2c_process_demux(struct h2c *h2c)
+{
+	struct buffer *dbuf = h2c->dbuf;
+	unsigned char hdr[H2_FH_SIZE];
+	int ret;
+
+	while (h2c->st0 < H2_CS_ERROR && !(h2c->flags & H2_CF_DEM_BLOCK_ANY)) {
+		if (h2c->st0 == H2_CS_PREFACE) {
+			if (dbuf->i < H2_CONN_PREFACE_LEN) {
+				/* reject HTTP/1 clients as soon as possible */
+				if (dbuf->i && bi_contig_data(dbuf) == dbuf->i &&
+				    memcmp(dbuf->p, H2_CONN_PREFACE, dbuf->i) != 0)
+					h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+				break;
+			}
+			if (bi_contig_data(dbuf) < H2_CONN_PREFACE_LEN)
+				buffer_slow_realign(dbuf);
+			if (memcmp(dbuf->p, H2_CONN_PREFACE, H2_CONN_PREFACE_LEN) != 0) {
+				h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+				break;
+			}
+			h2_bi_skip(dbuf, H2_CONN_PREFACE_LEN);
+			h2c_send_settings(h2c);
+			h2c->st0 = H2_CS_SETTINGS1;
+		}
+
+		if (h2c->st0 == H2_CS_SETTINGS1 || h2c->st0 == H2_CS_FRAME_H) {
+			if (dbuf->i < H2_FH_SIZE)
+				break;
+
+			h2_bi_peek(dbuf, 0, hdr, H2_FH_SIZE);
+			h2c->dfl = h2_get_n24(hdr);
+			h2c->dft = hdr[3];
+			h2c->dff = hdr[4];
+			h2c->dsi = h2_get_n32(hdr + 5) & 0x7fffffff;
+			h2c->dpl = 0;
+
+			/* the first frame must be a SETTINGS frame (3.5) */
+			if (h2c->st0 == H2_CS_SETTINGS1 &&
+			    (h2c->dft != H2_FT_SETTINGS || (h2c->dff & H2_F_SETTINGS_ACK))) {
+				h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+				break;
+			}
+
+			if (h2c->dfl > H2_MIN_FRAME_SIZE ||
+			    (h2c->dft != H2_FT_DATA && h2c->dfl > dbuf->size)) {
+				h2c_error(h2c, H2_ERR_FRAME_SIZE_ERROR);
+				break;
+			}
+
+			/* a header block must not be interrupted (6.10) */
+			if ((h2c->hsi && (h2c->dft != H2_FT_CONTINUATION || h2c->dsi != h2c->hsi)) ||
+			    (!h2c->hsi && h2c->dft == H2_FT_CONTINUATION)) {
+				h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+				break;
+			}
+
+			h2_bi_skip(dbuf, H2_FH_SIZE);
+			h2c->st0 = H2_CS_FRAME_P;
+		}
+
+		ret = h2c_handle_frame(h2c);
+		if (ret <= 0)
+			break;
+		h2c->st0 = H2_CS_FRAME_H;
+	}
+
+	h2c_send_wu(h2c);
+}
+
+/*****************************************************************/
+/* functions below are the connection's I/O and task callbacks   */
+/*****************************************************************/
+
+/* Emits the frames which do not belong to any active stream : GOAWAY and the
+ * closing frames of orphaned streams.
+ */
+static void h2c_process_mux(struct h2c *h2c)
+{
+	struct h2s *h2s, *back;
+	char buf[8];
+
+	if (h2c->st0 == H2_CS_ERROR) {
+		h2_set_n32(buf, h2c->max_id);
+		h2_set_n32(buf + 4, h2c->errcode);
+		if (!h2c_send_frame(h2c, H2_FT_GOAWAY, 0, 0, buf, 8))
+			return;
+		h2c->flags |= H2_CF_GOAWAY_SENT;
+		h2c->st0 = H2_CS_ERROR2;
+		return;
+	}
+
+	h2c_send_wu(h2c);
+
+	list_for_each_entry_safe(h2s, back, &h2c->send_list, list) {
+		if (h2s->appctx)
+			continue;
+		if (!h2s_send_close(h2s))
+			break;
+		h2s_destroy(h2s);
+	}
+}
+
+/* updates the polling of the connection */
+static void h2c_update_polling(struct h2c *h2c)
+{
+	struct connection *conn = h2c->conn;
+
+	if (h2c->st0 >= H2_CS_ERROR || h2c->dbuf->i == h2c->dbuf->size)
+		__conn_data_stop_recv(conn);
+	else
+		__conn_data_want_recv(conn);
+
+	if (h2c->mbuf->o)
+		__conn_data_want_send(conn);
+	else
+		__conn_data_stop_send(conn);
+	conn_cond_update_data_polling(conn);
+}
+
+/* Demuxes what was received and emits what has to be. The connection must
+ * not be released from here.
+ */
+static void h2c_process(struct h2c *h2c)
+{
+	h2c_process_demux(h2c);
+	h2c_process_mux(h2c);
+	h2c_update_polling(h2c);
+}
+
+/* returns non-zero if the connection must be closed */
+static int h2c_is_dead(const struct h2c *h2c)
+{
+	if ((h2c->conn->flags & (CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH)) ||
+	    (h2c->st0 == H2_CS_ERROR2 && !h2c->mbuf->o) ||
+	    ((h2c->flags & H2_CF_GOAWAY_RCVD) && !h2c->nb_streams && !h2c->mbuf->o) ||
+	    (h2c->st0 >= H2_CS_ERROR && tick_is_expired(h2c->task->expire, now_ms)))
+		return 1;
+	return 0;
+}
+
+/* Releases the connection and everything attached to it. It must not have
+ * any stream left.
+ */
+static void h2c_release(struct h2c *h2c)
+{
+	struct connection *conn = h2c->conn;
+	struct session *sess = h2c->sess;
+	struct listener *l = sess->listener;
+
+	hpack_dht_free(h2c->ddht);
+	b_free(&h2c->dbuf);
+	b_free(&h2c->mbuf);
+	if (h2c->hsi)
+		b_free(&h2c->hbuf);
+	task_delete(h2c->task);
+	task_free(h2c->task);
+	pool_free2(pool2_h2c, h2c);
+
+	conn_force_close(conn);
+	conn_free(conn);
+
+	sess->fe->feconn--;
+	if (!(l->options & LI_O_UNLIMITED))
+		actconn--;
+	jobs--;
+	l->nbconn--;
+	if (l->state == LI_FULL)
+		resume_listener(l);
+
+	/* Dequeues all of the listeners waiting for a resource */
+	if (!LIST_ISEMPTY(&global_listener_queue))
+		dequeue_all_listeners(&global_listener_queue);
+
+	if (!LIST_ISEMPTY(&sess->fe->listener_queue) &&
+	    (!sess->fe->fe_sps_lim || freq_ctr_remain(&sess->fe->fe_sess_per_sec, sess->fe->fe_sps_lim, 0) > 0))
+		dequeue_all_listeners(&sess->fe->listener_queue);
+
+	session_free(sess);
+}
+
+/* closes the connection if it is dead and nothing references it anymore.
+ * Returns 1 if it was released.
+ */
+static int h2c_check_release(struct h2c *h2c)
+{
+	if (!h2c_is_dead(h2c))
+		return 0;
+
+	h2c_abort_streams(h2c);
+	if (h2c->nb_streams || h2c->nb_sess)
+		return 0;
+
+	h2c_release(h2c);
+	return 1;
+}
+
+static void h2_recv(struct connection *conn)
+{
+	struct h2c *h2c = conn->owner;
+	struct buffer *dbuf = h2c->dbuf;
+
+	if (conn->flags & CO_FL_ERROR)
+		return;
+
+	if (dbuf->i < dbuf->size)
+		conn->xprt->rcv_buf(conn, dbuf, dbuf->size - dbuf->i);
+
+	h2c_process(h2c);
+}
+
+static void h2_send(struct connection *conn)
+{
+	struct h2c *h2c = conn->owner;
+	struct buffer *mbuf = h2c->mbuf;
+	int done = 0;
+
+	if (conn->flags & CO_FL_ERROR)
+		return;
+
+	if (mbuf->o)
+		done = conn->xprt->snd_buf(conn, mbuf, 0);
+	if (!mbuf->o)
+		mbuf->p = mbuf->data;
+
+	if (done > 0) {
+		/* there is room again */
+		h2c->flags &= ~H2_CF_DEM_MROOM;
+		h2c_process(h2c);
+		h2c_wake_senders(h2c);
+	}
+	else
+		h2c_update_polling(h2c);
+
+	if (h2c_is_dead(h2c))
+		task_wakeup(h2c->task, TASK_WOKEN_IO);
+}
+
+/* called on connection establishment, shutdowns and errors. Returns -1 if the
+ * connection was released.
+ */
+static int h2_wake(struct connection *conn)
+{
+	struct h2c *h2c = conn->owner;
+
+	if (h2c_check_release(h2c))
+		return -1;
+	return 0;
+}
+
+/* the connection's task, it handles the idle timeout and the deferred
+ * processing and releases.
+ */
+static struct task *h2_timeout_task(struct task *t)
+{
+	struct h2c *h2c = t->context;
+
+	if (tick_is_expired(t->expire, now_ms)) {
+		if (h2c->nb_streams && h2c->st0 < H2_CS_ERROR)
+			t->expire = TICK_ETERNITY;
+		else if (h2c->st0 < H2_CS_ERROR) {
+			/* idle connection, say goodbye */
+			h2c_error(h2c, H2_ERR_NO_ERROR);
+			t->expire = tick_add_ifset(now_ms, h2c->timeout);
+		}
+	}
+
+	h2c_process(h2c);
+	if (h2c_check_release(h2c))
+		return NULL;
+	return t;
+}
+
+static struct data_cb h2_conn_cb = {
+	.recv = h2_recv,
+	.send = h2_send,
+	.wake = h2_wake,
+	.name = "H2",
+};
+
+/*****************************************************************/
+/* functions below are the stream applet                         */
+/*****************************************************************/
+
+/* Returns the HTTP transaction of the stream if the request headers indexed
+ * by <h2s> may be installed into it once moved to the empty request channel
+ * <ic>, or NULL if the stream has to parse them.
+ */
+static struct http_txn *h2s_idx_txn(struct h2s *h2s, struct channel *ic)
+{
+	struct http_txn *txn = chn_strm(ic)->txn;
+	struct buffer *buf = ic->buf;
+
+	if (!txn || txn->req.msg_state != HTTP_MSG_RQBEFORE || txn->req.next ||
+	    (txn->flags & TX_NOT_FIRST) || txn->hdr_idx.size != h2s->idx.size)
+		return NULL;
+
+	/* the parser expects the headers to be contiguous */
+	if (buffer_len(buf) || buf->p + h2s->hdr_len > buf->data + buf->size ||
+	    bi_contig_data(h2s->rxbuf) < h2s->hdr_len ||
+	    channel_recv_limit(ic) < h2s->hdr_len)
+		return NULL;
+	return txn;
+}
+
+/* Installs the index of the request headers of <h2s> into <txn> and sets its
+ * request message as the parser would have once reaching the body. The
+ * headers must have been moved to the request channel.
+ */
+static void h2s_install_idx(struct h2s *h2s, struct http_txn *txn)
+{
+	struct http_msg *msg = &txn->req;
+
+	memcpy(txn->hdr_idx.v, h2s->idx.v, h2s->idx.last * sizeof(*h2s->idx.v));
+	txn->hdr_idx.tail = h2s->idx.tail;
+	txn->hdr_idx.used = h2s->idx.used;
+	txn->hdr_idx.last = h2s->idx.last;
+	hdr_idx_hash_invalidate(&txn->hdr_idx);
+
+	msg->sl.rq.m_l = h2s->rq_m_l;
+	msg->sl.rq.u = h2s->rq_m_l + 1;
+	msg->sl.rq.u_l = h2s->rq_u_l;
+	msg->sl.rq.v = msg->sl.rq.u + msg->sl.rq.u_l + 1;
+	msg->sl.rq.v_l = 8;
+	msg->sl.rq.l = msg->sl.rq.v + msg->sl.rq.v_l;
+	msg->sol = 0;
+	msg->eoh = h2s->hdr_len - 2;
+	msg->eol = 2;
+	msg->sov = msg->next = h2s->hdr_len;
+	msg->msg_state = HTTP_MSG_BODY;
+}
+
+/* moves as much as possible of the request from the stream's buffer to the
+ * request channel. The headers index built by the demux is installed into
+ * the stream on the first call when possible, and released in any case.
+ */
+static void h2s_xfer_request(struct h2s *h2s, struct channel *ic)
+{
+	struct h2c *h2c = h2s->h2c;
+	struct buffer *rxbuf = h2s->rxbuf;
+	struct http_txn *txn = NULL;
+	int len, room, moved = 0;
+
+	if (h2s->idx.v)
+		txn = h2s_idx_txn(h2s, ic);
+
+	while (rxbuf->i) {
+		room = channel_recv_limit(ic) - buffer_len(ic->buf);
+		len = MIN(bi_contig_data(rxbuf), room);
+		if (len <= 0)
+			break;
+		if (bi_putblk(ic, rxbuf->p, len) == -2) {
+			/* the request was closed, don't bother anymore */
+			moved += rxbuf->i;
+			b_reset(rxbuf);
+			break;
+		}
+		h2_bi_skip(rxbuf, len);
+		moved += len;
+	}
+
+	if (h2s->idx.v) {
+		if (txn && moved >= h2s->hdr_len && !channel_input_closed(ic))
+			h2s_install_idx(h2s, txn);
+		pool_free2(pool2_hdr_idx, h2s->idx.v);
+		h2s->idx.v = NULL;
+	}
+
+	if (moved && (h2c->flags & H2_CF_DEM_SFULL) && h2c->dsi == h2s->by_id.key) {
+		h2c->flags &= ~H2_CF_DEM_SFULL;
+		task_wakeup(h2c->task, TASK_WOKEN_IO);
+	}
+}
+
+/* Emits the response headers from <blk> of <len> bytes, HPACK-encoded, as a
+ * HEADERS frame followed by as many CONTINUATION frames as needed. Returns 1
+ * on success or 0 if there is not enough room.
+ */
+static int h2s_send_headers(struct h2s *h2s, const char *blk, int len, int es)
+{
+	struct h2c *h2c = h2s->h2c;
+	int type = H2_FT_HEADERS;
+	int flags, n;
+
+	if (h2c_mux_room(h2c) < len + H2_FH_SIZE * (len / h2c->mfs + 1))
+		return 0;
+
+	do {
+		n = MIN(len, h2c->mfs);
+		flags = (n == len) ? H2_F_HEADERS_END_HEADERS : 0;
+		if (type == H2_FT_HEADERS && es)
+			flags |= H2_F_HEADERS_END_STREAM;
+		h2c_send_frame(h2c, type, flags, h2s->by_id.key, blk, n);
+		blk += n;
+		len -= n;
+		type = H2_FT_CONTINUATION;
+	} while (len);
+	return 1;
+}
+
+/* Parses the HTTP/1 response headers at the beginning of <oc> and sends them.
+ * Returns 1 if they were sent, 0 if more data or room are needed, or -1 if the
+ * response cannot be converted.
+ */
+static int h2s_make_res_headers(struct h2s *h2s, struct channel *oc)
+{
+	struct chunk *in, *out;
+	char *p, *end, *eol, *n, *v, *ve;
+	int status, nl, es, chunked = 0, has_cl = 0, len, i;
+	unsigned long long cl = 0;
+
+	in = get_trash_chunk();
+	len = MIN(oc->buf->o, in->size);
+	if (bo_getblk(oc, in->str, len, 0) <= 0)
+		return 0;
+	p = in->str;
+	end = p + len;
+
+	/* status line : HTTP/1.x SSS reason */
+	eol = memchr(p, '\n', end - p);
+	if (!eol)
+		goto need_more;
+	if (eol - p < 12 || memcmp(p, "HTTP/1.", 7) != 0 ||
+	    !isdigit((unsigned char)p[9]) || !isdigit((unsigned char)p[10]) || !isdigit((unsigned char)p[11]))
+		return -1;
+	status = (p[9] - '0') * 100 + (p[10] - '0') * 10 + (p[11] - '0');
+	if (status == 101)
+		return -1;
+
+	out = get_trash_chunk();
+	chunk_reset(out);
+	if (!hpack_encode_status(out, status))
+		return -1;
+
+	p = eol + 1;
+	while (1) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			goto need_more;
+		ve = eol;
+		if (ve > p && ve[-1] == '\r')
+			ve--;
+		if (ve == p)
+			break; /* end of headers */
+
+		n = p;
+		p = eol + 1;
+		v = memchr(n, ':', ve - n);
+		if (!v || v == n)
+			return -1;
+		nl = v - n;
+		for (v++; v < ve && HTTP_IS_SPHT(*v); v++)
+			;
+		while (ve > v && HTTP_IS_SPHT(ve[-1]))
+			ve--;
+
+		/* names are lower case in HTTP/2 */
+		for (i = 0; i < nl; i++)
+			n[i] = tolower((unsigned char)n[i]);
+
+		if (h2_hdr_is(n, nl, "connection") ||
+		    h2_hdr_is(n, nl, "proxy-connection") ||
+		    h2_hdr_is(n, nl, "keep-alive") ||
+		    h2_hdr_is(n, nl, "upgrade"))
+			continue;
+
+		if (h2_hdr_is(n, nl, "transfer-encoding")) {
+			chunked = (ve - v >= 7 && strncasecmp(ve - 7, "chunked", 7) == 0);
+			continue;
+		}
+
+		if (h2_hdr_is(n, nl, "content-length")) {
+			has_cl = 1;
+			cl = strtoull(v, NULL, 10);
+		}
+
+		if (!hpack_encode_header(out, n, nl, v, ve - v))
+			return -1;
+	}
+	len = eol + 1 - in->str;
+
+	if (status < 200) {
+		/* interim response, the final one follows */
+		if (!h2s_send_headers(h2s, out->str, out->len, 0))
+			goto need_room;
+		bo_skip(oc, len);
+		return 1;
+	}
+
+	if ((h2s->flags & H2_SF_HEAD) || status == 204 || status == 304)
+		h2s->res_st = H2_RS_DONE;
+	else if (chunked)
+		h2s->res_st = H2_RS_CHNK_SIZE;
+	else if (has_cl) {
+		h2s->res_st = cl ? H2_RS_BODY_CL : H2_RS_DONE;
+		h2s->body_len = cl;
+	}
+	else
+		h2s->res_st = H2_RS_BODY_CLOSE;
+
+	es = (h2s->res_st == H2_RS_DONE);
+	if (!h2s_send_headers(h2s, out->str, out->len, es)) {
+		h2s->res_st = H2_RS_HDR;
+		goto need_room;
+	}
+	bo_skip(oc, len);
+	h2s->flags |= H2_SF_HDRS_SENT;
+	if (es)
+		h2s->flags |= H2_SF_ES_SENT;
+	return 1;
+
+ need_more:
+	/* the headers must fit in a buffer */
+	if (len == in->size || len >= oc->buf->size - global.tune.maxrewrite ||
+	    (oc->flags & (CF_SHUTW | CF_SHUTW_NOW)))
+		return -1;
+	return 0;
+
+ need_room:
+	h2s->flags |= H2_SF_BLK_MROOM;
+	return 0;
+}
+
+/* Sends up to <max> bytes of response body from <oc> in a DATA frame, with
+ * END_STREAM if <last> is set and everything was sent. Returns the number of
+ * bytes sent, or 0 if the stream is blocked.
+ */
+static int h2s_send_data(struct h2s *h2s, struct channel *oc, int max, int last)
+{
+	struct h2c *h2c = h2s->h2c;
+	struct buffer *buf = oc->buf;
+	char hdr[H2_FH_SIZE];
+	int len, n;
+
+	len = MIN(max, buf->o);
+	if (len > h2c->mfs)
+		len = h2c->mfs;
+	if (len > h2s->mws) {
+		len = h2s->mws;
+		if (len <= 0)
+			h2s->flags |= H2_SF_BLK_SFCTL;
+	}
+	if (len > h2c->mws) {
+		len = h2c->mws;
+		if (len <= 0)
+			h2s->flags |= H2_SF_BLK_MFCTL;
+	}
+	if (len > h2c_mux_room(h2c) - H2_FH_SIZE) {
+		len = h2c_mux_room(h2c) - H2_FH_SIZE;
+		if (len <= 0)
+			h2s->flags |= H2_SF_BLK_MROOM;
+	}
+	if (len <= 0)
+		return 0;
+
+	h2_set_frame_hdr(hdr, len, H2_FT_DATA,
+	                 (last && len == max) ? H2_F_DATA_END_STREAM : 0, h2s->by_id.key);
+	bo_putblk(h2c->mbuf, hdr, H2_FH_SIZE);
+
+	n = MIN(len, bo_contig_data(buf));
+	bo_putblk(h2c->mbuf, bo_ptr(buf), n);
+	if (len > n)
+		bo_putblk(h2c->mbuf, buf->data, len - n);
+	bo_skip(oc, len);
+
+	h2s->mws -= len;
+	h2c->mws -= len;
+	if (last && len == max)
+		h2s->flags |= H2_SF_ES_SENT;
+	return len;
+}
+
+/* Converts the HTTP/1 response available in <oc> to frames. Returns 1 if some
+ * progress was made, 0 if nothing could be done, or -1 on error.
+ */
+static int h2s_make_response(struct h2s *h2s, struct channel *oc)
+{
+	struct buffer *buf = oc->buf;
+	char line[32];
+	char *eol;
+	int progress = 0;
+	int ret, len;
+
+	while (h2s->res_st != H2_RS_DONE && !(h2s->flags & H2_SF_BLK_ANY)) {
+		switch (h2s->res_st) {
+		case H2_RS_HDR:
+			if (!buf->o)
+				return progress;
+			ret = h2s_make_res_headers(h2s, oc);
+			if (ret <= 0)
+				return ret < 0 ? ret : progress;
+			break;
+
+		case H2_RS_BODY_CL:
+		case H2_RS_CHNK_DATA:
+			if (!buf->o)
+				return progress;
+			len = MIN(h2s->body_len, (unsigned long long)buf->o);
+			ret = h2s_send_data(h2s, oc, len,
+			                    h2s->res_st == H2_RS_BODY_CL && len == h2s->body_len);
+			if (!ret)
+				return progress;
+			h2s->body_len -= ret;
+			if (!h2s->body_len)
+				h2s->res_st = (h2s->res_st == H2_RS_BODY_CL) ? H2_RS_DONE : H2_RS_CHNK_CRLF;
+			break;
+
+		case H2_RS_BODY_CLOSE:
+			if (!buf->o)
+				return progress;
+			if (!h2s_send_data(h2s, oc, buf->o, 0))
+				return progress;
+			break;
+
+		case H2_RS_CHNK_SIZE:
+		case H2_RS_TRAILERS:
+			/* chunk sizes and trailers are read line by line, only
+			 * the beginning of the line is needed.
+			 */
+			len = MIN(buf->o, (int)sizeof(line));
+			if (!len || bo_getblk(oc, line, len, 0) <= 0)
+				return progress;
+			eol = memchr(line, '\n', len);
+			if (!eol) {
+				if (len == sizeof(line) && h2s->res_st == H2_RS_TRAILERS) {
+					/* long trailer, skip what we have */
+					bo_skip(oc, len);
+					break;
+				}
+				return len == sizeof(line) ? -1 : progress;
+			}
+
+			if (h2s->res_st == H2_RS_TRAILERS) {
+				bo_skip(oc, eol + 1 - line);
+				if (eol > line && (eol[-1] != '\r' || eol - 1 > line))
+					break;
+				/* empty line, the response ends here */
+				if (!h2c_send_frame(h2s->h2c, H2_FT_DATA, H2_F_DATA_END_STREAM, h2s->by_id.key, NULL, 0)) {
+					h2s->flags |= H2_SF_BLK_MROOM;
+					return progress;
+				}
+				h2s->flags |= H2_SF_ES_SENT;
+				h2s->res_st = H2_RS_DONE;
+				break;
+			}
+
+			if (!ishex(line[0]))
+				return -1;
+			h2s->body_len = strtoull(line, NULL, 16);
+			bo_skip(oc, eol + 1 - line);
+			h2s->res_st = h2s->body_len ? H2_RS_CHNK_DATA : H2_RS_TRAILERS;
+			break;
+
+		case H2_RS_CHNK_CRLF:
+			if (!buf->o)
+				return progress;
+			if (*bo_ptr(buf) == '\r') {
+				if (buf->o < 2)
+					return progress;
+				bo_skip(oc, 1);
+			}
+			if (*bo_ptr(buf) != '\n')
+				return -1;
+			bo_skip(oc, 1);
+			h2s->res_st = H2_RS_CHNK_SIZE;
+			break;
+
+		case H2_RS_DONE:
+			break;
+		}
+		progress = 1;
+	}
+	return progress;
+}
+
+/* The stream applet's I/O handler. It moves the request to the stream and the
+ * response to the connection.
+ */
+static void h2_appctx_io_handler(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct channel *ic = si_ic(si);
+	struct channel *oc = si_oc(si);
+	struct h2s *h2s = appctx->ctx.h2.h2s;
+	struct h2c *h2c;
+	int ret;
+
+	if (unlikely(si->state == SI_ST_DIS || si->state == SI_ST_CLO))
+		return;
+
+	if (!h2s || h2s->st == H2_SS_ERROR)
+		goto abort;
+	h2c = h2s->h2c;
+
+	/* request */
+	if (h2s->rxbuf->i && ic->buf->size)
+		h2s_xfer_request(h2s, ic);
+	if (h2s->rxbuf->i)
+		si_applet_cant_put(si);
+
+	/* response */
+	ret = h2s_make_response(h2s, oc);
+	if (ret < 0) {
+		h2s_reset(h2s, H2_ERR_INTERNAL_ERROR);
+		conn_data_want_send(h2c->conn);
+		goto abort;
+	}
+	if (h2c->mbuf->o)
+		conn_data_want_send(h2c->conn);
+
+	if (h2s->res_st == H2_RS_DONE) {
+		/* the release callback sends what remains */
+		si_shutw(si);
+		si_shutr(si);
+		ic->flags |= CF_READ_NULL;
+		return;
+	}
+
+	if (h2s->flags & H2_SF_BLK_ANY) {
+		if (LIST_ISEMPTY(&h2s->list))
+			LIST_ADDQ(&h2c->send_list, &h2s->list);
+	}
+	else if (oc->flags & CF_SHUTW) {
+		/* the response ends with the stream, the release
+		 * callback sends END_STREAM or resets the stream.
+		 */
+		si_shutr(si);
+		ic->flags |= CF_READ_NULL;
+	}
+	return;
+
+ abort:
+	si_shutw(si);
+	si_shutr(si);
+	ic->flags |= CF_READ_NULL;
+	si->flags |= SI_FL_ERR;
+}
+
+/* The stream applet's release callback. The stream is detached and orphaned
+ * until its closing frame is sent.
+ */
+static void h2_appctx_release(struct appctx *appctx)
+{
+	struct h2s *h2s = appctx->ctx.h2.h2s;
+	struct h2c *h2c;
+
+	if (!h2s)
+		return;
+
+	h2c = h2s->h2c;
+	appctx->ctx.h2.h2s = NULL;
+	h2s->appctx = NULL;
+	h2s->flags &= ~H2_SF_BLK_ANY;
+	LIST_DEL(&h2s->list);
+	LIST_INIT(&h2s->list);
+
+	if (h2c->st0 >= H2_CS_ERROR || h2s_send_close(h2s)) {
+		h2s_destroy(h2s);
+	}
+	else {
+		LIST_ADDQ(&h2c->send_list, &h2s->list);
+		task_wakeup(h2c->task, TASK_WOKEN_OTHER);
+	}
+	if (h2c->mbuf->o)
+		conn_data_want_send(h2c->conn);
+}
+
+static struct applet h2_applet = {
+	.obj_type = OBJ_TYPE_APPLET,
+	.name = "<H2>",
+	.fct = h2_appctx_io_handler,
+	.release = h2_appctx_release,
+};
+
+/*****************************************************************/
+/* functions below are the entry points                          */
+/*****************************************************************/
+
+/* returns non-zero if connection <conn> accepted on listener <l> must speak
+ * HTTP/2, either because it was configured so or because it was negotiated.
+ */
+int h2c_frt_wanted(struct connection *conn, struct listener *l)
+{
+#ifdef USE_OPENSSL
+	const char *alpn;
+	int len;
+#endif
+
+	if (l->frontend->mode != PR_MODE_HTTP)
+		return 0;
+
+	if (l->options & LI_O_H2)
+		return 1;
+#ifdef USE_OPENSSL
+	if (ssl_sock_get_alpn(conn, &alpn, &len) && len == 2 && memcmp(alpn, "h2", 2) == 0)
+		return 1;
+#endif
+	return 0;
+}
+
+/* Takes over connection <conn> of session <sess>, which was just accepted, to
+ * speak HTTP/2 over it. <t> is the session's task which is reused for the
+ * connection. Returns 0 on success or -1 on failure, in which case nothing
+ * was changed.
+ */
+int h2c_frt_init(struct connection *conn, struct session *sess, struct task *t)
+{
+	struct h2c *h2c;
+
+	if (!h2_hdr_list) {
+		h2_hdr_list = calloc(global.tune.max_http_hdr, sizeof(*h2_hdr_list));
+		if (!h2_hdr_list)
+			goto fail;
+	}
+
+	h2c = pool_alloc2(pool2_h2c);
+	if (!h2c)
+		goto fail;
+
+	h2c->ddht = hpack_dht_alloc(h2_settings_header_table_size);
+	if (!h2c->ddht)
+		goto fail_free;
+
+	h2c->dbuf = h2c->mbuf = &buf_empty;
+	if (!b_alloc_margin(&h2c->dbuf, 0) || !b_alloc_margin(&h2c->mbuf, 0))
+		goto fail_buf;
+
+	h2c->conn = conn;
+	h2c->sess = sess;
+	h2c->task = t;
+	h2c->st0 = H2_CS_PREFACE;
+	h2c->errcode = H2_ERR_NO_ERROR;
+	h2c->flags = 0;
+	h2c->max_id = 0;
+	h2c->dsi = h2c->dfl = h2c->dpl = 0;
+	h2c->dft = h2c->dff = 0;
+	h2c->hsi = 0;
+	h2c->hff = 0;
+	h2c->hbuf = &buf_empty;
+	h2c->rcvd_c = h2c->rcvd_s = h2c->rcvd_sid = 0;
+	h2c->miw = H2_INITIAL_WINDOW_SIZE;
+	h2c->mws = H2_INITIAL_WINDOW_SIZE;
+	h2c->mfs = H2_MIN_FRAME_SIZE;
+	h2c->nb_streams = 0;
+	h2c->nb_sess = 0;
+	h2c->timeout = sess->fe->timeout.client;
+	h2c->streams_by_id = EB_ROOT_UNIQUE;
+	LIST_INIT(&h2c->send_list);
+
+	t->process = h2_timeout_task;
+	t->context = h2c;
+	h2c_update_timeout(h2c);
+
+	conn_attach(conn, h2c, &h2_conn_cb);
+	conn_data_want_recv(conn);
+	return 0;
+
+ fail_buf:
+	b_free(&h2c->dbuf);
+	b_free(&h2c->mbuf);
+	hpack_dht_free(h2c->ddht);
+ fail_free:
+	pool_free2(pool2_h2c, h2c);
+ fail:
+	return -1;
+}
+
+/* Called when a stream created over connection <conn> is released, once it
+ * does not reference the connection anymore.
+ */
+void h2c_stream_gone(struct connection *conn)
+{
+	struct h2c *h2c = conn->owner;
+
+	if (!--h2c->nb_sess)
+		task_wakeup(h2c->task, TASK_WOKEN_OTHER);
+}
+
+/*****************************************************************/
+/* functions below are configuration keywords                    */
+/*****************************************************************/
+
+/* parse the "proto" bind keyword */
+static int bind_parse_proto(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	struct listener *l;
+
+	if (strcmp(args[cur_arg + 1], "h2") == 0) {
+		list_for_each_entry(l, &conf->listeners, by_bind)
+			l->options |= LI_O_H2;
+	}
+	else if (strcmp(args[cur_arg + 1], "h1") == 0) {
+		list_for_each_entry(l, &conf->listeners, by_bind)
+			l->options &= ~LI_O_H2;
+	}
+	else {
+		memprintf(err, "'%s' expects 'h1' or 'h2'.", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	return 0;
+}
+
+/* parses the tune.h2.* global keywords, all taking a positive integer */
+static int h2_parse_tune(char **args, int section_type, struct proxy *curpx,
+                         struct proxy *defpx, const char *file, int line,
+                         char **err)
+{
+	long long val;
+	char *error;
+
+	val = strtoll(args[1], &error, 10);
+	if (!*args[1] || *error != '\0') {
+		memprintf(err, "'%s' expects a positive integer argument.", args[0]);
+		return -1;
+	}
+
+	if (strcmp(args[0], "tune.h2.header-table-size") == 0) {
+		if (val < 0 || val > 65535) {
+			memprintf(err, "'%s' expects a value between 0 and 65535.", args[0]);
+			return -1;
+		}
+		h2_settings_header_table_size = val;
+	}
+	else if (strcmp(args[0], "tune.h2.initial-window-size") == 0) {
+		if (val < 0 || val > H2_MAX_WINDOW_SIZE) {
+			memprintf(err, "'%s' expects a value between 0 and %d.", args[0], H2_MAX_WINDOW_SIZE);
+			return -1;
+		}
+		h2_settings_initial_window_size = val;
+	}
+	else {
+		if (val < 1 || val > 65535) {
+			memprintf(err, "'%s' expects a value between 1 and 65535.", args[0]);
+			return -1;
+		}
+		h2_settings_max_concurrent_streams = val;
+	}
+	return 0;
+}
+
+static struct bind_kw_list bind_kws = { "ALL", { }, {
+	{ "proto", bind_parse_proto, 1 }, /* set the application protocol : h1 or h2 */
+	{ NULL, NULL, 0 },
+}};
+
+static struct cfg_kw_list cfg_kws = {{ },{
+	{ CFG_GLOBAL, "tune.h2.header-table-size",      h2_parse_tune },
+	{ CFG_GLOBAL, "tune.h2.initial-window-size",    h2_parse_tune },
+	{ CFG_GLOBAL, "tune.h2.max-concurrent-streams", h2_parse_tune },
+	{ 0, NULL, NULL }
+}};
+
+#ifdef __VMS
+void __mux_h2_init(void)
+#else
+__attribute__((constructor))
+static void __mux_h2_init(void)
+#endif
+{
+	bind_register_keywords(&bind_kws);
+	cfg_register_keywords(&cfg_kws);
+	pool2_h2c = create_pool("h2c", sizeof(struct h2c), MEM_F_SHARED);
+	pool2_h2s = create_pool("h2s", sizeof(struct h2s), MEM_F_SHARED);
+}
+
+#ifndef __VMS
+__attribute__((destructor))
+#endif
+static void
+__mux_h2_deinit(void)
+{
+	pool_destroy2(pool2_h2s);
+	pool_destroy2(pool2_h2c);
+	free(h2_hdr_list);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -15,6 +15,7 @@
 
 #include <common/config.h>
 #include <common/standard.h>
+#include <common/ticks.h>
 
 #include <types/global.h>
 #include <types/pattern.h>
@@ -22,6 +23,7 @@
 #include <proto/log.h>
 #include <proto/pattern.h>
 #include <proto/sample.h>
+#include <proto/task.h>
 
 #include <ebsttree.h>
 #include <import/lru.h>
@@ -150,12 +152,45 @@ int pat_match_types[PAT_MATCH_NUM] = {
 /* this struct is used to return information */
 static struct pattern static_pattern;
 
+/* the entry of a compiled map returned in static_pattern, and its sample */
+static struct pat_ref_elt static_cmap_elt;
+static struct sample_data static_cmap_smp;
+
 /* This is the root of the list of all pattern_ref avalaibles. */
 struct list pattern_reference = LIST_HEAD_INIT(pattern_reference);
 
 static struct lru64_head *pat_lru_tree;
 static unsigned long long pat_lru_seed;
 
+/* String lists used by "sub", "beg" and "end" are matched using an automaton
+ * once they contain at least this number of patterns.
+ */
+#define PAT_AC_MIN_PATTERNS 8
+
+#ifdef USE_REGEX_DFA
+#ifndef USE_PCRE
+#error "USE_REGEX_DFA relies on PCRE for the expressions it cannot match, enable USE_PCRE."
+#endif
+/* Regex lists used by "reg" and "regm" are matched using a combined DFA once
+ * they contain at least this number of patterns.
+ */
+#define PAT_RX_MIN_PATTERNS 8
+#endif
+
+/* Number of lines loaded into a version being prepared, or of elements of a
+ * replaced version released, per call.
+ */
+#define PAT_REF_BATCH 1000
+
+/* Replaced and abandoned versions of pattern references, waiting to be
+ * released by pat_ref_purge_task.
+ */
+static struct list pat_ref_purge_list = LIST_HEAD_INIT(pat_ref_purge_list);
+static struct task *pat_ref_purge_task;
+
+/* Rebuilds the IP tables which changed enough at run time, see pat_ref_update_ipt(). */
+static struct task *pat_ipt_task;
+
 /*
  *
  * The following functions are not exported and are used by internals process
@@ -429,6 +464,36 @@ int pat_parse_ip(const char *text, struct pattern *pattern, int mflags, char **e
  *
  */
 
+/* Returns static_cmap_elt describing entry <entry> of compiled map <m>. */
+static struct pat_ref_elt *pat_cmap_elt(const struct cmap *m, int entry)
+{
+	static_cmap_elt.pattern = (char *)cmap_key(m, entry);
+	static_cmap_elt.sample = (char *)cmap_value(m, entry);
+	static_cmap_elt.line = -1;
+	return &static_cmap_elt;
+}
+
+/* Fills static_pattern with entry <entry> of the compiled map of <expr>. The
+ * sample is parsed on the fly since the map only holds its text. Returns
+ * &static_pattern, or NULL if the sample cannot be parsed, in which case the
+ * entry does not match.
+ */
+static struct pattern *pat_cmap_fill(struct pattern_expr *expr, int entry, int type)
+{
+	struct pat_ref_elt *elt = pat_cmap_elt(expr->ref->cmap, entry);
+
+	static_pattern.data = NULL;
+	if (expr->pat_head->parse_smp) {
+		if (!expr->pat_head->parse_smp(elt->sample, &static_cmap_smp))
+			return NULL;
+		static_pattern.data = &static_cmap_smp;
+	}
+	static_pattern.ref = elt;
+	static_pattern.sflags = PAT_SF_TREE;
+	static_pattern.type = type;
+	return &static_pattern;
+}
+
 /* always return false */
 struct pattern *pat_match_nothing(struct sample *smp, struct pattern_expr *expr, int fill)
 {
@@ -457,6 +522,20 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	int entry;
+
+	/* The entries of a compiled map come first */
+	if (expr->ref && expr->ref->cmap) {
+		entry = cmap_lookup_str(expr->ref->cmap, smp->data.u.str.str, smp->data.u.str.len);
+		if (entry >= 0) {
+			if (fill) {
+				if (!pat_cmap_fill(expr, entry, SMP_T_STR))
+					return NULL;
+				static_pattern.ptr.str = static_cmap_elt.pattern;
+			}
+			return &static_pattern;
+		}
+	}
 
 	/* Lookup a string in the expression's pattern tree. */
 	if (!eb_is_empty(&expr->pattern_tree)) {
@@ -546,6 +625,117 @@ struct pattern *pat_match_bin(struct sample *smp, struct pattern_expr *expr, int
 	return ret;
 }
 
+#ifdef USE_REGEX_DFA
+/* Releases the combined matcher of <expr> so that it is rebuilt from the list
+ * on next lookup. It must be called whenever the list changes.
+ */
+static void pat_rx_free(struct pattern_expr *expr)
+{
+	if (!expr->rx)
+		return;
+	rxset_free(expr->rx->set);
+	free(expr->rx->pats);
+	free(expr->rx->slow);
+	free(expr->rx);
+	expr->rx = NULL;
+}
+
+/* Returns the combined matcher of the regex list of <expr>, after building it
+ * if needed. Its <set> is NULL if the list is too short or could not be
+ * compiled, and NULL is returned on memory shortage. In both cases the list
+ * must be walked.
+ */
+static struct pat_rx *pat_list_rx(struct pattern_expr *expr)
+{
+	struct pattern_list *lst;
+	struct pat_rx *rx;
+	unsigned int count = 0;
+	int ret;
+
+	if (expr->rx)
+		return expr->rx;
+
+	rx = calloc(1, sizeof(*rx));
+	if (!rx)
+		return NULL;
+	expr->rx = rx;
+
+	list_for_each_entry(lst, &expr->patterns, list)
+		count++;
+	if (count < PAT_RX_MIN_PATTERNS)
+		return rx;
+
+	rx->pats = calloc(count, sizeof(*rx->pats));
+	rx->slow = calloc(count, sizeof(*rx->slow));
+	rx->set = rxset_new(!!(expr->mflags & PAT_MF_IGNORE_CASE));
+	if (!rx->pats || !rx->slow || !rx->set)
+		goto fail;
+
+	list_for_each_entry(lst, &expr->patterns, list) {
+		ret = lst->pat.ref ? rxset_add(rx->set, lst->pat.ref->pattern, rx->nb_pats) : 0;
+		if (ret < 0)
+			goto fail;
+		if (!ret)
+			rx->slow[rx->nb_slow++] = rx->nb_pats;
+		rx->pats[rx->nb_pats++] = &lst->pat;
+	}
+
+	/* nothing to gain if PCRE has to match all of them */
+	if (rx->nb_slow < rx->nb_pats && rxset_prepare(rx->set) == 0)
+		return rx;
+
+ fail:
+	rxset_free(rx->set);
+	rx->set = NULL;
+	return rx;
+}
+
+/* Looks the sample up using combined matcher <rx>. The patterns the matcher
+ * does not support and which precede the one it found are tried first, in
+ * list order. The matching array is filled for the first matching pattern
+ * if <cap> is set.
+ */
+static struct pattern *pat_rx_match(struct pat_rx *rx, struct sample *smp, int cap)
+{
+	struct pattern *pattern;
+	unsigned int id, i;
+	int ret;
+
+	ret = rxset_exec(rx->set, smp->data.u.str.str, smp->data.u.str.len, &id);
+	if (ret < 0) {
+		/* memory shortage, let the regex library try them all */
+		for (id = 0; id < rx->nb_pats; id++)
+			if (regex_exec2(rx->pats[id]->ptr.reg, smp->data.u.str.str, smp->data.u.str.len))
+				break;
+	}
+	else {
+		if (!ret)
+			id = rx->nb_pats;
+		for (i = 0; i < rx->nb_slow && rx->slow[i] < id; i++) {
+			if (regex_exec2(rx->pats[rx->slow[i]]->ptr.reg, smp->data.u.str.str, smp->data.u.str.len)) {
+				id = rx->slow[i];
+				break;
+			}
+		}
+	}
+
+	if (id >= rx->nb_pats)
+		return NULL;
+
+	pattern = rx->pats[id];
+	if (cap) {
+		regex_exec_match2(pattern->ptr.reg, smp->data.u.str.str, smp->data.u.str.len,
+		                  MAX_MATCH, pmatch, 0);
+		smp->ctx.a[0] = pmatch;
+	}
+	return pattern;
+}
+#else
+static inline void pat_rx_free(struct pattern_expr *expr)
+{
+}
+#endif
+
 /* Executes a regex. It temporarily changes the data to add a trailing zero,
  * and restores the previous character when leaving. This function fills
  * a matching array.
@@ -555,6 +745,13 @@ struct pattern *pat_match_regm(struct sample *smp, struct pattern_expr *expr, in
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
+#ifdef USE_REGEX_DFA
+	struct pat_rx *rx;
+
+	rx = pat_list_rx(expr);
+	if (rx && rx->set)
+		return pat_rx_match(rx, smp, 1);
+#endif
 
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
@@ -579,6 +776,9 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+#ifdef USE_REGEX_DFA
+	struct pat_rx *rx;
+#endif
 
 	if (pat_lru_tree) {
 		unsigned long long seed = pat_lru_seed ^ (long)expr;
@@ -589,6 +789,14 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 			return lru->data;
 	}
 
+#ifdef USE_REGEX_DFA
+	rx = pat_list_rx(expr);
+	if (rx && rx->set) {
+		ret = pat_rx_match(rx, smp, 0);
+		goto leave;
+	}
+#endif
+
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
@@ -598,16 +806,65 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
+#ifdef USE_REGEX_DFA
+ leave:
+#endif
 	if (lru)
 	    lru64_commit(lru, ret, expr, expr->revision, NULL);
 
 	return ret;
 }
 
+/* Returns the automaton indexing the string list of <expr>, after building it
+ * if the list has become long enough, and updating it if the list changed. It
+ * returns NULL if the list must be walked instead, which is also the case on
+ * memory shortage.
+ */
+static struct ac_tree *pat_list_ac(struct pattern_expr *expr)
+{
+	struct pattern_list *lst;
+	int count = 0;
+
+	/* rebuild a clean trie when most of its strings were deleted */
+	if (expr->ac && expr->ac->dirty && expr->ac->dead > expr->ac->live) {
+		ac_free(expr->ac);
+		expr->ac = NULL;
+	}
+
+	if (!expr->ac) {
+		list_for_each_entry(lst, &expr->patterns, list) {
+			if (++count >= PAT_AC_MIN_PATTERNS)
+				break;
+		}
+		if (count < PAT_AC_MIN_PATTERNS)
+			return NULL;
+
+		expr->ac = ac_new(expr->mflags & PAT_MF_IGNORE_CASE);
+		if (!expr->ac)
+			return NULL;
+
+		/* the list order gives the insertion order */
+		list_for_each_entry(lst, &expr->patterns, list) {
+			if (ac_insert(expr->ac, lst->pat.ptr.str, lst->pat.len, &lst->pat) < 0)
+				goto fail;
+		}
+	}
+
+	if (ac_prepare(expr->ac) < 0)
+		goto fail;
+	return expr->ac;
+
+ fail:
+	ac_free(expr->ac);
+	expr->ac = NULL;
+	return NULL;
+}
+
 /* Checks that the pattern matches the beginning of the tested string. */
 struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int fill)
 {
 	int icase;
+	struct ac_tree *ac;
 	struct ebmb_node *node;
 	char prev;
 	struct pattern_tree *elt;
@@ -649,6 +906,12 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 			return lru->data;
 	}
 
+	ac = pat_list_ac(expr);
+	if (ac) {
+		ret = ac_match_beg(ac, smp->data.u.str.str, smp->data.u.str.len);
+		goto leave;
+	}
+
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
@@ -663,7 +926,7 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 		ret = pattern;
 		break;
 	}
-
+ leave:
 	if (lru)
 	    lru64_commit(lru, ret, expr, expr->revision, NULL);
 
@@ -678,6 +941,7 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	struct ac_tree *ac;
 
 	if (pat_lru_tree) {
 		unsigned long long seed = pat_lru_seed ^ (long)expr;
@@ -688,6 +952,12 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 			return lru->data;
 	}
 
+	ac = pat_list_ac(expr);
+	if (ac) {
+		ret = ac_match_end(ac, smp->data.u.str.str, smp->data.u.str.len);
+		goto leave;
+	}
+
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
@@ -702,15 +972,15 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 		ret = pattern;
 		break;
 	}
-
+ leave:
 	if (lru)
 	    lru64_commit(lru, ret, expr, expr->revision, NULL);
 
 	return ret;
 }
 
-/* Checks that the pattern is included inside the tested string.
- * NB: Suboptimal, should be rewritten using a Boyer-Moore method.
+/* Checks that the pattern is included inside the tested string. Long lists
+ * are matched using an automaton, short ones are walked.
  */
 struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int fill)
 {
@@ -721,6 +991,7 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	struct ac_tree *ac;
 
 	if (pat_lru_tree) {
 		unsigned long long seed = pat_lru_seed ^ (long)expr;
@@ -731,6 +1002,12 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 			return lru->data;
 	}
 
+	ac = pat_list_ac(expr);
+	if (ac) {
+		ret = ac_match_sub(ac, smp->data.u.str.str, smp->data.u.str.len);
+		goto leave;
+	}
+
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
@@ -860,6 +1137,21 @@ struct pattern *pat_match_int(struct sample *smp, struct pattern_expr *expr, int
 {
 	struct pattern_list *lst;
 	struct pattern *pattern;
+	int entry;
+
+	/* The entries of a compiled map come first */
+	if (expr->ref && expr->ref->cmap) {
+		entry = cmap_lookup_int(expr->ref->cmap, smp->data.u.sint);
+		if (entry >= 0) {
+			if (fill) {
+				if (!pat_cmap_fill(expr, entry, SMP_T_SINT))
+					return NULL;
+				static_pattern.val.range.min = static_pattern.val.range.max = smp->data.u.sint;
+				static_pattern.val.range.min_set = static_pattern.val.range.max_set = 1;
+			}
+			return &static_pattern;
+		}
+	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
@@ -885,13 +1177,153 @@ struct pattern *pat_match_len(struct sample *smp, struct pattern_expr *expr, int
 	return NULL;
 }
 
+/* Looks IPv4 address <v4> in network byte order up in the networks indexed
+ * by <expr> using the longest match method. Returns &static_pattern, filled if
+ * <fill> is set, or NULL if no network matches. The prefix length is set into
+ * <len> on success.
+ */
+static struct pattern *pat_match_ip4_tree(struct pattern_expr *expr, const void *v4, int fill, unsigned int *len)
+{
+	struct ebmb_node *node;
+	struct pattern_tree *elt;
+	struct ipt_entry *e;
+
+	if (expr->ipt4) {
+		e = ipt_lookup(expr->ipt4, v4);
+		if (!e)
+			return NULL;
+		*len = e->len;
+		if (fill) {
+			static_pattern.data = e->data;
+			static_pattern.ref = (struct pat_ref_elt *)e->owner;
+			static_pattern.sflags = PAT_SF_TREE;
+			static_pattern.type = SMP_T_IPV4;
+			memcpy(&static_pattern.val.ipv4.addr.s_addr, ipt_key(expr->ipt4, e), 4);
+			if (!cidr2dotted(e->len, &static_pattern.val.ipv4.mask))
+				return NULL;
+		}
+		return &static_pattern;
+	}
+
+	node = ebmb_lookup_longest(&expr->pattern_tree, v4);
+	if (!node)
+		return NULL;
+	*len = node->node.pfx;
+	if (fill) {
+		elt = ebmb_entry(node, struct pattern_tree, node);
+		static_pattern.data = elt->data;
+		static_pattern.ref = elt->ref;
+		static_pattern.sflags = PAT_SF_TREE;
+		static_pattern.type = SMP_T_IPV4;
+		memcpy(&static_pattern.val.ipv4.addr.s_addr, elt->node.key, 4);
+		if (!cidr2dotted(elt->node.node.pfx, &static_pattern.val.ipv4.mask))
+			return NULL;
+	}
+	return &static_pattern;
+}
+
+/* Same as above for IPv6 address <v6> */
+static struct pattern *pat_match_ip6_tree(struct pattern_expr *expr, const void *v6, int fill, unsigned int *len)
+{
+	struct ebmb_node *node;
+	struct pattern_tree *elt;
+	struct ipt_entry *e;
+
+	if (expr->ipt6) {
+		e = ipt_lookup(expr->ipt6, v6);
+		if (!e)
+			return NULL;
+		*len = e->len;
+		if (fill) {
+			static_pattern.data = e->data;
+			static_pattern.ref = (struct pat_ref_elt *)e->owner;
+			static_pattern.sflags = PAT_SF_TREE;
+			static_pattern.type = SMP_T_IPV6;
+			memcpy(&static_pattern.val.ipv6.addr, ipt_key(expr->ipt6, e), 16);
+			static_pattern.val.ipv6.mask = e->len;
+		}
+		return &static_pattern;
+	}
+
+	node = ebmb_lookup_longest(&expr->pattern_tree_2, v6);
+	if (!node)
+		return NULL;
+	*len = node->node.pfx;
+	if (fill) {
+		elt = ebmb_entry(node, struct pattern_tree, node);
+		static_pattern.data = elt->data;
+		static_pattern.ref = elt->ref;
+		static_pattern.sflags = PAT_SF_TREE;
+		static_pattern.type = SMP_T_IPV6;
+		memcpy(&static_pattern.val.ipv6.addr, elt->node.key, 16);
+		static_pattern.val.ipv6.mask = elt->node.node.pfx;
+	}
+	return &static_pattern;
+}
+
+/* Looks IPv4 address <v4> in network byte order up in the networks of <expr>,
+ * including those of its compiled map, using the longest match method. The
+ * compiled map wins ties since its entries were loaded first. Returns
+ * &static_pattern, filled if <fill> is set, or NULL if no network matches.
+ */
+static struct pattern *pat_match_ip4_net(struct pattern_expr *expr, const void *v4, int fill)
+{
+	struct pattern *pattern;
+	unsigned int len = 0, clen;
+	int entry;
+
+	pattern = pat_match_ip4_tree(expr, v4, fill, &len);
+	if (!expr->ref || !expr->ref->cmap)
+		return pattern;
+
+	entry = cmap_lookup_ip(expr->ref->cmap, v4, 4, &clen);
+	if (entry < 0 || (pattern && len > clen))
+		return pattern;
+
+	if (fill) {
+		if (!pat_cmap_fill(expr, entry, SMP_T_IPV4))
+			return NULL;
+		if (!cidr2dotted(clen, &static_pattern.val.ipv4.mask))
+			return NULL;
+		memcpy(&static_pattern.val.ipv4.addr.s_addr, v4, 4);
+		static_pattern.val.ipv4.addr.s_addr &= static_pattern.val.ipv4.mask.s_addr;
+	}
+	return &static_pattern;
+}
+
+/* Same as above for IPv6 address <v6> */
+static struct pattern *pat_match_ip6_net(struct pattern_expr *expr, const void *v6, int fill)
+{
+	struct pattern *pattern;
+	unsigned int len = 0, clen, i;
+	unsigned char *addr;
+	int entry;
+
+	pattern = pat_match_ip6_tree(expr, v6, fill, &len);
+	if (!expr->ref || !expr->ref->cmap)
+		return pattern;
+
+	entry = cmap_lookup_ip(expr->ref->cmap, v6, 16, &clen);
+	if (entry < 0 || (pattern && len > clen))
+		return pattern;
+
+	if (fill) {
+		if (!pat_cmap_fill(expr, entry, SMP_T_IPV6))
+			return NULL;
+		addr = (unsigned char *)&static_pattern.val.ipv6.addr;
+		memcpy(addr, v6, 16);
+		for (i = 0; i < 16; i++)
+			if (clen < 8 * (i + 1))
+				addr[i] &= clen > 8 * i ? 0xff00 >> (clen - 8 * i) : 0;
+		static_pattern.val.ipv6.mask = clen;
+	}
+	return &static_pattern;
+}
+
 struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int fill)
 {
 	unsigned int v4; /* in network byte order */
 	struct in6_addr tmp6;
-	struct in_addr *s;
-	struct ebmb_node *node;
-	struct pattern_tree *elt;
 	struct pattern_list *lst;
 	struct pattern *pattern;
 
@@ -900,21 +1332,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		/* Lookup an IPv4 address in the expression's pattern tree using
 		 * the longest match method.
 		 */
-		s = &smp->data.u.ipv4;
-		node = ebmb_lookup_longest(&expr->pattern_tree, &s->s_addr);
-		if (node) {
-			if (fill) {
-				elt = ebmb_entry(node, struct pattern_tree, node);
-				static_pattern.data = elt->data;
-				static_pattern.ref = elt->ref;
-				static_pattern.sflags = PAT_SF_TREE;
-				static_pattern.type = SMP_T_IPV4;
-				memcpy(&static_pattern.val.ipv4.addr.s_addr, elt->node.key, 4);
-				if (!cidr2dotted(elt->node.node.pfx, &static_pattern.val.ipv4.mask))
-					return NULL;
-			}
-			return &static_pattern;
-		}
+		pattern = pat_match_ip4_net(expr, &smp->data.u.ipv4.s_addr, fill);
+		if (pattern)
+			return pattern;
 
 		/* The IPv4 sample dont match the IPv4 tree. Convert the IPv4
 		 * sample address to IPv6 with the mapping method using the ::ffff:
@@ -923,19 +1343,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		memset(&tmp6, 0, 10);
 		*(uint16_t*)&tmp6.s6_addr[10] = htons(0xffff);
 		*(uint32_t*)&tmp6.s6_addr[12] = smp->data.u.ipv4.s_addr;
-		node = ebmb_lookup_longest(&expr->pattern_tree_2, &tmp6);
-		if (node) {
-			if (fill) {
-				elt = ebmb_entry(node, struct pattern_tree, node);
-				static_pattern.data = elt->data;
-				static_pattern.ref = elt->ref;
-				static_pattern.sflags = PAT_SF_TREE;
-				static_pattern.type = SMP_T_IPV6;
-				memcpy(&static_pattern.val.ipv6.addr, elt->node.key, 16);
-				static_pattern.val.ipv6.mask = elt->node.node.pfx;
-			}
-			return &static_pattern;
-		}
+		pattern = pat_match_ip6_net(expr, &tmp6, fill);
+		if (pattern)
+			return pattern;
 	}
 
 	/* The input sample is IPv6. Try to match in the trees. */
@@ -943,19 +1353,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		/* Lookup an IPv6 address in the expression's pattern tree using
 		 * the longest match method.
 		 */
-		node = ebmb_lookup_longest(&expr->pattern_tree_2, &smp->data.u.ipv6);
-		if (node) {
-			if (fill) {
-				elt = ebmb_entry(node, struct pattern_tree, node);
-				static_pattern.data = elt->data;
-				static_pattern.ref = elt->ref;
-				static_pattern.sflags = PAT_SF_TREE;
-				static_pattern.type = SMP_T_IPV6;
-				memcpy(&static_pattern.val.ipv6.addr, elt->node.key, 16);
-				static_pattern.val.ipv6.mask = elt->node.node.pfx;
-			}
-			return &static_pattern;
-		}
+		pattern = pat_match_ip6_net(expr, &smp->data.u.ipv6, fill);
+		if (pattern)
+			return pattern;
 
 		/* Try to convert 6 to 4 when the start of the ipv6 address match the
 		 * following forms :
@@ -977,20 +1377,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 			/* Lookup an IPv4 address in the expression's pattern tree using the longest
 			 * match method.
 			 */
-			node = ebmb_lookup_longest(&expr->pattern_tree, &v4);
-			if (node) {
-				if (fill) {
-					elt = ebmb_entry(node, struct pattern_tree, node);
-					static_pattern.data = elt->data;
-					static_pattern.ref = elt->ref;
-					static_pattern.sflags = PAT_SF_TREE;
-					static_pattern.type = SMP_T_IPV4;
-					memcpy(&static_pattern.val.ipv4.addr.s_addr, elt->node.key, 4);
-					if (!cidr2dotted(elt->node.node.pfx, &static_pattern.val.ipv4.mask))
-						return NULL;
-				}
-				return &static_pattern;
-			}
+			pattern = pat_match_ip4_net(expr, &v4, fill);
+			if (pattern)
+				return pattern;
 		}
 	}
 
@@ -1049,6 +1438,19 @@ void free_pattern_tree(struct eb_root *root)
 	}
 }
 
+/* releases table <t> and the data of its entries */
+static void pat_free_ipt(struct ipt *t)
+{
+	unsigned int i;
+
+	if (!t)
+		return;
+
+	for (i = 0; i < t->nb_entries; i++)
+		free(t->entries[i].data);
+	ipt_free(t);
+}
+
 void pat_prune_val(struct pattern_expr *expr)
 {
 	struct pattern_list *pat, *tmp;
@@ -1058,6 +1460,10 @@ void pat_prune_val(struct pattern_expr *expr)
 		free(pat);
 	}
 
+	pat_free_ipt(expr->ipt4);
+	pat_free_ipt(expr->ipt6);
+	expr->ipt4 = expr->ipt6 = NULL;
+
 	free_pattern_tree(&expr->pattern_tree);
 	free_pattern_tree(&expr->pattern_tree_2);
 	LIST_INIT(&expr->patterns);
@@ -1073,6 +1479,9 @@ void pat_prune_ptr(struct pattern_expr *expr)
 		free(pat);
 	}
 
+	ac_free(expr->ac);
+	expr->ac = NULL;
+
 	free_pattern_tree(&expr->pattern_tree);
 	free_pattern_tree(&expr->pattern_tree_2);
 	LIST_INIT(&expr->patterns);
@@ -1082,6 +1491,7 @@ void pat_prune_reg(struct pattern_expr *expr)
 {
 	struct pattern_list *pat, *tmp;
 
+	pat_rx_free(expr);
 	list_for_each_entry_safe(pat, tmp, &expr->patterns, list) {
 		regex_free(pat->pat.ptr.ptr);
 		free(pat->pat.data);
@@ -1176,6 +1586,14 @@ int pat_idx_list_str(struct pattern_expr *expr, struct pattern *pat, char **err)
 	LIST_ADDQ(&expr->patterns, &patl->list);
 	expr->revision = rdtsc();
 
+	/* keep the automaton up to date if it was already built, otherwise
+	 * the next lookup will build it.
+	 */
+	if (expr->ac && ac_insert(expr->ac, patl->pat.ptr.str, patl->pat.len, &patl->pat) < 0) {
+		ac_free(expr->ac);
+		expr->ac = NULL;
+	}
+
 	/* that's ok */
 	return 1;
 }
@@ -1213,6 +1631,7 @@ int pat_idx_list_reg_cap(struct pattern_expr *expr, struct pattern *pat, int cap
 	/* chain pattern in the expression */
 	LIST_ADDQ(&expr->patterns, &patl->list);
 	expr->revision = rdtsc();
+	pat_rx_free(expr);
 
 	/* that's ok */
 	return 1;
@@ -1228,6 +1647,23 @@ int pat_idx_list_regm(struct pattern_expr *expr, struct pattern *pat, char **err
 	return pat_idx_list_reg_cap(expr, pat, 1, err);
 }
 
+/* Adds network <addr>/<len> of pattern <pat> to table <*ipt> of <klen> bytes
+ * keys, allocating it if needed. Returns 1 on success or 0 with <err> filled.
+ */
+static int pat_idx_ipt(struct pattern_expr *expr, struct ipt **ipt, unsigned int klen,
+                       const void *addr, unsigned int len, struct pattern *pat, char **err)
+{
+	if (!*ipt)
+		*ipt = ipt_new(klen);
+
+	if (!*ipt || ipt_insert(*ipt, addr, len, pat->data, pat->ref) < 0) {
+		memprintf(err, "out of memory while loading pattern");
+		return 0;
+	}
+	expr->revision = rdtsc();
+	return 1;
+}
+
 int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 {
 	unsigned int mask;
@@ -1244,6 +1680,9 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 		if (mask + (mask & -mask) == 0) {
 			mask = mask ? 33 - flsnz(mask & -mask) : 0; /* equals cidr value */
 
+			if (expr->mflags & PAT_MF_IP_TABLE)
+				return pat_idx_ipt(expr, &expr->ipt4, 4, &pat->val.ipv4.addr, mask, pat, err);
+
 			/* node memory allocation */
 			node = calloc(1, sizeof(*node) + 4);
 			if (!node) {
@@ -1273,6 +1712,9 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 	}
 	else if (pat->type == SMP_T_IPV6) {
 		/* IPv6 also can be indexed */
+		if (expr->mflags & PAT_MF_IP_TABLE)
+			return pat_idx_ipt(expr, &expr->ipt6, 16, &pat->val.ipv6.addr, pat->val.ipv6.mask, pat, err);
+
 		node = calloc(1, sizeof(*node) + 16);
 		if (!node) {
 			memprintf(err, "out of memory while loading pattern");
@@ -1399,10 +1841,51 @@ void pat_del_list_val(struct pattern_expr *expr, struct pat_ref_elt *ref)
 	expr->revision = rdtsc();
 }
 
+/* Deletes the entries of <ref> for network <key>/<len> from table <t>, or all
+ * of them if <key> is NULL.
+ */
+static void pat_del_ipt(struct ipt *t, const void *key, unsigned int len, struct pat_ref_elt *ref)
+{
+	struct ipt_entry *e;
+
+	if (!t)
+		return;
+
+	while ((e = ipt_find(t, key, len, ref))) {
+		free(e->data);
+		ipt_remove(t, e);
+	}
+}
+
 void pat_del_tree_ip(struct pattern_expr *expr, struct pat_ref_elt *ref)
 {
 	struct ebmb_node *node, *next_node;
 	struct pattern_tree *elt;
+	struct pattern pattern;
+	unsigned int mask;
+	char *err = NULL;
+
+	if (expr->mflags & PAT_MF_IP_TABLE) {
+		/* The tables are looked up by network, which the reference
+		 * tells. If it cannot be parsed anymore, they are scanned.
+		 */
+		if (!pat_parse_ip(ref->pattern, &pattern, expr->mflags | PAT_MF_NO_DNS, &err)) {
+			free(err);
+			pat_del_ipt(expr->ipt4, NULL, 0, ref);
+			pat_del_ipt(expr->ipt6, NULL, 0, ref);
+		}
+		else if (pattern.type == SMP_T_IPV4) {
+			mask = ntohl(pattern.val.ipv4.mask.s_addr);
+			if (mask + (mask & -mask) == 0)
+				pat_del_ipt(expr->ipt4, &pattern.val.ipv4.addr, mask ? 33 - flsnz(mask & -mask) : 0, ref);
+		}
+		else
+			pat_del_ipt(expr->ipt6, &pattern.val.ipv6.addr, pattern.val.ipv6.mask, ref);
+
+		pat_del_list_val(expr, ref);
+		expr->revision = rdtsc();
+		return;
+	}
 
 	/* browse each node of the tree for IPv4 addresses. */
 	for (node = ebmb_first(&expr->pattern_tree), next_node = node ? ebmb_next(node) : NULL;
@@ -1454,6 +1937,8 @@ void pat_del_list_ptr(struct pattern_expr *expr, struct pat_ref_elt *ref)
 			continue;
 
 		/* Delete and free entry. */
+		if (expr->ac)
+			ac_delete(expr->ac, pat->pat.ptr.str, pat->pat.len, &pat->pat);
 		LIST_DEL(&pat->list);
 		free(pat->pat.ptr.ptr);
 		free(pat->pat.data);
@@ -1502,6 +1987,7 @@ void pat_del_list_reg(struct pattern_expr *expr, struct pat_ref_elt *ref)
 	struct pattern_list *pat;
 	struct pattern_list *safe;
 
+	pat_rx_free(expr);
 	list_for_each_entry_safe(pat, safe, &expr->patterns, list) {
 		/* Check equality. */
 		if (pat->pat.ref != ref)
@@ -1522,6 +2008,10 @@ void pattern_init_expr(struct pattern_expr *expr)
 	expr->revision = 0;
 	expr->pattern_tree = EB_ROOT;
 	expr->pattern_tree_2 = EB_ROOT;
+	expr->ac = NULL;
+	expr->rx = NULL;
+	expr->ipt4 = NULL;
+	expr->ipt6 = NULL;
 }
 
 void pattern_init_head(struct pattern_head *head)
@@ -1579,23 +2069,102 @@ struct pat_ref *pat_ref_lookupid(int unique_id)
 	return NULL;
 }
 
-/* This function remove all pattern matching the pointer <refelt> from
- * the the reference and from each expr member of the reference. This
- * function returns 1 if the deletion is done and return 0 is the entry
- * is not found.
+/* Rebuilds IP table <t> if enough networks were added or deleted since the
+ * last build, and indexes the networks left in the delta tree. A failure only
+ * leaves the latest additions out.
  */
-int pat_ref_delete_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt)
+static void pat_ipt_update(struct ipt *t)
+{
+	if (!t)
+		return;
+	if (ipt_need_build(t))
+		ipt_build(t);
+	ipt_prepare(t);
+}
+
+static struct task *pat_ipt_process(struct task *t)
 {
+	struct pat_ref *ref;
 	struct pattern_expr *expr;
-	struct pat_ref_elt *elt, *safe;
-	struct bref *bref, *back;
 
-	/* delete pattern from reference */
-	list_for_each_entry_safe(elt, safe, &ref->head, list) {
-		if (elt == refelt) {
-			list_for_each_entry_safe(bref, back, &elt->back_refs, users) {
-				/*
-				 * we have to unlink all watchers. We must not relink them if
+	list_for_each_entry(ref, &pattern_reference, list) {
+		list_for_each_entry(expr, &ref->pat, list) {
+			pat_ipt_update(expr->ipt4);
+			pat_ipt_update(expr->ipt6);
+		}
+	}
+	return t;
+}
+
+/* Makes the networks added to the IP tables of <ref> at run time visible to
+ * the lookups. Only the delta trees are updated here, the tables which need a
+ * rebuild are left to pat_ipt_task so that it never happens in the middle of
+ * a lookup nor of the rules of a stream. They are rebuilt at once if no task
+ * is available.
+ */
+static void pat_ref_update_ipt(struct pat_ref *ref)
+{
+	struct pattern_expr *expr;
+	int build = 0;
+
+	list_for_each_entry(expr, &ref->pat, list) {
+		/* a failure only leaves the latest additions out */
+		if (expr->ipt4) {
+			ipt_prepare(expr->ipt4);
+			build |= ipt_need_build(expr->ipt4);
+		}
+		if (expr->ipt6) {
+			ipt_prepare(expr->ipt6);
+			build |= ipt_need_build(expr->ipt6);
+		}
+	}
+
+	if (!build)
+		return;
+
+	if (!pat_ipt_task) {
+		pat_ipt_task = task_new();
+		if (pat_ipt_task) {
+			pat_ipt_task->process = pat_ipt_process;
+			pat_ipt_task->context = NULL;
+			pat_ipt_task->expire = TICK_ETERNITY;
+			pat_ipt_task->nice = 1024;
+		}
+	}
+
+	if (pat_ipt_task) {
+		task_wakeup(pat_ipt_task, TASK_WOKEN_OTHER);
+		return;
+	}
+
+	list_for_each_entry(expr, &ref->pat, list) {
+		pat_ipt_update(expr->ipt4);
+		pat_ipt_update(expr->ipt6);
+	}
+}
+
+/* This function remove all pattern matching the pointer <refelt> from
+ * the the reference and from each expr member of the reference. This
+ * function returns 1 if the deletion is done and return 0 is the entry
+ * is not found.
+ */
+int pat_ref_delete_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt)
+{
+	struct pattern_expr *expr;
+	struct pat_ref_elt *elt, *safe;
+	struct bref *bref, *back;
+	int entry;
+
+	/* entries of a compiled map are only marked as deleted */
+	if (ref->cmap && (entry = cmap_entry_at(ref->cmap, refelt)) >= 0)
+		return !cmap_is_dead(ref->cmap, entry) && cmap_delete(ref->cmap, entry) == 0;
+
+	/* delete pattern from reference */
+	list_for_each_entry_safe(elt, safe, &ref->head, list) {
+		if (elt == refelt) {
+			list_for_each_entry_safe(bref, back, &elt->back_refs, users) {
+				/*
+				 * we have to unlink all watchers. We must not relink them if
 				 * this elt  was the last one in the list.
 				 */
 				LIST_DEL(&bref->users);
@@ -1606,6 +2175,7 @@ int pat_ref_delete_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt)
 			}
 			list_for_each_entry(expr, &ref->pat, list)
 				pattern_delete(expr, elt);
+			pat_ref_update_ipt(ref);
 
 			LIST_DEL(&elt->list);
 			free(elt->sample);
@@ -1627,6 +2197,7 @@ int pat_ref_delete(struct pat_ref *ref, const char *key)
 	struct pat_ref_elt *elt, *safe;
 	struct bref *bref, *back;
 	int found = 0;
+	int entry;
 
 	/* delete pattern from reference */
 	list_for_each_entry_safe(elt, safe, &ref->head, list) {
@@ -1654,8 +2225,16 @@ int pat_ref_delete(struct pat_ref *ref, const char *key)
 		}
 	}
 
+	if (ref->cmap) {
+		entry = -1;
+		while ((entry = cmap_find(ref->cmap, key, entry)) >= 0)
+			if (cmap_delete(ref->cmap, entry) == 0)
+				found = 1;
+	}
+
 	if (!found)
 		return 0;
+	pat_ref_update_ipt(ref);
 	return 1;
 }
 
@@ -1666,6 +2245,11 @@ int pat_ref_delete(struct pat_ref *ref, const char *key)
 struct pat_ref_elt *pat_ref_find_elt(struct pat_ref *ref, const char *key)
 {
 	struct pat_ref_elt *elt;
+	int entry;
+
+	/* the entries of a compiled map come first */
+	if (ref->cmap && (entry = cmap_find(ref->cmap, key, -1)) >= 0)
+		return pat_cmap_elt(ref->cmap, entry);
 
 	list_for_each_entry(elt, &ref->head, list) {
 		if (strcmp(key, elt->pattern) == 0)
@@ -1720,10 +2304,43 @@ static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
 	return 1;
 }
 
+/* Changes the sample of entry <entry> of the compiled map of <ref>, and of all
+ * the following ones with the same key if <all> is set. The mapped file cannot
+ * be changed, so the entries are deleted and replaced with a single one added
+ * to <ref>. Returns 1 on success, or 0 with <err> filled.
+ */
+static int pat_ref_set_cmap(struct pat_ref *ref, int entry, int all, const char *value, char **err)
+{
+	struct pattern_expr *expr;
+	struct sample_data test;
+	const char *key;
+
+	list_for_each_entry(expr, &ref->pat, list) {
+		if (expr->pat_head->parse_smp && !expr->pat_head->parse_smp(value, &test)) {
+			memprintf(err, "unable to parse '%s'", value);
+			return 0;
+		}
+	}
+
+	key = cmap_key(ref->cmap, entry);
+	do {
+		if (cmap_delete(ref->cmap, entry) < 0) {
+			memprintf(err, "out of memory error");
+			return 0;
+		}
+	} while (all && (entry = cmap_find(ref->cmap, key, entry)) >= 0);
+
+	return pat_ref_add(ref, key, value, err);
+}
+
 /* This function modify the sample of the first pattern that match the <key>. */
 int pat_ref_set_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt, const char *value, char **err)
 {
 	struct pat_ref_elt *elt;
+	int entry;
+
+	if (ref->cmap && (entry = cmap_entry_at(ref->cmap, refelt)) >= 0 && !cmap_is_dead(ref->cmap, entry))
+		return pat_ref_set_cmap(ref, entry, 0, value, err);
 
 	/* Look for pattern in the reference. */
 	list_for_each_entry(elt, &ref->head, list) {
@@ -1745,6 +2362,7 @@ int pat_ref_set(struct pat_ref *ref, const char *key, const char *value, char **
 	int found = 0;
 	char *_merr;
 	char **merr;
+	int entry;
 
 	if (err) {
 		merr = &_merr;
@@ -1769,6 +2387,20 @@ int pat_ref_set(struct pat_ref *ref, const char *key, const char *value, char **
 		}
 	}
 
+	/* done last so that the entry replacing them is not set twice */
+	if (ref->cmap && (entry = cmap_find(ref->cmap, key, -1)) >= 0) {
+		if (!pat_ref_set_cmap(ref, entry, 1, value, merr) && err) {
+			if (!found)
+				*err = *merr;
+			else {
+				memprintf(err, "%s, %s", *err, *merr);
+				free(*merr);
+				*merr = NULL;
+			}
+		}
+		found = 1;
+	}
+
 	if (!found) {
 		memprintf(err, "entry not found");
 		return 0;
@@ -1809,6 +2441,9 @@ struct pat_ref *pat_ref_new(const char *reference, const char *display, unsigned
 
 	ref->flags = flags;
 	ref->unique_id = -1;
+	ref->cmap = NULL;
+	ref->next = NULL;
+	ref->next_gen = ref->curr_gen = 0;
 
 	LIST_INIT(&ref->head);
 	LIST_INIT(&ref->pat);
@@ -1846,6 +2481,9 @@ struct pat_ref *pat_ref_newid(int unique_id, const char *display, unsigned int f
 	ref->reference = NULL;
 	ref->flags = flags;
 	ref->unique_id = unique_id;
+	ref->cmap = NULL;
+	ref->next = NULL;
+	ref->next_gen = ref->curr_gen = 0;
 	LIST_INIT(&ref->head);
 	LIST_INIT(&ref->pat);
 
@@ -1940,15 +2578,12 @@ int pat_ref_push(struct pat_ref_elt *elt, struct pattern_expr *expr,
 	return 1;
 }
 
-/* This function adds entry to <ref>. It can failed with memory error. The new
- * entry is added at all the pattern_expr registered in this reference. The
- * function stop on the first error encountered. It returns 0 and err is
- * filled. If an error is encountered, the complete add operation is cancelled.
- * If the insertion is a success the function returns 1.
+/* Same as pat_ref_add() but leaves the new networks of the IP tables out of
+ * the lookups until the indexes are built, for versions being loaded.
  */
-int pat_ref_add(struct pat_ref *ref,
-                const char *pattern, const char *sample,
-                char **err)
+static int __pat_ref_add(struct pat_ref *ref,
+                         const char *pattern, const char *sample,
+                         char **err)
 {
 	struct pat_ref_elt *elt;
 	struct pattern_expr *expr;
@@ -1993,6 +2628,22 @@ int pat_ref_add(struct pat_ref *ref,
 	return 1;
 }
 
+/* This function adds entry to <ref>. It can failed with memory error. The new
+ * entry is added at all the pattern_expr registered in this reference. The
+ * function stop on the first error encountered. It returns 0 and err is
+ * filled. If an error is encountered, the complete add operation is cancelled.
+ * If the insertion is a success the function returns 1.
+ */
+int pat_ref_add(struct pat_ref *ref,
+                const char *pattern, const char *sample,
+                char **err)
+{
+	if (!__pat_ref_add(ref, pattern, sample, err))
+		return 0;
+	pat_ref_update_ipt(ref);
+	return 1;
+}
+
 /* This function prune <ref>, replace all reference by the references
  * of <replace>, and reindex all the news values.
  *
@@ -2009,6 +2660,8 @@ void pat_ref_reload(struct pat_ref *ref, struct pat_ref *replace)
 
 	LIST_ADD(&replace->head, &ref->head);
 	LIST_DEL(&replace->head);
+	ref->cmap = replace->cmap;
+	replace->cmap = NULL;
 
 	list_for_each_entry(elt, &ref->head, list) {
 		list_for_each_entry(expr, &ref->pat, list) {
@@ -2019,6 +2672,7 @@ void pat_ref_reload(struct pat_ref *ref, struct pat_ref *replace)
 			}
 		}
 	}
+	pat_ref_update_ipt(ref);
 }
 
 /* This function prune all entries of <ref>. This function
@@ -2048,6 +2702,9 @@ void pat_ref_prune(struct pat_ref *ref)
 		free(elt);
 	}
 
+	cmap_close(ref->cmap);
+	ref->cmap = NULL;
+
 	list_for_each_entry(expr, &ref->pat, list)
 		expr->pat_head->prune(expr);
 }
@@ -2158,14 +2815,13 @@ struct pattern_expr *pattern_new_expr(struct pattern_head *head, struct pat_ref
 	return expr;
 }
 
-/* Reads patterns from a file. If <err_msg> is non-NULL, an error message will
- * be returned there on errors and the caller will have to free it.
+/* Splits line <line> of a map file into a key and a value, which are returned
+ * into <key> and <value>. The line is modified to terminate them.
  *
- * The file contains one key + value per line. Lines which start with '#' are
- * ignored, just like empty lines. Leading tabs/spaces are stripped. The key is
- * then the first "word" (series of non-space/tabs characters), and the value is
- * what follows this series of space/tab till the end of the line excluding
- * trailing spaces/tabs.
+ * Lines which start with '#' are ignored, just like empty lines. Leading
+ * tabs/spaces are stripped. The key is then the first "word" (series of
+ * non-space/tabs characters), and the value is what follows this series of
+ * space/tab till the end of the line excluding trailing spaces/tabs.
  *
  * Example :
  *
@@ -2178,18 +2834,78 @@ struct pattern_expr *pattern_new_expr(struct pattern_head *head, struct pat_ref
  *      |       `------------------------ key
  *      `-------------------------------- leading spaces ignored
  *
+ * Returns 0 if the line is to be ignored, otherwise non-zero.
+ */
+int pat_ref_split_line(char *line, char **key, char **value)
+{
+	char *c = line;
+	char *key_end;
+	char *value_end;
+
+	/* ignore lines beginning with a dash */
+	if (*c == '#')
+		return 0;
+
+	/* strip leading spaces and tabs */
+	while (*c == ' ' || *c == '\t')
+		c++;
+
+	/* empty lines are ignored too */
+	if (*c == '\0' || *c == '\r' || *c == '\n')
+		return 0;
+
+	/* look for the end of the key */
+	*key = c;
+	while (*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
+		c++;
+
+	key_end = c;
+
+	/* strip middle spaces and tabs */
+	while (*c == ' ' || *c == '\t')
+		c++;
+
+	/* look for the end of the value, it is the end of the line */
+	*value = c;
+	while (*c && *c != '\n' && *c != '\r')
+		c++;
+	value_end = c;
+
+	/* trim possibly trailing spaces and tabs */
+	while (value_end > *value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+		value_end--;
+
+	/* set final \0 */
+	*key_end = '\0';
+	*value_end = '\0';
+	return 1;
+}
+
+/* Reads patterns from a file. If <err_msg> is non-NULL, an error message will
+ * be returned there on errors and the caller will have to free it.
+ *
+ * The file contains one key + value per line, as described above
+ * pat_ref_split_line(). It may also be a map compiled by map_compile(), in
+ * which case it is only mapped into memory and attached to <ref>.
+ *
  * Return non-zero in case of succes, otherwise 0.
  */
 int pat_ref_read_from_file_smp(struct pat_ref *ref, const char *filename, char **err)
 {
 	FILE *file;
-	char *c;
+	const char *msg;
 	int ret = 0;
 	int line = 0;
-	char *key_beg;
-	char *key_end;
-	char *value_beg;
-	char *value_end;
+	char *key;
+	char *value;
+
+	ref->cmap = cmap_open(filename, &msg);
+	if (ref->cmap)
+		return 1;
+	if (msg) {
+		memprintf(err, "failed to load compiled map <%s> : %s", filename, msg);
+		return 0;
+	}
 
 	file = fopen(filename, "r");
 	if (!file) {
@@ -2203,47 +2919,11 @@ int pat_ref_read_from_file_smp(struct pat_ref *ref, const char *filename, char *
 	 */
 	while (fgets(trash.str, trash.size, file) != NULL) {
 		line++;
-		c = trash.str;
-
-		/* ignore lines beginning with a dash */
-		if (*c == '#')
+		if (!pat_ref_split_line(trash.str, &key, &value))
 			continue;
 
-		/* strip leading spaces and tabs */
-		while (*c == ' ' || *c == '\t')
-			c++;
-
-		/* empty lines are ignored too */
-		if (*c == '\0' || *c == '\r' || *c == '\n')
-			continue;
-
-		/* look for the end of the key */
-		key_beg = c;
-		while (*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
-			c++;
-
-		key_end = c;
-
-		/* strip middle spaces and tabs */
-		while (*c == ' ' || *c == '\t')
-			c++;
-
-		/* look for the end of the value, it is the end of the line */
-		value_beg = c;
-		while (*c && *c != '\n' && *c != '\r')
-			c++;
-		value_end = c;
-
-		/* trim possibly trailing spaces and tabs */
-		while (value_end > value_beg && (value_end[-1] == ' ' || value_end[-1] == '\t'))
-			value_end--;
-
-		/* set final \0 and check entries */
-		*key_end = '\0';
-		*value_end = '\0';
-
 		/* insert values */
-		if (!pat_ref_append(ref, key_beg, value_beg, line)) {
+		if (!pat_ref_append(ref, key, value, line)) {
 			memprintf(err, "out of memory");
 			goto out_close;
 		}
@@ -2257,6 +2937,33 @@ int pat_ref_read_from_file_smp(struct pat_ref *ref, const char *filename, char *
 	return ret;
 }
 
+/* Extracts the pattern of line <line> of an ACL file into <pattern>. The line
+ * is modified to terminate it. The file may contain only one pattern per line.
+ * If the line contains spaces, they will be part of the pattern. The pattern
+ * stops at the first CR, LF or EOF encountered. Leading spaces and tabs are
+ * stripped. Returns 0 if the line is empty or a comment, otherwise non-zero.
+ */
+static int pat_ref_split_pattern(char *line, char **pattern)
+{
+	char *c = line;
+
+	/* ignore lines beginning with a dash */
+	if (*c == '#')
+		return 0;
+
+	/* strip leading spaces and tabs */
+	while (*c == ' ' || *c == '\t')
+		c++;
+
+	*pattern = c;
+	while (*c && *c != '\n' && *c != '\r')
+		c++;
+	*c = 0;
+
+	/* empty lines are ignored too */
+	return c != *pattern;
+}
+
 /* Reads patterns from a file. If <err_msg> is non-NULL, an error message will
  * be returned there on errors and the caller will have to free it.
  */
@@ -2282,22 +2989,12 @@ int pat_ref_read_from_file(struct pat_ref *ref, const char *filename, char **err
 		line++;
 		c = trash.str;
 
-		/* ignore lines beginning with a dash */
-		if (*c == '#')
-			continue;
-
-		/* strip leading spaces and tabs */
-		while (*c == ' ' || *c == '\t')
-			c++;
-
-
-		arg = c;
-		while (*c && *c != '\n' && *c != '\r')
-			c++;
-		*c = 0;
+		if (line == 1 && strncmp(c, CMAP_MAGIC_PREFIX, strlen(CMAP_MAGIC_PREFIX)) == 0) {
+			memprintf(err, "compiled map file <%s> cannot be used as a list of patterns", filename);
+			goto out_close;
+		}
 
-		/* empty lines are ignored too */
-		if (c == arg)
+		if (!pat_ref_split_pattern(c, &arg))
 			continue;
 
 		if (!pat_ref_append(ref, arg, NULL, line)) {
@@ -2313,6 +3010,22 @@ int pat_ref_read_from_file(struct pat_ref *ref, const char *filename, char **err
 	return ret;
 }
 
+/* Returns non-zero if compiled map <m> can be used by pattern <head> with
+ * matching flags <mflags>.
+ */
+static int pat_cmap_usable(const struct cmap *m, const struct pattern_head *head, int mflags)
+{
+	switch (m->kind) {
+	case CMAP_STR:
+		return head->match == pat_match_str && !(mflags & PAT_MF_IGNORE_CASE);
+	case CMAP_INT:
+		return head->match == pat_match_int;
+	case CMAP_IP:
+		return head->match == pat_match_ip;
+	}
+	return 0;
+}
+
 int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
                            const char *filename, int patflags, int load_smp,
                            char **err, const char *file, int line)
@@ -2388,6 +3101,16 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 		ref->flags |= refflags;
 	}
 
+	/* A compiled map is only looked up by the match method it was
+	 * compiled for.
+	 */
+	if (ref->cmap && !pat_cmap_usable(ref->cmap, head, patflags)) {
+		memprintf(err, "compiled map file \"%s\" cannot be matched this way, "
+		               "it was compiled for %s keys",
+		               filename, cmap_kinds[ref->cmap->kind]);
+		return 0;
+	}
+
 	/* Now, we can loading patterns from the reference. */
 
 	/* Lookup for existing reference in the head. If the reference
@@ -2421,6 +3144,359 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 	return 1;
 }
 
+/* Moves the elements of list <from> to empty list <to>. */
+static void pat_move_list(struct list *to, struct list *from)
+{
+	if (LIST_ISEMPTY(from)) {
+		LIST_INIT(to);
+		return;
+	}
+	*to = *from;
+	to->n->p = to;
+	to->p->n = to;
+	LIST_INIT(from);
+}
+
+/* Moves the nodes of tree <from> to empty tree <to>. Only the top node refers
+ * to the root.
+ */
+static void pat_move_tree(struct eb_root *to, struct eb_root *from)
+{
+	eb_troot_t *top = from->b[EB_LEFT];
+
+	to->b[EB_LEFT] = top;
+	from->b[EB_LEFT] = NULL;
+	if (!top)
+		return;
+
+	if (eb_gettag(top) == EB_LEAF)
+		eb_root_to_node(eb_untag(top, EB_LEAF))->leaf_p = eb_dotag(to, EB_LEFT);
+	else
+		eb_root_to_node(eb_untag(top, EB_NODE))->node_p = eb_dotag(to, EB_LEFT);
+}
+
+/* Exchanges the patterns and indexes of <a> and <b>, which were created for
+ * the same pattern head and flags. The revision of <a> is updated so that the
+ * lookups cached for its previous patterns are not used anymore.
+ */
+static void pattern_swap_expr(struct pattern_expr *a, struct pattern_expr *b)
+{
+	struct pattern_expr tmp;
+
+	pattern_init_expr(&tmp);
+
+	pat_move_list(&tmp.patterns, &a->patterns);
+	pat_move_list(&a->patterns, &b->patterns);
+	pat_move_list(&b->patterns, &tmp.patterns);
+
+	pat_move_tree(&tmp.pattern_tree, &a->pattern_tree);
+	pat_move_tree(&a->pattern_tree, &b->pattern_tree);
+	pat_move_tree(&b->pattern_tree, &tmp.pattern_tree);
+
+	pat_move_tree(&tmp.pattern_tree_2, &a->pattern_tree_2);
+	pat_move_tree(&a->pattern_tree_2, &b->pattern_tree_2);
+	pat_move_tree(&b->pattern_tree_2, &tmp.pattern_tree_2);
+
+	tmp.ac   = a->ac;   a->ac   = b->ac;   b->ac   = tmp.ac;
+	tmp.rx   = a->rx;   a->rx   = b->rx;   b->rx   = tmp.rx;
+	tmp.ipt4 = a->ipt4; a->ipt4 = b->ipt4; b->ipt4 = tmp.ipt4;
+	tmp.ipt6 = a->ipt6; a->ipt6 = b->ipt6; b->ipt6 = tmp.ipt6;
+
+	a->revision++;
+}
+
+/* Builds the indexes of the expressions of <ref>. The pattern lists are
+ * otherwise indexed on the first lookup after a change, and a failure only
+ * leaves it to the lookups. The IP tables are never built by the lookups.
+ */
+static void pat_ref_build_indexes(struct pat_ref *ref)
+{
+	struct pattern_expr *expr;
+	struct pattern *(*match)(struct sample *, struct pattern_expr *, int);
+
+	list_for_each_entry(expr, &ref->pat, list) {
+		pat_ipt_update(expr->ipt4);
+		pat_ipt_update(expr->ipt6);
+
+		match = expr->pat_head->match;
+		if (match == pat_match_beg || match == pat_match_end || match == pat_match_sub)
+			pat_list_ac(expr);
+#ifdef USE_REGEX_DFA
+		else if (match == pat_match_reg || match == pat_match_regm)
+			pat_list_rx(expr);
+#endif
+	}
+}
+
+/* Releases up to <count> nodes of tree <root> like free_pattern_tree(). Returns
+ * the number of nodes released.
+ */
+static int pat_free_tree_nodes(struct eb_root *root, int count)
+{
+	struct eb_node *node;
+	struct pattern_tree *elt;
+	int done;
+
+	for (done = 0; done < count && (node = eb_first(root)); done++) {
+		eb_delete(node);
+		elt = container_of(node, struct pattern_tree, node);
+		free(elt->data);
+		free(elt);
+	}
+	return done;
+}
+
+/* Releases the versions of pat_ref_purge_list, PAT_REF_BATCH elements at a
+ * time so that replacing a large map does not stall the process. Returns
+ * non-zero if some remain.
+ */
+static int pat_ref_purge_batch(void)
+{
+	struct pat_ref *gen;
+	struct pattern_expr *expr;
+	struct pat_ref_elt *elt;
+	struct bref *bref, *back;
+	int budget = PAT_REF_BATCH;
+
+	while (budget > 0 && !LIST_ISEMPTY(&pat_ref_purge_list)) {
+		gen = LIST_NEXT(&pat_ref_purge_list, struct pat_ref *, list);
+
+		if (!LIST_ISEMPTY(&gen->pat)) {
+			expr = LIST_NEXT(&gen->pat, struct pattern_expr *, list);
+			/* the trees hold most large maps, they are released
+			 * progressively before the rest is pruned at once.
+			 */
+			budget -= pat_free_tree_nodes(&expr->pattern_tree, budget);
+			budget -= pat_free_tree_nodes(&expr->pattern_tree_2, budget);
+			if (budget <= 0)
+				break;
+			LIST_DEL(&expr->list);
+			expr->pat_head->prune(expr);
+			free(expr);
+			break;
+		}
+
+		if (!LIST_ISEMPTY(&gen->head)) {
+			elt = LIST_NEXT(&gen->head, struct pat_ref_elt *, list);
+			/* the dumps in progress notice the new version and stop */
+			list_for_each_entry_safe(bref, back, &elt->back_refs, users) {
+				LIST_DEL(&bref->users);
+				LIST_INIT(&bref->users);
+			}
+			LIST_DEL(&elt->list);
+			free(elt->pattern);
+			free(elt->sample);
+			free(elt);
+			budget--;
+			continue;
+		}
+
+		LIST_DEL(&gen->list);
+		cmap_close(gen->cmap);
+		free(gen);
+	}
+
+	return !LIST_ISEMPTY(&pat_ref_purge_list);
+}
+
+static struct task *pat_ref_purge(struct task *t)
+{
+	if (pat_ref_purge_batch())
+		task_wakeup(t, TASK_WOKEN_OTHER);
+	return t;
+}
+
+/* Queues version <gen>, which is not attached to its reference anymore, to be
+ * released in the background. It is released at once if no task is available.
+ */
+static void pat_ref_discard(struct pat_ref *gen)
+{
+	LIST_ADDQ(&pat_ref_purge_list, &gen->list);
+
+	if (!pat_ref_purge_task) {
+		pat_ref_purge_task = task_new();
+		if (pat_ref_purge_task) {
+			pat_ref_purge_task->process = pat_ref_purge;
+			pat_ref_purge_task->context = NULL;
+			pat_ref_purge_task->expire = TICK_ETERNITY;
+			pat_ref_purge_task->nice = 1024;
+		}
+	}
+
+	if (pat_ref_purge_task) {
+		task_wakeup(pat_ref_purge_task, TASK_WOKEN_OTHER);
+		return;
+	}
+
+	while (pat_ref_purge_batch())
+		;
+}
+
+/* Creates a new empty version of <ref>, with one pattern expression per
+ * expression of <ref>, to be filled with pat_ref_add() and swapped in by
+ * pat_ref_commit(). It replaces the version being prepared, if any, and its
+ * number is found in ref->next_gen. Returns it, or NULL on memory shortage.
+ */
+struct pat_ref *pat_ref_prepare(struct pat_ref *ref)
+{
+	struct pat_ref *gen;
+	struct pattern_expr *expr, *copy;
+
+	gen = calloc(1, sizeof(*gen));
+	if (!gen)
+		return NULL;
+
+	gen->flags = ref->flags;
+	gen->unique_id = ref->unique_id;
+	LIST_INIT(&gen->head);
+	LIST_INIT(&gen->pat);
+
+	list_for_each_entry(expr, &ref->pat, list) {
+		copy = malloc(sizeof(*copy));
+		if (!copy) {
+			pat_ref_discard(gen);
+			return NULL;
+		}
+		pattern_init_expr(copy);
+		copy->mflags = expr->mflags;
+		copy->pat_head = expr->pat_head;
+		copy->ref = gen;
+		LIST_ADDQ(&gen->pat, &copy->list);
+	}
+
+	pat_ref_abort(ref, ref->next_gen);
+	ref->next = gen;
+	ref->next_gen++;
+	return gen;
+}
+
+/* Discards version <gen> of <ref> if it is still being prepared. */
+void pat_ref_abort(struct pat_ref *ref, unsigned int gen)
+{
+	struct pat_ref *next = pat_ref_gen(ref, gen);
+
+	if (next) {
+		ref->next = NULL;
+		pat_ref_discard(next);
+	}
+}
+
+/* Opens file <filename> to be loaded into version <gen> by
+ * pat_ref_load_gen(). A compiled map is mapped at once, in which case <file>
+ * is set to NULL. Returns 0 and fills <err> on error, otherwise non-zero.
+ */
+int pat_ref_open_gen(struct pat_ref *gen, const char *filename, FILE **file, char **err)
+{
+	struct pattern_expr *expr;
+	const char *msg;
+
+	*file = NULL;
+	if (gen->flags & PAT_REF_SMP) {
+		gen->cmap = cmap_open(filename, &msg);
+		if (gen->cmap) {
+			list_for_each_entry(expr, &gen->pat, list) {
+				if (!pat_cmap_usable(gen->cmap, expr->pat_head, expr->mflags)) {
+					memprintf(err, "compiled map file <%s> cannot be matched this way, it was compiled for %s keys",
+					          filename, cmap_kinds[gen->cmap->kind]);
+					return 0;
+				}
+			}
+			return 1;
+		}
+		if (msg) {
+			memprintf(err, "failed to load compiled map <%s> : %s", filename, msg);
+			return 0;
+		}
+	}
+
+	*file = fopen(filename, "r");
+	if (!*file) {
+		memprintf(err, "failed to open pattern file <%s>", filename);
+		return 0;
+	}
+	return 1;
+}
+
+/* Loads the next PAT_REF_BATCH lines of <file> into version <gen>, <line>
+ * holding the number of the last line read. The indexes are built once the
+ * whole file is loaded. Returns 1 once done, 0 if lines remain, or -1 with
+ * <err> filled on error.
+ */
+int pat_ref_load_gen(struct pat_ref *gen, FILE *file, int *line, char **err)
+{
+	char *key, *value;
+	int count;
+
+	for (count = 0; count < PAT_REF_BATCH; count++) {
+		if (fgets(trash.str, trash.size, file) == NULL) {
+			if (ferror(file)) {
+				memprintf(err, "read error after line %d", *line);
+				return -1;
+			}
+			pat_ref_build_indexes(gen);
+			return 1;
+		}
+		(*line)++;
+
+		if (gen->flags & PAT_REF_SMP) {
+			if (!pat_ref_split_line(trash.str, &key, &value))
+				continue;
+		}
+		else {
+			if (*line == 1 && strncmp(trash.str, CMAP_MAGIC_PREFIX, strlen(CMAP_MAGIC_PREFIX)) == 0) {
+				memprintf(err, "a compiled map cannot be used as a list of patterns");
+				return -1;
+			}
+			if (!pat_ref_split_pattern(trash.str, &key))
+				continue;
+			value = NULL;
+		}
+
+		if (!__pat_ref_add(gen, key, value, err)) {
+			if (*err)
+				memprintf(err, "%s at line %d", *err, *line);
+			else
+				memprintf(err, "out of memory error at line %d", *line);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Replaces the contents of <ref> with those of the version being prepared,
+ * which must exist and be loaded. It is done at once, so that lookups find
+ * either version in full, and the indexes which are still missing are built
+ * before. The previous contents are released in the background.
+ */
+void pat_ref_commit(struct pat_ref *ref)
+{
+	struct pat_ref *gen = ref->next;
+	struct pattern_expr *expr, *copy;
+	struct cmap *cmap;
+	struct list tmp;
+
+	pat_ref_build_indexes(gen);
+
+	/* both lists of expressions were built in the same order */
+	copy = LIST_NEXT(&gen->pat, struct pattern_expr *, list);
+	list_for_each_entry(expr, &ref->pat, list) {
+		pattern_swap_expr(expr, copy);
+		copy = LIST_NEXT(&copy->list, struct pattern_expr *, list);
+	}
+
+	pat_move_list(&tmp, &ref->head);
+	pat_move_list(&ref->head, &gen->head);
+	pat_move_list(&gen->head, &tmp);
+
+	cmap = ref->cmap;
+	ref->cmap = gen->cmap;
+	gen->cmap = cmap;
+
+	ref->curr_gen = ref->next_gen;
+	ref->next = NULL;
+	pat_ref_discard(gen);
+}
+
 /* This function executes a pattern match on a sample. It applies pattern <expr>
  * to sample <smp>. The function returns NULL if the sample dont match. It returns
  * non-null if the sample match. If <fill> is true and the sample match, the
@@ -2481,6 +3557,13 @@ struct sample_data **pattern_find_smp(struct pattern_expr *expr, struct pat_ref_
 	struct ebmb_node *node;
 	struct pattern_tree *elt;
 	struct pattern_list *pat;
+	struct ipt_entry *e;
+
+	if (expr->ipt4 && (e = ipt_find(expr->ipt4, NULL, 0, ref)))
+		return (struct sample_data **)&e->data;
+
+	if (expr->ipt6 && (e = ipt_find(expr->ipt6, NULL, 0, ref)))
+		return (struct sample_data **)&e->data;
 
 	for (node = ebmb_first(&expr->pattern_tree);
 	     node;
@@ -2522,6 +3605,7 @@ void pattern_finalize_config(void)
 {
 	int i = 0;
 	struct pat_ref *ref, *ref2, *ref3;
+	struct pattern_expr *expr;
 	struct list pr = LIST_HEAD_INIT(pr);
 
 	pat_lru_seed = random();
@@ -2564,4 +3648,12 @@ void pattern_finalize_config(void)
 	/* swap root */
 	LIST_ADD(&pr, &pattern_reference);
 	LIST_DEL(&pr);
+
+	/* the IP tables are not built by the lookups */
+	list_for_each_entry(ref, &pattern_reference, list) {
+		list_for_each_entry(expr, &ref->pat, list) {
+			pat_ipt_update(expr->ipt4);
+			pat_ipt_update(expr->ipt6);
+		}
+	}
 }
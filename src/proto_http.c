@@ -30,6 +30,7 @@
 #include <common/compat.h>
 #include <common/config.h>
 #include <common/debug.h>
+#include <common/http_scan.h>
 #include <common/memory.h>
 #include <common/mini-clist.h>
 #include <common/standard.h>
@@ -276,6 +277,9 @@ fd_set http_encode_map[(sizeof(fd_set) > (256/8)) ? 1 : ((256/8) / sizeof(fd_set
 #error "Check if your OS uses bitfields for fd_sets"
 #endif
 
+/* non-zero when the cost of http-request rules is measured */
+static int http_rules_profiling = 0;
+
 static int http_apply_redirect_rule(struct redirect_rule *rule, struct stream *s, struct http_txn *txn);
 
 static inline int http_msg_forward_body(struct stream *s, struct http_msg *msg);
@@ -664,7 +668,7 @@ int http_header_add_tail(struct http_msg *msg, struct hdr_idx *hdr_idx, const ch
 	if (!bytes)
 		return -1;
 	http_msg_move_end(msg, bytes);
-	return hdr_idx_add(len, 1, hdr_idx, hdr_idx->tail);
+	return hdr_idx_add(len, 1, hdr_idx, hdr_idx->tail, text);
 }
 
 /*
@@ -684,7 +688,7 @@ int http_header_add_tail2(struct http_msg *msg,
 	if (!bytes)
 		return -1;
 	http_msg_move_end(msg, bytes);
-	return hdr_idx_add(len, 1, hdr_idx, hdr_idx->tail);
+	return hdr_idx_add(len, 1, hdr_idx, hdr_idx->tail, text);
 }
 
 /*
@@ -713,6 +717,46 @@ int http_header_match2(const char *hdr, const char *end,
 	return val - hdr;
 }
 
+/* Looks up the first header called <name> of length <len> following header
+ * <after> (0 for the first one) in the message starting at <msg>, using the
+ * name index of <idx>, which must exist. On success, the header's index is
+ * returned, and <line> and <prev> are set to the beginning of its line and to
+ * the previous header in the list. If no such header exists, 0 is returned.
+ * If <after> is not indexed under the same name, -1 is returned so that the
+ * caller falls back to walking over the list.
+ */
+static int http_find_hashed_header(const char *name, int len, char *msg,
+                                   struct hdr_idx *idx, int after,
+                                   char **line, int *prev)
+{
+	struct hdr_hash *hash = idx->hash;
+	unsigned int bucket = hdr_hash_bucket(name, len);
+	char *sol;
+	int cur;
+
+	if (unlikely(hash->dirty))
+		hdr_idx_hash_build(idx, msg);
+
+	if (after) {
+		if (hash->e[after].bucket != bucket)
+			return -1;
+		cur = hash->e[after].next;
+	}
+	else
+		cur = hash->head[bucket];
+
+	for (; cur; cur = hash->e[cur].next) {
+		sol = msg + hash->e[cur].ofs;
+		if (len < idx->v[cur].len && sol[len] == ':' &&
+		    strncasecmp(sol, name, len) == 0) {
+			*line = sol;
+			*prev = hash->e[cur].prev;
+			return cur;
+		}
+	}
+	return 0;
+}
+
 /* Find the first or next occurrence of header <name> in message buffer <sol>
  * using headers index <idx>, and return it in the <ctx> structure. This
  * structure holds everything necessary to use the header and find next
@@ -732,6 +776,17 @@ int http_find_full_header2(const char *name, int len,
 	int cur_idx, old_idx;
 
 	cur_idx = ctx->idx;
+	if (idx->hash && len) {
+		cur_idx = http_find_hashed_header(name, len, sol, idx, cur_idx, &sol, &old_idx);
+		if (cur_idx > 0) {
+			eol = sol + idx->v[cur_idx].len;
+			goto found_hdr;
+		}
+		if (!cur_idx)
+			return 0;
+		cur_idx = ctx->idx;
+	}
+
 	if (cur_idx) {
 		/* We have previously returned a header, let's search another one */
 		sol = ctx->line;
@@ -757,6 +812,7 @@ int http_find_full_header2(const char *name, int len,
 		if ((len < eol - sol) &&
 		    (sol[len] == ':') &&
 		    (strncasecmp(sol, name, len) == 0)) {
+		found_hdr:
 			ctx->del = len;
 			sov = sol + len + 1;
 			while (sov < eol && HTTP_IS_LWS(*sov))
@@ -900,6 +956,7 @@ int http_find_header2(const char *name, int len,
 		      char *sol, struct hdr_idx *idx,
 		      struct hdr_ctx *ctx)
 {
+	char *msg = sol;
 	char *eol, *sov;
 	int cur_idx, old_idx;
 
@@ -913,9 +970,12 @@ int http_find_header2(const char *name, int len,
 		sov = sol + ctx->del;
 		eol = sol + idx->v[cur_idx].len;
 
-		if (sov >= eol)
+		if (sov >= eol) {
 			/* no more values in this header */
+			if (idx->hash && len)
+				goto find_hashed;
 			goto next_hdr;
+		}
 
 		/* values remaining for this header, skip the comma but save it
 		 * for later use (eg: for header deletion).
@@ -927,6 +987,23 @@ int http_find_header2(const char *name, int len,
 		goto return_hdr;
 	}
 
+	if (idx->hash && len) {
+	find_hashed:
+		cur_idx = http_find_hashed_header(name, len, msg, idx, cur_idx, &sol, &old_idx);
+		if (cur_idx > 0) {
+			eol = sol + idx->v[cur_idx].len;
+			goto found_hdr;
+		}
+		if (!cur_idx)
+			return 0;
+
+		/* continue walking from the previous header */
+		cur_idx = ctx->idx;
+		sol = ctx->line;
+		eol = sol + idx->v[cur_idx].len;
+		goto next_hdr;
+	}
+
 	/* first request for this header */
 	sol += hdr_idx_first_pos(idx);
 	old_idx = 0;
@@ -945,6 +1022,7 @@ int http_find_header2(const char *name, int len,
 		if ((len < eol - sol) &&
 		    (sol[len] == ':') &&
 		    (strncasecmp(sol, name, len) == 0)) {
+		found_hdr:
 			ctx->del = len;
 			sov = sol + len + 1;
 			while (sov < eol && HTTP_IS_LWS(*sov))
@@ -1006,6 +1084,8 @@ int http_remove_header2(struct http_msg *msg, struct hdr_idx *idx, struct hdr_ct
 		idx->used--;
 		hdr->len = 0;   /* unused entry */
 		idx->v[ctx->prev].next = idx->v[ctx->idx].next;
+		hdr_idx_hash_del(idx, ctx->idx, ctx->prev);
+		hdr_idx_hash_shift(idx, ctx->prev, delta);
 		if (idx->tail == ctx->idx)
 			idx->tail = ctx->prev;
 		ctx->idx = ctx->prev;    /* walk back to the end of previous header */
@@ -1025,6 +1105,7 @@ int http_remove_header2(struct http_msg *msg, struct hdr_idx *idx, struct hdr_ct
 				sol + ctx->val + ctx->vlen + ctx->tws + skip_comma,
 				NULL, 0);
 	hdr->len += delta;
+	hdr_idx_hash_shift(idx, cur_idx, delta);
 	http_msg_move_end(msg, delta);
 	ctx->val = ctx->del;
 	ctx->tws = ctx->vlen = 0;
@@ -1674,7 +1755,7 @@ const char *http_parse_reqline(struct http_msg *msg,
  */
 
 /* This bufffer is initialized in the file 'src/haproxy.c'. This length is
- * set according to global.tune.bufsize.
+ * set according to global.tune.bufsize, or global.tune.bufsize_large if set.
  */
 char *get_http_auth_buff;
 
@@ -1725,7 +1806,7 @@ get_http_auth(struct stream *s)
 	if (!strncasecmp("Basic", auth_method.str, auth_method.len)) {
 
 		len = base64dec(txn->auth.method_data.str, txn->auth.method_data.len,
-				get_http_auth_buff, global.tune.bufsize - 1);
+				get_http_auth_buff, MAX(global.tune.bufsize, global.tune.bufsize_large) - 1);
 
 		if (len < 0)
 			return 0;
@@ -1926,13 +2007,23 @@ void http_msg_analyzer(struct http_msg *msg, struct hdr_idx *idx)
 	http_msg_hdr_first:
 		msg->sol = ptr - buf->p;
 		if (likely(!HTTP_IS_CRLF(*ptr))) {
-			goto http_msg_hdr_name;
+			goto http_msg_hdr_name_fast;
 		}
 
 		if (likely(*ptr == '\r'))
 			EAT_AND_JUMP_OR_RETURN(http_msg_last_lf, HTTP_MSG_LAST_LF);
 		goto http_msg_last_lf;
 
+	http_msg_hdr_name_fast:
+		/* speedup: skip the common name characters at once, the FSM
+		 * below only sees the end of the name.
+		 */
+		ptr = (char *)http_scan.name_end(ptr, end);
+		if (unlikely(ptr >= end)) {
+			state = HTTP_MSG_HDR_NAME;
+			goto http_msg_ood;
+		}
+
 	case HTTP_MSG_HDR_NAME:
 	http_msg_hdr_name:
 		/* assumes msg->sol points to the first char */
@@ -1993,27 +2084,10 @@ void http_msg_analyzer(struct http_msg *msg, struct hdr_idx *idx)
 		 * points to the first character of the value.
 		 */
 
-		/* speedup: we'll skip packs of 4 or 8 bytes not containing bytes 0x0D
-		 * and lower. In fact since most of the time is spent in the loop, we
-		 * also remove the sign bit test so that bytes 0x8e..0x0d break the
-		 * loop, but we don't care since they're very rare in header values.
+		/* speedup: skip the bulk of the value at once, the loop below
+		 * only has to finish the job. See http_scan.c for details.
 		 */
-#if defined(__x86_64__) && !defined(__VMS)
-		while (ptr <= end - sizeof(long)) {
-			if ((*(long *)ptr - 0x0e0e0e0e0e0e0e0eULL) & 0x8080808080808080ULL)
-				goto http_msg_hdr_val2;
-			ptr += sizeof(long);
-		}
-#endif
-#if (defined(__x86_64__) || \
-    defined(__i386__) || defined(__i486__) || defined(__i586__) || defined(__i686__) || \
-    defined(__ARM_ARCH_7A__)) && !defined(__VMS)
-		while (ptr <= end - sizeof(int)) {
-			if ((*(int*)ptr - 0x0e0e0e0e) & 0x80808080)
-				goto http_msg_hdr_val2;
-			ptr += sizeof(int);
-		}
-#endif
+		ptr = (char *)http_scan.crlf(ptr, end);
 		if (ptr >= end) {
 			state = HTTP_MSG_HDR_VAL;
 			goto http_msg_ood;
@@ -2053,14 +2127,14 @@ void http_msg_analyzer(struct http_msg *msg, struct hdr_idx *idx)
 		 * header into the index.
 		 */
 		if (unlikely(hdr_idx_add(msg->eol - msg->sol, buf->p[msg->eol] == '\r',
-					 idx, idx->tail) < 0)) {
+					 idx, idx->tail, buf->p + msg->sol) < 0)) {
 			state = HTTP_MSG_HDR_L2_LWS;
 			goto http_msg_invalid;
 		}
 
 		msg->sol = ptr - buf->p;
 		if (likely(!HTTP_IS_CRLF(*ptr))) {
-			goto http_msg_hdr_name;
+			goto http_msg_hdr_name_fast;
 		}
 
 		if (likely(*ptr == '\r'))
@@ -2277,93 +2351,22 @@ static inline int http_parse_chunk_size(struct http_msg *msg)
 #else
 	const char *ptr = b_ptr(buf, msg->next);
 #endif
-	const char *ptr_old = ptr;
-	const char *end = buf->data + buf->size;
-	const char *stop = bi_end(buf);
-	unsigned int chunk = 0;
-
-	/* The chunk size is in the following form, though we are only
-	 * interested in the size and CRLF :
-	 *    1*HEXDIGIT *WSP *[ ';' extensions ] CRLF
-	 */
-	while (1) {
-		int c;
-		if (ptr == stop)
-			return 0;
-		c = hex2i(*ptr);
-		if (c < 0) /* not a hex digit anymore */
-			break;
-		if (unlikely(++ptr >= end))
-			ptr = buf->data;
-		if (chunk & 0xF8000000) /* integer overflow will occur if result >= 2GB */
-			goto error;
-		chunk = (chunk << 4) + c;
-	}
-
-	/* empty size not allowed */
-	if (unlikely(ptr == ptr_old))
-		goto error;
+	const char *err = NULL;
+	unsigned int chunk;
+	int ret;
 
-	while (HTTP_IS_SPHT(*ptr)) {
-		if (++ptr >= end)
-			ptr = buf->data;
-		if (unlikely(ptr == stop))
-			return 0;
+	ret = http_scan_chunk_size(buf->data, buf->size, ptr, buf->i - msg->next, &chunk, &err);
+	if (unlikely(ret < 0)) {
+		msg->err_pos = buffer_count(buf, buf->p, err);
+		return -1;
 	}
-
-	/* Up to there, we know that at least one byte is present at *ptr. Check
-	 * for the end of chunk size.
-	 */
-	while (1) {
-		if (likely(HTTP_IS_CRLF(*ptr))) {
-			/* we now have a CR or an LF at ptr */
-			if (likely(*ptr == '\r')) {
-				if (++ptr >= end)
-					ptr = buf->data;
-				if (ptr == stop)
-					return 0;
-			}
-
-			if (*ptr != '\n')
-				goto error;
-			if (++ptr >= end)
-				ptr = buf->data;
-			/* done */
-			break;
-		}
-		else if (*ptr == ';') {
-			/* chunk extension, ends at next CRLF */
-			if (++ptr >= end)
-				ptr = buf->data;
-			if (ptr == stop)
-				return 0;
-
-			while (!HTTP_IS_CRLF(*ptr)) {
-				if (++ptr >= end)
-					ptr = buf->data;
-				if (ptr == stop)
-					return 0;
-			}
-			/* we have a CRLF now, loop above */
-			continue;
-		}
-		else
-			goto error;
+	if (ret > 0) {
+		/* we save the number of bytes parsed into msg->sol */
+		msg->sol = ret;
+		msg->chunk_len = chunk;
+		msg->body_len += chunk;
 	}
-
-	/* OK we found our CRLF and now <ptr> points to the next byte, which may
-	 * or may not be present. We save the number of bytes parsed into
-	 * msg->sol.
-	 */
-	msg->sol = ptr - ptr_old;
-	if (unlikely(ptr < ptr_old))
-		msg->sol += buf->size;
-	msg->chunk_len = chunk;
-	msg->body_len += chunk;
-	return msg->sol;
- error:
-	msg->err_pos = buffer_count(buf, buf->p, ptr);
-	return -1;
+	return ret;
 }
 
 /* This function skips trailers in the buffer associated with HTTP message
@@ -2456,34 +2459,18 @@ static int http_forward_trailers(struct http_msg *msg)
 static inline int http_skip_chunk_crlf(struct http_msg *msg)
 {
 	const struct buffer *buf = msg->chn->buf;
-	const char *ptr;
-	int bytes;
-
-	/* NB: we'll check data availabilty at the end. It's not a
-	 * problem because whatever we match first will be checked
-	 * against the correct length.
-	 */
-	bytes = 1;
 #ifdef __VMS
-	ptr = b_ptr((struct buffer *) buf, msg->next);
+	const char *ptr = b_ptr((struct buffer *) buf, msg->next);
 #else
-	ptr = b_ptr(buf, msg->next);
+	const char *ptr = b_ptr(buf, msg->next);
 #endif
-	if (*ptr == '\r') {
-		bytes++;
-		ptr++;
-		if (ptr >= buf->data + buf->size)
-			ptr = buf->data;
-	}
-
-	if (msg->next + bytes > buf->i)
-		return 0;
+	const char *err = NULL;
+	int ret;
 
-	if (*ptr != '\n') {
-		msg->err_pos = buffer_count(buf, buf->p, ptr);
-		return -1;
-	}
-	return bytes;
+	ret = http_scan_chunk_crlf(buf->data, buf->size, ptr, buf->i - msg->next, &err);
+	if (unlikely(ret < 0))
+		msg->err_pos = buffer_count(buf, buf->p, err);
+	return ret;
 }
 
 /* Parses a qvalue and returns it multipled by 1000, from 0 to 1000. If the
@@ -2711,9 +2698,11 @@ int http_wait_for_request(struct stream *s, struct channel *req, int an_bit)
 		/* 1: Since we are in header mode, if there's no space
 		 *    left for headers, we won't be able to free more
 		 *    later, so the stream will never terminate. We
-		 *    must terminate it now.
+		 *    must terminate it now, unless we can move it to a
+		 *    large buffer.
 		 */
-		if (unlikely(buffer_full(req->buf, global.tune.maxrewrite))) {
+		if (unlikely(buffer_full(req->buf, global.tune.maxrewrite)) &&
+		    !b_upgrade(&req->buf)) {
 			/* FIXME: check if URI is set and return Status
 			 * 414 Request URI too long instead.
 			 */
@@ -3410,6 +3399,7 @@ int http_transform_header_str(struct stream* s, struct http_msg *msg,
 		delta = buffer_replace2(msg->chn->buf, val, val_end, output->str, output->len);
 
 		hdr->len += delta;
+		hdr_idx_hash_shift(idx, ctx.idx, delta);
 		http_msg_move_end(msg, delta);
 
 		/* Adjust the length of the current value of the index. */
@@ -3442,6 +3432,16 @@ static int http_transform_header(struct stream* s, struct http_msg *msg,
 	return ret;
 }
 
+/* Accounts one evaluation of rule <rule> which started at <start> (in rdtsc()
+ * units) and whose condition matched if <match> is non-zero.
+ */
+static inline void http_rule_profile(struct act_rule *rule, unsigned long long start, int match)
+{
+	rule->prof.calls++;
+	rule->prof.matches += !!match;
+	rule->prof.cost += rdtsc() - start;
+}
+
 /* Executes the http-request rules <rules> for stream <s>, proxy <px> and
  * transaction <txn>. Returns the verdict of the first rule that prevents
  * further processing of the request (auth, deny, ...), and defaults to
@@ -3459,10 +3459,18 @@ http_req_get_intercept_rule(struct proxy *px, struct list *rules, struct stream
 	struct connection *cli_conn;
 	struct act_rule *rule;
 	struct hdr_ctx ctx;
+	struct acl_memo memo;
 	const char *auth_realm;
+	unsigned long long prof_start = 0;
 	int act_flags = 0;
 	int len;
 
+	/* ACLs used by several rules are only evaluated once as long as no
+	 * action is executed.
+	 */
+	memo.nb = 0;
+	memset(memo.known, 0, sizeof(memo.known));
+
 	/* If "the current_rule_list" match the executed rule list, we are in
 	 * resume condition. If a resume is needed it is always in the action
 	 * and never in the ACL or converters. In this case, we initialise the
@@ -3478,20 +3486,32 @@ http_req_get_intercept_rule(struct proxy *px, struct list *rules, struct stream
 
 	list_for_each_entry(rule, rules, list) {
 
+		if (unlikely(http_rules_profiling))
+			prof_start = rdtsc();
+
 		/* check optional condition */
 		if (rule->cond) {
 			int ret;
 
-			ret = acl_exec_cond(rule->cond, px, sess, s, SMP_OPT_DIR_REQ|SMP_OPT_FINAL);
+			ret = acl_exec_cond_memo(rule->cond, px, sess, s, SMP_OPT_DIR_REQ|SMP_OPT_FINAL, &memo);
 			ret = acl_pass(ret);
 
 			if (rule->cond->pol == ACL_COND_UNLESS)
 				ret = !ret;
 
-			if (!ret) /* condition not matched */
+			if (!ret) { /* condition not matched */
+				if (unlikely(http_rules_profiling))
+					http_rule_profile(rule, prof_start, 0);
 				continue;
+			}
 		}
 
+		if (unlikely(http_rules_profiling))
+			http_rule_profile(rule, prof_start, 1);
+
+		/* the action may change what the next conditions see */
+		acl_memo_reset(&memo);
+
 		act_flags |= ACT_FLAG_FIRST;
 resume_execution:
 		switch (rule->action) {
@@ -5315,6 +5335,18 @@ void http_end_txn_clean_session(struct stream *s)
 	}
 	s->req.analysers = strm_li(s) ? strm_li(s)->analysers : 0;
 	s->res.analysers = 0;
+
+	/* With "option http-idle-release", an HTTP/1 client connection waiting
+	 * for its next request doesn't need the stream anymore, which will be
+	 * released by process_stream() if nothing remains in the buffers. The
+	 * server connection is then either pooled or closed, so we must not do
+	 * this when it is expected to carry the authentication of the next
+	 * request.
+	 */
+	if ((fe->options2 & PR_O2_IDLE_REL) && fe->state != PR_STSTOPPED &&
+	    objt_conn(strm_orig(s)) && s->si[0].end == strm_orig(s) &&
+	    !(s->txn->flags & TX_PREFER_LAST))
+		s->flags |= SF_KEEP_SESS;
 }
 
 
@@ -6043,8 +6075,11 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 			return 0;
 		}
 
-		/* too large response does not fit in buffer. */
-		else if (buffer_full(rep->buf, global.tune.maxrewrite)) {
+		/* too large response does not fit in buffer, even once
+		 * moved to a large one.
+		 */
+		else if (buffer_full(rep->buf, global.tune.maxrewrite) &&
+			 !b_upgrade(&rep->buf)) {
 			if (msg->err_pos < 0)
 				msg->err_pos = rep->buf->i;
 			goto hdr_response_bad;
@@ -7168,6 +7203,28 @@ http_msg_forward_chunked_body(struct stream *s, struct http_msg *msg)
   switch_states:
 	switch (msg->msg_state) {
 		case HTTP_MSG_DATA:
+			/* Without data filter, nobody needs to see chunk
+			 * boundaries, so we skip all the complete chunks present
+			 * in the contiguous part of the buffer at once. The FSM
+			 * below then handles what remains (partial chunk, wrapped
+			 * or unusual sequence, last chunk).
+			 */
+			if (!HAS_DATA_FILTERS(s, chn) && chn->buf->i > msg->next) {
+				const char *start = b_ptr(chn->buf, msg->next);
+				const char *stop = bi_end(chn->buf);
+				const char *ptr;
+
+				if (stop <= start)
+					stop = chn->buf->data + chn->buf->size;
+				ptr = http_scan_chunks(start, stop, &msg->chunk_len, &msg->body_len);
+				if (ptr != start) {
+					msg->next += ptr - start;
+					if (!msg->chunk_len) {
+						msg->msg_state = HTTP_MSG_TRAILERS;
+						goto switch_states;
+					}
+				}
+			}
 #ifdef __VMS
 			FLT_STRM_DATA_CB_IMPL_2(s, chn, flt_http_data(s, msg),
 					       /* default_ret */ MIN(msg->chunk_len, chn->buf->i - msg->next),
@@ -7384,6 +7441,7 @@ int apply_filter_to_req_headers(struct stream *s, struct channel *req, struct hd
 				cur_end += delta;
 				cur_next += delta;
 				cur_hdr->len += delta;
+				hdr_idx_hash_invalidate(&txn->hdr_idx);
 				http_msg_move_end(&txn->req, delta);
 				break;
 
@@ -7395,6 +7453,8 @@ int apply_filter_to_req_headers(struct stream *s, struct channel *req, struct hd
 				txn->hdr_idx.v[old_idx].next = cur_hdr->next;
 				txn->hdr_idx.used--;
 				cur_hdr->len = 0;
+				hdr_idx_hash_del(&txn->hdr_idx, cur_idx, old_idx);
+				hdr_idx_hash_shift(&txn->hdr_idx, old_idx, delta);
 				cur_end = NULL; /* null-term has been rewritten */
 				cur_idx = old_idx;
 				break;
@@ -7777,6 +7837,7 @@ void manage_client_side_cookies(struct stream *s, struct channel *req)
 					hdr_end  += delta;
 					hdr_next += delta;
 					cur_hdr->len += delta;
+					hdr_idx_hash_shift(&txn->hdr_idx, cur_idx, delta);
 					http_msg_move_end(&txn->req, delta);
 					prev     = del_from;
 					del_from = NULL;
@@ -7810,6 +7871,7 @@ void manage_client_side_cookies(struct stream *s, struct channel *req)
 				hdr_end      += stripped_before;
 				hdr_next     += stripped_before;
 				cur_hdr->len += stripped_before;
+				hdr_idx_hash_shift(&txn->hdr_idx, cur_idx, stripped_before);
 				http_msg_move_end(&txn->req, stripped_before);
 			}
 			/* now everything is as on the diagram above */
@@ -7987,6 +8049,7 @@ void manage_client_side_cookies(struct stream *s, struct channel *req)
 					hdr_end  += delta;
 					hdr_next += delta;
 					cur_hdr->len += delta;
+					hdr_idx_hash_shift(&txn->hdr_idx, cur_idx, delta);
 					http_msg_move_end(&txn->req, delta);
 
 					del_from = NULL;
@@ -8015,6 +8078,7 @@ void manage_client_side_cookies(struct stream *s, struct channel *req)
 					hdr_end  += delta;
 					hdr_next += delta;
 					cur_hdr->len += delta;
+					hdr_idx_hash_shift(&txn->hdr_idx, cur_idx, delta);
 					http_msg_move_end(&txn->req, delta);
 					prev     = del_from;
 					del_from = NULL;
@@ -8038,6 +8102,7 @@ void manage_client_side_cookies(struct stream *s, struct channel *req)
 				delta = del_hdr_value(req->buf, &del_from, hdr_end);
 				hdr_end = del_from;
 				cur_hdr->len += delta;
+				hdr_idx_hash_shift(&txn->hdr_idx, cur_idx, delta);
 			} else {
 				delta = buffer_replace2(req->buf, hdr_beg, hdr_next, NULL, 0);
 
@@ -8045,6 +8110,8 @@ void manage_client_side_cookies(struct stream *s, struct channel *req)
 				txn->hdr_idx.v[old_idx].next = cur_hdr->next;
 				txn->hdr_idx.used--;
 				cur_hdr->len = 0;
+				hdr_idx_hash_del(&txn->hdr_idx, cur_idx, old_idx);
+				hdr_idx_hash_shift(&txn->hdr_idx, old_idx, delta);
 				cur_idx = old_idx;
 			}
 			hdr_next += delta;
@@ -8120,6 +8187,7 @@ int apply_filter_to_resp_headers(struct stream *s, struct channel *rtr, struct h
 				cur_end += delta;
 				cur_next += delta;
 				cur_hdr->len += delta;
+				hdr_idx_hash_invalidate(&txn->hdr_idx);
 				http_msg_move_end(&txn->rsp, delta);
 				break;
 
@@ -8131,6 +8199,8 @@ int apply_filter_to_resp_headers(struct stream *s, struct channel *rtr, struct h
 				txn->hdr_idx.v[old_idx].next = cur_hdr->next;
 				txn->hdr_idx.used--;
 				cur_hdr->len = 0;
+				hdr_idx_hash_del(&txn->hdr_idx, cur_idx, old_idx);
+				hdr_idx_hash_shift(&txn->hdr_idx, old_idx, delta);
 				cur_end = NULL; /* null-term has been rewritten */
 				cur_idx = old_idx;
 				break;
@@ -8463,6 +8533,7 @@ void manage_server_side_cookies(struct stream *s, struct channel *res)
 				hdr_end      += stripped_before;
 				hdr_next     += stripped_before;
 				cur_hdr->len += stripped_before;
+				hdr_idx_hash_shift(&txn->hdr_idx, cur_idx, stripped_before);
 				http_msg_move_end(&txn->rsp, stripped_before);
 			}
 
@@ -8515,6 +8586,8 @@ void manage_server_side_cookies(struct stream *s, struct channel *res)
 						txn->hdr_idx.v[old_idx].next = cur_hdr->next;
 						txn->hdr_idx.used--;
 						cur_hdr->len = 0;
+						hdr_idx_hash_del(&txn->hdr_idx, cur_idx, old_idx);
+						hdr_idx_hash_shift(&txn->hdr_idx, old_idx, delta);
 						cur_idx = old_idx;
 						hdr_next += delta;
 						http_msg_move_end(&txn->rsp, delta);
@@ -8528,6 +8601,7 @@ void manage_server_side_cookies(struct stream *s, struct channel *res)
 						hdr_end  += delta;
 						hdr_next += delta;
 						cur_hdr->len += delta;
+						hdr_idx_hash_shift(&txn->hdr_idx, cur_idx, delta);
 						http_msg_move_end(&txn->rsp, delta);
 					}
 					txn->flags &= ~TX_SCK_MASK;
@@ -8543,6 +8617,7 @@ void manage_server_side_cookies(struct stream *s, struct channel *res)
 					hdr_end  += delta;
 					hdr_next += delta;
 					cur_hdr->len += delta;
+					hdr_idx_hash_shift(&txn->hdr_idx, cur_idx, delta);
 					http_msg_move_end(&txn->rsp, delta);
 
 					txn->flags &= ~TX_SCK_MASK;
@@ -8557,6 +8632,7 @@ void manage_server_side_cookies(struct stream *s, struct channel *res)
 					hdr_end  += delta;
 					hdr_next += delta;
 					cur_hdr->len += delta;
+					hdr_idx_hash_shift(&txn->hdr_idx, cur_idx, delta);
 					http_msg_move_end(&txn->rsp, delta);
 
 					val_beg[srv->cklen] = COOKIE_DELIM;
@@ -8931,6 +9007,16 @@ struct http_txn *http_alloc_txn(struct stream *s)
 		return NULL;
 	}
 
+	txn->hdr_idx.hash = NULL;
+	if (global.tune.options & GTUNE_HTTP_HDR_HASH) {
+		txn->hdr_idx.hash = pool_alloc2(pool2_hdr_hash);
+		if (!txn->hdr_idx.hash) {
+			pool_free2(pool2_hdr_idx, txn->hdr_idx.v);
+			pool_free2(pool2_http_txn, txn);
+			return NULL;
+		}
+	}
+
 	s->txn = txn;
 	return txn;
 }
@@ -9121,6 +9207,8 @@ struct act_rule *parse_http_req_cond(const char **args, const char *file, int li
 		goto out_err;
 	}
 
+	rule->conf.file = file;
+	rule->conf.line = linenum;
 	rule->deny_status = HTTP_ERR_403;
 	if (!strcmp(args[0], "allow")) {
 		rule->action = ACT_ACTION_ALLOW;
@@ -10256,7 +10344,8 @@ int smp_prefetch_http(struct proxy *px, struct stream *s, unsigned int opt,
 			/* Still no valid request ? */
 			if (unlikely(msg->msg_state < HTTP_MSG_BODY)) {
 				if ((msg->msg_state == HTTP_MSG_ERROR) ||
-				    buffer_full(s->req.buf, global.tune.maxrewrite)) {
+				    (buffer_full(s->req.buf, global.tune.maxrewrite) &&
+				     !b_upgrade(&s->req.buf))) {
 					return 0;
 				}
 				/* wait for final state */
@@ -12529,6 +12618,7 @@ int http_replace_req_line(int action, const char *replace, int len,
 	delta = buffer_replace2(s->req.buf, cur_ptr, cur_end, replace + offset, len - offset);
 	txn->req.sl.rq.l += delta;
 	txn->hdr_idx.v[0].len += delta;
+	hdr_idx_hash_shift(&txn->hdr_idx, 0, delta);
 	http_msg_move_end(&txn->req, delta);
 	return 0;
 }
@@ -12575,6 +12665,7 @@ void http_set_status(unsigned int status, const char *reason, struct stream *s)
 	delta = trash.len - (cur_end - cur_ptr);
 	txn->rsp.sl.st.l += delta;
 	txn->hdr_idx.v[0].len += delta;
+	hdr_idx_hash_shift(&txn->hdr_idx, 0, delta);
 	http_msg_move_end(&txn->rsp, delta);
 }
 
@@ -13238,12 +13329,124 @@ static int cli_io_handler_show_errors(struct appctx *appctx)
 	return 1;
 }
 
+/* parses "set profiling rules {on|off}". Enabling the profiling resets the
+ * counters of all rules.
+ */
+static int cli_parse_set_profiling_rules(char **args, struct appctx *appctx, void *private)
+{
+	struct proxy *px;
+	struct act_rule *rule;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	if (strcmp(args[2], "rules") != 0 ||
+	    (strcmp(args[3], "on") != 0 && strcmp(args[3], "off") != 0)) {
+		appctx->ctx.cli.msg = "Expects 'set profiling rules {on|off}'.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		return 1;
+	}
+
+	if (strcmp(args[3], "off") == 0) {
+		http_rules_profiling = 0;
+		return 1;
+	}
+
+	if (!http_rules_profiling) {
+		for (px = proxy; px; px = px->next) {
+			list_for_each_entry(rule, &px->http_req_rules, list)
+				memset(&rule->prof, 0, sizeof(rule->prof));
+		}
+		http_rules_profiling = 1;
+	}
+	return 1;
+}
+
+static int cli_parse_show_profiling_rules(char **args, struct appctx *appctx, void *private)
+{
+	if (!cli_has_level(appctx, ACCESS_LVL_OPER))
+		return 1;
+
+	if (strcmp(args[2], "rules") != 0) {
+		appctx->ctx.cli.msg = "Expects 'show profiling rules'.\n";
+		appctx->st0 = CLI_ST_PRINT;
+		return 1;
+	}
+
+	appctx->ctx.rules.px = proxy;
+	appctx->ctx.rules.rule = NULL;
+	appctx->ctx.rules.idx = 0;
+	appctx->st2 = 0;
+	return 0;
+}
+
+/* This function dumps the profiling counters of all http-request rules, one
+ * line per rule. It returns 0 if the output buffer is full and it needs to be
+ * called again, otherwise non-zero.
+ */
+static int cli_io_handler_show_profiling_rules(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct proxy *px;
+	struct act_rule *rule;
+
+	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW)))
+		return 1;
+
+	chunk_reset(&trash);
+
+	if (!appctx->st2) {
+		chunk_appendf(&trash, "# profiling: %s\n", http_rules_profiling ? "on" : "off");
+		chunk_appendf(&trash, "# proxy rule location calls matches cost avg_cost\n");
+		if (bi_putchk(si_ic(si), &trash) == -1) {
+			si_applet_cant_put(si);
+			return 0;
+		}
+		appctx->st2 = 1;
+	}
+
+	for (px = appctx->ctx.rules.px; px; px = px->next) {
+		rule = appctx->ctx.rules.rule;
+		if (!rule)
+			rule = LIST_ELEM(px->http_req_rules.n, struct act_rule *, list);
+
+		for (; &rule->list != &px->http_req_rules;
+		     rule = LIST_ELEM(rule->list.n, struct act_rule *, list)) {
+			chunk_reset(&trash);
+			chunk_appendf(&trash, "%s %d %s:%d %llu %llu %llu %llu\n",
+			              px->id, appctx->ctx.rules.idx + 1,
+			              rule->conf.file ? rule->conf.file : "?", rule->conf.line,
+			              rule->prof.calls, rule->prof.matches, rule->prof.cost,
+			              rule->prof.calls ? rule->prof.cost / rule->prof.calls : 0);
+
+			if (bi_putchk(si_ic(si), &trash) == -1) {
+				appctx->ctx.rules.px = px;
+				appctx->ctx.rules.rule = rule;
+				si_applet_cant_put(si);
+				return 0;
+			}
+			appctx->ctx.rules.idx++;
+		}
+		appctx->ctx.rules.rule = NULL;
+		appctx->ctx.rules.idx = 0;
+	}
+	return 1;
+}
+
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "show", "errors", NULL },
 	  "show errors    : report last request and response errors for each proxy",
 	  cli_parse_show_errors, cli_io_handler_show_errors, NULL,
 	},
+	{ { "set", "profiling", NULL },
+	  "set profiling  : enable or disable the profiling of http-request rules",
+	  cli_parse_set_profiling_rules, NULL, NULL,
+	},
+	{ { "show", "profiling", NULL },
+	  "show profiling : report the cost of each http-request rule",
+	  cli_parse_show_profiling_rules, cli_io_handler_show_profiling_rules, NULL,
+	},
 	{{},}
 }};
 
@@ -34,6 +34,10 @@
 #include <netinet/tcp.h>
 #include <netinet/in.h>
 
+#if defined(__linux__)
+#include <linux/filter.h>
+#endif
+
 #ifdef __VMS
 #include <ioctl.h>
 #endif
@@ -759,6 +763,54 @@ int tcp_connect_probe(struct connection *conn)
 }
 
 
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+/* Attaches to the SO_REUSEPORT group of listener <listener>'s socket <fd> a
+ * classic BPF program which selects the shard whose processes are bound by
+ * cpu-map to the CPU the connection was received on. The shards of a listener
+ * immediately follow it in its bind_conf and their sockets are bound in the
+ * same order, so shard N is socket N of the group. CPUs not covered by any
+ * cpu-map entry are spread by the modulo of their number. Returns 0 on
+ * success, -1 on failure.
+ */
+static int tcp_attach_shard_steering(struct listener *listener, int fd)
+{
+	struct sock_filter code[2 * LONGBITS + 3];
+	struct sock_fprog prog;
+	unsigned long cpus[LONGBITS];
+	struct listener *l;
+	int nb, proc, cpu, shard, len;
+
+	memset(cpus, 0, sizeof(cpus));
+	nb = 0;
+	for (l = listener; &l->by_bind != &listener->bind_conf->listeners && l->shard == nb;
+	     l = LIST_ELEM(l->by_bind.n, struct listener *, by_bind)) {
+		for (proc = 0; proc < LONGBITS; proc++)
+			if (l->bind_proc & (1UL << proc))
+				cpus[nb] |= global.cpu_map[proc];
+		if (++nb >= LONGBITS)
+			break;
+	}
+
+	len = 0;
+	code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+	for (cpu = 0; cpu < LONGBITS; cpu++) {
+		for (shard = 0; shard < nb; shard++)
+			if (cpus[shard] & (1UL << cpu))
+				break;
+		if (shard == nb)
+			continue;
+		code[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpu, 0, 1);
+		code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, shard);
+	}
+	code[len++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, nb);
+	code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+
+	prog.len = len;
+	prog.filter = code;
+	return setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+#endif
+
 /* This function tries to bind a TCPv4/v6 listener. It may return a warning or
  * an error message in <errmsg> if the message is at most <errlen> bytes long
  * (including '\0'). Note that <errmsg> may be NULL if <errlen> is also zero.
@@ -958,6 +1010,15 @@ int tcp_bind_listener(struct listener *listener, char *errmsg, int errlen)
 		goto tcp_close_return;
 	}
 
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+	/* the first shard carries the steering program for its whole group */
+	if (!ext && (listener->options & LI_O_SHARD_CPU) && !listener->shard &&
+	    listener->bind_conf->shards > 1 && tcp_attach_shard_steering(listener, fd) == -1) {
+		msg = "cannot attach the CPU steering program, connections will be hashed";
+		err |= ERR_WARN;
+	}
+#endif
+
 #if defined(TCP_QUICKACK)
 	if (listener->options & LI_O_NOQUICKACK)
 		setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &zero, sizeof(zero));
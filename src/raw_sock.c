@@ -157,9 +157,14 @@ int raw_sock_to_pipe(struct connection *conn, struct pipe *pipe, unsigned int co
 			}
 			else if (errno == ENOSYS || errno == EINVAL || errno == EBADF) {
 				/* splice not supported on this end, disable it.
-				 * We can safely return -1 since there is no
-				 * chance that any data has been piped yet.
+				 * This may only happen in the middle of a stream
+				 * with kTLS sockets, where the kernel refuses to
+				 * splice non-data records. Then what was already
+				 * piped must be reported, and the next call will
+				 * return -1.
 				 */
+				if (retval)
+					break;
 				return -1;
 			}
 			else if (errno == EINTR) {
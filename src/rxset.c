@@ -0,0 +1,1135 @@
+/*
+ * Combined matcher for sets of regular expressions
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * All the expressions of a set are compiled into a single NFA whose final
+ * states carry the id of their expression. The NFA is then run as a DFA built
+ * lazily : each DFA state is the set of NFA states active at a given position,
+ * and its transitions are only computed the first time they are needed, then
+ * cached. The subject is thus scanned once, with one table lookup per byte in
+ * the common case, whatever the number of expressions. Bytes that no charset
+ * tells apart are grouped into classes to keep the transition tables small.
+ *
+ * The supported syntax is the subset of PCRE that describes regular languages
+ * and which does not depend on options : literals, ".", bracket expressions,
+ * the \d \w \s classes and their negations, groups, alternations, greedy and
+ * lazy quantifiers, plus "^" at the beginning and "$" at the end of top-level
+ * branches. Anything else is reported to the caller, which is expected to
+ * match such expressions with the regex library.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/compiler.h>
+#include <common/rxset.h>
+
+#define RX_NONE        UINT_MAX   /* no state, or end of a patch list */
+#define RX_MAX_REPEAT  1000       /* larger counted repetitions are not supported */
+#define RX_MAX_DEPTH   100        /* maximum nesting of groups */
+#define RX_HASH_SIZE   4096       /* buckets of the DFA cache */
+
+/* AST node types */
+enum {
+	RXA_EMPTY = 0,
+	RXA_CS,                 /* charset <cs> */
+	RXA_CAT,                /* <a> followed by <b> */
+	RXA_ALT,                /* <a> or <b> */
+	RXA_REP,                /* <a> repeated <min> to <max> times, -1 for no limit */
+};
+
+struct rx_ast {
+	int type;
+	int a, b;
+	int min, max;
+	unsigned int cs;
+};
+
+/* parsing context of one expression */
+struct rx_parse {
+	struct rxset *s;
+	const unsigned char *p;
+	struct rx_ast *ast;
+	unsigned int nb_ast, sz_ast;
+	unsigned int base;      /* number of NFA states before this expression */
+	int nomem;              /* failed on memory shortage instead of syntax */
+};
+
+/* a piece of NFA : its start state and the list of its dangling outputs */
+struct rx_frag {
+	unsigned int start;
+	unsigned int out;
+};
+
+static inline int cs_has(const struct rx_charset *cs, unsigned char c)
+{
+	return (cs->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static inline void cs_set(struct rx_charset *cs, unsigned char c)
+{
+	cs->bits[c >> 5] |= 1U << (c & 31);
+}
+
+static void cs_range(struct rx_charset *cs, int lo, int hi)
+{
+	for (; lo <= hi; lo++)
+		cs_set(cs, lo);
+}
+
+static void cs_invert(struct rx_charset *cs)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		cs->bits[i] = ~cs->bits[i];
+}
+
+/* adds the other case of the ASCII letters of <cs>, as PCRE does by default */
+static void cs_fold(struct rx_charset *cs)
+{
+	int c;
+
+	for (c = 'a'; c <= 'z'; c++) {
+		if (cs_has(cs, c) || cs_has(cs, c - 'a' + 'A')) {
+			cs_set(cs, c);
+			cs_set(cs, c - 'a' + 'A');
+		}
+	}
+}
+
+static unsigned int cs_hash(const struct rx_charset *cs)
+{
+	unsigned int h = 2166136261U;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		h = (h ^ cs->bits[i]) * 16777619U;
+	return h;
+}
+
+/* Returns the index of a charset equal to <cs>, which is added if needed, or
+ * -1 on memory shortage.
+ */
+static int rx_cs_get(struct rxset *s, const struct rx_charset *cs)
+{
+	unsigned int h, i, n, size;
+	unsigned int *tbl;
+	void *new;
+
+	if (s->nb_cs * 2 >= s->sz_cs_hash) {
+		size = s->sz_cs_hash ? s->sz_cs_hash * 2 : 256;
+		tbl = calloc(size, sizeof(*tbl));
+		if (!tbl)
+			return -1;
+		for (n = 0; n < s->nb_cs; n++) {
+			for (h = cs_hash(&s->cs[n]) & (size - 1); tbl[h]; h = (h + 1) & (size - 1))
+				;
+			tbl[h] = n + 1;
+		}
+		free(s->cs_hash);
+		s->cs_hash = tbl;
+		s->sz_cs_hash = size;
+	}
+
+	for (h = cs_hash(cs) & (s->sz_cs_hash - 1); (i = s->cs_hash[h]); h = (h + 1) & (s->sz_cs_hash - 1))
+		if (memcmp(&s->cs[i - 1], cs, sizeof(*cs)) == 0)
+			return i - 1;
+
+	if (s->nb_cs >= s->sz_cs) {
+		size = s->sz_cs ? s->sz_cs * 2 : 64;
+		new = realloc(s->cs, size * sizeof(*s->cs));
+		if (!new)
+			return -1;
+		s->cs = new;
+		s->sz_cs = size;
+	}
+
+	s->cs[s->nb_cs] = *cs;
+	s->cs_hash[h] = ++s->nb_cs;
+	return s->nb_cs - 1;
+}
+
+/* appends <n> to the array <arr> of <nb> elements out of <sz> */
+static int rx_push(unsigned int **arr, unsigned int *nb, unsigned int *sz, unsigned int n)
+{
+	unsigned int size;
+	void *new;
+
+	if (*nb >= *sz) {
+		size = *sz ? *sz * 2 : 16;
+		new = realloc(*arr, size * sizeof(**arr));
+		if (!new)
+			return -1;
+		*arr = new;
+		*sz = size;
+	}
+	(*arr)[(*nb)++] = n;
+	return 0;
+}
+
+/***** parser : builds an AST from the expression *****/
+
+static int rx_ast_new(struct rx_parse *ctx, int type, int a, int b)
+{
+	unsigned int size;
+	void *new;
+
+	if (ctx->nb_ast >= ctx->sz_ast) {
+		size = ctx->sz_ast ? ctx->sz_ast * 2 : 64;
+		new = realloc(ctx->ast, size * sizeof(*ctx->ast));
+		if (!new) {
+			ctx->nomem = 1;
+			return -1;
+		}
+		ctx->ast = new;
+		ctx->sz_ast = size;
+	}
+
+	ctx->ast[ctx->nb_ast].type = type;
+	ctx->ast[ctx->nb_ast].a = a;
+	ctx->ast[ctx->nb_ast].b = b;
+	ctx->ast[ctx->nb_ast].min = ctx->ast[ctx->nb_ast].max = 0;
+	ctx->ast[ctx->nb_ast].cs = 0;
+	return ctx->nb_ast++;
+}
+
+/* returns a new node matching charset <cs>, folded if needed */
+static int rx_ast_cs(struct rx_parse *ctx, struct rx_charset *cs)
+{
+	int cs_idx, n;
+
+	if (ctx->s->icase)
+		cs_fold(cs);
+
+	cs_idx = rx_cs_get(ctx->s, cs);
+	if (cs_idx < 0) {
+		ctx->nomem = 1;
+		return -1;
+	}
+
+	n = rx_ast_new(ctx, RXA_CS, -1, -1);
+	if (n >= 0)
+		ctx->ast[n].cs = cs_idx;
+	return n;
+}
+
+static int rx_hex(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Parses the escape sequence after a backslash. Returns 1 and sets <c> if it
+ * designates a single byte, 2 and fills <cs> if it designates a class, or 0
+ * if it is not supported.
+ */
+static int rx_escape(struct rx_parse *ctx, int in_class, int *c, struct rx_charset *cs)
+{
+	int ch = *ctx->p++;
+	int i, v;
+
+	memset(cs, 0, sizeof(*cs));
+	switch (ch) {
+	case 0:
+		return 0;
+	case 'd': case 'D':
+		cs_range(cs, '0', '9');
+		goto class;
+	case 'w': case 'W':
+		cs_range(cs, 'a', 'z');
+		cs_range(cs, 'A', 'Z');
+		cs_range(cs, '0', '9');
+		cs_set(cs, '_');
+		goto class;
+	case 's': case 'S':
+		/* VT is included since PCRE 8.34 */
+		cs_range(cs, '\t', '\r');
+		cs_set(cs, ' ');
+		goto class;
+	case 't': *c = '\t'; return 1;
+	case 'n': *c = '\n'; return 1;
+	case 'r': *c = '\r'; return 1;
+	case 'f': *c = '\f'; return 1;
+	case 'e': *c = 0x1b; return 1;
+	case 'a': *c = 0x07; return 1;
+	case 'b':
+		if (!in_class)
+			return 0;
+		*c = '\b';
+		return 1;
+	case 'x':
+		if (*ctx->p == '{')
+			return 0;
+		for (v = i = 0; i < 2 && rx_hex(*ctx->p) >= 0; i++)
+			v = v * 16 + rx_hex(*ctx->p++);
+		*c = v;
+		return 1;
+	case '0':
+		for (v = i = 0; i < 2 && *ctx->p >= '0' && *ctx->p <= '7'; i++)
+			v = v * 8 + *ctx->p++ - '0';
+		*c = v;
+		return 1;
+	}
+
+	/* back-references, assertions, properties, ... */
+	if ((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z'))
+		return 0;
+
+	*c = ch;
+	return 1;
+
+ class:
+	if (ch >= 'A' && ch <= 'Z')
+		cs_invert(cs);
+	return 2;
+}
+
+/* parses a bracket expression, the opening bracket being already consumed */
+static int rx_parse_class(struct rx_parse *ctx)
+{
+	struct rx_charset cs, esc;
+	int neg = 0, first = 1;
+	int lo, hi, ret;
+
+	memset(&cs, 0, sizeof(cs));
+	if (*ctx->p == '^') {
+		neg = 1;
+		ctx->p++;
+	}
+
+	while (1) {
+		if (!*ctx->p)
+			return -1;
+		if (*ctx->p == ']' && !first)
+			break;
+		first = 0;
+
+		/* POSIX classes and collating elements */
+		if (*ctx->p == '[' && (ctx->p[1] == ':' || ctx->p[1] == '=' || ctx->p[1] == '.'))
+			return -1;
+
+		if (*ctx->p == '\\') {
+			ctx->p++;
+			ret = rx_escape(ctx, 1, &lo, &esc);
+			if (!ret)
+				return -1;
+			if (ret == 2) {
+				for (lo = 0; lo < 8; lo++)
+					cs.bits[lo] |= esc.bits[lo];
+				continue;
+			}
+		}
+		else
+			lo = *ctx->p++;
+
+		if (*ctx->p != '-' || !ctx->p[1] || ctx->p[1] == ']') {
+			cs_set(&cs, lo);
+			continue;
+		}
+
+		ctx->p++;
+		if (*ctx->p == '\\') {
+			ctx->p++;
+			if (rx_escape(ctx, 1, &hi, &esc) != 1)
+				return -1;
+		}
+		else
+			hi = *ctx->p++;
+
+		if (hi < lo)
+			return -1;
+		cs_range(&cs, lo, hi);
+	}
+	ctx->p++;
+
+	if (ctx->s->icase)
+		cs_fold(&cs);
+	if (neg)
+		cs_invert(&cs);
+	return rx_ast_cs(ctx, &cs);
+}
+
+/* Parses a counted repetition "{n}", "{n,}" or "{n,m}" at <p>. Returns the
+ * position after it and fills <min> and <max>, or returns NULL if <p> does
+ * not start such a repetition, in which case PCRE takes the brace literally.
+ */
+static const unsigned char *rx_parse_count(const unsigned char *p, int *min, int *max)
+{
+	int n;
+
+	if (*p++ != '{' || *p < '0' || *p > '9')
+		return NULL;
+
+	for (n = 0; *p >= '0' && *p <= '9'; p++)
+		n = n < 100000 ? n * 10 + *p - '0' : n;
+	*min = *max = n;
+
+	if (*p == ',') {
+		p++;
+		*max = -1;
+		if (*p >= '0' && *p <= '9') {
+			for (n = 0; *p >= '0' && *p <= '9'; p++)
+				n = n < 100000 ? n * 10 + *p - '0' : n;
+			*max = n;
+		}
+	}
+
+	if (*p != '}')
+		return NULL;
+	return p + 1;
+}
+
+static int rx_parse_alt(struct rx_parse *ctx, int depth);
+
+static int rx_parse_atom(struct rx_parse *ctx, int depth)
+{
+	struct rx_charset cs;
+	int min, max, c, ret;
+
+	memset(&cs, 0, sizeof(cs));
+	switch (*ctx->p) {
+	case '(':
+		ctx->p++;
+		if (*ctx->p == '?') {
+			if (ctx->p[1] != ':')
+				return -1;
+			ctx->p += 2;
+		}
+		else if (*ctx->p == '*')
+			return -1;
+
+		if (depth >= RX_MAX_DEPTH)
+			return -1;
+		ret = rx_parse_alt(ctx, depth + 1);
+		if (ret < 0)
+			return -1;
+		if (*ctx->p != ')')
+			return -1;
+		ctx->p++;
+		return ret;
+
+	case '[':
+		ctx->p++;
+		return rx_parse_class(ctx);
+
+	case '.':
+		ctx->p++;
+		cs_invert(&cs);
+		cs.bits['\n' >> 5] &= ~(1U << ('\n' & 31));
+		return rx_ast_cs(ctx, &cs);
+
+	case '\\':
+		ctx->p++;
+		ret = rx_escape(ctx, 0, &c, &cs);
+		if (!ret)
+			return -1;
+		if (ret == 1)
+			cs_set(&cs, c);
+		return rx_ast_cs(ctx, &cs);
+
+	case '{':
+		if (rx_parse_count(ctx->p, &min, &max))
+			return -1;
+		break;
+
+	case '^': case '$': case '*': case '+': case '?': case ')': case '|': case 0:
+		return -1;
+	}
+
+	cs_set(&cs, *ctx->p++);
+	return rx_ast_cs(ctx, &cs);
+}
+
+static int rx_parse_repeat(struct rx_parse *ctx, int depth)
+{
+	const unsigned char *next;
+	int n, r, min, max;
+
+	n = rx_parse_atom(ctx, depth);
+	if (n < 0)
+		return -1;
+
+	switch (*ctx->p) {
+	case '*': min = 0; max = -1; next = ctx->p + 1; break;
+	case '+': min = 1; max = -1; next = ctx->p + 1; break;
+	case '?': min = 0; max = 1;  next = ctx->p + 1; break;
+	case '{':
+		next = rx_parse_count(ctx->p, &min, &max);
+		if (next)
+			break;
+		/* fall through */
+	default:
+		return n;
+	}
+
+	if (min > RX_MAX_REPEAT || max > RX_MAX_REPEAT || (max >= 0 && max < min))
+		return -1;
+
+	ctx->p = next;
+
+	/* lazy quantifiers match the same subjects, possessive ones do not */
+	if (*ctx->p == '?')
+		ctx->p++;
+	else if (*ctx->p == '+')
+		return -1;
+
+	if (*ctx->p == '*' || *ctx->p == '+' || *ctx->p == '?' ||
+	    (*ctx->p == '{' && rx_parse_count(ctx->p, &r, &r)))
+		return -1;
+
+	r = rx_ast_new(ctx, RXA_REP, n, -1);
+	if (r >= 0) {
+		ctx->ast[r].min = min;
+		ctx->ast[r].max = max;
+	}
+	return r;
+}
+
+/* Parses a sequence up to the end of the branch. At the top level, a '$' is
+ * accepted at the end and reported in <eos>.
+ */
+static int rx_parse_cat(struct rx_parse *ctx, int depth, int *eos)
+{
+	int left = -1, n;
+
+	while (*ctx->p && *ctx->p != '|' && *ctx->p != ')') {
+		if (*ctx->p == '$' && !depth && (!ctx->p[1] || ctx->p[1] == '|')) {
+			*eos = 1;
+			ctx->p++;
+			break;
+		}
+
+		n = rx_parse_repeat(ctx, depth);
+		if (n < 0)
+			return -1;
+		if (left >= 0) {
+			n = rx_ast_new(ctx, RXA_CAT, left, n);
+			if (n < 0)
+				return -1;
+		}
+		left = n;
+	}
+
+	if (left < 0)
+		left = rx_ast_new(ctx, RXA_EMPTY, -1, -1);
+	return left;
+}
+
+static int rx_parse_alt(struct rx_parse *ctx, int depth)
+{
+	int left, n;
+
+	left = rx_parse_cat(ctx, depth, NULL);
+	while (left >= 0 && *ctx->p == '|') {
+		ctx->p++;
+		n = rx_parse_cat(ctx, depth, NULL);
+		if (n < 0)
+			return -1;
+		left = rx_ast_new(ctx, RXA_ALT, left, n);
+	}
+	return left;
+}
+
+/***** compiler : turns the AST into NFA states *****/
+
+static unsigned int rx_state(struct rx_parse *ctx, int type, unsigned int out, unsigned int out1, unsigned int arg)
+{
+	struct rxset *s = ctx->s;
+	unsigned int size;
+	void *new;
+
+	if (s->nb_nfa - ctx->base >= RXSET_MAX_NFA)
+		return RX_NONE;
+
+	if (s->nb_nfa >= s->sz_nfa) {
+		size = s->sz_nfa ? s->sz_nfa * 2 : 256;
+		new = realloc(s->nfa, size * sizeof(*s->nfa));
+		if (!new) {
+			ctx->nomem = 1;
+			return RX_NONE;
+		}
+		s->nfa = new;
+		s->sz_nfa = size;
+	}
+
+	s->nfa[s->nb_nfa].type = type;
+	s->nfa[s->nb_nfa].out = out;
+	s->nfa[s->nb_nfa].out1 = out1;
+	s->nfa[s->nb_nfa].arg = arg;
+	return s->nb_nfa++;
+}
+
+/* Dangling outputs are chained through the fields they designate, <l>
+ * being (state << 1) + 1 for out1 or + 0 for out.
+ */
+static inline unsigned int *rx_slot(struct rxset *s, unsigned int l)
+{
+	return (l & 1) ? &s->nfa[l >> 1].out1 : &s->nfa[l >> 1].out;
+}
+
+static void rx_patch(struct rxset *s, unsigned int l, unsigned int target)
+{
+	unsigned int *slot;
+
+	while (l != RX_NONE) {
+		slot = rx_slot(s, l);
+		l = *slot;
+		*slot = target;
+	}
+}
+
+static unsigned int rx_append(struct rxset *s, unsigned int l1, unsigned int l2)
+{
+	unsigned int l = l1;
+
+	if (l1 == RX_NONE)
+		return l2;
+	while (*rx_slot(s, l) != RX_NONE)
+		l = *rx_slot(s, l);
+	*rx_slot(s, l) = l2;
+	return l1;
+}
+
+/* concatenates <f2> to <f1>, which may be empty */
+static struct rx_frag rx_cat(struct rxset *s, struct rx_frag f1, struct rx_frag f2)
+{
+	if (f1.start == RX_NONE)
+		return f2;
+	rx_patch(s, f1.out, f2.start);
+	f1.out = f2.out;
+	return f1;
+}
+
+/* Emits the states of node <n>. The returned start is RX_NONE on failure. */
+static struct rx_frag rx_emit(struct rx_parse *ctx, int n)
+{
+	struct rxset *s = ctx->s;
+	struct rx_ast *a = &ctx->ast[n];
+	struct rx_frag f = { RX_NONE, RX_NONE }, g, h;
+	unsigned int st;
+	int i;
+
+	switch (a->type) {
+	case RXA_EMPTY:
+	case RXA_CS:
+		st = rx_state(ctx, a->type == RXA_CS ? RXN_CHAR : RXN_EPS, RX_NONE, RX_NONE, a->cs);
+		if (st != RX_NONE) {
+			f.start = st;
+			f.out = st << 1;
+		}
+		return f;
+
+	case RXA_CAT:
+		g = rx_emit(ctx, a->a);
+		if (g.start == RX_NONE)
+			return g;
+		h = rx_emit(ctx, a->b);
+		if (h.start == RX_NONE)
+			return h;
+		return rx_cat(s, g, h);
+
+	case RXA_ALT:
+		g = rx_emit(ctx, a->a);
+		if (g.start == RX_NONE)
+			return g;
+		h = rx_emit(ctx, a->b);
+		if (h.start == RX_NONE)
+			return h;
+		st = rx_state(ctx, RXN_SPLIT, g.start, h.start, 0);
+		if (st != RX_NONE) {
+			f.start = st;
+			f.out = rx_append(s, g.out, h.out);
+		}
+		return f;
+	}
+
+	/* RXA_REP: x{2,} is emitted as x x+, and x{1,3} as x x? x? */
+	for (i = 0; i < a->min || (i == a->min && a->max < 0); i++) {
+		g = rx_emit(ctx, a->a);
+		if (g.start == RX_NONE)
+			return g;
+
+		if (i >= a->min - 1 && a->max < 0) {
+			/* loop on the last instance, optional if min is 0 */
+			st = rx_state(ctx, RXN_SPLIT, g.start, RX_NONE, 0);
+			if (st == RX_NONE) {
+				g.start = RX_NONE;
+				return g;
+			}
+			rx_patch(s, g.out, st);
+			g.out = (st << 1) + 1;
+			if (!a->min)
+				g.start = st;
+			f = rx_cat(s, f, g);
+			break;
+		}
+		f = rx_cat(s, f, g);
+	}
+
+	for (i = a->min; a->max >= 0 && i < a->max; i++) {
+		g = rx_emit(ctx, a->a);
+		if (g.start == RX_NONE)
+			return g;
+
+		st = rx_state(ctx, RXN_SPLIT, g.start, RX_NONE, 0);
+		if (st == RX_NONE) {
+			g.start = RX_NONE;
+			return g;
+		}
+		g.start = st;
+		g.out = rx_append(s, g.out, (st << 1) + 1);
+		f = rx_cat(s, f, g);
+	}
+
+	if (f.start == RX_NONE) {
+		/* x{0} */
+		st = rx_state(ctx, RXN_EPS, RX_NONE, RX_NONE, 0);
+		if (st != RX_NONE) {
+			f.start = st;
+			f.out = st << 1;
+		}
+	}
+	return f;
+}
+
+/* Parses and emits one top-level branch. Returns 0 on success or -1. */
+static int rx_branch(struct rx_parse *ctx, unsigned int id)
+{
+	struct rxset *s = ctx->s;
+	struct rx_charset nl;
+	struct rx_frag f;
+	unsigned int end, st;
+	int anchored = 0, eos = 0;
+	int n, cs_nl;
+
+	if (*ctx->p == '^') {
+		anchored = 1;
+		ctx->p++;
+	}
+
+	ctx->nb_ast = 0;
+	n = rx_parse_cat(ctx, 0, &eos);
+	if (n < 0)
+		return -1;
+
+	f = rx_emit(ctx, n);
+	if (f.start == RX_NONE)
+		return -1;
+
+	if (eos) {
+		/* '$' also matches before a final newline */
+		memset(&nl, 0, sizeof(nl));
+		cs_set(&nl, '\n');
+		cs_nl = rx_cs_get(s, &nl);
+		if (cs_nl < 0) {
+			ctx->nomem = 1;
+			return -1;
+		}
+		end = rx_state(ctx, RXN_EOS, RX_NONE, RX_NONE, id);
+		if (end == RX_NONE)
+			return -1;
+		st = rx_state(ctx, RXN_CHAR, end, RX_NONE, cs_nl);
+		if (st == RX_NONE)
+			return -1;
+		st = rx_state(ctx, RXN_SPLIT, end, st, 0);
+	}
+	else
+		st = rx_state(ctx, RXN_MATCH, RX_NONE, RX_NONE, id);
+
+	if (st == RX_NONE)
+		return -1;
+	rx_patch(s, f.out, st);
+
+	if (anchored) {
+		if (rx_push(&s->astart, &s->nb_astart, &s->sz_astart, f.start) < 0)
+			goto nomem;
+	}
+	else if (rx_push(&s->ustart, &s->nb_ustart, &s->sz_ustart, f.start) < 0)
+		goto nomem;
+	return 0;
+
+ nomem:
+	ctx->nomem = 1;
+	return -1;
+}
+
+struct rxset *rxset_new(int icase)
+{
+	struct rxset *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->icase = icase;
+	s->init = -1;
+	return s;
+}
+
+/* releases the DFA states, keeping the allocated arrays */
+static void rx_flush(struct rxset *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < s->nb_dfa; i++)
+		free(s->dfa[i].set);
+	s->nb_dfa = 0;
+	s->init = -1;
+	s->mem = 0;
+	if (s->dfa_hash)
+		memset(s->dfa_hash, 0xff, s->sz_dfa_hash * sizeof(*s->dfa_hash));
+}
+
+void rxset_free(struct rxset *s)
+{
+	if (!s)
+		return;
+	rx_flush(s);
+	free(s->nfa);
+	free(s->cs);
+	free(s->cs_hash);
+	free(s->astart);
+	free(s->ustart);
+	free(s->uset);
+	free(s->mark);
+	free(s->work);
+	free(s->stack);
+	free(s->dfa);
+	free(s->trans);
+	free(s->dfa_hash);
+	free(s);
+}
+
+int rxset_add(struct rxset *s, const char *str, unsigned int id)
+{
+	struct rx_parse ctx;
+	unsigned int nb_astart = s->nb_astart;
+	unsigned int nb_ustart = s->nb_ustart;
+
+	if (s->prepared)
+		return -1;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.s = s;
+	ctx.p = (const unsigned char *)str;
+	ctx.base = s->nb_nfa;
+
+	while (1) {
+		if (rx_branch(&ctx, id) < 0)
+			goto fail;
+		if (!*ctx.p)
+			break;
+		if (*ctx.p != '|')
+			goto fail;
+		ctx.p++;
+	}
+
+	free(ctx.ast);
+	if (!s->nb_exprs++)
+		s->min_id = id;
+	return 1;
+
+ fail:
+	/* the charsets which were added are simply left unused */
+	free(ctx.ast);
+	s->nb_nfa = ctx.base;
+	s->nb_astart = nb_astart;
+	s->nb_ustart = nb_ustart;
+	return ctx.nomem ? -1 : 0;
+}
+
+/***** lazy DFA *****/
+
+static inline void rx_new_gen(struct rxset *s)
+{
+	if (unlikely(!++s->gen)) {
+		memset(s->mark, 0, s->nb_nfa * sizeof(*s->mark));
+		s->gen = 1;
+	}
+}
+
+/* adds to the work list the CHAR, MATCH and EOS states reachable from <st>
+ * through empty transitions, which were not already marked.
+ */
+static void rx_closure(struct rxset *s, unsigned int st)
+{
+	unsigned int sp = 0;
+	const struct rxn_state *n;
+
+	if (s->mark[st] == s->gen)
+		return;
+	s->mark[st] = s->gen;
+	s->stack[sp++] = st;
+
+	while (sp) {
+		st = s->stack[--sp];
+		n = &s->nfa[st];
+		switch (n->type) {
+		case RXN_SPLIT:
+			if (s->mark[n->out1] != s->gen) {
+				s->mark[n->out1] = s->gen;
+				s->stack[sp++] = n->out1;
+			}
+			/* fall through */
+		case RXN_EPS:
+			if (s->mark[n->out] != s->gen) {
+				s->mark[n->out] = s->gen;
+				s->stack[sp++] = n->out;
+			}
+			break;
+		default:
+			s->work[s->nb_work++] = st;
+		}
+	}
+}
+
+static int rx_cmp(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Returns the DFA state made of the work list, creating it if needed, or -1
+ * on memory shortage. The cache may be flushed when creating a state.
+ */
+static int rx_dfa_get(struct rxset *s)
+{
+	struct rxd_state *d;
+	unsigned int h, i, size, cost;
+	unsigned int acc, acc_end, id;
+	void *new;
+	int x;
+
+	qsort(s->work, s->nb_work, sizeof(*s->work), rx_cmp);
+
+	h = 2166136261U;
+	for (i = 0; i < s->nb_work; i++)
+		h = (h ^ s->work[i]) * 16777619U;
+
+	for (x = s->dfa_hash[h & (s->sz_dfa_hash - 1)]; x >= 0; x = s->dfa[x].hnext) {
+		d = &s->dfa[x];
+		if (d->hash == h && d->nb == s->nb_work &&
+		    (!d->nb || memcmp(d->set, s->work, d->nb * sizeof(*s->work)) == 0))
+			return x;
+	}
+
+	cost = sizeof(*d) + s->nb_cls * sizeof(*s->trans) + s->nb_work * sizeof(*s->work);
+	if (s->nb_dfa && s->mem + cost > RXSET_CACHE_SIZE) {
+		rx_flush(s);
+		s->flushes++;
+	}
+
+	if (s->nb_dfa >= s->sz_dfa) {
+		size = s->sz_dfa ? s->sz_dfa * 2 : 64;
+		new = realloc(s->dfa, size * sizeof(*s->dfa));
+		if (!new)
+			return -1;
+		s->dfa = new;
+		new = realloc(s->trans, size * s->nb_cls * sizeof(*s->trans));
+		if (!new)
+			return -1;
+		s->trans = new;
+		s->sz_dfa = size;
+	}
+
+	d = &s->dfa[s->nb_dfa];
+	d->set = NULL;
+	if (s->nb_work) {
+		d->set = malloc(s->nb_work * sizeof(*s->work));
+		if (!d->set)
+			return -1;
+		memcpy(d->set, s->work, s->nb_work * sizeof(*s->work));
+	}
+	d->nb = s->nb_work;
+	d->hash = h;
+
+	acc = s->uacc;
+	acc_end = s->uacc_end;
+	for (i = 0; i < d->nb; i++) {
+		id = s->nfa[d->set[i]].arg;
+		if (s->nfa[d->set[i]].type == RXN_MATCH && id < acc)
+			acc = id;
+		else if (s->nfa[d->set[i]].type == RXN_EOS && id < acc_end)
+			acc_end = id;
+	}
+	d->acc = acc;
+	d->acc_end = acc < acc_end ? acc : acc_end;
+
+	memset(s->trans + s->nb_dfa * s->nb_cls, 0, s->nb_cls * sizeof(*s->trans));
+	d->hnext = s->dfa_hash[h & (s->sz_dfa_hash - 1)];
+	s->dfa_hash[h & (s->sz_dfa_hash - 1)] = s->nb_dfa;
+	s->mem += cost;
+	return s->nb_dfa++;
+}
+
+/* marks the states of the unanchored starts' closure, which are implicit */
+static inline void rx_mark_uset(struct rxset *s)
+{
+	unsigned int i;
+
+	rx_new_gen(s);
+	for (i = 0; i < s->nb_uset; i++)
+		s->mark[s->uset[i]] = s->gen;
+	s->nb_work = 0;
+}
+
+static int rx_dfa_init(struct rxset *s)
+{
+	unsigned int i;
+
+	rx_mark_uset(s);
+	for (i = 0; i < s->nb_astart; i++)
+		rx_closure(s, s->astart[i]);
+	return rx_dfa_get(s);
+}
+
+/* Returns the state reached from state <d> with a byte of class <c>, or -1 on
+ * memory shortage.
+ */
+static int rx_dfa_step(struct rxset *s, int d, unsigned int c)
+{
+	const struct rxn_state *n;
+	unsigned char b = s->rep[c];
+	unsigned int i, flushes;
+	int x;
+
+	rx_mark_uset(s);
+	for (i = 0; i < s->dfa[d].nb; i++) {
+		n = &s->nfa[s->dfa[d].set[i]];
+		if (n->type == RXN_CHAR && cs_has(&s->cs[n->arg], b))
+			rx_closure(s, n->out);
+	}
+	for (i = 0; i < s->nb_uset; i++) {
+		n = &s->nfa[s->uset[i]];
+		if (n->type == RXN_CHAR && cs_has(&s->cs[n->arg], b))
+			rx_closure(s, n->out);
+	}
+
+	flushes = s->flushes;
+	x = rx_dfa_get(s);
+	if (x >= 0 && flushes == s->flushes)
+		s->trans[d * s->nb_cls + c] = x + 1;
+	return x;
+}
+
+int rxset_prepare(struct rxset *s)
+{
+	unsigned char cls[256];
+	int map[512];
+	unsigned int i, k, n;
+	unsigned int id;
+
+	if (s->prepared)
+		return 0;
+
+	/* split the bytes into classes that no charset tells apart */
+	memset(s->cls, 0, sizeof(s->cls));
+	s->nb_cls = 1;
+	for (k = 0; k < s->nb_cs; k++) {
+		memset(map, 0xff, 2 * s->nb_cls * sizeof(*map));
+		for (i = n = 0; i < 256; i++) {
+			int key = s->cls[i] * 2 + cs_has(&s->cs[k], i);
+
+			if (map[key] < 0)
+				map[key] = n++;
+			cls[i] = map[key];
+		}
+		memcpy(s->cls, cls, sizeof(cls));
+		s->nb_cls = n;
+	}
+	for (i = 256; i-- > 0; )
+		s->rep[s->cls[i]] = i;
+
+	s->mark = calloc(s->nb_nfa + 1, sizeof(*s->mark));
+	s->work = malloc((s->nb_nfa + 1) * sizeof(*s->work));
+	s->stack = malloc((s->nb_nfa + 1) * sizeof(*s->stack));
+	s->dfa_hash = malloc(RX_HASH_SIZE * sizeof(*s->dfa_hash));
+	if (!s->mark || !s->work || !s->stack || !s->dfa_hash)
+		return -1;
+	s->sz_dfa_hash = RX_HASH_SIZE;
+	memset(s->dfa_hash, 0xff, s->sz_dfa_hash * sizeof(*s->dfa_hash));
+
+	/* closure of the unanchored starts */
+	rx_new_gen(s);
+	s->nb_work = 0;
+	for (i = 0; i < s->nb_ustart; i++)
+		rx_closure(s, s->ustart[i]);
+
+	s->uset = malloc((s->nb_work + 1) * sizeof(*s->uset));
+	if (!s->uset)
+		return -1;
+	memcpy(s->uset, s->work, s->nb_work * sizeof(*s->work));
+	s->nb_uset = s->nb_work;
+
+	s->uacc = s->uacc_end = UINT_MAX;
+	for (i = 0; i < s->nb_uset; i++) {
+		id = s->nfa[s->uset[i]].arg;
+		if (s->nfa[s->uset[i]].type == RXN_MATCH && id < s->uacc)
+			s->uacc = id;
+		else if (s->nfa[s->uset[i]].type == RXN_EOS && id < s->uacc_end)
+			s->uacc_end = id;
+	}
+
+	s->prepared = 1;
+	return 0;
+}
+
+int rxset_exec(struct rxset *s, const char *str, int len, unsigned int *id)
+{
+	const unsigned char *p = (const unsigned char *)str;
+	const unsigned char *e = p + len;
+	unsigned int best, t;
+	int d;
+
+	if (!s->nb_exprs)
+		return 0;
+
+	if (s->init < 0) {
+		s->init = rx_dfa_init(s);
+		if (s->init < 0)
+			return -1;
+	}
+
+	d = s->init;
+	best = s->dfa[d].acc;
+	while (p < e && best != s->min_id) {
+		t = s->trans[d * s->nb_cls + s->cls[*p]];
+		if (likely(t))
+			d = t - 1;
+		else {
+			d = rx_dfa_step(s, d, s->cls[*p]);
+			if (d < 0)
+				return -1;
+		}
+		p++;
+		if (s->dfa[d].acc < best)
+			best = s->dfa[d].acc;
+	}
+
+	if (p == e && s->dfa[d].acc_end < best)
+		best = s->dfa[d].acc_end;
+
+	if (best == UINT_MAX)
+		return 0;
+	*id = best;
+	return 1;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -187,6 +187,8 @@ void srv_shutdown_streams(struct server *srv, int why)
 	list_for_each_entry_safe(stream, stream_bck, &srv->actconns, by_srv)
 		if (stream->srv_conn == srv)
 			stream_shutdown(stream, why);
+
+	srv_purge_pool(srv, srv->pool_cur);
 }
 
 /* Shutdown all connections of all backup servers of a proxy. The caller must
@@ -202,6 +204,138 @@ void srv_shutdown_backup_streams(struct proxy *px, int why)
 			srv_shutdown_streams(srv, why);
 }
 
+/* Releases pooled connection <conn> which belongs to server <srv> */
+static void srv_pool_kill_conn(struct server *srv, struct connection *conn)
+{
+	LIST_DEL(&conn->list);
+	srv->pool_cur--;
+	if (srv->pool_unused > srv->pool_cur)
+		srv->pool_unused = srv->pool_cur;
+	conn_force_close(conn);
+	conn_free(conn);
+}
+
+/* I/O callback for pooled connections. Anything received is drained so that
+ * a close from the server is reported to srv_pool_conn_wake_cb().
+ */
+static void srv_pool_conn_io_cb(struct connection *conn)
+{
+	conn_sock_drain(conn);
+}
+
+/* Wake callback for pooled connections. It kills the connection once a close
+ * or an error was detected on it. It returns 0 if it did nothing, or -1 if it
+ * killed the connection.
+ */
+static int srv_pool_conn_wake_cb(struct connection *conn)
+{
+	if (!conn_ctrl_ready(conn))
+		return 0;
+
+	if (conn->flags & (CO_FL_ERROR | CO_FL_SOCK_RD_SH)) {
+		/* warning, we can't do anything on <conn> after this call ! */
+		srv_pool_kill_conn(__objt_server(conn->target), conn);
+		return -1;
+	}
+	return 0;
+}
+
+static struct data_cb srv_pool_conn_cb = {
+	.recv    = srv_pool_conn_io_cb,
+	.send    = srv_pool_conn_io_cb,
+	.wake    = srv_pool_conn_wake_cb,
+	.name    = "POOL",
+};
+
+/* Tries to move the idle server connection <conn>, which is not attached to
+ * any stream interface anymore, to its server's pool so that any other stream
+ * may pick it. The most recently pooled connections are picked first, leaving
+ * the oldest ones to the purge task. Returns 1 if the connection was pooled,
+ * otherwise 0, in which case the caller remains responsible for releasing it.
+ */
+int srv_pool_conn(struct connection *conn)
+{
+	struct server *srv = objt_server(conn->target);
+
+	if (!srv || srv->pool_cur >= srv->pool_max_conn)
+		return 0;
+
+	/* only connections left idle at the end of a transaction are safe */
+	if (conn->data != &si_idle_conn_cb || !conn_xprt_ready(conn) ||
+	    (conn->flags & (CO_FL_PRIVATE | CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH |
+	                    CO_FL_DATA_RD_SH | CO_FL_DATA_WR_SH)))
+		return 0;
+
+	LIST_DEL(&conn->list);
+	LIST_ADD(&srv->pool_conns, &conn->list);
+	conn_attach(conn, NULL, &srv_pool_conn_cb);
+	conn_data_want_recv(conn);
+	srv->pool_cur++;
+
+	if (!tick_isset(srv->pool_task->expire))
+		task_schedule(srv->pool_task, tick_add(now_ms, MS_TO_TICKS(srv->pool_purge_delay)));
+	return 1;
+}
+
+/* Picks the most recently pooled connection of server <srv>, or returns NULL
+ * if the pool is empty. The connection is not attached to anything.
+ */
+struct connection *srv_take_pooled_conn(struct server *srv)
+{
+	struct connection *conn;
+
+	if (LIST_ISEMPTY(&srv->pool_conns))
+		return NULL;
+
+	conn = LIST_ELEM(srv->pool_conns.n, struct connection *, list);
+	LIST_DEL(&conn->list);
+	LIST_INIT(&conn->list);
+	srv->pool_cur--;
+	if (srv->pool_unused > srv->pool_cur)
+		srv->pool_unused = srv->pool_cur;
+	return conn;
+}
+
+/* Closes the <count> oldest connections of server <srv>'s pool */
+void srv_purge_pool(struct server *srv, unsigned int count)
+{
+	while (count-- && !LIST_ISEMPTY(&srv->pool_conns))
+		srv_pool_kill_conn(srv, LIST_ELEM(srv->pool_conns.p, struct connection *, list));
+}
+
+/* Task run every pool-purge-delay while a server's pool is not empty. The
+ * connections which were never picked since the previous run are in excess,
+ * they are closed. Since the pool is used in LIFO order, these are the oldest
+ * ones.
+ */
+static struct task *srv_pool_purge(struct task *t)
+{
+	struct server *srv = t->context;
+
+	srv_purge_pool(srv, srv->pool_unused);
+	srv->pool_unused = srv->pool_cur;
+
+	t->expire = TICK_ETERNITY;
+	if (srv->pool_cur)
+		t->expire = tick_add(now_ms, MS_TO_TICKS(srv->pool_purge_delay));
+	return t;
+}
+
+/* Allocates the purge task of server <srv>'s idle connection pool. Returns 0
+ * on success, or -1 on memory allocation failure.
+ */
+int srv_init_pool(struct server *srv)
+{
+	srv->pool_task = task_new();
+	if (!srv->pool_task)
+		return -1;
+
+	srv->pool_task->process = srv_pool_purge;
+	srv->pool_task->context = srv;
+	srv->pool_task->expire = TICK_ETERNITY;
+	return 0;
+}
+
 /* Appends some information to a message string related to a server going UP or
  * DOWN.  If both <forced> and <reason> are null and the server tracks another
  * one, a "via" information will be provided to know where the status came from.
@@ -995,6 +1129,7 @@ int parse_server(const char *file, int linenum, char **args, struct proxy *curpr
 			LIST_INIT(&newsrv->priv_conns);
 			LIST_INIT(&newsrv->idle_conns);
 			LIST_INIT(&newsrv->safe_conns);
+			LIST_INIT(&newsrv->pool_conns);
 			do_check = 0;
 			do_agent = 0;
 			newsrv->flags = 0;
@@ -1096,6 +1231,8 @@ int parse_server(const char *file, int linenum, char **args, struct proxy *curpr
 			newsrv->minconn		= curproxy->defsrv.minconn;
 			newsrv->maxconn		= curproxy->defsrv.maxconn;
 			newsrv->slowstart	= curproxy->defsrv.slowstart;
+			newsrv->pool_max_conn	= curproxy->defsrv.pool_max_conn;
+			newsrv->pool_purge_delay = curproxy->defsrv.pool_purge_delay;
 			newsrv->onerror		= curproxy->defsrv.onerror;
 			newsrv->onmarkeddown    = curproxy->defsrv.onmarkeddown;
 			newsrv->onmarkedup      = curproxy->defsrv.onmarkedup;
@@ -1490,6 +1627,35 @@ int parse_server(const char *file, int linenum, char **args, struct proxy *curpr
 				newsrv->slowstart = (val + 999) / 1000;
 				cur_arg += 2;
 			}
+			else if (!strcmp(args[cur_arg], "pool-max-conn")) {
+				char *end;
+
+				newsrv->pool_max_conn = strtoul(args[cur_arg + 1], &end, 10);
+				if (!*args[cur_arg + 1] || *end) {
+					Alert("parsing [%s:%d] : '%s' expects an integer argument for server %s.\n",
+					      file, linenum, args[cur_arg], newsrv->id);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				cur_arg += 2;
+			}
+			else if (!strcmp(args[cur_arg], "pool-purge-delay")) {
+				const char *err = parse_time_err(args[cur_arg + 1], &val, TIME_UNIT_MS);
+				if (err) {
+					Alert("parsing [%s:%d] : unexpected character '%c' in 'pool-purge-delay' argument of server %s.\n",
+					      file, linenum, *err, newsrv->id);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				if (val <= 0) {
+					Alert("parsing [%s:%d] : 'pool-purge-delay' of server %s must be strictly positive.\n",
+					      file, linenum, newsrv->id);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				newsrv->pool_purge_delay = val;
+				cur_arg += 2;
+			}
 			else if (!defsrv && !strcmp(args[cur_arg], "track")) {
 
 				if (!*args[cur_arg + 1]) {
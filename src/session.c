@@ -21,6 +21,7 @@
 #include <proto/connection.h>
 #include <proto/listener.h>
 #include <proto/log.h>
+#include <proto/mux_h2.h>
 #include <proto/proto_http.h>
 #include <proto/proxy.h>
 #include <proto/raw_sock.h>
@@ -34,6 +35,10 @@ struct pool_head *pool2_session;
 static int conn_complete_session(struct connection *conn);
 static int conn_update_session(struct connection *conn);
 static struct task *session_expire_embryonic(struct task *t);
+static void session_release_conn(struct session *sess, struct task *task);
+static void conn_resume_idle_session(struct connection *conn);
+static int conn_update_idle_session(struct connection *conn);
+static struct task *session_expire_idle(struct task *t);
 
 /* data layer callbacks for an embryonic stream */
 struct data_cb sess_conn_cb = {
@@ -44,6 +49,15 @@ struct data_cb sess_conn_cb = {
 	.name = "SESS",
 };
 
+/* data layer callbacks for an idle keep-alive session without stream */
+struct data_cb sess_idle_conn_cb = {
+	.recv = conn_resume_idle_session,
+	.send = NULL,
+	.wake = conn_update_idle_session,
+	.init = NULL,
+	.name = "IDLE",
+};
+
 /* Create a a new session and assign it to frontend <fe>, listener <li>,
  * origin <origin>, set the current date and clear the stick counters pointers.
  * Returns the session upon success or NULL. The session may be released using
@@ -62,6 +76,7 @@ struct session *session_new(struct proxy *fe, struct listener *li, enum obj_type
 		sess->tv_accept   = now;  /* corrected date for internal use */
 		memset(sess->stkctr, 0, sizeof(sess->stkctr));
 		vars_init(&sess->vars, SCOPE_SESS);
+		sess->flags = 0;
 	}
 	return sess;
 }
@@ -272,6 +287,14 @@ int session_accept_fd(struct listener *l, int cfd, struct sockaddr_storage *addr
 	if ((l->options & LI_O_TCP_L5_RULES) && !tcp_exec_l5_rules(sess))
 		goto out_free_sess;
 
+	/* HTTP/2 connections create their streams themselves */
+	if (h2c_frt_wanted(cli_conn, l)) {
+		session_count_new(sess);
+		if (h2c_frt_init(cli_conn, sess, t) < 0)
+			goto out_free_task;
+		return 1;
+	}
+
 	session_count_new(sess);
 	strm = stream_new(sess, t, &cli_conn->obj_type);
 	if (!strm)
@@ -380,6 +403,18 @@ static void session_kill_embryonic(struct session *sess, struct task *task)
 				 trash.str, conn->err_code, conn->flags);
 	}
 
+	session_release_conn(sess, task);
+}
+
+/* Closes the connection of session <sess> which has no stream, updates the
+ * counters, resumes the listener if it was disabled, then frees the session
+ * and its task. This function requires that sess->origin points to the
+ * incoming connection.
+ */
+static void session_release_conn(struct session *sess, struct task *task)
+{
+	struct connection *conn = __objt_conn(sess->origin);
+
 	/* kill the connection now */
 	conn_force_close(conn);
 	conn_free(conn);
@@ -443,6 +478,14 @@ static int conn_complete_session(struct connection *conn)
 	if ((sess->listener->options & LI_O_TCP_L5_RULES) && !tcp_exec_l5_rules(sess))
 		goto fail;
 
+	if (h2c_frt_wanted(conn, sess->listener)) {
+		session_count_new(sess);
+		if (h2c_frt_init(conn, sess, task) < 0)
+			goto fail;
+		conn->flags &= ~CO_FL_INIT_DATA;
+		return 0;
+	}
+
 	session_count_new(sess);
 	task->process = sess->listener->handler;
 	strm = stream_new(sess, task, &conn->obj_type);
@@ -475,6 +518,90 @@ static int conn_update_session(struct connection *conn)
 	return 0;
 }
 
+/* Turns session <sess>, whose stream was just released between two HTTP
+ * requests, into an idle session which only holds client connection <conn>
+ * and task <t>, until either the next request starts to arrive or the
+ * keep-alive timeout strikes. The caller must return <t> to the scheduler.
+ * The dates are reset so that the next request is logged as if the stream
+ * had been kept.
+ */
+void session_set_idle(struct session *sess, struct connection *conn, struct task *t)
+{
+	struct proxy *fe = sess->fe;
+	int timeout = tick_isset(fe->timeout.httpka) ? fe->timeout.httpka : fe->timeout.httpreq;
+
+	sess->accept_date = date;
+	sess->tv_accept   = now;
+
+	conn_attach(conn, t, &sess_idle_conn_cb);
+	conn_data_stop_send(conn);
+	conn_data_want_recv(conn);
+
+	t->process = session_expire_idle;
+	t->context = sess;
+	t->expire  = tick_first(tick_add_ifset(now_ms, timeout),
+	                        tick_add_ifset(now_ms, fe->timeout.client));
+}
+
+/* Silently closes an idle session once its keep-alive timeout strikes, just
+ * like the stream would have done.
+ */
+static struct task *session_expire_idle(struct task *t)
+{
+	struct session *sess = t->context;
+
+	if (!(t->state & TASK_WOKEN_TIMER))
+		return t;
+
+	session_release_conn(sess, t);
+	return NULL;
+}
+
+/* Some data (or a close) arrived on an idle session : a new stream is created
+ * on the connection exactly like a keep-alive stream would wait for its next
+ * request, and the data are passed to it. If the stream cannot be created, an
+ * error is reported so that the wake callback kills the connection.
+ */
+static void conn_resume_idle_session(struct connection *conn)
+{
+	struct task *task = conn->owner;
+	struct session *sess = task->context;
+	struct stream *strm;
+
+	sess->flags |= SESS_FL_RESUMED;
+	task->process = sess->listener->handler;
+	strm = stream_new(sess, task, &conn->obj_type);
+	if (!strm) {
+		task->process = session_expire_idle;
+		task->context = sess;
+		conn_attach(conn, task, &sess_idle_conn_cb);
+		conn->flags |= CO_FL_ERROR;
+		return;
+	}
+
+	strm->target         = sess->listener->default_target;
+	strm->req.analysers |= sess->listener->analysers;
+	strm->logs.t_handshake = 0;
+	if (strm->txn)
+		strm->txn->flags |= TX_NOT_FIRST | TX_WAIT_NEXT_RQ;
+
+	/* the connection now belongs to the stream */
+	conn->data->recv(conn);
+}
+
+/* Kills an idle session whose connection reports an error or a shutdown */
+static int conn_update_idle_session(struct connection *conn)
+{
+	struct task *task = conn->owner;
+	struct session *sess = task->context;
+
+	if (conn->flags & (CO_FL_ERROR | CO_FL_SOCK_RD_SH)) {
+		session_release_conn(sess, task);
+		return -1;
+	}
+	return 0;
+}
+
 /*
  * Local variables:
  *  c-indent-level: 8
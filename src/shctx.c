@@ -12,19 +12,9 @@
  */
 
 #include <sys/mman.h>
-#ifndef USE_PRIVATE_CACHE
-#ifdef USE_PTHREAD_PSHARED
-#include <pthread.h>
-#else
-#ifdef USE_SYSCALL_FUTEX
-#include <unistd.h>
-#include <linux/futex.h>
-#include <sys/syscall.h>
-#endif
-#endif
-#endif
 #include <arpa/inet.h>
 #include <ebmbtree.h>
+#include <common/shlock.h>
 #include <types/global.h>
 #include "proto/shctx.h"
 #include <proto/openssl-compat.h>
@@ -60,13 +50,7 @@ struct shared_block {
 };
 
 struct shared_context {
-#ifndef USE_PRIVATE_CACHE
-#ifdef USE_PTHREAD_PSHARED
-	pthread_mutex_t mutex;
-#else
-	unsigned int waiters;
-#endif
-#endif
+	struct shlock lock;
 	struct shsess_packet_hdr upd;
 	unsigned char data[SHSESS_MAX_DATA_LEN];
 	short int data_len;
@@ -84,133 +68,11 @@ static struct shared_context *shctx = NULL;
 #define shared_context_lock()
 #define shared_context_unlock()
 
-#elif defined (USE_PTHREAD_PSHARED)
-static int use_shared_mem = 0;
-
-#define shared_context_lock()   if (use_shared_mem) pthread_mutex_lock(&shctx->mutex)
-#define shared_context_unlock() if (use_shared_mem) pthread_mutex_unlock(&shctx->mutex)
-
 #else
 static int use_shared_mem = 0;
 
-#ifdef USE_SYSCALL_FUTEX
-static inline void _shared_context_wait4lock(unsigned int *count, unsigned int *uaddr, int value)
-{
-	syscall(SYS_futex, uaddr, FUTEX_WAIT, value, NULL, 0, 0);
-}
-
-static inline void _shared_context_awakelocker(unsigned int *uaddr)
-{
-	syscall(SYS_futex, uaddr, FUTEX_WAKE, 1, NULL, 0, 0);
-}
-
-#else /* internal spin lock */
-
-#if (defined (__i486__) || defined (__i586__) || defined (__i686__) || defined (__x86_64__)) && !defined(__VMS)
-static inline void relax()
-{
-	__asm volatile("rep;nop\n" ::: "memory");
-}
-#else /* if no x86_64 or i586 arch: use less optimized but generic asm */
-static inline void relax()
-{
-	__asm volatile("" ::: "memory");
-}
-#endif
-
-static inline void _shared_context_wait4lock(unsigned int *count, unsigned int *uaddr, int value)
-{
-        int i;
-
-        for (i = 0; i < *count; i++) {
-                relax();
-                relax();
-        }
-        *count = *count << 1;
-}
-
-#define _shared_context_awakelocker(a)
-
-#endif
-
-#if (defined (__i486__) || defined (__i586__) || defined (__i686__) || defined (__x86_64__)) && !defined(__VMS)
-static inline unsigned int xchg(unsigned int *ptr, unsigned int x)
-{
-	__asm volatile("lock xchgl %0,%1"
-		     : "=r" (x), "+m" (*ptr)
-		     : "0" (x)
-		     : "memory");
-	return x;
-}
-
-static inline unsigned int cmpxchg(unsigned int *ptr, unsigned int old, unsigned int new)
-{
-	unsigned int ret;
-
-	__asm volatile("lock cmpxchgl %2,%1"
-		     : "=a" (ret), "+m" (*ptr)
-		     : "r" (new), "0" (old)
-		     : "memory");
-	return ret;
-}
-
-static inline unsigned char atomic_dec(unsigned int *ptr)
-{
-	unsigned char ret;
-	__asm volatile("lock decl %0\n"
-		     "setne %1\n"
-		     : "+m" (*ptr), "=qm" (ret)
-		     :
-		     : "memory");
-	return ret;
-}
-
-#else /* if no x86_64 or i586 arch: use less optimized gcc >= 4.1 built-ins */
-static inline unsigned int xchg(unsigned int *ptr, unsigned int x)
-{
-	return __sync_lock_test_and_set(ptr, x);
-}
-
-static inline unsigned int cmpxchg(unsigned int *ptr, unsigned int old, unsigned int new)
-{
-	return __sync_val_compare_and_swap(ptr, old, new);
-}
-
-static inline unsigned char atomic_dec(unsigned int *ptr)
-{
-	return __sync_sub_and_fetch(ptr, 1) ? 1 : 0;
-}
-
-#endif
-
-static inline void _shared_context_lock(void)
-{
-	unsigned int x;
-	unsigned int count = 4;
-
-	x = cmpxchg(&shctx->waiters, 0, 1);
-	if (x) {
-		if (x != 2)
-			x = xchg(&shctx->waiters, 2);
-
-		while (x) {
-			_shared_context_wait4lock(&count, &shctx->waiters, 2);
-			x = xchg(&shctx->waiters, 2);
-		}
-	}
-}
-
-static inline void _shared_context_unlock(void)
-{
-	if (atomic_dec(&shctx->waiters)) {
-		shctx->waiters = 0;
-		_shared_context_awakelocker(&shctx->waiters);
-	}
-}
-
-#define shared_context_lock()   if (use_shared_mem) _shared_context_lock()
-
-#define shared_context_unlock() if (use_shared_mem) _shared_context_unlock()
+#define shared_context_lock()   if (use_shared_mem) shlock_lock(&shctx->lock)
+#define shared_context_unlock() if (use_shared_mem) shlock_unlock(&shctx->lock)
 
 #endif
 
@@ -554,11 +416,6 @@ void shctx_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
 int shared_context_init(int size, int shared)
 {
 	int i;
-#ifndef USE_PRIVATE_CACHE
-#ifdef USE_PTHREAD_PSHARED
-	pthread_mutexattr_t attr;
-#endif
-#endif
 	struct shared_block *prev,*cur;
 	int maptype = MAP_PRIVATE;
 
@@ -584,29 +441,11 @@ int shared_context_init(int size, int shared)
 
 #ifndef USE_PRIVATE_CACHE
 	if (maptype == MAP_SHARED) {
-#ifdef USE_PTHREAD_PSHARED
-		if (pthread_mutexattr_init(&attr)) {
-			munmap(shctx, sizeof(struct shared_context)+(size*sizeof(struct shared_block)));
-			shctx = NULL;
-			return SHCTX_E_INIT_LOCK;
-		}
-
-		if (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED)) {
-			pthread_mutexattr_destroy(&attr);
-			munmap(shctx, sizeof(struct shared_context)+(size*sizeof(struct shared_block)));
-			shctx = NULL;
-			return SHCTX_E_INIT_LOCK;
-		}
-
-		if (pthread_mutex_init(&shctx->mutex, &attr)) {
-			pthread_mutexattr_destroy(&attr);
+		if (shlock_init(&shctx->lock)) {
 			munmap(shctx, sizeof(struct shared_context)+(size*sizeof(struct shared_block)));
 			shctx = NULL;
 			return SHCTX_E_INIT_LOCK;
 		}
-#else
-		shctx->waiters = 0;
-#endif
 		use_shared_mem = 1;
 	}
 #endif
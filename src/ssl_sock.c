@@ -98,6 +98,7 @@
 #include <proto/stream_interface.h>
 #include <proto/log.h>
 #include <proto/proxy.h>
+#include <proto/raw_sock.h>
 #include <proto/shctx.h>
 #include <proto/ssl_sock.h>
 #include <proto/stream.h>
@@ -108,6 +109,16 @@
 #define SSL_SOCK_ST_FL_16K_WBFSIZE  0x00000002
 #define SSL_SOCK_SEND_UNLIMITED     0x00000004
 #define SSL_SOCK_RECV_HEARTBEAT     0x00000008
+#define SSL_SOCK_KTLS_SEND          0x00000010
+#define SSL_SOCK_KTLS_RECV          0x00000020
+
+/* kernel TLS offload requires OpenSSL >= 3.0 built with enable-ktls. Once the
+ * handshake is done, the kernel encrypts and decrypts the records itself so
+ * that the socket may be spliced exactly like a clear text one.
+ */
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS) && defined(CONFIG_HAP_LINUX_SPLICE)
+#define SSL_SOCK_HAVE_KTLS
+#endif
 
 /* bits 0xFFFF0000 are reserved to store verify errors */
 
@@ -2746,6 +2757,10 @@ int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, SSL_CTX *ctx, struct proxy
 		ssloptions |= SSL_OP_NO_TLSv1_2;
 	if (bind_conf->ssl_options & BC_SSL_O_NO_TLS_TICKETS)
 		ssloptions |= SSL_OP_NO_TICKET;
+#ifdef SSL_SOCK_HAVE_KTLS
+	if (bind_conf->ssl_options & BC_SSL_O_KTLS)
+		ssloptions |= SSL_OP_ENABLE_KTLS;
+#endif
 	if (bind_conf->ssl_options & BC_SSL_O_USE_SSLV3) {
 #ifndef OPENSSL_NO_SSL3
 		SSL_CTX_set_ssl_version(ctx, SSLv3_server_method());
@@ -3122,6 +3137,10 @@ int ssl_sock_prepare_srv_ctx(struct server *srv, struct proxy *curproxy)
 		options |= SSL_OP_NO_TLSv1_2;
 	if (srv->ssl_ctx.options & SRV_SSL_O_NO_TLS_TICKETS)
 		options |= SSL_OP_NO_TICKET;
+#ifdef SSL_SOCK_HAVE_KTLS
+	if (srv->ssl_ctx.options & SRV_SSL_O_KTLS)
+		options |= SSL_OP_ENABLE_KTLS;
+#endif
 	if (srv->ssl_ctx.options & SRV_SSL_O_USE_SSLV3) {
 #ifndef OPENSSL_NO_SSL3
 		SSL_CTX_set_ssl_version(srv->ssl_ctx.ctx, SSLv3_client_method());
@@ -3702,6 +3721,17 @@ reneg_ok:
 		}
 	}
 
+#ifdef SSL_SOCK_HAVE_KTLS
+	/* OpenSSL has pushed the session keys to the kernel for the directions
+	 * it could offload. Note that a renegotiation cannot happen on such a
+	 * socket, so this state is final.
+	 */
+	if (BIO_get_ktls_send(SSL_get_wbio(conn->xprt_ctx)))
+		conn->xprt_st |= SSL_SOCK_KTLS_SEND;
+	if (BIO_get_ktls_recv(SSL_get_rbio(conn->xprt_ctx)))
+		conn->xprt_st |= SSL_SOCK_KTLS_RECV;
+#endif
+
 	/* The connection is now established at both layers, it's time to leave */
 	conn->flags &= ~(flag | CO_FL_WAIT_L4_CONN | CO_FL_WAIT_L6_CONN);
 	return 1;
@@ -3940,6 +3970,45 @@ static void ssl_sock_close(struct connection *conn) {
 	}
 }
 
+#ifdef SSL_SOCK_HAVE_KTLS
+/* Reports whether the pipe callbacks may be used on this connection : only
+ * once the handshake is complete and the kernel took over the records for
+ * direction <dir> (0 = receive, 1 = send).
+ */
+static int ssl_sock_pipe_ready(const struct connection *conn, int dir)
+{
+	if (!conn->xprt_ctx || (conn->flags & CO_FL_HANDSHAKE))
+		return 0;
+	return !!(conn->xprt_st & (dir ? SSL_SOCK_KTLS_SEND : SSL_SOCK_KTLS_RECV));
+}
+
+/* Splices up to <count> bytes of already decrypted data from the kTLS socket
+ * into <pipe>. Returns -1 when splicing is not possible so that the caller
+ * falls back to ssl_sock_to_buf(). This happens when OpenSSL still holds some
+ * data of its own, or when the kernel meets a non-data record (alert, session
+ * ticket, key update) which it refuses to splice (EINVAL) and which must be
+ * processed by SSL_read(). If some data were spliced before such a record,
+ * their amount is returned instead and the next call returns -1.
+ */
+static int ssl_sock_to_pipe(struct connection *conn, struct pipe *pipe, unsigned int count)
+{
+	if (!(conn->xprt_st & SSL_SOCK_KTLS_RECV) || SSL_has_pending(conn->xprt_ctx))
+		return -1;
+	return raw_sock_to_pipe(conn, pipe, count);
+}
+
+/* Splices the pipe's contents to the kTLS socket, the kernel taking care of
+ * building and encrypting the records. Returns -1 if kTLS is not active on
+ * the send side, otherwise the amount of data sent.
+ */
+static int ssl_sock_from_pipe(struct connection *conn, struct pipe *pipe)
+{
+	if (!(conn->xprt_st & SSL_SOCK_KTLS_SEND))
+		return -1;
+	return raw_sock_from_pipe(conn, pipe);
+}
+#endif
+
 /* This function tries to perform a clean shutdown on an SSL connection, and in
  * any case, flags the connection as reusable if no handshake was in progress.
  */
@@ -3966,6 +4035,34 @@ const char *ssl_sock_get_cipher_name(struct connection *conn)
 	return SSL_get_cipher_name(conn->xprt_ctx);
 }
 
+/* Retrieves the protocol negotiated with ALPN or NPN on connection <conn> into
+ * <str> and <len>. Returns 1 if a protocol was negotiated, otherwise 0.
+ */
+int ssl_sock_get_alpn(const struct connection *conn, const char **str, int *len)
+{
+	unsigned int l = 0;
+
+	if (!conn->xprt_ctx || conn->xprt != &ssl_sock)
+		return 0;
+
+	*str = NULL;
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+	SSL_get0_alpn_selected(conn->xprt_ctx, (const unsigned char **)str, &l);
+	if (*str) {
+		*len = l;
+		return 1;
+	}
+#endif
+#ifdef OPENSSL_NPN_NEGOTIATED
+	SSL_get0_next_proto_negotiated(conn->xprt_ctx, (const unsigned char **)str, &l);
+	if (*str) {
+		*len = l;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
 /* used for logging, may be changed for a sample fetch later */
 const char *ssl_sock_get_proto_version(struct connection *conn)
 {
@@ -5402,6 +5499,19 @@ static int bind_parse_force_tlsv12(char **args, int cur_arg, struct proxy *px, s
 }
 
 
+/* parse the "ktls" bind keyword */
+static int bind_parse_ktls(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+#ifdef SSL_SOCK_HAVE_KTLS
+	conf->ssl_options |= BC_SSL_O_KTLS;
+	return 0;
+#else
+	if (err)
+		memprintf(err, "'%s' : library does not support kernel TLS offload", args[cur_arg]);
+	return ERR_ALERT | ERR_FATAL;
+#endif
+}
+
 /* parse the "no-tls-tickets" bind keyword */
 static int bind_parse_no_tls_tickets(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
 {
@@ -5833,6 +5943,19 @@ static int srv_parse_no_tlsv12(char **args, int *cur_arg, struct proxy *px, stru
 	return 0;
 }
 
+/* parse the "ktls" server keyword */
+static int srv_parse_ktls(char **args, int *cur_arg, struct proxy *px, struct server *newsrv, char **err)
+{
+#ifdef SSL_SOCK_HAVE_KTLS
+	newsrv->ssl_ctx.options |= SRV_SSL_O_KTLS;
+	return 0;
+#else
+	if (err)
+		memprintf(err, "'%s' : library does not support kernel TLS offload", args[*cur_arg]);
+	return ERR_ALERT | ERR_FATAL;
+#endif
+}
+
 /* parse the "no-tls-tickets" server keyword */
 static int srv_parse_no_tls_tickets(char **args, int *cur_arg, struct proxy *px, struct server *newsrv, char **err)
 {
@@ -5980,6 +6103,14 @@ static int ssl_parse_default_bind_options(char **args, int section_type, struct
 		}
 		else if (!strcmp(args[i], "no-tls-tickets"))
 			global.listen_default_ssloptions |= BC_SSL_O_NO_TLS_TICKETS;
+		else if (!strcmp(args[i], "ktls")) {
+#ifdef SSL_SOCK_HAVE_KTLS
+			global.listen_default_ssloptions |= BC_SSL_O_KTLS;
+#else
+			memprintf(err, "'%s' '%s': library does not support kernel TLS offload", args[0], args[i]);
+			return -1;
+#endif
+		}
 		else {
 			memprintf(err, "unknown option '%s' on global statement '%s'.", args[i], args[0]);
 			return -1;
@@ -6030,6 +6161,14 @@ static int ssl_parse_default_server_options(char **args, int section_type, struc
 		}
 		else if (!strcmp(args[i], "no-tls-tickets"))
 			global.connect_default_ssloptions |= SRV_SSL_O_NO_TLS_TICKETS;
+		else if (!strcmp(args[i], "ktls")) {
+#ifdef SSL_SOCK_HAVE_KTLS
+			global.connect_default_ssloptions |= SRV_SSL_O_KTLS;
+#else
+			memprintf(err, "'%s' '%s': library does not support kernel TLS offload", args[0], args[i]);
+			return -1;
+#endif
+		}
 		else {
 			memprintf(err, "unknown option '%s' on global statement '%s'.", args[i], args[0]);
 			return -1;
@@ -6387,6 +6526,7 @@ static struct bind_kw_list bind_kws = { "SSL", { }, {
 	{ "force-tlsv11",          bind_parse_force_tlsv11,    0 }, /* force TLSv11 */
 	{ "force-tlsv12",          bind_parse_force_tlsv12,    0 }, /* force TLSv12 */
 	{ "generate-certificates", bind_parse_generate_certs,  0 }, /* enable the server certificates generation */
+	{ "ktls",                  bind_parse_ktls,            0 }, /* offload TLS records to the kernel */
 	{ "no-sslv3",              bind_parse_no_sslv3,        0 }, /* disable SSLv3 */
 	{ "no-tlsv10",             bind_parse_no_tlsv10,       0 }, /* disable TLSv10 */
 	{ "no-tlsv11",             bind_parse_no_tlsv11,       0 }, /* disable TLSv11 */
@@ -6417,6 +6557,7 @@ static struct srv_kw_list srv_kws = { "SSL", { }, {
 	{ "force-tlsv10",          srv_parse_force_tlsv10,   0, 0 }, /* force TLSv10 */
 	{ "force-tlsv11",          srv_parse_force_tlsv11,   0, 0 }, /* force TLSv11 */
 	{ "force-tlsv12",          srv_parse_force_tlsv12,   0, 0 }, /* force TLSv12 */
+	{ "ktls",                  srv_parse_ktls,           0, 0 }, /* offload TLS records to the kernel */
 	{ "no-ssl-reuse",          srv_parse_no_ssl_reuse,   0, 0 }, /* disable session reuse */
 	{ "no-sslv3",              srv_parse_no_sslv3,       0, 0 }, /* disable SSLv3 */
 	{ "no-tlsv10",             srv_parse_no_tlsv10,      0, 0 }, /* disable TLSv10 */
@@ -6442,8 +6583,14 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 struct xprt_ops ssl_sock = {
 	.snd_buf  = ssl_sock_from_buf,
 	.rcv_buf  = ssl_sock_to_buf,
+#ifdef SSL_SOCK_HAVE_KTLS
+	.rcv_pipe = ssl_sock_to_pipe,
+	.snd_pipe = ssl_sock_from_pipe,
+	.pipe_ready = ssl_sock_pipe_ready,
+#else
 	.rcv_pipe = NULL,
 	.snd_pipe = NULL,
+#endif
 	.shutr    = NULL,
 	.shutw    = ssl_sock_shutw,
 	.close    = ssl_sock_close,
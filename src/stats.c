@@ -50,6 +50,7 @@
 #include <proto/compression.h>
 #include <proto/stats.h>
 #include <proto/fd.h>
+#include <proto/flt_cache.h>
 #include <proto/freq_ctr.h>
 #include <proto/frontend.h>
 #include <proto/log.h>
@@ -130,6 +131,20 @@ const char *info_field_names[INF_TOTAL_FIELDS] = {
 	[INF_IDLE_PCT]                       = "Idle_pct",
 	[INF_NODE]                           = "node",
 	[INF_DESCRIPTION]                    = "description",
+	[INF_POLL_EVENTS_0]                  = "Poll_events_0",
+	[INF_POLL_EVENTS_1]                  = "Poll_events_1",
+	[INF_POLL_EVENTS_2]                  = "Poll_events_2_3",
+	[INF_POLL_EVENTS_4]                  = "Poll_events_4_7",
+	[INF_POLL_EVENTS_8]                  = "Poll_events_8_15",
+	[INF_POLL_EVENTS_16]                 = "Poll_events_16_31",
+	[INF_POLL_EVENTS_32]                 = "Poll_events_32_63",
+	[INF_POLL_EVENTS_64]                 = "Poll_events_64_127",
+	[INF_POLL_EVENTS_128]                = "Poll_events_128_255",
+	[INF_POLL_EVENTS_256]                = "Poll_events_256_more",
+	[INF_LOOP_TIME]                      = "Loop_time_us",
+	[INF_ACCEPT_BATCH]                   = "Accept_batch",
+	[INF_ACCEPT_DEFERRALS]               = "Accept_deferrals",
+	[INF_ACCEPT_BACKLOG]                 = "Accept_backlog",
 };
 
 const char *stat_field_names[ST_F_TOTAL_FIELDS] = {
@@ -216,6 +231,13 @@ const char *stat_field_names[ST_F_TOTAL_FIELDS] = {
 	[ST_F_INTERCEPTED]    = "intercepted",
 	[ST_F_DCON]           = "dcon",
 	[ST_F_DSES]           = "dses",
+	[ST_F_CACHE_HITS]     = "cache_hits",
+	[ST_F_CACHE_MISSES]   = "cache_misses",
+	[ST_F_CACHE_EVICTIONS] = "cache_evictions",
+	[ST_F_CONNECT]        = "connect",
+	[ST_F_REUSE]          = "reuse",
+	[ST_F_SRV_ICUR]       = "srv_icur",
+	[ST_F_SRV_ILIM]       = "srv_ilim",
 };
 
 /* one line of info */
@@ -482,6 +504,20 @@ static int stats_dump_fields_html(struct chunk *out, const struct field *stats,
 			              U2H(stats[ST_F_INTERCEPTED].u.u64));
 		}
 
+		if (stats[ST_F_CACHE_HITS].type) {
+			chunk_appendf(out,
+			              "<tr><th>Cache hits:</th><td>%s</td><td>(%d%%)</td></tr>"
+			              "<tr><th>Cache misses:</th><td>%s</td></tr>"
+			              "<tr><th>Cache evictions:</th><td>%s</td></tr>"
+			              "",
+			              U2H(stats[ST_F_CACHE_HITS].u.u64),
+			              (stats[ST_F_CACHE_HITS].u.u64 + stats[ST_F_CACHE_MISSES].u.u64) ?
+			              (int)(100 * stats[ST_F_CACHE_HITS].u.u64 /
+			                    (stats[ST_F_CACHE_HITS].u.u64 + stats[ST_F_CACHE_MISSES].u.u64)) : 0,
+			              U2H(stats[ST_F_CACHE_MISSES].u.u64),
+			              U2H(stats[ST_F_CACHE_EVICTIONS].u.u64));
+		}
+
 		chunk_appendf(out,
 		              "</table></div></u></td>"
 		              /* sessions: lbtot, lastsess */
@@ -721,6 +757,20 @@ static int stats_dump_fields_html(struct chunk *out, const struct field *stats,
 			              U2H(stats[ST_F_HRSP_OTHER].u.u64), tot ? (int)(100 * stats[ST_F_HRSP_OTHER].u.u64 / tot) : 0);
 		}
 
+		/* server connections: new, reused, pooled */
+		chunk_appendf(out,
+		              "<tr><th>New connections:</th><td>%s</td></tr>"
+		              "<tr><th>Reused connections:</th><td>%s</td><td>(%d%%)</td></tr>"
+		              "",
+		              U2H(stats[ST_F_CONNECT].u.u64),
+		              U2H(stats[ST_F_REUSE].u.u64),
+		              (stats[ST_F_CONNECT].u.u64 + stats[ST_F_REUSE].u.u64) ?
+		              (int)(100 * stats[ST_F_REUSE].u.u64 / (stats[ST_F_CONNECT].u.u64 + stats[ST_F_REUSE].u.u64)) : 0);
+
+		if (stats[ST_F_SRV_ILIM].type)
+			chunk_appendf(out, "<tr><th>Pooled idle connections:</th><td>%s / %s</td></tr>",
+			              U2H(stats[ST_F_SRV_ICUR].u.u32), U2H(stats[ST_F_SRV_ILIM].u.u32));
+
 		chunk_appendf(out, "<tr><th colspan=3>Avg over last 1024 success. conn.</th></tr>");
 		chunk_appendf(out, "<tr><th>- Queue time:</th><td>%s</td><td>ms</td></tr>",   U2H(stats[ST_F_QTIME].u.u32));
 		chunk_appendf(out, "<tr><th>- Connect time:</th><td>%s</td><td>ms</td></tr>", U2H(stats[ST_F_CTIME].u.u32));
@@ -930,7 +980,6 @@ static int stats_dump_fields_html(struct chunk *out, const struct field *stats,
 			              "<tr><th>- HTTP 4xx responses:</th><td>%s</td></tr>"
 			              "<tr><th>- HTTP 5xx responses:</th><td>%s</td></tr>"
 			              "<tr><th>- other responses:</th><td>%s</td></tr>"
-				      "<tr><th colspan=3>Avg over last 1024 success. conn.</th></tr>"
 			              "",
 			              U2H(stats[ST_F_REQ_TOT].u.u64),
 			              U2H(stats[ST_F_HRSP_1XX].u.u64),
@@ -944,6 +993,23 @@ static int stats_dump_fields_html(struct chunk *out, const struct field *stats,
 			              U2H(stats[ST_F_HRSP_OTHER].u.u64));
 		}
 
+		if (stats[ST_F_CACHE_HITS].type) {
+			chunk_appendf(out,
+			              "<tr><th>Cache hits:</th><td>%s</td><td>(%d%%)</td></tr>"
+			              "<tr><th>Cache misses:</th><td>%s</td></tr>"
+			              "<tr><th>Cache evictions:</th><td>%s</td></tr>"
+			              "",
+			              U2H(stats[ST_F_CACHE_HITS].u.u64),
+			              (stats[ST_F_CACHE_HITS].u.u64 + stats[ST_F_CACHE_MISSES].u.u64) ?
+			              (int)(100 * stats[ST_F_CACHE_HITS].u.u64 /
+			                    (stats[ST_F_CACHE_HITS].u.u64 + stats[ST_F_CACHE_MISSES].u.u64)) : 0,
+			              U2H(stats[ST_F_CACHE_MISSES].u.u64),
+			              U2H(stats[ST_F_CACHE_EVICTIONS].u.u64));
+		}
+
+		if (strcmp(field_str(stats, ST_F_MODE), "http") == 0)
+			chunk_appendf(out, "<tr><th colspan=3>Avg over last 1024 success. conn.</th></tr>");
+
 		chunk_appendf(out, "<tr><th>- Queue time:</th><td>%s</td><td>ms</td></tr>",   U2H(stats[ST_F_QTIME].u.u32));
 		chunk_appendf(out, "<tr><th>- Connect time:</th><td>%s</td><td>ms</td></tr>", U2H(stats[ST_F_CTIME].u.u32));
 		if (strcmp(field_str(stats, ST_F_MODE), "http") == 0)
@@ -1033,6 +1099,21 @@ int stats_dump_one_line(const struct field *stats, unsigned int flags, struct pr
 		return stats_dump_fields_csv(&trash, stats);
 }
 
+/* Fills the cache fields of <stats> from the cache filter of proxy <px>, if
+ * any. The counters are shared by all the processes using the cache.
+ */
+static void stats_fill_cache_stats(struct proxy *px, struct field *stats)
+{
+	unsigned long long hits, misses, evictions;
+
+	if (!cache_get_proxy_stats(px, &hits, &misses, &evictions))
+		return;
+
+	stats[ST_F_CACHE_HITS]      = mkf_u64(FN_COUNTER, hits);
+	stats[ST_F_CACHE_MISSES]    = mkf_u64(FN_COUNTER, misses);
+	stats[ST_F_CACHE_EVICTIONS] = mkf_u64(FN_COUNTER, evictions);
+}
+
 /* Fill <stats> with the frontend statistics. <stats> is
  * preallocated array of length <len>. The length of the array
  * must be at least ST_F_TOTAL_FIELDS. If this length is less then
@@ -1090,6 +1171,9 @@ int stats_fill_fe_stats(struct proxy *px, struct field *stats, int len)
 	stats[ST_F_COMP_BYP]     = mkf_u64(FN_COUNTER, px->fe_counters.comp_byp);
 	stats[ST_F_COMP_RSP]     = mkf_u64(FN_COUNTER, px->fe_counters.p.http.comp_rsp);
 
+	/* cache: hits, misses, evictions */
+	stats_fill_cache_stats(px, stats);
+
 	/* connections : conn_rate, conn_rate_max, conn_tot, conn_max */
 	stats[ST_F_CONN_RATE]     = mkf_u32(FN_RATE, read_freq_ctr(&px->fe_conn_per_sec));
 	stats[ST_F_CONN_RATE_MAX] = mkf_u32(FN_MAX, px->fe_counters.cps_max);
@@ -1322,6 +1406,13 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 	stats[ST_F_ERESP]    = mkf_u64(FN_COUNTER, sv->counters.failed_resp);
 	stats[ST_F_WRETR]    = mkf_u64(FN_COUNTER, sv->counters.retries);
 	stats[ST_F_WREDIS]   = mkf_u64(FN_COUNTER, sv->counters.redispatches);
+	stats[ST_F_CONNECT]  = mkf_u64(FN_COUNTER, sv->counters.connect);
+	stats[ST_F_REUSE]    = mkf_u64(FN_COUNTER, sv->counters.reuse);
+
+	if (sv->pool_max_conn) {
+		stats[ST_F_SRV_ICUR] = mkf_u32(0, sv->pool_cur);
+		stats[ST_F_SRV_ILIM] = mkf_u32(FO_CONFIG|FN_LIMIT, sv->pool_max_conn);
+	}
 
 	/* status */
 	fld_status = chunk_newstr(out);
@@ -1556,6 +1647,14 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 	stats[ST_F_COMP_OUT]     = mkf_u64(FN_COUNTER, px->be_counters.comp_out);
 	stats[ST_F_COMP_BYP]     = mkf_u64(FN_COUNTER, px->be_counters.comp_byp);
 	stats[ST_F_COMP_RSP]     = mkf_u64(FN_COUNTER, px->be_counters.p.http.comp_rsp);
+
+	/* cache: hits, misses, evictions */
+	stats_fill_cache_stats(px, stats);
+
+	/* server connections: new, reused */
+	stats[ST_F_CONNECT]      = mkf_u64(FN_COUNTER, px->be_counters.connect);
+	stats[ST_F_REUSE]        = mkf_u64(FN_COUNTER, px->be_counters.reuse);
+
 	stats[ST_F_LASTSESS]     = mkf_s32(FN_AGE, be_lastsession(px));
 
 	stats[ST_F_QTIME]        = mkf_u32(FN_AVG, swrate_avg(px->be_counters.q_time, TIME_STATS_SAMPLES));
@@ -2932,6 +3031,7 @@ int stats_fill_info(struct field *info, int len)
 {
 	unsigned int up = (now.tv_sec - start_date.tv_sec);
 	struct chunk *out = get_trash_chunk();
+	int i;
 
 #ifdef USE_OPENSSL
 	int ssl_sess_rate = read_freq_ctr(&global.ssl_per_sec);
@@ -3013,6 +3113,12 @@ int stats_fill_info(struct field *info, int len)
 	info[INF_NODE]                           = mkf_str(FO_CONFIG|FN_OUTPUT|FS_SERVICE, global.node);
 	if (global.desc)
 		info[INF_DESCRIPTION]            = mkf_str(FO_CONFIG|FN_OUTPUT|FS_SERVICE, global.desc);
+	for (i = 0; i < POLL_HIST_BUCKETS; i++)
+		info[INF_POLL_EVENTS_0 + i]      = mkf_u32(FN_COUNTER, poll_events_hist[i]);
+	info[INF_LOOP_TIME]                      = mkf_u32(FN_AVG, loop_time);
+	info[INF_ACCEPT_BATCH]                   = mkf_u32(0, accept_batch);
+	info[INF_ACCEPT_DEFERRALS]               = mkf_u32(FN_COUNTER, accept_deferrals);
+	info[INF_ACCEPT_BACKLOG]                 = mkf_u32(0, accept_backlog);
 
 	return 1;
 }
@@ -44,6 +44,7 @@
 #include <proto/hlua.h>
 #include <proto/listener.h>
 #include <proto/log.h>
+#include <proto/mux_h2.h>
 #include <proto/raw_sock.h>
 #include <proto/session.h>
 #include <proto/stream.h>
@@ -255,6 +256,7 @@ struct stream *stream_new(struct session *sess, struct task *t, enum obj_type *o
 
 /*
  * frees  the context associated to a stream. It must have been removed first.
+ * With SF_KEEP_SESS, the session and the client connection are left intact.
  */
 static void stream_free(struct stream *s)
 {
@@ -262,6 +264,8 @@ static void stream_free(struct stream *s)
 	struct proxy *fe = sess->fe;
 	struct bref *bref, *back;
 	struct connection *cli_conn = objt_conn(sess->origin);
+	struct connection *mux_conn = NULL;
+	struct connection *srv_conn;
 	int i;
 
 	if (s->pend_pos)
@@ -305,7 +309,17 @@ static void stream_free(struct stream *s)
 	if (s->txn)
 		http_end_txn(s);
 
-	/* ensure the client-side transport layer is destroyed */
+	/* ensure the client-side transport layer is destroyed, unless it is
+	 * shared with other streams and only referenced by our session.
+	 */
+	if (cli_conn && s->si[0].end != &cli_conn->obj_type) {
+		mux_conn = cli_conn;
+		cli_conn = NULL;
+	}
+	if (cli_conn && (s->flags & SF_KEEP_SESS)) {
+		si_detach_endpoint(&s->si[0]);
+		cli_conn = NULL;
+	}
 	if (cli_conn)
 		conn_force_close(cli_conn);
 
@@ -318,6 +332,7 @@ static void stream_free(struct stream *s)
 
 	if (s->txn) {
 		pool_free2(pool2_hdr_idx, s->txn->hdr_idx.v);
+		pool_free2(pool2_hdr_hash, s->txn->hdr_idx.hash);
 		pool_free2(pool2_http_txn, s->txn);
 		s->txn = NULL;
 	}
@@ -347,20 +362,31 @@ static void stream_free(struct stream *s)
 		bref->ref = s->list.n;
 	}
 	LIST_DEL(&s->list);
+
+	/* an idle server connection may still serve other streams */
+	srv_conn = objt_conn(s->si[1].end);
+	if (srv_conn && srv_pool_conn(srv_conn))
+		si_detach_endpoint(&s->si[1]);
+
 	si_release_endpoint(&s->si[1]);
 	si_release_endpoint(&s->si[0]);
 
 	/* FIXME: for now we have a 1:1 relation between stream and session so
-	 * the stream must free the session.
+	 * the stream must free the session, unless the session stays idle.
 	 */
+	if (!(s->flags & SF_KEEP_SESS))
+		session_free(sess);
 	pool_free2(pool2_stream, s);
-	session_free(sess);
+
+	if (mux_conn)
+		h2c_stream_gone(mux_conn);
 
 	/* We may want to free the maximum amount of pools if the proxy is stopping */
 	if (fe && unlikely(fe->state == PR_STSTOPPED)) {
 		pool_flush2(pool2_buffer);
 		pool_flush2(pool2_http_txn);
 		pool_flush2(pool2_hdr_idx);
+		pool_flush2(pool2_hdr_hash);
 		pool_flush2(pool2_requri);
 		pool_flush2(pool2_capture);
 		pool_flush2(pool2_stream);
@@ -2081,8 +2107,8 @@ struct task *process_stream(struct task *t)
 	if (!(req->flags & (CF_KERN_SPLICING|CF_SHUTR)) &&
 	    req->to_forward &&
 	    (global.tune.options & GTUNE_USE_SPLICE) &&
-	    (objt_conn(si_f->end) && __objt_conn(si_f->end)->xprt && __objt_conn(si_f->end)->xprt->rcv_pipe) &&
-	    (objt_conn(si_b->end) && __objt_conn(si_b->end)->xprt && __objt_conn(si_b->end)->xprt->snd_pipe) &&
+	    (objt_conn(si_f->end) && conn_xprt_can_rcv_pipe(__objt_conn(si_f->end))) &&
+	    (objt_conn(si_b->end) && conn_xprt_can_snd_pipe(__objt_conn(si_b->end))) &&
 	    (pipes_used < global.maxpipes) &&
 	    (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_REQ) ||
 	     (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_AUT) &&
@@ -2262,8 +2288,8 @@ struct task *process_stream(struct task *t)
 	if (!(res->flags & (CF_KERN_SPLICING|CF_SHUTR)) &&
 	    res->to_forward &&
 	    (global.tune.options & GTUNE_USE_SPLICE) &&
-	    (objt_conn(si_f->end) && __objt_conn(si_f->end)->xprt && __objt_conn(si_f->end)->xprt->snd_pipe) &&
-	    (objt_conn(si_b->end) && __objt_conn(si_b->end)->xprt && __objt_conn(si_b->end)->xprt->rcv_pipe) &&
+	    (objt_conn(si_f->end) && conn_xprt_can_snd_pipe(__objt_conn(si_f->end))) &&
+	    (objt_conn(si_b->end) && conn_xprt_can_rcv_pipe(__objt_conn(si_b->end))) &&
 	    (pipes_used < global.maxpipes) &&
 	    (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_RTR) ||
 	     (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_AUT) &&
@@ -2358,6 +2384,24 @@ struct task *process_stream(struct task *t)
 		if (si_b->state == SI_ST_EST)
 			si_update(si_b);
 
+		/* an HTTP/1 client connection waiting for its next request may
+		 * leave the stream and its buffers, see http_end_txn_clean_session().
+		 */
+		if (unlikely(s->flags & SF_KEEP_SESS)) {
+			if (si_f->state == SI_ST_EST && si_b->state == SI_ST_INI &&
+			    !req->buf->i && channel_is_empty(req) && channel_is_empty(res) &&
+			    !(req->flags & (CF_SHUTR|CF_SHUTW|CF_SHUTR_NOW|CF_SHUTW_NOW)) &&
+			    !(res->flags & (CF_SHUTW|CF_SHUTW_NOW)) &&
+			    (!s->txn || s->txn->req.msg_state == HTTP_MSG_RQBEFORE)) {
+				struct connection *cli_conn = __objt_conn(sess->origin);
+
+				stream_free(s);
+				session_set_idle(sess, cli_conn, t);
+				return t;
+			}
+			s->flags &= ~SF_KEEP_SESS;
+		}
+
 		req->flags &= ~(CF_READ_NULL|CF_READ_PARTIAL|CF_WRITE_NULL|CF_WRITE_PARTIAL|CF_READ_ATTACHED);
 		res->flags &= ~(CF_READ_NULL|CF_READ_PARTIAL|CF_WRITE_NULL|CF_WRITE_PARTIAL|CF_READ_ATTACHED);
 		si_f->prev_state = si_f->state;
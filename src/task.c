@@ -32,11 +32,25 @@ unsigned int nb_tasks_cur = 0;     /* copy of the tasks count */
 unsigned int niced_tasks = 0;      /* number of niced tasks in the run queue */
 struct eb32_node *last_timer = NULL;  /* optimization: last queued timer */
 struct eb32_node *rq_next    = NULL;  /* optimization: next task except if delete/insert */
+unsigned int timer_wheel_count = 0;   /* number of tasks in the timer wheel */
 
 static struct eb_root timers;      /* sorted timers tree */
 static struct eb_root rqueue;      /* tree constituting the run queue */
 static unsigned int rqueue_ticks;  /* insertion count */
 
+/* Timers are never placed further than this in the timer wheel, so that its
+ * cursor may lag behind the current date without ever wrapping over a slot
+ * still in use. Tasks expiring later are requeued when their slot is reached.
+ */
+#define TIMER_WHEEL_HORIZON ((TIMER_WHEEL_SLOTS - TIMER_WHEEL_SLOTS / 8) << TIMER_WHEEL_SHIFT)
+
+/* start date of the timer wheel slot following the one holding date <date> */
+#define TIMER_WHEEL_NEXT(date) (((unsigned int)(date) & -(1U << TIMER_WHEEL_SHIFT)) + (1U << TIMER_WHEEL_SHIFT))
+
+static struct list *timer_wheel;   /* timer wheel slots, NULL if not enabled */
+static int timer_wheel_next;       /* date of the next slot to be processed */
+static unsigned long timer_wheel_map[(TIMER_WHEEL_SLOTS + LONGBITS - 1) / LONGBITS]; /* possibly non-empty slots */
+
 /* Puts the task <t> in run queue at a position depending on t->nice. <t> is
  * returned. The nice value assigns boosts in 32th of the run queue size. A
  * nice value of -1024 sets the task to -tasks_run_queue*32, while a nice value
@@ -69,6 +83,90 @@ struct task *__task_wakeup(struct task *t)
 	return t;
 }
 
+/* Inserts task <task> into the timer wheel, in the slot covering its
+ * expiration date, or in the farthest possible one if it expires beyond the
+ * wheel's horizon. The task must not be in any wait queue.
+ */
+static void __task_queue_wheel(struct task *task)
+{
+	unsigned int date = task->expire;
+	unsigned int slot;
+
+	if (!timer_wheel_count)
+		timer_wheel_next = TIMER_WHEEL_NEXT(now_ms);
+
+	if ((int)(date - now_ms) > TIMER_WHEEL_HORIZON)
+		date = now_ms + TIMER_WHEEL_HORIZON;
+
+	date &= -(1U << TIMER_WHEEL_SHIFT);
+	task->wq.key = date;
+
+	slot = (date >> TIMER_WHEEL_SHIFT) & (TIMER_WHEEL_SLOTS - 1);
+	LIST_ADDQ(&timer_wheel[slot], &task->tw);
+	timer_wheel_map[slot / LONGBITS] |= 1UL << (slot % LONGBITS);
+	timer_wheel_count++;
+}
+
+/* Moves all the tasks of the timer wheel slots whose start date was reached
+ * to the wait queue tree, or wakes them up if they already expired.
+ */
+static void task_wheel_process()
+{
+	struct task *task, *back;
+	unsigned int slot, loops = 0;
+
+	while (timer_wheel_count && tick_is_le(timer_wheel_next, now_ms)) {
+		/* all slots were visited once, whatever remains was requeued */
+		if (++loops > TIMER_WHEEL_SLOTS)
+			break;
+
+		slot = ((unsigned int)timer_wheel_next >> TIMER_WHEEL_SHIFT) & (TIMER_WHEEL_SLOTS - 1);
+		timer_wheel_map[slot / LONGBITS] &= ~(1UL << (slot % LONGBITS));
+		timer_wheel_next = TIMER_WHEEL_NEXT(timer_wheel_next);
+
+		list_for_each_entry_safe(task, back, &timer_wheel[slot], tw) {
+			__task_unlink_wq(task);
+			if (!tick_isset(task->expire))
+				continue;
+			if (tick_is_expired(task->expire, now_ms))
+				task_wakeup(task, TASK_WOKEN_TIMER);
+			else
+				__task_queue(task);
+		}
+	}
+
+	if (tick_is_le(timer_wheel_next, now_ms))
+		timer_wheel_next = TIMER_WHEEL_NEXT(now_ms);
+}
+
+/* Returns the start date of the first timer wheel slot which may hold a task,
+ * or TICK_ETERNITY if the wheel is empty.
+ */
+static int task_wheel_next_date()
+{
+	unsigned int cur = ((unsigned int)timer_wheel_next >> TIMER_WHEEL_SHIFT) & (TIMER_WHEEL_SLOTS - 1);
+	unsigned int i, slot;
+	unsigned long bits;
+
+	if (!timer_wheel_count)
+		return TICK_ETERNITY;
+
+	for (i = 0; i < TIMER_WHEEL_SLOTS; ) {
+		slot = (cur + i) & (TIMER_WHEEL_SLOTS - 1);
+		bits = timer_wheel_map[slot / LONGBITS] >> (slot % LONGBITS);
+		if (!bits) {
+			/* skip to the next word or back to the first slot */
+			i += MIN(LONGBITS - slot % LONGBITS, TIMER_WHEEL_SLOTS - slot);
+			continue;
+		}
+		i += my_ffsl(bits) - 1;
+		if (i >= TIMER_WHEEL_SLOTS)
+			break;
+		return tick_add(timer_wheel_next, i << TIMER_WHEEL_SHIFT);
+	}
+	return TICK_ETERNITY;
+}
+
 /*
  * __task_queue()
  *
@@ -76,7 +174,8 @@ struct task *__task_wakeup(struct task *t)
  * date. It does not matter if the task was already in the wait queue or not,
  * as it will be unlinked. The task must not have an infinite expiration timer.
  * Last, tasks must not be queued further than the end of the tree, which is
- * between <now_ms> and <now_ms> + 2^31 ms (now+24days in 32bit).
+ * between <now_ms> and <now_ms> + 2^31 ms (now+24days in 32bit). If the timer
+ * wheel is enabled, tasks expiring at least two wheel slots away go there.
  *
  * This function should not be used directly, it is meant to be called by the
  * inline version of task_queue() which performs a few cheap preliminary tests
@@ -95,6 +194,11 @@ void __task_queue(struct task *task)
 		return;
 #endif
 
+	if (timer_wheel && (int)(task->expire - now_ms) >= (2 << TIMER_WHEEL_SHIFT)) {
+		__task_queue_wheel(task);
+		return;
+	}
+
 	if (likely(last_timer &&
 		   last_timer->node.bit < 0 &&
 		   last_timer->key == task->wq.key &&
@@ -125,6 +229,10 @@ int wake_expired_tasks()
 {
 	struct task *task;
 	struct eb32_node *eb;
+	int next = TICK_ETERNITY;
+
+	if (timer_wheel_count)
+		task_wheel_process();
 
 	eb = eb32_lookup_ge(&timers, now_ms - TIMER_LOOK_BACK);
 	while (1) {
@@ -140,7 +248,8 @@ int wake_expired_tasks()
 
 		if (likely(tick_is_lt(now_ms, eb->key))) {
 			/* timer not expired yet, revisit it later */
-			return eb->key;
+			next = eb->key;
+			break;
 		}
 
 		/* timer looks expired, detach it from the queue */
@@ -159,21 +268,22 @@ int wake_expired_tasks()
 		 * the same place, before <eb>, so we have to check if this happens,
 		 * and adjust <eb>, otherwise we may skip it which is not what we want.
 		 * We may also not requeue the task (and not point eb at it) if its
-		 * expiration time is not set.
+		 * expiration time is not set, nor if it was moved to the timer wheel.
 		 */
 		if (!tick_is_expired(task->expire, now_ms)) {
 			if (!tick_isset(task->expire))
 				continue;
 			__task_queue(task);
-			if (!eb || eb->key > task->wq.key)
+			if (task->wq.node.leaf_p && (!eb || eb->key > task->wq.key))
 				eb = &task->wq;
 			continue;
 		}
 		task_wakeup(task, TASK_WOKEN_TIMER);
 	}
 
-	/* No task is expired */
-	return TICK_ETERNITY;
+	if (timer_wheel_count)
+		next = tick_first(next, task_wheel_next_date());
+	return next;
 }
 
 /* The run queue is chronologically sorted in a tree. An insertion counter is
@@ -198,8 +308,8 @@ void process_runnable_tasks()
 	if (!tasks_run_queue)
 		return;
 
-	if (max_processed > 200)
-		max_processed = 200;
+	if (max_processed > MAX_TASKS_PER_LOOP)
+		max_processed = MAX_TASKS_PER_LOOP;
 
 	if (likely(niced_tasks))
 		max_processed = (max_processed + 3) / 4;
@@ -256,6 +366,22 @@ int init_task()
 	return pool2_task != NULL;
 }
 
+/* Allocates and initializes the timer wheel. Tasks queued before this call
+ * remain in the tree. Reports 0 in case of error, 1 if OK.
+ */
+int init_timer_wheel()
+{
+	int slot;
+
+	timer_wheel = calloc(TIMER_WHEEL_SLOTS, sizeof(*timer_wheel));
+	if (!timer_wheel)
+		return 0;
+	for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+		LIST_INIT(&timer_wheel[slot]);
+	timer_wheel_next = TIMER_WHEEL_NEXT(now_ms);
+	return 1;
+}
+
 /*
  * Local variables:
  *  c-indent-level: 8
@@ -22,6 +22,7 @@ unsigned int   now_ms;          /* internal date in milliseconds (may wrap) */
 unsigned int   samp_time;       /* total elapsed time over current sample */
 unsigned int   idle_time;       /* total idle time over current sample */
 unsigned int   idle_pct;        /* idle to total ratio over last sample (percent) */
+unsigned int   loop_time;       /* average processing time per polling loop (us) */
 struct timeval now;             /* internal date is a monotonic function of real clock */
 struct timeval date;            /* the real current date */
 struct timeval start_date;      /* the process's start date */
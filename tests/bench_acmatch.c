@@ -0,0 +1,152 @@
+/*
+ * Measures the speed of the Aho-Corasick automaton from src/acmatch.c.
+ *
+ * Build with :
+ *   make benchmarks
+ *
+ * Run with :
+ *   ./tests/bench_acmatch [-n loops] [patterns...]
+ *
+ * For each number of patterns given in argument (10, 1000 and 20000 by
+ * default), user-agent-like subjects are matched against random words with
+ * the automaton and with the list walk of pat_match_sub(). The automaton's
+ * correctness is checked by tests/test_acmatch.c.
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/acmatch.h>
+
+#define MAXPAT 20000
+
+/* a pattern as in struct pattern_list */
+struct pat {
+	char *str;
+	int len;
+	int live;
+};
+
+static struct pat pats[MAXPAT];
+static int nbpats;
+
+static double now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static void rand_str(char *str, int len, const char *alpha)
+{
+	int n = strlen(alpha);
+
+	while (len--)
+		*str++ = alpha[random() % n];
+	*str = 0;
+}
+
+/* same walks as pat_match_sub(), pat_match_beg() and pat_match_end() */
+static struct pat *ref_sub(const char *s, int len, int icase)
+{
+	const char *c, *end;
+	int i;
+
+	for (i = 0; i < nbpats; i++) {
+		if (!pats[i].live || pats[i].len > len)
+			continue;
+		end = s + len - pats[i].len;
+		for (c = s; c <= end; c++) {
+			if ((icase && strncasecmp(pats[i].str, c, pats[i].len) == 0) ||
+			    (!icase && strncmp(pats[i].str, c, pats[i].len) == 0))
+				return &pats[i];
+		}
+	}
+	return NULL;
+}
+
+static void add_pat(struct ac_tree *t, const char *str)
+{
+	pats[nbpats].str = strdup(str);
+	pats[nbpats].len = strlen(str);
+	pats[nbpats].live = 1;
+	if (t && ac_insert(t, pats[nbpats].str, pats[nbpats].len, &pats[nbpats]) < 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	nbpats++;
+}
+
+static void reset_pats(void)
+{
+	while (nbpats)
+		free(pats[--nbpats].str);
+}
+
+/* benchmarks <count> words against user-agent-like subjects */
+static void bench(int count, int loops)
+{
+	static const char *uas[] = {
+		"Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/60.0.3112.101 Safari/537.36",
+		"Mozilla/5.0 (iPhone; CPU iPhone OS 10_3_2 like Mac OS X) AppleWebKit/603.2.4 (KHTML, like Gecko) Version/10.0 Mobile/14F89 Safari/602.1",
+		"Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:55.0) Gecko/20100101 Firefox/55.0",
+		"curl/7.52.1",
+	};
+	struct ac_tree *t;
+	char str[32];
+	double start, ns_ac, ns_ref;
+	int ref_loops, i, u;
+	int hits_ac = 0, hits_ref = 0;
+
+	t = ac_new(1);
+	while (nbpats < count) {
+		rand_str(str, random() % 10 + 6, "abcdefghijklmnopqrstuvwxyz0123456789");
+		add_pat(t, str);
+	}
+	ac_prepare(t);
+
+	start = now_us();
+	for (i = 0; i < loops; i++)
+		for (u = 0; u < 4; u++)
+			hits_ac += !!ac_match_sub(t, uas[u], strlen(uas[u]));
+	ns_ac = (now_us() - start) * 1000.0 / (loops * 4.0);
+
+	/* the walk is much slower, keep the run time reasonable */
+	ref_loops = loops / count + 1;
+	start = now_us();
+	for (i = 0; i < ref_loops; i++)
+		for (u = 0; u < 4; u++)
+			hits_ref += !!ref_sub(uas[u], strlen(uas[u]), 1);
+	ns_ref = (now_us() - start) * 1000.0 / (ref_loops * 4.0);
+
+	printf("%6d patterns : automaton %8.1f ns/lookup, list walk %10.1f ns/lookup, x%.1f (%d/%d matches)\n",
+	       count, ns_ac, ns_ref, ns_ref / ns_ac, hits_ac / loops, hits_ref / ref_loops);
+	reset_pats();
+	ac_free(t);
+}
+
+int main(int argc, char **argv)
+{
+	int loops = 100000;
+	int i;
+
+	while (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		loops = atoi(argv[2]);
+		argc -= 2; argv += 2;
+	}
+
+	srandom(1);
+	if (argc > 1) {
+		for (i = 1; i < argc; i++)
+			bench(atoi(argv[i]) > MAXPAT ? MAXPAT : atoi(argv[i]), loops);
+	}
+	else {
+		bench(10, loops);
+		bench(1000, loops);
+		bench(20000, loops);
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Measures the speed of the chunked body fast path from src/http_scan.c.
+ *
+ * Build with :
+ *   make benchmarks
+ *
+ * Run with :
+ *   ./tests/bench_chunk_fwd [-n loops] [chunk_size...]
+ *
+ * The forwarding loop of tests/chunk_fwd.h is timed with and without
+ * http_scan_chunks() on a buffer full of chunks of each size given in
+ * argument (1 and 16 by default). Its correctness is checked by
+ * tests/test_chunk_fwd.c.
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk_fwd.h"
+
+static double now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+/* Fills a buffer with as many <size>-byte chunks as possible (keeping room
+ * for the last chunk) and returns the number of chunks.
+ */
+static int fill_chunks(struct ring *r, int size)
+{
+	char hdr[16], *data;
+	int chunks = 0, hlen;
+
+	data = malloc(size + 2);
+	memset(data, 'x', size);
+	memcpy(data + size, "\r\n", 2);
+	hlen = sprintf(hdr, "%x\r\n", size);
+
+	r->p = r->i = 0;
+	while (r->i + hlen + size + 2 + 5 <= BUFSIZE) {
+		ring_put(r, hdr, hlen);
+		ring_put(r, data, size + 2);
+		chunks++;
+	}
+	ring_put(r, "0\r\n\r\n", 5);
+	free(data);
+	return chunks;
+}
+
+int main(int argc, char **argv)
+{
+	static const int default_sizes[] = { 1, 16 };
+	static struct ring r;
+	struct msg m;
+	const int *sizes = default_sizes;
+	int nb_sizes = 2;
+	int loops = 20000;
+	int chunks, size, fast, i, s;
+	double start, total;
+
+	while (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		loops = atoi(argv[2]);
+		argc -= 2; argv += 2;
+	}
+
+	if (argc > 1) {
+		int *list = calloc(argc - 1, sizeof(*list));
+
+		for (i = 1; i < argc; i++)
+			list[i - 1] = atoi(argv[i]) > 0 ? atoi(argv[i]) : 1;
+		sizes = list;
+		nb_sizes = argc - 1;
+	}
+
+	for (s = 0; s < nb_sizes; s++) {
+		size = sizes[s];
+		chunks = fill_chunks(&r, size);
+		for (fast = 0; fast < 2; fast++) {
+			start = now_us();
+			for (i = 0; i < loops; i++) {
+				memset(&m, 0, sizeof(m));
+				m.state = ST_SIZE;
+				forward(&r, &m, fast);
+			}
+			total = now_us() - start;
+
+			if (m.state != ST_LAST || m.body_len != (unsigned long long)chunks * size) {
+				printf("%-8s : %d-byte chunks not parsed correctly\n",
+				       fast ? "fast" : "generic", size);
+				return 1;
+			}
+			printf("%-8s : %5d x %4d-byte chunks, %6.2f ns/chunk, %8.1f MB/s of payload\n",
+			       fast ? "fast" : "generic", chunks, size,
+			       total * 1000.0 / loops / chunks,
+			       (double)chunks * size * loops / total);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Measures the speed of the compiled maps from src/cmap.c.
+ *
+ * Build with :
+ *   make benchmarks
+ *
+ * Run with :
+ *   ./tests/bench_cmap [-n lookups] [entries...]
+ *
+ * For each number of entries given in argument (1000000 by default), a map
+ * of random IPv4 networks is compiled and the time to write it, to map it and
+ * to look it up are reported. The maps' correctness is checked by
+ * tests/test_cmap.c.
+ */
+
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <common/cmap.h>
+
+static char path[] = "/tmp/bench_cmap.XXXXXX";
+
+static double now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	unlink(path);
+	exit(1);
+}
+
+/* benchmarks a map of <count> random IPv4 networks */
+static void bench(int count, int loops)
+{
+	struct cmap_builder *b;
+	struct cmap *m;
+	const char *msg;
+	uint32_t addr, *addrs;
+	char key[32];
+	double start, ms_write, us_open, ns_lookup;
+	int hits = 0, i, entry, len;
+	unsigned int plen;
+
+	addrs = malloc(loops * sizeof(*addrs));
+	b = cmapb_new(CMAP_IP);
+	if (!addrs || !b)
+		die("out of memory");
+	for (i = 0; i < loops; i++)
+		addrs[i] = random() ^ (random() << 16);
+
+	start = now_us();
+	for (i = 0; i < count; i++) {
+		addr = random() ^ (random() << 16);
+		len = 16 + random() % 9;
+		addr &= htonl(~0U << (32 - len));
+		snprintf(key, sizeof(key), "%u.%u.%u.%u/%d", ((unsigned char *)&addr)[0], ((unsigned char *)&addr)[1],
+		         ((unsigned char *)&addr)[2], ((unsigned char *)&addr)[3], len);
+		entry = cmapb_add(b, key, "value");
+		if (entry < 0 || cmapb_add_net(b, entry, &addr, 4, len) < 0)
+			die("out of memory");
+	}
+	if (cmapb_write(b, path) < 0)
+		die("cannot write the map");
+	ms_write = (now_us() - start) / 1000.0;
+	cmapb_free(b);
+
+	start = now_us();
+	m = cmap_open(path, &msg);
+	us_open = now_us() - start;
+	if (!m)
+		die(msg ? msg : "not a compiled map");
+
+	start = now_us();
+	for (i = 0; i < loops; i++)
+		hits += cmap_lookup_ip(m, &addrs[i], 4, &plen) >= 0;
+	ns_lookup = (now_us() - start) * 1000.0 / loops;
+
+	printf("%8d networks : compiled in %.0f ms, %.1f MB, mapped in %.0f us, %.1f ns/lookup (%d/%d matches)\n",
+	       count, ms_write, m->size / 1048576.0, us_open, ns_lookup, hits, loops);
+
+	cmap_close(m);
+	free(addrs);
+}
+
+int main(int argc, char **argv)
+{
+	int loops = 1000000;
+	int fd, i;
+
+	while (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		loops = atoi(argv[2]);
+		argc -= 2; argv += 2;
+	}
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		die("cannot create a temporary file");
+	close(fd);
+
+	srandom(1);
+	if (argc > 1) {
+		for (i = 1; i < argc; i++)
+			bench(atoi(argv[i]), loops);
+	}
+	else
+		bench(1000000, loops);
+
+	unlink(path);
+	return 0;
+}
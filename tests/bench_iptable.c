@@ -0,0 +1,156 @@
+/*
+ * Measures the speed and the memory usage of the IP table from src/iptable.c.
+ *
+ * Build with :
+ *   make benchmarks
+ *
+ * Run with :
+ *   ./tests/bench_iptable [-n lookups] [prefixes...]
+ *
+ * For each number of prefixes given in argument (100000 and 1000000 by
+ * default), random IPv4 networks are loaded both in the table and in an ebmb
+ * tree of the nodes used by the pattern trees, and the lookup time and the
+ * memory used by each are reported. The table's correctness is checked by
+ * tests/test_iptable.c.
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <common/iptable.h>
+
+/* the node used by pat_idx_tree_ip() */
+struct pattern_tree {
+	void *data;
+	void *ref;
+	struct ebmb_node node;
+};
+
+static double now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+/* resident memory in bytes */
+static long rss(void)
+{
+	long size, res = 0;
+	FILE *f;
+
+	f = fopen("/proc/self/statm", "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%ld %ld", &size, &res) != 2)
+		res = 0;
+	fclose(f);
+	return res * sysconf(_SC_PAGESIZE);
+}
+
+/* benchmarks <count> random IPv4 networks */
+static void bench(int count, int loops)
+{
+	struct ipt *t;
+	struct eb_root tree = EB_ROOT;
+	struct pattern_tree *node;
+	struct ebmb_node *eb, *next;
+	uint32_t *addrs, *keys;
+	unsigned char *lens;
+	double start, ns_ipt, ns_tree, ms_build;
+	long mem_base, mem_ipt, mem_tree;
+	int hits_ipt = 0, hits_tree = 0;
+	int i;
+
+	keys = malloc(count * sizeof(*keys));
+	lens = malloc(count);
+	addrs = malloc(loops * sizeof(*addrs));
+	if (!keys || !lens || !addrs) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	/* mostly /16 to /24 like routing or geolocation tables */
+	for (i = 0; i < count; i++) {
+		keys[i] = random() ^ (random() << 16);
+		lens[i] = 16 + random() % 9 + (random() % 8 == 0 ? 8 : 0);
+	}
+	for (i = 0; i < loops; i++)
+		addrs[i] = random() ^ (random() << 16);
+
+	mem_base = rss();
+	start = now_us();
+	t = ipt_new(4);
+	for (i = 0; i < count; i++)
+		ipt_insert(t, &keys[i], lens[i], &keys[i], &keys[i]);
+	ipt_build(t);
+	ms_build = (now_us() - start) / 1000.0;
+	mem_ipt = rss() - mem_base;
+
+	start = now_us();
+	for (i = 0; i < loops; i++)
+		hits_ipt += ipt_lookup(t, &addrs[i]) != NULL;
+	ns_ipt = (now_us() - start) * 1000.0 / loops;
+	ipt_free(t);
+
+	mem_base = rss();
+	for (i = 0; i < count; i++) {
+		node = calloc(1, sizeof(*node) + 4);
+		if (!node) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		node->data = &keys[i];
+		memcpy(node->node.key, &keys[i], 4);
+		node->node.node.pfx = lens[i];
+		ebmb_insert_prefix(&tree, &node->node, 4);
+	}
+	mem_tree = rss() - mem_base;
+
+	start = now_us();
+	for (i = 0; i < loops; i++)
+		hits_tree += ebmb_lookup_longest(&tree, &addrs[i]) != NULL;
+	ns_tree = (now_us() - start) * 1000.0 / loops;
+
+	for (eb = ebmb_first(&tree); eb; eb = next) {
+		next = ebmb_next(eb);
+		ebmb_delete(eb);
+		free(container_of(eb, struct pattern_tree, node));
+	}
+
+	printf("%8d prefixes : table %6.1f ns/lookup %6.1f MB/M prefixes (built in %.0f ms), "
+	       "tree %6.1f ns/lookup %6.1f MB/M prefixes, x%.1f (%d/%d matches)\n",
+	       count, ns_ipt, mem_ipt / (count / 1000000.0) / 1048576.0, ms_build,
+	       ns_tree, mem_tree / (count / 1000000.0) / 1048576.0, ns_tree / ns_ipt,
+	       hits_ipt, hits_tree);
+
+	free(keys);
+	free(lens);
+	free(addrs);
+}
+
+int main(int argc, char **argv)
+{
+	int loops = 1000000;
+	int i;
+
+	while (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		loops = atoi(argv[2]);
+		argc -= 2; argv += 2;
+	}
+
+	srandom(1);
+	if (argc > 1) {
+		for (i = 1; i < argc; i++)
+			bench(atoi(argv[i]), loops);
+	}
+	else {
+		bench(100000, loops);
+		bench(1000000, loops);
+	}
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Measures the speed of the combined regex matcher from src/rxset.c.
+ *
+ * Build with :
+ *   make benchmarks USE_PCRE=1 USE_REGEX_DFA=1
+ *
+ * Run with :
+ *   ./tests/bench_rxset [-n loops] [expressions...]
+ *
+ * For each number of expressions given in argument (10, 200 and 2000 by
+ * default), URL-like subjects are matched against WAF-like expressions with
+ * the set and with PCRE one expression after the other, as regex_exec() does.
+ * The set's correctness is checked by tests/test_rxset.c.
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pcre.h>
+
+#include <common/rxset.h>
+
+#define MAXEXP 2000
+
+static pcre *regs[MAXEXP];
+static int nbregs;
+
+static double now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+/* compiles <expr> as the next reference expression like regex_comp() does
+ * without captures. Returns 0 if PCRE rejects it.
+ */
+static int ref_add(const char *expr, int icase)
+{
+	const char *error;
+	int erroffset;
+
+	regs[nbregs] = pcre_compile(expr, PCRE_NO_AUTO_CAPTURE | (icase ? PCRE_CASELESS : 0),
+	                            &error, &erroffset, NULL);
+	if (!regs[nbregs])
+		return 0;
+	nbregs++;
+	return 1;
+}
+
+/* index of the first expression matching <subj>, -1 if none does, or -2 if
+ * PCRE gave up on one of them (eg: match limit reached) before.
+ */
+static int ref_match(const char *subj)
+{
+	int i, ret;
+
+	for (i = 0; i < nbregs; i++) {
+		ret = pcre_exec(regs[i], NULL, subj, strlen(subj), 0, 0, NULL, 0);
+		if (ret >= 0)
+			return i;
+		if (ret != PCRE_ERROR_NOMATCH)
+			return -2;
+	}
+	return -1;
+}
+
+static void reset_regs(void)
+{
+	while (nbregs)
+		pcre_free(regs[--nbregs]);
+}
+
+/* benchmarks <count> expressions against URL-like subjects */
+static void bench(int count, int loops)
+{
+	static const char *urls[] = {
+		"/static/js/app.min.js?v=3.2.1",
+		"/api/v2/users/12345/orders?page=3&sort=desc&filter=status:open",
+		"/search?q=how+to+configure+a+load+balancer&lang=en&safe=on",
+		"/index.php?id=1%27+union+select(1,2)--&submit=go",
+	};
+	static const char *words[] = { "select", "union", "insert", "script", "alert", "passwd", "exec", "eval", "onload", "iframe" };
+	struct rxset *s;
+	char expr[128];
+	unsigned int id;
+	double start, ns_set, ns_ref;
+	int ref_loops, i, u;
+	int hits_set = 0, hits_ref = 0;
+
+	s = rxset_new(1);
+	while (nbregs < count) {
+		snprintf(expr, sizeof(expr), "%s[^a-z0-9]+(%s|x%04d)[=(]",
+		         words[random() % 10], words[random() % 10], (int)(random() % 10000));
+		if (!ref_add(expr, 1) || rxset_add(s, expr, nbregs - 1) != 1) {
+			fprintf(stderr, "failed to add '%s'\n", expr);
+			exit(1);
+		}
+	}
+	rxset_prepare(s);
+
+	start = now_us();
+	for (i = 0; i < loops; i++)
+		for (u = 0; u < 4; u++)
+			hits_set += rxset_exec(s, urls[u], strlen(urls[u]), &id) > 0;
+	ns_set = (now_us() - start) * 1000.0 / (loops * 4.0);
+
+	/* the list walk is much slower, keep the run time reasonable */
+	ref_loops = loops / count + 1;
+	start = now_us();
+	for (i = 0; i < ref_loops; i++)
+		for (u = 0; u < 4; u++)
+			hits_ref += ref_match(urls[u]) >= 0;
+	ns_ref = (now_us() - start) * 1000.0 / (ref_loops * 4.0);
+
+	printf("%5d expressions : set %8.1f ns/lookup (%u states, %u flushes), list walk %10.1f ns/lookup, x%.1f (%d/%d matches)\n",
+	       count, ns_set, s->nb_dfa, s->flushes, ns_ref, ns_ref / ns_set, hits_set / loops, hits_ref / ref_loops);
+	reset_regs();
+	rxset_free(s);
+}
+
+int main(int argc, char **argv)
+{
+	int loops = 100000;
+	int i;
+
+	while (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		loops = atoi(argv[2]);
+		argc -= 2; argv += 2;
+	}
+
+	srandom(1);
+	if (argc > 1) {
+		for (i = 1; i < argc; i++)
+			bench(atoi(argv[i]) > MAXEXP ? MAXEXP : atoi(argv[i]), loops);
+	}
+	else {
+		bench(10, loops);
+		bench(200, loops);
+		bench(2000, loops);
+	}
+	return 0;
+}
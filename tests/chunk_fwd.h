@@ -0,0 +1,148 @@
+/*
+ * Chunked body forwarding loop shared by tests/test_chunk_fwd.c and
+ * tests/bench_chunk_fwd.c.
+ *
+ * The chunk forwarding loop of http_msg_forward_chunked_body() without data
+ * filters is run on a ring buffer, with the same chunk size and CRLF parsers
+ * as the analyser, either with these parsers only or with http_scan_chunks()
+ * first.
+ */
+
+#ifndef _TESTS_CHUNK_FWD_H
+#define _TESTS_CHUNK_FWD_H
+
+#include <common/http_scan.h>
+
+#define BUFSIZE 16384
+
+/* a minimal ring buffer and chunked message, as in struct buffer/http_msg */
+struct ring {
+	char data[BUFSIZE];
+	int p;                        /* first byte to parse */
+	int i;                        /* number of bytes after p */
+};
+
+enum { ST_DATA, ST_CRLF, ST_SIZE, ST_LAST, ST_ERROR };
+
+struct msg {
+	int state;
+	int next;                     /* bytes parsed after p */
+	unsigned long long chunk_len;
+	unsigned long long body_len;
+};
+
+static inline const char *ring_ptr(const struct ring *r, int ofs)
+{
+	ofs += r->p;
+	if (ofs >= BUFSIZE)
+		ofs -= BUFSIZE;
+	return r->data + ofs;
+}
+
+/* http_skip_chunk_crlf() on the ring */
+static inline int skip_crlf(const struct ring *r, struct msg *m)
+{
+	const char *err;
+
+	return http_scan_chunk_crlf(r->data, BUFSIZE, ring_ptr(r, m->next), r->i - m->next, &err);
+}
+
+/* http_parse_chunk_size() on the ring */
+static inline int parse_size(const struct ring *r, struct msg *m)
+{
+	const char *err;
+	unsigned int chunk;
+	int ret;
+
+	ret = http_scan_chunk_size(r->data, BUFSIZE, ring_ptr(r, m->next), r->i - m->next, &chunk, &err);
+	if (ret > 0) {
+		m->chunk_len = chunk;
+		m->body_len += chunk;
+	}
+	return ret;
+}
+
+/* The forwarding loop of http_msg_forward_chunked_body() without filters,
+ * with or without the fast path. Stops when data are missing, after the last
+ * chunk or on error.
+ */
+static inline void forward(const struct ring *r, struct msg *m, int fast)
+{
+	unsigned long long fwd;
+	int ret;
+
+	while (1) {
+		switch (m->state) {
+		case ST_DATA:
+			if (fast && r->i > m->next) {
+				const char *start = ring_ptr(r, m->next);
+				const char *stop = ring_ptr(r, r->i);
+				const char *ptr;
+
+				if (stop <= start)
+					stop = r->data + BUFSIZE;
+				ptr = http_scan_chunks(start, stop, &m->chunk_len, &m->body_len);
+				if (ptr != start) {
+					m->next += ptr - start;
+					if (!m->chunk_len) {
+						m->state = ST_LAST;
+						return;
+					}
+				}
+			}
+			fwd = r->i - m->next;
+			if (fwd > m->chunk_len)
+				fwd = m->chunk_len;
+			m->next += fwd;
+			m->chunk_len -= fwd;
+			if (m->chunk_len)
+				return;
+			m->state = ST_CRLF;
+			/* fall through */
+		case ST_CRLF:
+			ret = skip_crlf(r, m);
+			if (ret <= 0)
+				goto out;
+			m->next += ret;
+			m->state = ST_SIZE;
+			/* fall through */
+		case ST_SIZE:
+			ret = parse_size(r, m);
+			if (ret <= 0)
+				goto out;
+			m->next += ret;
+			m->state = m->chunk_len ? ST_DATA : ST_LAST;
+			if (m->state == ST_LAST)
+				return;
+			break;
+		default:
+			return;
+		}
+	}
+ out:
+	if (ret < 0)
+		m->state = ST_ERROR;
+}
+
+/* Writes <len> bytes from <src> at the end of ring <r> */
+static inline void ring_put(struct ring *r, const char *src, int len)
+{
+	int ofs;
+
+	while (len--) {
+		ofs = r->p + r->i++;
+		if (ofs >= BUFSIZE)
+			ofs -= BUFSIZE;
+		r->data[ofs] = *src++;
+	}
+}
+
+/* Consumes what was parsed by <m>, as the analyser does with b_adv() */
+static inline void ring_adv(struct ring *r, struct msg *m)
+{
+	r->p = (r->p + m->next) % BUFSIZE;
+	r->i -= m->next;
+	m->next = 0;
+}
+
+#endif /* _TESTS_CHUNK_FWD_H */
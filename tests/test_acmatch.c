@@ -0,0 +1,295 @@
+/*
+ * Checks the Aho-Corasick automaton from src/acmatch.c.
+ *
+ * Build and run with :
+ *   make tests
+ *
+ * The automaton is first checked on a few known pattern lists which exercise
+ * the list order, the fail links, the case modes, empty patterns, nodes with
+ * many children and deletions. Then it is compared with the list walks of
+ * pat_match_sub(), pat_match_beg() and pat_match_end() on random patterns and
+ * subjects built from a small alphabet so that matches are frequent, in both
+ * case modes and while strings are being inserted and deleted. The speed is
+ * measured by tests/bench_acmatch.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/acmatch.h>
+
+#define MAXPAT 20000
+
+/* a pattern as in struct pattern_list */
+struct pat {
+	char *str;
+	int len;
+	int live;
+};
+
+static struct pat pats[MAXPAT];
+static int nbpats;
+
+/* known pattern lists, the expected results being indexes in the list */
+static const struct {
+	const char *pats[24];
+	int icase;
+	const char *subj;
+	int sub, beg, end;            /* expected match, -1 for none */
+} cases[] = {
+	{ { "bcd", "abcde", "cd", NULL },        0, "xabcdex", 0, -1, -1 },
+	{ { "cd", "abcde", "bcd", NULL },        0, "xabcdex", 0, -1, -1 },
+	{ { "abcd", "bce", NULL },               0, "abce",    1, -1,  1 },
+	{ { "ab", "a", "bc", "c", NULL },        0, "abc",     0,  0,  2 },
+	{ { "xyz", NULL },                       0, "abc",    -1, -1, -1 },
+	{ { "abcd", NULL },                      0, "abc",    -1, -1, -1 },
+	{ { "", "x", NULL },                     0, "",        0,  0,  0 },
+	{ { "x", "", NULL },                     0, "abc",     1,  1,  1 },
+	{ { "ABC", NULL },                       0, "xabcx",  -1, -1, -1 },
+	{ { "ABC", NULL },                       1, "xabcx",   0, -1, -1 },
+	{ { "abc", NULL },                       1, "ABC",     0,  0,  0 },
+	{ { "aab", NULL },                       0, "aaab",    0, -1,  0 },
+	{ { "\xe9t\xe9", NULL },                1, "\xc9T\xc9", -1, -1, -1 },
+	{ { "xa", "xb", "xc", "xd", "xe", "xf", "xg", "xh", "xi", "xj",
+	    "xk", "xl", "xm", "xn", "xo", "xp", "xq", "x\x80", "x\xff", "x~", NULL },
+	                                         0, "abx\xff",  18, -1, 18 },
+	{ { "xa", "xb", "xc", "xd", "xe", "xf", "xg", "xh", "xi", "xj",
+	    "xk", "xl", "xm", "xn", "xo", "xp", "xq", "x\x80", "x\xff", "x~", NULL },
+	                                         1, "XQx",     16, 16, -1 },
+	{ { NULL } }
+};
+
+/* Checks the known pattern lists. Returns the number of errors. */
+static int check_cases(void)
+{
+	struct ac_tree *t;
+	const char *subj;
+	int i, p, len, exp, errors = 0;
+	void *ret[3];
+	const char *names[3] = { "sub", "beg", "end" };
+
+	for (i = 0; cases[i].subj; i++) {
+		t = ac_new(cases[i].icase);
+		for (p = 0; cases[i].pats[p]; p++) {
+			if (!t || ac_insert(t, cases[i].pats[p], strlen(cases[i].pats[p]), (void *)&cases[i].pats[p]) < 0) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+		}
+		if (ac_prepare(t) < 0) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+
+		subj = cases[i].subj;
+		len = strlen(subj);
+		ret[0] = ac_match_sub(t, subj, len);
+		ret[1] = ac_match_beg(t, subj, len);
+		ret[2] = ac_match_end(t, subj, len);
+		for (p = 0; p < 3; p++) {
+			exp = p == 0 ? cases[i].sub : p == 1 ? cases[i].beg : cases[i].end;
+			if (ret[p] == (exp < 0 ? NULL : (void *)&cases[i].pats[exp]))
+				continue;
+			printf("  case %d: match_%s returned %ld, expected %d\n", i, names[p],
+			       ret[p] ? (long)((const char **)ret[p] - cases[i].pats) : -1L, exp);
+			errors++;
+		}
+		ac_free(t);
+	}
+	return errors;
+}
+
+/* Checks that duplicate strings are kept apart, that a deleted string stops
+ * matching and that a string inserted again ranks last. Returns the number of
+ * errors.
+ */
+static int check_delete(void)
+{
+	struct ac_tree *t;
+	int a1, a2, b, errors = 0;
+
+	t = ac_new(0);
+	if (!t || ac_insert(t, "a", 1, &a1) < 0 || ac_insert(t, "b", 1, &b) < 0 ||
+	    ac_insert(t, "a", 1, &a2) < 0 || ac_prepare(t) < 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	errors += ac_match_sub(t, "ab", 2) != &a1;
+
+	errors += ac_delete(t, "a", 1, &a1) != 1;
+	errors += ac_delete(t, "a", 1, &a1) != 0;
+	errors += ac_delete(t, "c", 1, &b) != 0;
+	errors += ac_prepare(t) < 0;
+	errors += ac_match_sub(t, "ab", 2) != &b;
+	errors += ac_match_sub(t, "a", 1) != &a2;
+
+	errors += ac_delete(t, "b", 1, &b) != 1;
+	errors += ac_insert(t, "b", 1, &b) < 0;
+	errors += ac_prepare(t) < 0;
+	errors += ac_match_sub(t, "ab", 2) != &a2;
+
+	errors += ac_delete(t, "a", 1, &a2) != 1;
+	errors += ac_prepare(t) < 0;
+	errors += ac_match_sub(t, "a", 1) != NULL;
+	errors += ac_match_sub(t, "ab", 2) != &b;
+	ac_free(t);
+	return errors;
+}
+
+static void rand_str(char *str, int len, const char *alpha)
+{
+	int n = strlen(alpha);
+
+	while (len--)
+		*str++ = alpha[random() % n];
+	*str = 0;
+}
+
+/* same walks as pat_match_sub(), pat_match_beg() and pat_match_end() */
+static struct pat *ref_sub(const char *s, int len, int icase)
+{
+	const char *c, *end;
+	int i;
+
+	for (i = 0; i < nbpats; i++) {
+		if (!pats[i].live || pats[i].len > len)
+			continue;
+		end = s + len - pats[i].len;
+		for (c = s; c <= end; c++) {
+			if ((icase && strncasecmp(pats[i].str, c, pats[i].len) == 0) ||
+			    (!icase && strncmp(pats[i].str, c, pats[i].len) == 0))
+				return &pats[i];
+		}
+	}
+	return NULL;
+}
+
+static struct pat *ref_beg(const char *s, int len, int icase)
+{
+	int i;
+
+	for (i = 0; i < nbpats; i++) {
+		if (!pats[i].live || pats[i].len > len)
+			continue;
+		if ((icase && strncasecmp(pats[i].str, s, pats[i].len) == 0) ||
+		    (!icase && strncmp(pats[i].str, s, pats[i].len) == 0))
+			return &pats[i];
+	}
+	return NULL;
+}
+
+static struct pat *ref_end(const char *s, int len, int icase)
+{
+	int i;
+
+	for (i = 0; i < nbpats; i++) {
+		if (!pats[i].live || pats[i].len > len)
+			continue;
+		if ((icase && strncasecmp(pats[i].str, s + len - pats[i].len, pats[i].len) == 0) ||
+		    (!icase && strncmp(pats[i].str, s + len - pats[i].len, pats[i].len) == 0))
+			return &pats[i];
+	}
+	return NULL;
+}
+
+static void add_pat(struct ac_tree *t, const char *str)
+{
+	pats[nbpats].str = strdup(str);
+	pats[nbpats].len = strlen(str);
+	pats[nbpats].live = 1;
+	if (t && ac_insert(t, pats[nbpats].str, pats[nbpats].len, &pats[nbpats]) < 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	nbpats++;
+}
+
+static void reset_pats(void)
+{
+	while (nbpats)
+		free(pats[--nbpats].str);
+}
+
+/* compares the automaton and the walks on <loops> random subjects */
+static int compare(struct ac_tree *t, int icase, int loops)
+{
+	char subj[64];
+	int errors = 0;
+	int len;
+
+	if (ac_prepare(t) < 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	while (loops--) {
+		len = random() % 40;
+		rand_str(subj, len, "abcAB");
+		if (ac_match_sub(t, subj, len) != ref_sub(subj, len, icase))
+			errors++;
+		if (ac_match_beg(t, subj, len) != ref_beg(subj, len, icase))
+			errors++;
+		if (ac_match_end(t, subj, len) != ref_end(subj, len, icase))
+			errors++;
+	}
+	return errors;
+}
+
+/* Compares the automaton and the walks on random patterns and subjects while
+ * strings are being inserted and deleted. Returns the number of errors.
+ */
+static int check_random(void)
+{
+	struct ac_tree *t;
+	char str[16];
+	int icase, round, i, errors = 0;
+
+	for (icase = 0; icase <= 1; icase++) {
+		for (round = 0; round < 50; round++) {
+			t = ac_new(icase);
+			for (i = random() % 40 + 1; i; i--) {
+				rand_str(str, random() % 5 + (round == 0 ? 0 : 1), "abcAB");
+				add_pat(t, str);
+			}
+			errors += compare(t, icase, 200);
+
+			/* delete some, add some more */
+			for (i = 0; i < nbpats; i++) {
+				if (random() % 3)
+					continue;
+				if (ac_delete(t, pats[i].str, pats[i].len, &pats[i]) != 1)
+					errors++;
+				pats[i].live = 0;
+			}
+			for (i = random() % 10; i && nbpats < MAXPAT; i--) {
+				rand_str(str, random() % 5 + 1, "abcAB");
+				add_pat(t, str);
+			}
+			errors += compare(t, icase, 200);
+			reset_pats();
+			ac_free(t);
+		}
+	}
+	return errors;
+}
+
+int main(void)
+{
+	int errors = 0, err;
+
+	err = check_cases();
+	printf("Known patterns  : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	err = check_delete();
+	printf("Deletions       : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	srandom(1);
+	err = check_random();
+	printf("Random patterns : %s (%d errors)\n", err ? "FAILED" : "OK", err);
+	errors += err;
+
+	return errors ? 1 : 0;
+}
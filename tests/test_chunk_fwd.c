@@ -0,0 +1,193 @@
+/*
+ * Checks the chunked body fast path from src/http_scan.c.
+ *
+ * Build and run with :
+ *   make tests
+ *
+ * The forwarding loop of tests/chunk_fwd.h is run with and without
+ * http_scan_chunks() on a few known streams, delivered at once, byte per byte
+ * and wrapping at every position of the buffer, then both are checked to
+ * agree on random streams (random sizes, extensions, bare LFs and buffer
+ * wrapping). The speed is measured by tests/bench_chunk_fwd.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk_fwd.h"
+
+static const struct {
+	const char *str;
+	int state;                    /* expected final state */
+	unsigned long long body_len;  /* expected body length if ST_LAST */
+} cases[] = {
+	{ "0\r\n\r\n",                                  ST_LAST,  0 },
+	{ "1\r\na\r\n0\r\n\r\n",                         ST_LAST,  1 },
+	{ "A\r\n0123456789\r\n3\r\nabc\r\n0\r\n\r\n",      ST_LAST, 13 },
+	{ "0004\r\nabcd\r\n0\r\n\r\n",                   ST_LAST,  4 },
+	{ "4;name=value\r\nabcd\r\n0\r\n\r\n",           ST_LAST,  4 },
+	{ "4 ;ext\r\nabcd\r\n0;last\r\n\r\n",            ST_LAST,  4 },
+	{ "4\nabcd\n2\r\nef\n0\n\n",                     ST_LAST,  6 },
+	{ "4\r\n\r\n\r\n\r\n0\r\n\r\n",                   ST_LAST,  4 },
+	{ "1f\r\n0123456789abcdef0123456789abcde\r\n0\r\n\r\n", ST_LAST, 31 },
+	{ "4\r\nabcdX\r\n0\r\n\r\n",                     ST_ERROR, 0 },
+	{ "g\r\nabcd\r\n0\r\n\r\n",                      ST_ERROR, 0 },
+	{ "\r\nabcd\r\n0\r\n\r\n",                       ST_ERROR, 0 },
+	{ "4x\r\nabcd\r\n0\r\n\r\n",                     ST_ERROR, 0 },
+	{ "80000000\r\nabcd\r\n0\r\n\r\n",               ST_ERROR, 0 },
+	{ "1\r\na\r\n4\r\nabcd\r0\r\n\r\n",                ST_ERROR, 0 },
+	{ NULL }
+};
+
+/* Feeds <len> bytes of <str> by steps of <step> bytes to the forwarding loop
+ * into message <m>, on a ring whose end is <wrap> bytes after the start.
+ */
+static void feed(const char *str, int len, int step, int wrap, int fast, struct msg *m)
+{
+	static struct ring r;
+	int ofs, n;
+
+	r.p = (BUFSIZE - wrap) % BUFSIZE;
+	r.i = 0;
+	memset(m, 0, sizeof(*m));
+	m->state = ST_SIZE;
+
+	for (ofs = 0; ofs < len && m->state != ST_LAST && m->state != ST_ERROR; ofs += n) {
+		n = len - ofs < step ? len - ofs : step;
+		ring_put(&r, str + ofs, n);
+		forward(&r, m, fast);
+		ring_adv(&r, m);
+	}
+}
+
+/* Checks the known streams in every delivery mode. Returns the number of
+ * errors.
+ */
+static int check_cases(void)
+{
+	struct msg m;
+	int steps[4] = { 1, 2, 7, 0 };
+	int i, s, len, step, wrap, fast, errors = 0;
+
+	for (i = 0; cases[i].str; i++) {
+		len = strlen(cases[i].str);
+		steps[3] = len;
+		for (fast = 0; fast < 2; fast++) {
+			for (s = 0; s < 4; s++) {
+				step = steps[s];
+				for (wrap = 0; wrap <= len; wrap++) {
+					feed(cases[i].str, len, step, wrap, fast, &m);
+					if (m.state == cases[i].state &&
+					    (m.state != ST_LAST || m.body_len == cases[i].body_len))
+						continue;
+					printf("  case %d (%s, step %d, wrap %d): state=%d body=%llu, expected state=%d body=%llu\n",
+					       i, fast ? "fast" : "generic", step, wrap,
+					       m.state, m.body_len, cases[i].state, cases[i].body_len);
+					errors++;
+					break;
+				}
+			}
+		}
+	}
+	return errors;
+}
+
+/* Builds a random chunked stream of about <max> bytes into <out> and returns
+ * its length. Some chunk sizes have leading zeroes, spaces, extensions or
+ * bare LFs, and a few streams have a syntax error.
+ */
+static int random_stream(char *out, int max)
+{
+	int len = 0, size, i;
+
+	while (len < max - 64) {
+		size = random() % 8 ? random() % 20 + 1 : random() % 300 + 1;
+		if (len + size + 40 >= max)
+			break;
+		switch (random() % 16) {
+		case 0:  len += sprintf(out + len, "%08X", size); break;
+		case 1:  len += sprintf(out + len, "%x ;ext=1", size); break;
+		case 2:  len += sprintf(out + len, "%x;a", size); break;
+		default: len += sprintf(out + len, "%x", size); break;
+		}
+		len += sprintf(out + len, random() % 16 ? "\r\n" : "\n");
+		for (i = 0; i < size; i++)
+			out[len++] = "ab\r\n0123456789"[random() % 14];
+		if (!(random() % 500))
+			out[len++] = 'x';
+		len += sprintf(out + len, random() % 16 ? "\r\n" : "\n");
+	}
+	len += sprintf(out + len, "0\r\n\r\n");
+	return len;
+}
+
+/* Feeds the same random streams by random steps to both versions and checks
+ * that they always agree. Returns the number of errors.
+ */
+static int check_random(void)
+{
+	static char stream[65536];
+	static struct ring r1, r2;
+	struct msg m1, m2;
+	int len, ofs, step, errors = 0, loop;
+
+	srandom(1);
+	for (loop = 0; loop < 200 && errors < 10; loop++) {
+		len = random_stream(stream, random() % 2 ? 1000 : sizeof(stream));
+		r1.p = r2.p = random() % BUFSIZE;
+		r1.i = r2.i = 0;
+		memset(&m1, 0, sizeof(m1));
+		memset(&m2, 0, sizeof(m2));
+		m1.state = m2.state = ST_SIZE;
+
+		for (ofs = 0; ofs < len; ofs += step) {
+			step = random() % 4 ? random() % 64 + 1 : random() % BUFSIZE + 1;
+			if (step > len - ofs)
+				step = len - ofs;
+			if (step > BUFSIZE - r1.i)
+				step = BUFSIZE - r1.i;
+			if (!step)
+				break;
+			ring_put(&r1, stream + ofs, step);
+			ring_put(&r2, stream + ofs, step);
+			forward(&r1, &m1, 0);
+			forward(&r2, &m2, 1);
+			if (m1.state == ST_ERROR || m2.state == ST_ERROR ||
+			    m1.state == ST_LAST || m2.state == ST_LAST)
+				break;
+			/* the reference may be in a different state in the middle of
+			 * a chunk, but they must have consumed the same bytes
+			 */
+			if (r1.i - m1.next != r2.i - m2.next ||
+			    m1.body_len != m2.body_len)
+				break;
+			ring_adv(&r1, &m1);
+			ring_adv(&r2, &m2);
+		}
+
+		if (m1.state != m2.state || m1.body_len != m2.body_len ||
+		    r1.i - m1.next != r2.i - m2.next) {
+			printf("  stream %d (%d bytes): ref state=%d body=%llu left=%d, fast state=%d body=%llu left=%d\n",
+			       loop, len, m1.state, m1.body_len, r1.i - m1.next,
+			       m2.state, m2.body_len, r2.i - m2.next);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+int main(void)
+{
+	int errors = 0, err;
+
+	err = check_cases();
+	printf("Known streams  : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	err = check_random();
+	printf("Random streams : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	return errors ? 1 : 0;
+}
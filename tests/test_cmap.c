@@ -0,0 +1,389 @@
+/*
+ * Checks the compiled maps from src/cmap.c.
+ *
+ * Build and run with :
+ *   make tests
+ *
+ * Small string, integer and IPv4/IPv6 maps with known results are first
+ * compiled to a temporary file, mapped and looked up before and after a
+ * deletion, and files which are not compiled maps or are truncated must be
+ * refused. Then random maps with duplicate keys are looked up while entries
+ * are being deleted, the result being compared with a walk over the entries
+ * in file order. The compilation and lookup speeds are measured by
+ * tests/bench_cmap.c.
+ */
+
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <common/cmap.h>
+
+#define MAXENT 3000
+
+/* an entry as found in the text file */
+struct ent {
+	char key[64];
+	char value[16];
+	long long ival;
+	unsigned char addr[16];
+	unsigned int klen, len;
+	int live;
+};
+
+static struct ent ents[MAXENT];
+static int nbents;
+static char path[] = "/tmp/test_cmap.XXXXXX";
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	unlink(path);
+	exit(1);
+}
+
+/* Compiles the <nb> entries of <keys> and <values> into a map of <kind>.
+ * Integer maps take their key as the value, IP maps the network in the key.
+ */
+static struct cmap *compile_known(unsigned int kind, const char * const *keys, int nb)
+{
+	struct cmap_builder *b;
+	struct cmap *m;
+	const char *msg;
+	unsigned char addr[16];
+	char net[64], *slash;
+	unsigned int klen;
+	int i, entry;
+
+	b = cmapb_new(kind);
+	if (!b)
+		die("out of memory");
+	for (i = 0; i < nb; i++) {
+		snprintf(net, sizeof(net), "v%d", i);
+		entry = cmapb_add(b, keys[i], net);
+		if (entry != i)
+			die("cannot add entry");
+		if (kind == CMAP_INT && cmapb_add_int(b, entry, atoll(keys[i])) < 0)
+			die("out of memory");
+		if (kind == CMAP_IP) {
+			snprintf(net, sizeof(net), "%s", keys[i]);
+			slash = strchr(net, '/');
+			*slash = 0;
+			klen = strchr(net, ':') ? 16 : 4;
+			inet_pton(klen == 4 ? AF_INET : AF_INET6, net, addr);
+			if (cmapb_add_net(b, entry, addr, klen, atoi(slash + 1)) < 0)
+				die("out of memory");
+		}
+	}
+	if (cmapb_write(b, path) < 0)
+		die("cannot write the map");
+	cmapb_free(b);
+
+	m = cmap_open(path, &msg);
+	if (!m)
+		die(msg ? msg : "not a compiled map");
+	return m;
+}
+
+/* Looks <str> up in IP map <m>, returns the entry and sets <len> to the
+ * prefix length.
+ */
+static int lookup_ip(const struct cmap *m, const char *str, unsigned int *len)
+{
+	unsigned char addr[16];
+	unsigned int klen = strchr(str, ':') ? 16 : 4;
+
+	inet_pton(klen == 4 ? AF_INET : AF_INET6, str, addr);
+	return cmap_lookup_ip(m, addr, klen, len);
+}
+
+/* Checks small maps with known results. Returns the number of errors. */
+static int check_known(void)
+{
+	static const char * const strs[] = { "foo", "bar", "foo", "foobar", "" };
+	static const char * const ints[] = { "10", "-5", "10", "0", "1099511627776" };
+	static const char * const nets[] = { "10.0.0.0/8", "10.1.0.0/16", "2001:db8::/32", "0.0.0.0/0", "10.1.2.3/32" };
+	struct cmap *m;
+	unsigned int len;
+	int errors = 0;
+
+	m = compile_known(CMAP_STR, strs, 5);
+	errors += cmap_lookup_str(m, "foo", 3) != 0;
+	errors += cmap_lookup_str(m, "foobar", 3) != 0;
+	errors += cmap_lookup_str(m, "foobar", 6) != 3;
+	errors += cmap_lookup_str(m, "fo", 2) != -1;
+	errors += cmap_lookup_str(m, "foob", 4) != -1;
+	errors += cmap_lookup_str(m, "", 0) != 4;
+	errors += cmap_lookup_str(m, "foo\0", 4) != -1;
+	errors += cmap_lookup_str(m, "foo\0bar", 7) != -1;
+	errors += cmap_lookup_str(m, "\0", 1) != -1;
+	errors += cmap_lookup_str(m, "baz", 3) != -1;
+	errors += cmap_find(m, "foo", -1) != 0;
+	errors += cmap_find(m, "foo", 0) != 2;
+	errors += cmap_find(m, "foo", 2) != -1;
+	errors += strcmp(cmap_value(m, 3), "v3") != 0;
+	errors += cmap_entry_at(m, cmap_ptr(m, 1)) != 1;
+	errors += cmap_delete(m, 0) < 0;
+	errors += cmap_lookup_str(m, "foo", 3) != 2;
+	errors += cmap_delete(m, 2) < 0;
+	errors += cmap_lookup_str(m, "foo", 3) != -1;
+	errors += cmap_lookup_str(m, "bar", 3) != 1;
+	cmap_close(m);
+
+	m = compile_known(CMAP_INT, ints, 5);
+	errors += cmap_lookup_int(m, 10) != 0;
+	errors += cmap_lookup_int(m, -5) != 1;
+	errors += cmap_lookup_int(m, 0) != 3;
+	errors += cmap_lookup_int(m, 1LL << 40) != 4;
+	errors += cmap_lookup_int(m, 7) != -1;
+	errors += cmap_lookup_int(m, -6) != -1;
+	errors += cmap_delete(m, 0) < 0;
+	errors += cmap_lookup_int(m, 10) != 2;
+	cmap_close(m);
+
+	m = compile_known(CMAP_IP, nets, 5);
+	errors += lookup_ip(m, "10.1.2.3", &len) != 4 || len != 32;
+	errors += lookup_ip(m, "10.1.2.4", &len) != 1 || len != 16;
+	errors += lookup_ip(m, "10.2.0.0", &len) != 0 || len != 8;
+	errors += lookup_ip(m, "11.0.0.0", &len) != 3 || len != 0;
+	errors += lookup_ip(m, "2001:db8::1", &len) != 2 || len != 32;
+	errors += lookup_ip(m, "2001:db9::1", &len) != -1;
+	errors += cmap_delete(m, 1) < 0;
+	errors += lookup_ip(m, "10.1.2.4", &len) != 0 || len != 8;
+	errors += lookup_ip(m, "10.1.2.3", &len) != 4 || len != 32;
+	cmap_close(m);
+	return errors;
+}
+
+/* Checks that a text map is not taken for a compiled one, and that a truncated
+ * compiled map or one from another version is refused with an error. Returns
+ * the number of errors.
+ */
+static int check_open(void)
+{
+	static const char * const strs[] = { "foo", "bar" };
+	const char *msg;
+	struct stat st;
+	FILE *f;
+	int errors = 0;
+
+	f = fopen(path, "w");
+	if (!f)
+		die("cannot write the map");
+	fprintf(f, "foo bar\n");
+	fclose(f);
+	errors += cmap_open(path, &msg) != NULL || msg != NULL;
+
+	cmap_close(compile_known(CMAP_STR, strs, 2));
+	if (stat(path, &st) < 0 || truncate(path, st.st_size - 1) < 0)
+		die("cannot truncate the map");
+	errors += cmap_open(path, &msg) != NULL || msg == NULL;
+
+	cmap_close(compile_known(CMAP_STR, strs, 2));
+	f = fopen(path, "r+");
+	if (!f)
+		die("cannot write the map");
+	fprintf(f, "%s1", CMAP_MAGIC_PREFIX);
+	fclose(f);
+	errors += cmap_open(path, &msg) != NULL || msg == NULL;
+	return errors;
+}
+
+static int net_match(const struct ent *e, const unsigned char *addr, unsigned int klen)
+{
+	unsigned int bits = e->len, i;
+
+	if (e->klen != klen)
+		return 0;
+	for (i = 0; bits >= 8; i++, bits -= 8)
+		if (e->addr[i] != addr[i])
+			return 0;
+	return !bits || !((e->addr[i] ^ addr[i]) & (0xff00 >> bits));
+}
+
+/* first live entry matching, the first longest network for IP maps */
+static int ref_lookup(unsigned int kind, const char *str, long long ival, const unsigned char *addr, unsigned int klen)
+{
+	int best = -1, i;
+
+	for (i = 0; i < nbents; i++) {
+		if (!ents[i].live)
+			continue;
+		if (kind == CMAP_STR && strcmp(ents[i].key, str) == 0)
+			return i;
+		if (kind == CMAP_INT && ents[i].ival == ival)
+			return i;
+		if (kind == CMAP_IP && net_match(&ents[i], addr, klen) &&
+		    (best < 0 || ents[i].len > ents[best].len))
+			best = i;
+	}
+	return best;
+}
+
+/* random address of <klen> bytes around a few values */
+static void rand_addr(unsigned char *addr, int klen)
+{
+	int i;
+
+	for (i = 0; i < klen; i++)
+		addr[i] = (i < klen - 2) ? (random() % 2) * 0x80 : random() % 4 * 0x41;
+}
+
+/* fills the entries with random keys of <kind> */
+static void make_entries(unsigned int kind, int count)
+{
+	struct ent *e;
+	int i;
+
+	for (nbents = 0; nbents < count; nbents++) {
+		e = &ents[nbents];
+		memset(e, 0, sizeof(*e));
+		e->live = 1;
+		snprintf(e->value, sizeof(e->value), "v%d", nbents);
+		if (kind == CMAP_STR) {
+			snprintf(e->key, sizeof(e->key), "k%ld", random() % (count / 2 + 1));
+		}
+		else if (kind == CMAP_INT) {
+			e->ival = random() % (count / 2 + 1) - count / 4;
+			snprintf(e->key, sizeof(e->key), "%lld", e->ival);
+		}
+		else {
+			e->klen = (random() & 1) ? 4 : 16;
+			rand_addr(e->addr, e->klen);
+			e->len = random() % (e->klen * 8 + 1);
+			for (i = 0; i < e->klen; i++)
+				if (e->len < 8 * (i + 1))
+					e->addr[i] &= e->len > 8 * i ? 0xff00 >> (e->len - 8 * i) : 0;
+			snprintf(e->key, sizeof(e->key), "net%d", nbents);
+		}
+	}
+}
+
+static struct cmap *compile(unsigned int kind)
+{
+	struct cmap_builder *b;
+	struct cmap *m;
+	const char *msg;
+	int i, entry;
+
+	b = cmapb_new(kind);
+	if (!b)
+		die("out of memory");
+	for (i = 0; i < nbents; i++) {
+		entry = cmapb_add(b, ents[i].key, ents[i].value);
+		if (entry != i)
+			die("cannot add entry");
+		if (kind == CMAP_INT && cmapb_add_int(b, entry, ents[i].ival) < 0)
+			die("out of memory");
+		if (kind == CMAP_IP && cmapb_add_net(b, entry, ents[i].addr, ents[i].klen, ents[i].len) < 0)
+			die("out of memory");
+	}
+	if (cmapb_write(b, path) < 0)
+		die("cannot write the map");
+	cmapb_free(b);
+
+	m = cmap_open(path, &msg);
+	if (!m)
+		die(msg ? msg : "not a compiled map");
+	return m;
+}
+
+/* compares the map and the walk on <loops> random keys */
+static int compare(struct cmap *m, int loops)
+{
+	unsigned char addr[16];
+	char str[64];
+	long long ival = 0;
+	unsigned int klen = 4, len;
+	int errors = 0, exp, got;
+
+	while (loops--) {
+		if (m->kind == CMAP_STR) {
+			snprintf(str, sizeof(str), "k%ld", random() % (nbents / 2 + 2));
+			got = cmap_lookup_str(m, str, strlen(str));
+		}
+		else if (m->kind == CMAP_INT) {
+			ival = random() % (nbents / 2 + 2) - nbents / 4;
+			got = cmap_lookup_int(m, ival);
+		}
+		else {
+			klen = (random() & 1) ? 4 : 16;
+			rand_addr(addr, klen);
+			got = cmap_lookup_ip(m, addr, klen, &len);
+		}
+		exp = ref_lookup(m->kind, str, ival, addr, klen);
+		if (exp != got)
+			errors++;
+	}
+	return errors;
+}
+
+/* Compares the map with a walk over random entries with duplicate keys while
+ * they are being deleted. Returns the number of errors.
+ */
+static int check_random(void)
+{
+	struct cmap *m;
+	unsigned int kind;
+	int round, step, i, e, errors = 0;
+
+	for (kind = 0; kind < CMAP_KINDS; kind++) {
+		for (round = 0; round < 10; round++) {
+			make_entries(kind, random() % (round < 5 ? 30 : MAXENT) + 1);
+			m = compile(kind);
+			errors += compare(m, 500);
+
+			/* the keys are found again, in file order */
+			for (i = 0; i < nbents; i++) {
+				for (e = -1; (e = cmap_find(m, ents[i].key, e)) >= 0 && e < i; )
+					;
+				if (e != i || strcmp(cmap_value(m, e), ents[i].value) != 0 ||
+				    cmap_entry_at(m, cmap_ptr(m, e)) != e)
+					errors++;
+			}
+
+			/* delete some, several times */
+			for (step = 0; step < 4; step++) {
+				for (i = 0; i < nbents; i++) {
+					if (!ents[i].live || random() % 4)
+						continue;
+					if (cmap_delete(m, i) < 0)
+						die("out of memory");
+					ents[i].live = 0;
+				}
+				errors += compare(m, 500);
+			}
+			cmap_close(m);
+		}
+	}
+	return errors;
+}
+
+int main(void)
+{
+	int errors = 0, err, fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		die("cannot create a temporary file");
+	close(fd);
+
+	err = check_known();
+	printf("Known maps   : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	err = check_open();
+	printf("Map files    : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	srandom(1);
+	err = check_random();
+	printf("Random maps  : %s (%d errors)\n", err ? "FAILED" : "OK", err);
+	errors += err;
+
+	unlink(path);
+	return errors ? 1 : 0;
+}
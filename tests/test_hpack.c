@@ -0,0 +1,396 @@
+/*
+ * Checks the HPACK codec from src/hpack.c.
+ *
+ * Build and run with :
+ *   make tests
+ *
+ * or alone with :
+ *   gcc -O2 -Iinclude -Iebtree -o tests/test_hpack tests/test_hpack.c src/hpack.c src/hdr_idx.c
+ *   ./tests/test_hpack
+ *
+ * The decoder is first checked against the examples of RFC7541 appendix C,
+ * including the contents of the dynamic table after each header block. Then
+ * the encoder is checked by decoding what it produces, and the conversion of
+ * the header list to HTTP/1 lines is checked against the header index. The
+ * decoding speed is measured separately by tests/bench_hpack.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/hpack.h>
+#include <proto/hdr_idx.h>
+
+struct vector {
+	const char *name;
+	const char *hex;            /* header block */
+	const char *hdrs[16];       /* expected name/value pairs, NULL-terminated */
+	int total;                  /* expected dynamic table size */
+	const char *table[10];      /* expected dynamic entries, newest first */
+};
+
+/* C.2 : each example uses a new table */
+static const struct vector c2[] = {
+	{ "C.2.1", "400a637573746f6d2d6b65790d637573746f6d2d686561646572",
+	  { "custom-key", "custom-header", NULL }, 55,
+	  { "custom-key", "custom-header", NULL } },
+	{ "C.2.2", "040c2f73616d706c652f70617468",
+	  { ":path", "/sample/path", NULL }, 0, { NULL } },
+	{ "C.2.3", "100870617373776f726406736563726574",
+	  { "password", "secret", NULL }, 0, { NULL } },
+	{ "C.2.4", "82",
+	  { ":method", "GET", NULL }, 0, { NULL } },
+	{ NULL }
+};
+
+/* C.3 : requests without Huffman coding, sharing a table */
+static const struct vector c3[] = {
+	{ "C.3.1", "828684410f7777772e6578616d706c652e636f6d",
+	  { ":method", "GET", ":scheme", "http", ":path", "/", ":authority", "www.example.com", NULL }, 57,
+	  { ":authority", "www.example.com", NULL } },
+	{ "C.3.2", "828684be58086e6f2d6361636865",
+	  { ":method", "GET", ":scheme", "http", ":path", "/", ":authority", "www.example.com",
+	    "cache-control", "no-cache", NULL }, 110,
+	  { "cache-control", "no-cache", ":authority", "www.example.com", NULL } },
+	{ "C.3.3", "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565",
+	  { ":method", "GET", ":scheme", "https", ":path", "/index.html", ":authority", "www.example.com",
+	    "custom-key", "custom-value", NULL }, 164,
+	  { "custom-key", "custom-value", "cache-control", "no-cache", ":authority", "www.example.com", NULL } },
+	{ NULL }
+};
+
+/* C.4 : same requests with Huffman coding */
+static const struct vector c4[] = {
+	{ "C.4.1", "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+	  { ":method", "GET", ":scheme", "http", ":path", "/", ":authority", "www.example.com", NULL }, 57,
+	  { ":authority", "www.example.com", NULL } },
+	{ "C.4.2", "828684be5886a8eb10649cbf",
+	  { ":method", "GET", ":scheme", "http", ":path", "/", ":authority", "www.example.com",
+	    "cache-control", "no-cache", NULL }, 110,
+	  { "cache-control", "no-cache", ":authority", "www.example.com", NULL } },
+	{ "C.4.3", "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+	  { ":method", "GET", ":scheme", "https", ":path", "/index.html", ":authority", "www.example.com",
+	    "custom-key", "custom-value", NULL }, 164,
+	  { "custom-key", "custom-value", "cache-control", "no-cache", ":authority", "www.example.com", NULL } },
+	{ NULL }
+};
+
+/* C.5 : responses without Huffman coding, with a 256 bytes table causing
+ * evictions.
+ */
+static const struct vector c5[] = {
+	{ "C.5.1", "4803333032580770726976617465611d4d6f6e2c203231204f637420323031332032303a31333a323120474d546e1768747470733a2f2f7777772e6578616d706c652e636f6d",
+	  { ":status", "302", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+	    "location", "https://www.example.com", NULL }, 222,
+	  { "location", "https://www.example.com", "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+	    "cache-control", "private", ":status", "302", NULL } },
+	{ "C.5.2", "4803333037c1c0bf",
+	  { ":status", "307", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+	    "location", "https://www.example.com", NULL }, 222,
+	  { ":status", "307", "location", "https://www.example.com",
+	    "date", "Mon, 21 Oct 2013 20:13:21 GMT", "cache-control", "private", NULL } },
+	{ "C.5.3", "88c1611d4d6f6e2c203231204f637420323031332032303a31333a323220474d54c05a04677a69707738666f6f3d4153444a4b48514b425a584f5157454f50495541585157454f49553b206d61782d6167653d333630303b2076657273696f6e3d31",
+	  { ":status", "200", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:22 GMT",
+	    "location", "https://www.example.com", "content-encoding", "gzip",
+	    "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1", NULL }, 215,
+	  { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1",
+	    "content-encoding", "gzip", "date", "Mon, 21 Oct 2013 20:13:22 GMT", NULL } },
+	{ NULL }
+};
+
+/* C.6 : same responses with Huffman coding */
+static const struct vector c6[] = {
+	{ "C.6.1", "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff6e919d29ad171863c78f0b97c8e9ae82ae43d3",
+	  { ":status", "302", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+	    "location", "https://www.example.com", NULL }, 222,
+	  { "location", "https://www.example.com", "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+	    "cache-control", "private", ":status", "302", NULL } },
+	{ "C.6.2", "4883640effc1c0bf",
+	  { ":status", "307", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+	    "location", "https://www.example.com", NULL }, 222,
+	  { ":status", "307", "location", "https://www.example.com",
+	    "date", "Mon, 21 Oct 2013 20:13:21 GMT", "cache-control", "private", NULL } },
+	{ "C.6.3", "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e7821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1ab270fb5291f9587316065c003ed4ee5b1063d5007",
+	  { ":status", "200", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:22 GMT",
+	    "location", "https://www.example.com", "content-encoding", "gzip",
+	    "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1", NULL }, 215,
+	  { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1",
+	    "content-encoding", "gzip", "date", "Mon, 21 Oct 2013 20:13:22 GMT", NULL } },
+	{ NULL }
+};
+
+/* invalid Huffman strings, as literal values of header "a" */
+static const struct {
+	const char *name;
+	const char *hex;
+} bad_huff[] = {
+	{ "EOS in string",        "00016184ffffffff" },
+	{ "padding of 8 bits",    "00016182" "1fff" },
+	{ "padding not EOS",      "00016181" "1e" },
+	{ NULL }
+};
+
+static char tmp_area[65536];
+static struct chunk tmp = { .str = tmp_area, .size = sizeof(tmp_area) };
+static struct hpack_hdr list[256];
+
+/* converts hex string <hex> to bytes in <out>, returns the length */
+static int unhex(const char *hex, unsigned char *out)
+{
+	int len = 0;
+	unsigned int c;
+
+	while (hex[0] && hex[1] && sscanf(hex, "%2x", &c) == 1) {
+		out[len++] = c;
+		hex += 2;
+	}
+	return len;
+}
+
+static int hdr_eq(const struct hpack_hdr *hdr, const char *n, const char *v)
+{
+	return hdr->nl == strlen(n) && memcmp(hdr->n, n, hdr->nl) == 0 &&
+	       hdr->vl == strlen(v) && memcmp(hdr->v, v, hdr->vl) == 0;
+}
+
+/* Checks that the dynamic table matches <table>, newest first, by decoding a
+ * block made of references to all of its entries. Returns 0 if OK.
+ */
+static int check_table(struct hpack_dht *dht, const char * const *table)
+{
+	unsigned char blk[16];
+	int nb, i, ret;
+
+	for (nb = 0; table[nb * 2]; nb++)
+		blk[nb] = 0x80 | (HPACK_SHT_SIZE + 1 + nb);
+
+	if (dht->used != nb)
+		return -1;
+
+	tmp.len = 0;
+	ret = hpack_decode_frame(dht, blk, nb, list, 256, &tmp);
+	if (ret != nb)
+		return -1;
+	for (i = 0; i < nb; i++) {
+		if (!hdr_eq(&list[i], table[i * 2], table[i * 2 + 1]))
+			return -1;
+	}
+	return 0;
+}
+
+/* Decodes the sequence of <vec> with a table of <size> bytes and compares the
+ * results. Returns the number of errors.
+ */
+static int check_vectors(const struct vector *vec, int size)
+{
+	struct hpack_dht *dht = NULL;
+	unsigned char raw[512];
+	int errors = 0;
+	int len, nb, i;
+
+	for (; vec->name; vec++) {
+		/* C.2 examples are independent */
+		if (!dht || vec->name[2] == '2') {
+			hpack_dht_free(dht);
+			dht = hpack_dht_alloc(size);
+		}
+
+		len = unhex(vec->hex, raw);
+		tmp.len = 0;
+		nb = hpack_decode_frame(dht, raw, len, list, 256, &tmp);
+
+		for (i = 0; vec->hdrs[i * 2]; i++) {
+			if (i >= nb || !hdr_eq(&list[i], vec->hdrs[i * 2], vec->hdrs[i * 2 + 1]))
+				break;
+		}
+
+		if (nb < 0 || i != nb || vec->hdrs[i * 2]) {
+			printf("  %s: bad header list (ret=%d)\n", vec->name, nb);
+			errors++;
+		}
+		else if (dht->total != vec->total) {
+			printf("  %s: table size %u instead of %d\n", vec->name, dht->total, vec->total);
+			errors++;
+		}
+		else if (check_table(dht, vec->table) != 0) {
+			printf("  %s: bad dynamic table contents\n", vec->name);
+			errors++;
+		}
+	}
+	hpack_dht_free(dht);
+	return errors;
+}
+
+/* Checks that invalid Huffman strings are rejected */
+static int check_bad_huffman(void)
+{
+	struct hpack_dht *dht = hpack_dht_alloc(4096);
+	unsigned char raw[64];
+	int errors = 0;
+	int i, len, ret;
+
+	for (i = 0; bad_huff[i].name; i++) {
+		len = unhex(bad_huff[i].hex, raw);
+		tmp.len = 0;
+		ret = hpack_decode_frame(dht, raw, len, list, 256, &tmp);
+		if (ret != HPACK_ERR_HUFFMAN) {
+			printf("  %s: returned %d\n", bad_huff[i].name, ret);
+			errors++;
+		}
+	}
+	hpack_dht_free(dht);
+	return errors;
+}
+
+/* Encodes random headers, decodes them and compares. Returns the number of
+ * errors.
+ */
+static int check_encoder(void)
+{
+	static char names[64][32], values[64][256];
+	static char out_area[65536];
+	struct chunk out = { .str = out_area, .size = sizeof(out_area) };
+	struct hpack_dht *dht = hpack_dht_alloc(4096);
+	int nl[64], vl[64];
+	int errors = 0;
+	int loop, nb, i, j, ret;
+
+	srandom(1);
+	for (loop = 0; loop < 20000 && errors < 10; loop++) {
+		nb = 1 + random() % 64;
+		out.len = 0;
+		for (i = 0; i < nb; i++) {
+			/* lower case names, sometimes from the static table */
+			if (random() % 4 == 0) {
+				j = 1 + random() % HPACK_SHT_SIZE;
+				nl[i] = hpack_sht[j].nl;
+				memcpy(names[i], hpack_sht[j].n, nl[i]);
+			}
+			else {
+				nl[i] = 1 + random() % sizeof(names[i]);
+				for (j = 0; j < nl[i]; j++)
+					names[i][j] = "abcdefghijklmnopqrstuvwxyz-0123"[random() % 32];
+			}
+
+			/* values are mostly text, sometimes any byte */
+			vl[i] = random() % sizeof(values[i]);
+			for (j = 0; j < vl[i]; j++)
+				values[i][j] = (loop & 1) ? random() : 32 + random() % 95;
+
+			if (!hpack_encode_header(&out, names[i], nl[i], values[i], vl[i])) {
+				printf("  encoder: out of room\n");
+				errors++;
+				break;
+			}
+		}
+
+		tmp.len = 0;
+		ret = hpack_decode_frame(dht, (unsigned char *)out.str, out.len, list, 256, &tmp);
+		if (ret != nb) {
+			printf("  encoder: decoded %d headers instead of %d\n", ret, nb);
+			errors++;
+			continue;
+		}
+		for (i = 0; i < nb; i++) {
+			if (list[i].nl != nl[i] || memcmp(list[i].n, names[i], nl[i]) != 0 ||
+			    list[i].vl != vl[i] || memcmp(list[i].v, values[i], vl[i]) != 0) {
+				printf("  encoder: header %d differs after decoding\n", i);
+				errors++;
+				break;
+			}
+		}
+	}
+
+	out.len = 0;
+	if (!hpack_encode_status(&out, 200) || !hpack_encode_status(&out, 302)) {
+		printf("  encoder: cannot encode status\n");
+		errors++;
+	}
+	tmp.len = 0;
+	ret = hpack_decode_frame(dht, (unsigned char *)out.str, out.len, list, 256, &tmp);
+	if (ret != 2 || !hdr_eq(&list[0], ":status", "200") || !hdr_eq(&list[1], ":status", "302")) {
+		printf("  encoder: bad status\n");
+		errors++;
+	}
+	hpack_dht_free(dht);
+	return errors;
+}
+
+/* Converts the C.3.3 request to HTTP/1 and checks the header index. Returns
+ * the number of errors.
+ */
+static int check_h1(void)
+{
+	static const char * const exp[] = { "custom-key: custom-value", NULL };
+	static char out_area[1024];
+	struct chunk out = { .str = out_area, .size = sizeof(out_area) };
+	struct hdr_idx_elem v[16];
+	struct hdr_idx idx = { .v = v, .size = 16 };
+	struct hpack_dht *dht = hpack_dht_alloc(4096);
+	unsigned char raw[512];
+	int errors = 0;
+	int len, nb, cur, pos, i;
+
+	for (i = 0; c3[i].name; i++) {
+		len = unhex(c3[i].hex, raw);
+		tmp.len = 0;
+		nb = hpack_decode_frame(dht, raw, len, list, 256, &tmp);
+	}
+
+	out.len = sprintf(out.str, "GET /index.html HTTP/1.1\r\n");
+	hdr_idx_init(&idx);
+	idx.v[0].len = out.len - 2;
+	idx.v[0].cr = 1;
+
+	if (hpack_hdrs_to_h1(list, nb, &out, &idx) != 1) {
+		printf("  h1: bad number of lines\n");
+		errors++;
+	}
+
+	/* walk over the index as the HTTP code does */
+	pos = hdr_idx_first_pos(&idx);
+	for (cur = idx.v[0].next, i = 0; cur; cur = idx.v[cur].next, i++) {
+		if (!exp[i] || idx.v[cur].len != strlen(exp[i]) ||
+		    memcmp(out.str + pos, exp[i], idx.v[cur].len) != 0 ||
+		    memcmp(out.str + pos + idx.v[cur].len, "\r\n", 2) != 0) {
+			printf("  h1: index does not match the message\n");
+			errors++;
+			break;
+		}
+		pos += idx.v[cur].len + idx.v[cur].cr + 1;
+	}
+	if (exp[i] || pos != out.len) {
+		printf("  h1: index does not cover the message\n");
+		errors++;
+	}
+	hpack_dht_free(dht);
+	return errors;
+}
+
+int main(void)
+{
+	int errors = 0, err;
+
+	err = check_vectors(c2, 4096);
+	err += check_vectors(c3, 4096);
+	err += check_vectors(c4, 4096);
+	err += check_vectors(c5, 256);
+	err += check_vectors(c6, 256);
+	printf("RFC7541 examples : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	err = check_bad_huffman();
+	printf("Huffman errors   : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	err = check_encoder();
+	printf("Encoder          : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	err = check_h1();
+	printf("HTTP/1 index     : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	return errors ? 1 : 0;
+}
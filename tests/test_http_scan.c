@@ -0,0 +1,151 @@
+/*
+ * Checks the HTTP header scanners from src/http_scan.c.
+ *
+ * Build and run with :
+ *   make tests
+ *
+ * All implementations supported by the CPU are first checked with each
+ * character which must stop them placed at every position of a buffer and at
+ * every alignment, the scanner having to stop on it or before and never to
+ * read past the end it is given. Then they are checked against a byte-per-byte
+ * reference on random data. The speed is measured by tests/bench_http_scan.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/http_scan.h>
+
+static int is_name(unsigned char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+	       (c >= '0' && c <= '9') || c == '-';
+}
+
+static const char *ref_name_end(const char *p, const char *e)
+{
+	while (p < e && is_name(*p))
+		p++;
+	return p;
+}
+
+static const char *ref_crlf(const char *p, const char *e)
+{
+	while (p < e && *p != '\r' && *p != '\n')
+		p++;
+	return p;
+}
+
+/* Places each stop character at every position of a buffer of name or value
+ * characters, at every alignment, and checks that <impl> stops on it or
+ * before, and stops before the end of the buffer when there is no stop
+ * character. Returns the number of errors.
+ */
+static int check_stops(const struct http_scan_impl *impl)
+{
+	static const char name_stops[] = ": \t\r\n_.\x00\x7f\x80\xff";
+	static const char crlf_stops[] = "\r\n";
+	char buf[160];
+	const char *r, *stops;
+	int fn, ofs, len, pos, s, nb_stops, errors = 0;
+
+	for (fn = 0; fn < 2; fn++) {
+		stops = fn ? crlf_stops : name_stops;
+		nb_stops = fn ? sizeof(crlf_stops) - 1 : sizeof(name_stops) - 1;
+		for (ofs = 0; ofs < 16; ofs++) {
+			for (len = 0; len <= 128; len++) {
+				/* no stop : it must not go further than the end */
+				memset(buf, fn ? '\x80' : 'a', sizeof(buf));
+				r = fn ? impl->crlf(buf + ofs, buf + ofs + len) :
+				         impl->name_end(buf + ofs, buf + ofs + len);
+				if (r < buf + ofs || r > buf + ofs + len) {
+					printf("  %s: %s(len=%d) returned %+d\n", impl->name,
+					       fn ? "crlf" : "name_end", len, (int)(r - buf - ofs));
+					errors++;
+				}
+
+				for (pos = 0; pos < len; pos++) {
+					for (s = 0; s < nb_stops; s++) {
+						buf[ofs + pos] = stops[s];
+						r = fn ? impl->crlf(buf + ofs, buf + ofs + len) :
+						         impl->name_end(buf + ofs, buf + ofs + len);
+						buf[ofs + pos] = fn ? '\x80' : 'a';
+						if (r >= buf + ofs && r <= buf + ofs + pos)
+							continue;
+						printf("  %s: %s(len=%d) returned %+d with 0x%02x at %d\n", impl->name,
+						       fn ? "crlf" : "name_end", len, (int)(r - buf - ofs),
+						       (unsigned char)stops[s], pos);
+						errors++;
+					}
+				}
+				if (errors > 10)
+					return errors;
+			}
+		}
+	}
+	return errors;
+}
+
+/* Checks on random data that <impl> never stops after the reference. Returns
+ * the number of errors.
+ */
+static int check_random(const struct http_scan_impl *impl)
+{
+	static const char alphabet[] = "abcXYZ019-_:; \t\r\n\x00\x0d\x7f\x80\xff";
+	char buf[256];
+	const char *r, *ref;
+	int i, j, len, ofs, errors = 0;
+
+	srandom(1);
+	for (i = 0; i < 20000; i++) {
+		len = random() % (sizeof(buf) - 64);
+		ofs = random() % 32;
+		for (j = 0; j < (int)sizeof(buf); j++) {
+			/* mostly regular characters, sometimes a special one */
+			if (random() % 16)
+				buf[j] = "abcdefghXYZ-0123"[random() % 16];
+			else
+				buf[j] = alphabet[random() % (sizeof(alphabet) - 1)];
+		}
+
+		r = impl->name_end(buf + ofs, buf + ofs + len);
+		ref = ref_name_end(buf + ofs, buf + ofs + len);
+		if (r < buf + ofs || r > ref) {
+			printf("  %s: name_end(len=%d) returned %+d instead of %+d\n",
+			       impl->name, len, (int)(r - buf - ofs), (int)(ref - buf - ofs));
+			errors++;
+		}
+
+		r = impl->crlf(buf + ofs, buf + ofs + len);
+		ref = ref_crlf(buf + ofs, buf + ofs + len);
+		if (r < buf + ofs || r > ref) {
+			printf("  %s: crlf(len=%d) returned %+d instead of %+d\n",
+			       impl->name, len, (int)(r - buf - ofs), (int)(ref - buf - ofs));
+			errors++;
+		}
+		if (errors > 10)
+			break;
+	}
+	return errors;
+}
+
+int main(void)
+{
+	const struct http_scan_impl *impl;
+	int errors = 0;
+
+	for (impl = http_scan_impls; impl->name; impl++) {
+		if (!impl->supported()) {
+			printf("%-8s : not supported by this CPU\n", impl->name);
+			continue;
+		}
+		if (check_stops(impl) || check_random(impl)) {
+			printf("%-8s : FAILED\n", impl->name);
+			errors++;
+			continue;
+		}
+		printf("%-8s : OK\n", impl->name);
+	}
+	return errors ? 1 : 0;
+}
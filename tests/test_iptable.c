@@ -0,0 +1,318 @@
+/*
+ * Checks the IP table from src/iptable.c.
+ *
+ * Build and run with :
+ *   make tests
+ *
+ * Known IPv4 and IPv6 tables are first looked up while their networks are in
+ * the delta tree, once the base is built, and mixed with later insertions and
+ * deletions. Then the table is compared with a walk over all the networks on
+ * random IPv4 and IPv6 networks drawn from a small address space so that they
+ * nest and overlap, while networks are being added and deleted. The speed and
+ * the memory usage are measured by tests/bench_iptable.c.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <common/iptable.h>
+
+#define MAXNET 4000
+
+/* a network as in struct pattern_list */
+struct net {
+	unsigned char key[16];
+	unsigned int len;
+	int live;
+};
+
+static struct net nets[MAXNET];
+static int nbnets;
+
+/* known networks, in insertion order */
+struct known {
+	const char *addr;
+	unsigned int len;
+};
+
+static const struct known known4[] = {
+	{ "10.0.0.0",       8 },    /* 0 */
+	{ "10.1.0.0",      16 },    /* 1 */
+	{ "10.1.2.0",      24 },    /* 2 */
+	{ "0.0.0.0",        0 },    /* 3 */
+	{ "192.168.1.1",   32 },    /* 4 */
+	{ "10.1.2.128",    25 },    /* 5 */
+	{ "10.1.0.0",      16 },    /* 6, duplicate of 1 */
+	{ "255.255.255.255", 32 },  /* 7 */
+	{ NULL }
+};
+
+static const struct known known6[] = {
+	{ "::",             0 },    /* 0 */
+	{ "2001:db8::",    32 },    /* 1 */
+	{ "2001:db8:1::",  48 },    /* 2 */
+	{ "2001:db8:1::1", 128 },   /* 3 */
+	{ "::ffff:10.0.0.0", 104 }, /* 4 */
+	{ "2001:db8:1:8000::", 49 }, /* 5 */
+	{ NULL }
+};
+
+/* addresses to look up and the expected network, -1 for none */
+struct lookup {
+	const char *addr;
+	int net;
+};
+
+static const struct lookup lookups4[] = {
+	{ "10.1.2.200",       5 },
+	{ "10.1.2.127",       2 },
+	{ "10.1.3.1",         1 },
+	{ "10.2.0.0",         0 },
+	{ "10.255.255.255",   0 },
+	{ "11.0.0.0",         3 },
+	{ "192.168.1.1",      4 },
+	{ "192.168.1.2",      3 },
+	{ "0.0.0.0",          3 },
+	{ "255.255.255.255",  7 },
+	{ "255.255.255.254",  3 },
+	{ NULL }
+};
+
+static const struct lookup lookups6[] = {
+	{ "2001:db8:1::1",    3 },
+	{ "2001:db8:1::2",    2 },
+	{ "2001:db8:1:8000::1", 5 },
+	{ "2001:db8:2::1",    1 },
+	{ "2001:db9::",       0 },
+	{ "::ffff:10.0.0.1",  4 },
+	{ "::ffff:11.0.0.1",  0 },
+	{ NULL }
+};
+
+/* Looks the addresses of <lookups> up in table <t> made of networks <ids>.
+ * Entry <skip> was removed, so the expected match is the next one in
+ * <fallback>. Returns the number of errors.
+ */
+static int check_lookups(struct ipt *t, const struct lookup *lookups, int *ids,
+                         int skip, int fallback, const char *when)
+{
+	unsigned char addr[16];
+	struct ipt_entry *e;
+	int i, exp, errors = 0;
+
+	for (i = 0; lookups[i].addr; i++) {
+		inet_pton(t->klen == 4 ? AF_INET : AF_INET6, lookups[i].addr, addr);
+		exp = lookups[i].net == skip ? fallback : lookups[i].net;
+		e = ipt_lookup(t, addr);
+		if ((e ? (int *)e->data : NULL) == (exp < 0 ? NULL : &ids[exp]))
+			continue;
+		printf("  %s: %s matched %ld, expected %d\n", when, lookups[i].addr,
+		       e ? (long)((int *)e->data - ids) : -1L, exp);
+		errors++;
+	}
+	return errors;
+}
+
+/* Inserts the networks of <known> from <from> to <to> excluded into <t>,
+ * their data and owner being their index in <ids>.
+ */
+static void insert_known(struct ipt *t, const struct known *known, int *ids, int from, int to)
+{
+	unsigned char key[16];
+
+	for (; from < to; from++) {
+		inet_pton(t->klen == 4 ? AF_INET : AF_INET6, known[from].addr, key);
+		if (ipt_insert(t, key, known[from].len, &ids[from], &ids[from]) < 0) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+}
+
+/* Checks table <klen> made of <known> looked up with <lookups> : with all the
+ * networks in the delta tree, then in the base, then with half of them added
+ * after the base was built, and finally after network <del> was removed, the
+ * expected match becoming <fallback>. Returns the number of errors.
+ */
+static int check_known(unsigned int klen, const struct known *known, const struct lookup *lookups,
+                       int del, int fallback)
+{
+	static int ids[16];
+	unsigned char key[16];
+	struct ipt_entry *e;
+	struct ipt *t;
+	int nb, errors = 0;
+
+	for (nb = 0; known[nb].addr; nb++)
+		;
+
+	t = ipt_new(klen);
+	if (!t) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	insert_known(t, known, ids, 0, nb);
+	errors += ipt_prepare(t) < 0;
+	errors += check_lookups(t, lookups, ids, -1, -1, "delta");
+	errors += ipt_build(t) < 0;
+	errors += check_lookups(t, lookups, ids, -1, -1, "base");
+	ipt_free(t);
+
+	t = ipt_new(klen);
+	if (!t) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	insert_known(t, known, ids, 0, nb / 2);
+	errors += ipt_build(t) < 0;
+	insert_known(t, known, ids, nb / 2, nb);
+	errors += ipt_prepare(t) < 0;
+	errors += check_lookups(t, lookups, ids, -1, -1, "mixed");
+
+	inet_pton(klen == 4 ? AF_INET : AF_INET6, known[del].addr, key);
+	e = ipt_find(t, key, known[del].len, &ids[del]);
+	if (!e || e->data != &ids[del])
+		errors++;
+	else
+		ipt_remove(t, e);
+	errors += ipt_find(t, NULL, 0, &ids[del]) != NULL;
+	errors += ipt_prepare(t) < 0;
+	errors += check_lookups(t, lookups, ids, del, fallback, "removed");
+	errors += ipt_build(t) < 0;
+	errors += check_lookups(t, lookups, ids, del, fallback, "rebuilt");
+	ipt_free(t);
+	return errors;
+}
+
+static int net_match(const struct net *n, const unsigned char *addr)
+{
+	unsigned int bits = n->len, i;
+
+	for (i = 0; bits >= 8; i++, bits -= 8)
+		if (n->key[i] != addr[i])
+			return 0;
+	return !bits || !((n->key[i] ^ addr[i]) & (0xff00 >> bits));
+}
+
+/* longest live network matching <addr>, the first added one on ties */
+static struct net *ref_lookup(const unsigned char *addr)
+{
+	struct net *best = NULL;
+	int i;
+
+	for (i = 0; i < nbnets; i++) {
+		if (!nets[i].live || !net_match(&nets[i], addr))
+			continue;
+		if (!best || nets[i].len > best->len)
+			best = &nets[i];
+	}
+	return best;
+}
+
+/* random address of <klen> bytes around a few values */
+static void rand_addr(unsigned char *addr, int klen)
+{
+	int i;
+
+	for (i = 0; i < klen; i++)
+		addr[i] = (i < klen - 2) ? (random() % 2) * 0x80 : random() % 4 * 0x41;
+}
+
+static void add_net(struct ipt *t, int klen)
+{
+	struct net *n = &nets[nbnets++];
+
+	rand_addr(n->key, klen);
+	n->len = random() % (klen * 8 + 1);
+	/* keep the key masked so that the walk is simple */
+	memset(n->key + (n->len + 7) / 8, 0, klen - (n->len + 7) / 8);
+	if (n->len % 8)
+		n->key[n->len / 8] &= 0xff00 >> (n->len % 8);
+	n->live = 1;
+	if (ipt_insert(t, n->key, n->len, n, n) < 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+}
+
+/* compares the table and the walk on <loops> random addresses */
+static int compare(struct ipt *t, int klen, int loops)
+{
+	unsigned char addr[16];
+	struct ipt_entry *e;
+	int errors = 0;
+
+	/* like the pattern code, which leaves the rebuilds to a task */
+	if ((ipt_need_build(t) && ipt_build(t) < 0) || ipt_prepare(t) < 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	while (loops--) {
+		rand_addr(addr, klen);
+		e = ipt_lookup(t, addr);
+		if ((e ? e->data : NULL) != ref_lookup(addr))
+			errors++;
+	}
+	return errors;
+}
+
+/* Compares the table with a walk over random nested networks while they are
+ * being added and deleted. Returns the number of errors.
+ */
+static int check_random(void)
+{
+	struct ipt *t;
+	struct ipt_entry *e;
+	int klen, round, step, i, errors = 0;
+
+	for (klen = 4; klen <= 16; klen += 12) {
+		for (round = 0; round < 30; round++) {
+			t = ipt_new(klen);
+			for (i = random() % (round < 15 ? 30 : 1000) + 1; i; i--)
+				add_net(t, klen);
+			errors += compare(t, klen, 300);
+
+			/* delete some, add some more, several times */
+			for (step = 0; step < 5; step++) {
+				for (i = 0; i < nbnets; i++) {
+					if (!nets[i].live || random() % 4)
+						continue;
+					e = ipt_find(t, (random() & 1) ? nets[i].key : NULL, nets[i].len, &nets[i]);
+					if (!e || e->data != &nets[i]) {
+						errors++;
+						continue;
+					}
+					ipt_remove(t, e);
+					nets[i].live = 0;
+				}
+				for (i = random() % 300; i && nbnets < MAXNET; i--)
+					add_net(t, klen);
+				errors += compare(t, klen, 300);
+			}
+			nbnets = 0;
+			ipt_free(t);
+		}
+	}
+	return errors;
+}
+
+int main(void)
+{
+	int errors = 0, err;
+
+	/* removing 10.1.0.0/16 leaves its duplicate, 2001:db8::/32 leaves ::/0 */
+	err = check_known(4, known4, lookups4, 1, 6);
+	err += check_known(16, known6, lookups6, 1, 0);
+	printf("Known networks  : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	srandom(1);
+	err = check_random();
+	printf("Random networks : %s (%d errors)\n", err ? "FAILED" : "OK", err);
+	errors += err;
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Checks the combined regex matcher from src/rxset.c.
+ *
+ * Build and run with :
+ *   make tests USE_PCRE=1 USE_REGEX_DFA=1
+ *
+ * The set is first checked on a few known expression lists which exercise the
+ * list order, anchors, alternations, classes, repetitions and the case modes,
+ * and it must refuse the constructs it does not support. USE_REGEX_DFA
+ * requires USE_PCRE, so PCRE is then used as the reference, called the same
+ * way as regex_comp() and regex_exec() do : random sets of expressions are
+ * matched against random subjects, and the lowest index reported by the set
+ * is compared with the first expression of the list that pcre_exec() finds,
+ * in both case modes. The speed is measured by tests/bench_rxset.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pcre.h>
+
+#include <common/rxset.h>
+
+#define MAXEXP 2000
+
+static pcre *regs[MAXEXP];
+static int nbregs;
+
+/* known expression lists, the expected result being an index in the list */
+static const struct {
+	const char *exprs[8];
+	int icase;
+	const char *subj;
+	int match;                    /* expected match, -1 for none */
+} cases[] = {
+	{ { "abc", "b", NULL },                  0, "xabcx",  0 },
+	{ { "z", "a", NULL },                    0, "az",     0 },
+	{ { "q", "a", NULL },                    0, "az",     1 },
+	{ { "^abc", "bc$", NULL },               0, "abcd",   0 },
+	{ { "^abc", "bc$", NULL },               0, "xabc",   1 },
+	{ { "^abc", "bc$", NULL },               0, "xbcx",  -1 },
+	{ { "^$", NULL },                        0, "",       0 },
+	{ { "^$", NULL },                        0, "a",     -1 },
+	{ { "x*", NULL },                        0, "",       0 },
+	{ { "a(b|cd)e", NULL },                  0, "acde",   0 },
+	{ { "a(b|cd)e", NULL },                  0, "ace",   -1 },
+	{ { "[^a-c]x", NULL },                   0, "ax",    -1 },
+	{ { "[^a-c]x", NULL },                   0, "dx",     0 },
+	{ { "ab{2}c", NULL },                    0, "abbc",   0 },
+	{ { "ab{2}c", NULL },                    0, "abc",   -1 },
+	{ { "ab{1,2}c", NULL },                  0, "abbbc", -1 },
+	{ { "ab+c?d", NULL },                    0, "abbd",   0 },
+	{ { "a.c", NULL },                       0, "a-c",    0 },
+	{ { "a.c", NULL },                       0, "a\nc",  -1 },
+	{ { "ABC", NULL },                       0, "xabcx", -1 },
+	{ { "ABC", NULL },                       1, "xabcx",  0 },
+	{ { "[A-C]x", NULL },                    1, "bX",     0 },
+	{ { "\\.php$", "\\.js$", NULL },         0, "/app.js", 1 },
+	{ { "a\\d+b", NULL },                    0, "xa123b", 0 },
+	{ { NULL } }
+};
+
+/* constructs the set must leave to PCRE */
+static const char *unsupported[] = {
+	"(a)\\1", "\\bfoo", "a(?=b)", "a*+b", "(?i)a", "a^b", "(a$)b", "[[:alpha:]]", NULL
+};
+
+/* Checks the known expression lists and the refused constructs. Returns the
+ * number of errors.
+ */
+static int check_cases(void)
+{
+	struct rxset *s;
+	unsigned int id;
+	int i, e, ret, errors = 0;
+
+	for (i = 0; cases[i].subj; i++) {
+		s = rxset_new(cases[i].icase);
+		if (!s) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		for (e = 0; cases[i].exprs[e]; e++) {
+			ret = rxset_add(s, cases[i].exprs[e], e);
+			if (ret != 1) {
+				printf("  case %d: unexpected result %d for '%s'\n", i, ret, cases[i].exprs[e]);
+				errors++;
+			}
+		}
+		if (rxset_prepare(s) < 0) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		ret = rxset_exec(s, cases[i].subj, strlen(cases[i].subj), &id);
+		if (ret < 0 || (ret ? (int)id : -1) != cases[i].match) {
+			printf("  case %d: returned %d, expected %d\n", i, ret ? (int)id : -1, cases[i].match);
+			errors++;
+		}
+		rxset_free(s);
+	}
+
+	s = rxset_new(0);
+	for (i = 0; unsupported[i]; i++) {
+		ret = rxset_add(s, unsupported[i], i);
+		if (ret != 0) {
+			printf("  '%s' : unexpected result %d\n", unsupported[i], ret);
+			errors++;
+		}
+	}
+	rxset_free(s);
+	return errors;
+}
+
+/* appends a random expression of depth <depth> to <out> */
+static void rand_expr(char *out, int depth)
+{
+	static const char *atoms[] = { "a", "b", "c", "A", ".", "[ab]", "[^a]", "[a-c]", "x" };
+	int i, n;
+
+	n = random() % 3 + 2;
+	for (i = 0; i < n; i++) {
+		if (depth > 0 && random() % 4 == 0) {
+			strcat(out, "(");
+			rand_expr(out, depth - 1);
+			strcat(out, "|");
+			rand_expr(out, depth - 1);
+			strcat(out, ")");
+		}
+		else
+			strcat(out, atoms[random() % (sizeof(atoms) / sizeof(*atoms))]);
+
+		switch (random() % 12) {
+		case 0: strcat(out, "*"); break;
+		case 1: strcat(out, "+"); break;
+		case 2: strcat(out, "?"); break;
+		case 3: strcat(out, "{1,2}"); break;
+		case 4: strcat(out, "{2}"); break;
+		}
+	}
+}
+
+static void rand_regex(char *out)
+{
+	*out = 0;
+	if (random() % 4 == 0)
+		strcat(out, "^");
+	rand_expr(out, 2);
+	if (random() % 4 == 0)
+		strcat(out, "$");
+	if (random() % 6 == 0) {
+		strcat(out, "|");
+		rand_expr(out, 1);
+	}
+}
+
+/* compiles <expr> as the next reference expression like regex_comp() does
+ * without captures. Returns 0 if PCRE rejects it.
+ */
+static int ref_add(const char *expr, int icase)
+{
+	const char *error;
+	int erroffset;
+
+	regs[nbregs] = pcre_compile(expr, PCRE_NO_AUTO_CAPTURE | (icase ? PCRE_CASELESS : 0),
+	                            &error, &erroffset, NULL);
+	if (!regs[nbregs])
+		return 0;
+	nbregs++;
+	return 1;
+}
+
+/* index of the first expression matching <subj>, -1 if none does, or -2 if
+ * PCRE gave up on one of them (eg: match limit reached) before.
+ */
+static int ref_match(const char *subj)
+{
+	int i, ret;
+
+	for (i = 0; i < nbregs; i++) {
+		ret = pcre_exec(regs[i], NULL, subj, strlen(subj), 0, 0, NULL, 0);
+		if (ret >= 0)
+			return i;
+		if (ret != PCRE_ERROR_NOMATCH)
+			return -2;
+	}
+	return -1;
+}
+
+static void reset_regs(void)
+{
+	while (nbregs)
+		pcre_free(regs[--nbregs]);
+}
+
+/* Compares the set with PCRE on random expressions and subjects. Returns the
+ * number of errors.
+ */
+static int check_random(void)
+{
+	struct rxset *s;
+	char expr[1024], subj[32];
+	unsigned int id;
+	int icase, round, i, len, ret, ref;
+	int errors = 0, skipped = 0;
+
+	for (icase = 0; icase <= 1; icase++) {
+		for (round = 0; round < 100; round++) {
+			s = rxset_new(icase);
+			for (i = random() % 30 + 1; i; i--) {
+				rand_regex(expr);
+				if (!ref_add(expr, icase))
+					continue;
+				ret = rxset_add(s, expr, nbregs - 1);
+				if (ret != 1) {
+					printf("unexpected result %d for '%s'\n", ret, expr);
+					errors++;
+				}
+			}
+			if (rxset_prepare(s) < 0) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+
+			for (i = 0; i < 300; i++) {
+				len = random() % 20;
+				subj[len] = 0;
+				while (len--)
+					subj[len] = "abcABx"[random() % 6];
+
+				ref = ref_match(subj);
+				if (ref == -2) {
+					/* the DFA has no such limit */
+					skipped++;
+					continue;
+				}
+				ret = rxset_exec(s, subj, strlen(subj), &id);
+				if (ret < 0 || (ret ? (int)id : -1) != ref) {
+					if (errors++ < 10)
+						printf("mismatch on '%s': %d instead of %d\n", subj, ret ? (int)id : -1, ref);
+				}
+			}
+			reset_regs();
+			rxset_free(s);
+		}
+	}
+
+	if (skipped)
+		printf("%d subjects skipped, PCRE gave up on them\n", skipped);
+	return errors;
+}
+
+int main(void)
+{
+	int errors = 0, err;
+
+	err = check_cases();
+	printf("Known expressions  : %s\n", err ? "FAILED" : "OK");
+	errors += err;
+
+	srandom(1);
+	err = check_random();
+	printf("Random expressions : %s (%d errors)\n", err ? "FAILED" : "OK", err);
+	errors += err;
+
+	return errors ? 1 : 0;
+}
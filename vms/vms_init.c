@@ -8,6 +8,7 @@ extern void __dns_init();
 extern void __ev_poll_init();
 extern void __ev_select_init();
 extern void __filters_init();
+extern void __flt_cache_init();
 extern void __flt_http_comp_init();
 extern void __spoe_init();
 extern void __flt_trace_init();
@@ -15,6 +16,7 @@ extern void __frontend_init();
 extern void __listener_init();
 extern void __map_init();
 extern void __memory_init();
+extern void __mux_h2_init();
 extern void __payload_init();
 extern void __pipe_module_init();
 extern void __http_protocol_init();
@@ -43,6 +45,7 @@ void HAProxy_VMS_init()
 	__ev_poll_init();
 	__ev_select_init();
 	__filters_init();
+	__flt_cache_init();
 	__flt_http_comp_init();
 	__spoe_init();
 	__flt_trace_init();
@@ -50,6 +53,7 @@ void HAProxy_VMS_init()
 	__listener_init();
 	__map_init();
 	__memory_init();
+	__mux_h2_init();
 	__payload_init();
 	__pipe_module_init();
 	__http_protocol_init();